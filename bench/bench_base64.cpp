@@ -0,0 +1,49 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "base64.hpp"
+#include "bench_inputs.hpp"
+
+static void BM_Base64Encode(benchmark::State& state)
+{
+    auto input = vacon::bench::FixedBytes(state.range(0));
+
+    for (auto _ : state) {
+        auto encoded = base64::encode(input);
+        benchmark::DoNotOptimize(encoded);
+    }
+
+    state.SetBytesProcessed(state.iterations() * input.size());
+}
+BENCHMARK(BM_Base64Encode)->Arg(64)->Arg(1024)->Arg(16384);
+
+static void BM_Base64Decode(benchmark::State& state)
+{
+    auto encoded = base64::encode(vacon::bench::FixedBytes(state.range(0)));
+
+    for (auto _ : state) {
+        auto decoded = base64::decode(encoded);
+        benchmark::DoNotOptimize(decoded);
+    }
+
+    state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+BENCHMARK(BM_Base64Decode)->Arg(64)->Arg(1024)->Arg(16384);
@@ -0,0 +1,39 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vacon {
+namespace bench {
+
+// Deterministic pseudo-random bytes, so that every run and every commit
+// benchmarks exactly the same input.
+inline std::vector<uint8_t> FixedBytes(size_t size, uint32_t seed = 1)
+{
+    std::vector<uint8_t> bytes(size);
+    uint32_t x = seed;
+    for (auto& b : bytes) {
+        x = x * 1664525u + 1013904223u;
+        b = static_cast<uint8_t>(x >> 24);
+    }
+    return bytes;
+}
+
+} // namespace bench
+} // namespace vacon
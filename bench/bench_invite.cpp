@@ -0,0 +1,73 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+
+#include "base64.hpp"
+#include "bench_inputs.hpp"
+#include "invite.hpp"
+
+// An invite with a fixed key, instead of one from Invite::Create(), which
+// generates a random key.
+static std::shared_ptr<vacon::Invite> FixedInvite()
+{
+    nlohmann::json message = {
+        { "d", "benchmark" },
+        { "s", "signaling.example.com:30307" },
+        { "k", vacon::bench::FixedBytes(hydro_secretbox_KEYBYTES) },
+    };
+    return vacon::Invite::Decode("vacon:" + base64::encode(nlohmann::json::to_msgpack(message)));
+}
+
+// A signaling message of about the size of a typical SDP offer.
+static nlohmann::json FixedMessage(size_t sdp_size)
+{
+    auto sdp = std::string(sdp_size, 'a');
+    auto bytes = vacon::bench::FixedBytes(sdp_size);
+    for (size_t i = 0; i < sdp_size; ++i) {
+        sdp[i] = static_cast<char>(' ' + bytes[i] % 95);
+    }
+    return nlohmann::json { { "type", "offer" }, { "sdp", sdp } };
+}
+
+static void BM_InviteEncryptJson(benchmark::State& state)
+{
+    auto invite = FixedInvite();
+    auto message = FixedMessage(state.range(0));
+
+    for (auto _ : state) {
+        auto ciphertext = invite->EncryptJson(message);
+        benchmark::DoNotOptimize(ciphertext);
+    }
+}
+BENCHMARK(BM_InviteEncryptJson)->Arg(256)->Arg(4096);
+
+static void BM_InviteDecryptJson(benchmark::State& state)
+{
+    auto invite = FixedInvite();
+    auto ciphertext = invite->EncryptJson(FixedMessage(state.range(0)));
+
+    for (auto _ : state) {
+        auto message = invite->DecryptJson(ciphertext);
+        benchmark::DoNotOptimize(message);
+    }
+}
+BENCHMARK(BM_InviteDecryptJson)->Arg(256)->Arg(4096);
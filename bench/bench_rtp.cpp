@@ -0,0 +1,186 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <rtc/rtc.hpp>
+
+#include "bench_inputs.hpp"
+#include "codecs.hpp"
+#include "rtp/generic_packetizer.hpp"
+#include "rtp/payload_format.hpp"
+
+using vacon::GenericRtpPacketizer;
+using vacon::PayloadFormat;
+using vacon::VideoCodec;
+
+static const size_t kFrameSize = 40 * 1024;
+static const size_t kFrameCount = 30;
+
+static std::shared_ptr<rtc::RtpPacketizationConfig> FixedRtpConfig()
+{
+    return std::make_shared<rtc::RtpPacketizationConfig>(42, "bench", 101,
+                                                         GenericRtpPacketizer::defaultClockRate);
+}
+
+static rtc::message_ptr FixedFrame(size_t size, uint32_t seed)
+{
+    auto bytes = vacon::bench::FixedBytes(size, seed);
+    auto data = reinterpret_cast<const std::byte*>(bytes.data());
+    return rtc::make_message(data, data + bytes.size());
+}
+
+// An H.264 access unit in Annex-B format: an SPS, a PPS, and a slice that
+// makes up the rest of the size.
+static rtc::message_ptr FixedAccessUnit(size_t size, uint32_t seed)
+{
+    static const uint8_t kHeaders[] = {
+        0, 0, 0, 1, 0x67, 0x42, 0xc0, 0x1f, 0xda, 0x01, 0x40, 0x16, 0xe8, 0x40,
+        0, 0, 0, 1, 0x68, 0xce, 0x3c, 0x80,
+        0, 0, 0, 1, 0x65,
+    };
+
+    auto bytes = vacon::bench::FixedBytes(size, seed);
+    std::copy(std::begin(kHeaders), std::end(kHeaders), bytes.begin());
+    // No start codes in the slice data.
+    for (size_t i = std::size(kHeaders); i < bytes.size(); ++i) {
+        bytes[i] |= 0x80;
+    }
+    auto data = reinterpret_cast<const std::byte*>(bytes.data());
+    return rtc::make_message(data, data + bytes.size());
+}
+
+// The RTP packets of kFrameCount consecutive frames, one timestamp per frame.
+static std::vector<rtc::message_ptr> FixedRtpPackets(PayloadFormat format)
+{
+    auto config = FixedRtpConfig();
+    auto packetizer = vacon::CreateVideoPacketizer(VideoCodec::AVC_8_420, format, config);
+
+    std::vector<rtc::message_ptr> packets;
+    for (size_t i = 0; i < kFrameCount; ++i) {
+        config->timestamp = config->startTimestamp + i * 3000;
+        rtc::message_vector messages = {
+            format == PayloadFormat::Standard ? FixedAccessUnit(kFrameSize, i + 1) : FixedFrame(kFrameSize, i + 1),
+        };
+        packetizer->outgoing(messages, [](rtc::message_ptr) {});
+        packets.insert(packets.end(), messages.begin(), messages.end());
+    }
+
+    return packets;
+}
+
+static void BM_PacketizerOutgoing(benchmark::State& state)
+{
+    auto config = FixedRtpConfig();
+    auto packetizer = GenericRtpPacketizer(config);
+    auto frame = FixedFrame(state.range(0), 1);
+
+    size_t n_packets = 0;
+    for (auto _ : state) {
+        rtc::message_vector messages = { frame };
+        packetizer.outgoing(messages, [](rtc::message_ptr) {});
+        n_packets += messages.size();
+        benchmark::DoNotOptimize(messages);
+    }
+
+    state.SetBytesProcessed(state.iterations() * frame->size());
+    state.counters["packets"] = benchmark::Counter(n_packets, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_PacketizerOutgoing)->Arg(1024)->Arg(40 * 1024)->Arg(256 * 1024);
+
+// The RFC 6184 packetizer, which has to find the NAL units first.
+static void BM_PacketizerOutgoingAvc(benchmark::State& state)
+{
+    auto config = FixedRtpConfig();
+    auto packetizer = vacon::CreateVideoPacketizer(VideoCodec::AVC_8_420, PayloadFormat::Standard, config);
+    auto frame = FixedAccessUnit(state.range(0), 1);
+
+    size_t n_packets = 0;
+    for (auto _ : state) {
+        rtc::message_vector messages = { frame };
+        packetizer->outgoing(messages, [](rtc::message_ptr) {});
+        n_packets += messages.size();
+        benchmark::DoNotOptimize(messages);
+    }
+
+    state.SetBytesProcessed(state.iterations() * frame->size());
+    state.counters["packets"] = benchmark::Counter(n_packets, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_PacketizerOutgoingAvc)->Arg(1024)->Arg(40 * 1024)->Arg(256 * 1024);
+
+enum class Impairment {
+    None,
+    Loss,
+    Reorder,
+};
+
+static void BM_DepacketizerIncoming(benchmark::State& state, Impairment impairment,
+                                    PayloadFormat format = PayloadFormat::Generic)
+{
+    auto packets = FixedRtpPackets(format);
+
+    // Apply the impairment deterministically: drop every 50th packet, or
+    // swap every 20th packet with its successor.
+    switch (impairment) {
+        case Impairment::None:
+            break;
+        case Impairment::Loss: {
+            std::vector<rtc::message_ptr> kept;
+            for (size_t i = 0; i < packets.size(); ++i) {
+                if (i % 50 != 49) {
+                    kept.push_back(packets[i]);
+                }
+            }
+            packets.swap(kept);
+            break;
+        }
+        case Impairment::Reorder:
+            for (size_t i = 19; i + 1 < packets.size(); i += 20) {
+                std::swap(packets[i], packets[i + 1]);
+            }
+            break;
+    }
+
+    size_t n_frames = 0;
+    size_t n_bytes = 0;
+    for (auto _ : state) {
+        // A fresh depacketizer for each pass, so that every pass starts in
+        // the same state.
+        auto depacketizer = vacon::CreateVideoDepacketizer(VideoCodec::AVC_8_420, format);
+        for (const auto& packet : packets) {
+            rtc::message_vector messages = { packet };
+            depacketizer->incoming(messages, [](rtc::message_ptr) {});
+            n_frames += messages.size();
+            n_bytes += packet->size();
+        }
+    }
+
+    state.SetBytesProcessed(n_bytes);
+    state.counters["frames"] = benchmark::Counter(n_frames, benchmark::Counter::kIsRate);
+}
+BENCHMARK_CAPTURE(BM_DepacketizerIncoming, in_order, Impairment::None);
+BENCHMARK_CAPTURE(BM_DepacketizerIncoming, loss, Impairment::Loss);
+BENCHMARK_CAPTURE(BM_DepacketizerIncoming, reorder, Impairment::Reorder);
+BENCHMARK_CAPTURE(BM_DepacketizerIncoming, v1_in_order, Impairment::None, PayloadFormat::GenericV1);
+BENCHMARK_CAPTURE(BM_DepacketizerIncoming, v1_loss, Impairment::Loss, PayloadFormat::GenericV1);
+BENCHMARK_CAPTURE(BM_DepacketizerIncoming, v1_reorder, Impairment::Reorder, PayloadFormat::GenericV1);
+BENCHMARK_CAPTURE(BM_DepacketizerIncoming, avc_in_order, Impairment::None, PayloadFormat::Standard);
+BENCHMARK_CAPTURE(BM_DepacketizerIncoming, avc_loss, Impairment::Loss, PayloadFormat::Standard);
+BENCHMARK_CAPTURE(BM_DepacketizerIncoming, avc_reorder, Impairment::Reorder, PayloadFormat::Standard);
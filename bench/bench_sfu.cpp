@@ -0,0 +1,108 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <rtc/rtc.hpp>
+
+#include "bench_inputs.hpp"
+#include "rtp/generic_packetizer.hpp"
+#include "rtp/generic_payload.hpp"
+#include "rtp/sfu_router.hpp"
+
+using vacon::GenericRtpPacketizer;
+using vacon::SfuRouter;
+
+// A 30 fps stream of 40 KB frames, about 10 Mbit/s.
+static const size_t kFrameSize = 40 * 1024;
+static const size_t kFrameCount = 30;
+static const double kStreamFrameRate = 30.0;
+
+// The RTP packets of kFrameCount consecutive frames. With two temporal
+// layers, every other frame is in layer 1.
+static std::vector<rtc::message_ptr> FixedRtpPackets(unsigned n_layers)
+{
+    auto config = std::make_shared<rtc::RtpPacketizationConfig>(42, "bench", 101,
+                                                                GenericRtpPacketizer::defaultClockRate);
+    auto packetizer = GenericRtpPacketizer(config);
+
+    std::vector<rtc::message_ptr> packets;
+    for (size_t i = 0; i < kFrameCount; ++i) {
+        config->timestamp = config->startTimestamp + i * 3000;
+        auto bytes = vacon::bench::FixedBytes(kFrameSize, i + 1);
+        auto data = reinterpret_cast<const std::byte*>(bytes.data());
+        rtc::message_vector messages = { rtc::make_message(data, data + bytes.size()) };
+        packetizer.outgoing(messages, [](rtc::message_ptr) {});
+
+        auto layer = static_cast<unsigned>(i % n_layers);
+        for (auto& message : messages) {
+            auto rtp = reinterpret_cast<const rtc::RtpHeader*>(message->data());
+            auto& descriptor = (*message)[rtp->getSize() + rtp->getExtensionHeaderSize()];
+            descriptor |= std::byte(layer << vacon::kGenericTemporalLayerShift);
+        }
+        packets.insert(packets.end(), messages.begin(), messages.end());
+    }
+
+    return packets;
+}
+
+// Forward one publisher's stream to state.range(0) subscribers. The send
+// functions only count the bytes, so this measures the router itself:
+// layer selection, the per-subscriber copy and header rewrite, but not
+// SRTP or the socket. The "streams" counter is the number of subscriber
+// streams that one core could forward at this rate.
+static void BM_SfuForward(benchmark::State& state, unsigned n_layers, unsigned max_kbps)
+{
+    auto packets = FixedRtpPackets(n_layers);
+    auto n_subscribers = static_cast<size_t>(state.range(0));
+
+    auto router = SfuRouter::Create(vacon::SfuRouterParams { .max_kbps = max_kbps });
+    size_t n_bytes_sent = 0;
+    auto send = [&n_bytes_sent](rtc::binary&& packet) {
+        n_bytes_sent += packet.size();
+        benchmark::DoNotOptimize(packet);
+    };
+
+    // Everyone subscribes to participant 1, the presenter.
+    for (size_t id = 1; id <= n_subscribers + 1; ++id) {
+        router->AddParticipant(id, 43, 101, send);
+    }
+
+    // One pass over the stream at its real frame rate, so that the layer
+    // selection sees the stream's bitrate.
+    for (const auto& packet : packets) {
+        router->Forward(1, packet);
+    }
+    router->UpdateLayers(std::chrono::duration<double>(kFrameCount / kStreamFrameRate));
+
+    auto n_out_start = router->n_packets_out_.load();
+    for (auto _ : state) {
+        for (const auto& packet : packets) {
+            router->Forward(1, packet);
+        }
+    }
+    auto n_out = router->n_packets_out_.load() - n_out_start;
+
+    auto packets_per_stream = packets.size() / (kFrameCount / kStreamFrameRate);
+    state.SetBytesProcessed(n_bytes_sent);
+    state.counters["packets"] = benchmark::Counter(n_out, benchmark::Counter::kIsRate);
+    state.counters["streams"] = benchmark::Counter(n_out / packets_per_stream, benchmark::Counter::kIsRate);
+}
+BENCHMARK_CAPTURE(BM_SfuForward, all, 1u, 0u)->Arg(1)->Arg(10)->Arg(100);
+BENCHMARK_CAPTURE(BM_SfuForward, base_layer, 2u, 6'000u)->Arg(1)->Arg(10)->Arg(100);
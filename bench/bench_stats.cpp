@@ -0,0 +1,48 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include <benchmark/benchmark.h>
+
+#include "stats.hpp"
+
+// Shared by all the benchmark threads, to measure the cost of the mutex
+// under contention, e.g. the render thread reading stats that a worker
+// thread updates.
+static vacon::Welford gWelford;
+
+static void BM_WelfordUpdate(benchmark::State& state)
+{
+    if (state.thread_index() == 0) {
+        gWelford.Reset();
+    }
+
+    double value = state.thread_index();
+    for (auto _ : state) {
+        gWelford.Update(value);
+        value += 1.0;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_WelfordUpdate)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_WelfordResult(benchmark::State& state)
+{
+    for (auto _ : state) {
+        auto s = gWelford.Result();
+        benchmark::DoNotOptimize(s);
+    }
+}
+BENCHMARK(BM_WelfordResult);
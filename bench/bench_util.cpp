@@ -0,0 +1,50 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include <cstddef>
+#include <cstdint>
+
+#include <benchmark/benchmark.h>
+
+#include "bench_inputs.hpp"
+#include "util.hpp"
+
+static void BM_FourCcToString(benchmark::State& state)
+{
+    // NV12, YUYV, P010, AV01.
+    const uint32_t fourccs[] = { 0x3231564e, 0x56595559, 0x30313050, 0x31305641 };
+
+    size_t i = 0;
+    for (auto _ : state) {
+        auto s = vacon::util::FourCcToString(fourccs[i++ % 4]);
+        benchmark::DoNotOptimize(s);
+    }
+}
+BENCHMARK(BM_FourCcToString);
+
+// The generic payload, version 1, checksums every frame on both ends.
+static void BM_Crc32c(benchmark::State& state)
+{
+    auto bytes = vacon::bench::FixedBytes(state.range(0));
+    auto data = reinterpret_cast<const std::byte*>(bytes.data());
+
+    for (auto _ : state) {
+        auto crc = vacon::util::Crc32c(data, bytes.size());
+        benchmark::DoNotOptimize(crc);
+    }
+
+    state.SetBytesProcessed(state.iterations() * bytes.size());
+}
+BENCHMARK(BM_Crc32c)->Arg(1024)->Arg(40 * 1024)->Arg(256 * 1024);
@@ -15,22 +15,39 @@
 
 #include "app.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <csignal>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <format>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
 
 #include <SDL3/SDL.h>
 #include <hydrogen.h>
 #include <plog/Log.h>
+#include <rtc/rtc.hpp>
 
 #include "event.hpp"
+#include "event_bus.hpp"
+#include "fanout.hpp"
 #include "invite.hpp"
 #include "linux/camera.hpp"
 #include "linux/decoder.hpp"
 #include "linux/encoder.hpp"
+#include "linux/mfx.hpp"
 #include "linux/mfx_loader.hpp"
 #include "network_handler.hpp"
+#include "peer.hpp"
 #include "util.hpp"
 
 namespace vacon {
@@ -62,6 +79,28 @@ int App::AppInit(int argc, char *argv[])
         std::signal(SIGUSR1, SignalUSR1);
     }
 
+    enable_degradation_ = args_["--video-no-degradation"] == false;
+    enable_bandwidth_probe_ = args_["--network-no-probe"] == false;
+    enable_frame_pacing_ = args_["--video-no-frame-pacing"] == false;
+
+    if (auto mode = linux::PresentModeFromString(args_.get<std::string>("--present-mode"))) {
+        present_mode_ = *mode;
+    } else {
+        LOG_FATAL << "Unknown presentation mode " << args_.get<std::string>("--present-mode");
+        return -1;
+    }
+
+    if (auto format = PayloadFormatFromString(args_.get<std::string>("--video-payload-format"))) {
+        video_payload_format_ = *format;
+    } else {
+        LOG_FATAL << "Unknown video payload format " << args_.get<std::string>("--video-payload-format");
+        return -1;
+    }
+
+    if (!ParseNetworkArgs()) {
+        return -1;
+    }
+
     if (!util::SetupRealtimePriority()) {
         LOG_ERROR << "Unable to set real-time thread priority, performance may be affected!";
     }
@@ -71,31 +110,115 @@ int App::AppInit(int argc, char *argv[])
         return -1;
     }
 
+    if (args_["--sfu"] == true) {
+        if (!InitSfu()) {
+            LOG_FATAL << "App::InitSfu() failed";
+            return -1;
+        }
+        return 0;
+    }
+
+    if (auto timeout_ms = args_.get<unsigned>("--watchdog-timeout"); timeout_ms > 0) {
+        watchdog_ = Watchdog::Create(WatchdogParams {
+            .stall_timeout = std::chrono::milliseconds(timeout_ms),
+        });
+        if (!watchdog_) {
+            LOG_FATAL << "Watchdog::Create() failed!";
+            return -1;
+        }
+        watchdog_->StartThread();
+    }
+
+    // The bus is set before the threads that push events start.
+    event_bus_ = EventBus::Create(EventBusParams {});
+    if (!event_bus_) {
+        LOG_FATAL << "EventBus::Create() failed!";
+        return -1;
+    }
+    event_bus_->Subscribe(Event::NetworkStarted, [this](const EventMessage& message) {
+        if (auto codecs = std::get_if<NegotiatedCodecs>(&message.payload)) {
+            StartPeerVideo(message.peer_id, *codecs, message.t_push);
+        }
+    });
+    event_bus_->Subscribe(Event::FirstFrameEncoded, [this](const EventMessage& message) {
+        ReportFirstFrame(message.t_push);
+    });
+    event_bus_->StartThread();
+    SetEventBus(event_bus_.get());
+
     if (!InitVideoCodecs()) {
         LOG_FATAL << "App::InitVideoCodecs() failed";
         return -1;
     }
 
-    if (!InitSDL()) {
-        LOG_FATAL << "App::InitSDL() failed";
-        return -1;
+    headless_ = args_["--headless"] == true;
+    if (headless_) {
+        if (!InitHeadless()) {
+            LOG_FATAL << "App::InitHeadless() failed";
+            return -1;
+        }
+    } else {
+        if (!InitSDL()) {
+            LOG_FATAL << "App::InitSDL() failed";
+            return -1;
+        }
+
+        if (!InitImgui()) {
+            LOG_FATAL << "App::InitImgui() failed";
+            return -1;
+        }
+
+        // Carry on without audio, e.g. if there is no audio device.
+        if (args_["--audio-disable"] == false && !InitAudio()) {
+            LOG_ERROR << "App::InitAudio() failed, audio is disabled";
+            audio_sender_ = nullptr;
+            audio_player_ = nullptr;
+        }
     }
 
-    if (!InitImgui()) {
-        LOG_FATAL << "App::InitImgui() failed";
-        return -1;
+    if (auto path = args_.present("--export-socket")) {
+        frame_export_ = linux::FrameExport::Create(linux::FrameExportParams { .path = *path });
+        if (!frame_export_) {
+            LOG_FATAL << "linux::FrameExport::Create() failed!";
+            return -1;
+        }
+        frame_export_->StartThread();
+        export_self_view_ = args_["--export-self-view"] == true;
     }
 
-    StartVideoCamera();
+    // Without a window, the decoded frames are only needed by the frame
+    // export. Otherwise they are decoded, but not exported or queued.
+    if (headless_) {
+        video_output_enabled_->store(frame_export_ != nullptr, std::memory_order_relaxed);
+    }
+
+    if (!file_source_) {
+        StartVideoCamera();
+    }
 
-    auto invite_str = args_.get<std::string>("invite");
-    if (invite_str != "") {
-        invite_ = Invite::Decode(invite_str);
-        if (!invite_) {
+    // The camera starts asynchronously, so the invites are joined once it
+    // has started.
+    for (const auto& invite_str : args_.get<std::vector<std::string>>("invite")) {
+        auto invite = Invite::Decode(invite_str);
+        if (!invite) {
             LOG_FATAL << "Unable to decode invite: " << invite_str;
             return -1;
         }
-        CreateConference();
+        if (file_source_) {
+            JoinConference(invite);
+        } else {
+            pending_invites_.emplace_back(invite);
+        }
+    }
+
+    // A headless bot without an invite starts a conference, and logs the
+    // invite for the other participants.
+    if (headless_ && peers_.empty() && pending_invites_.empty()) {
+        if (file_source_) {
+            CreateConference();
+        } else {
+            pending_invites_.emplace_back(nullptr);
+        }
     }
 
     return 0;
@@ -103,14 +226,45 @@ int App::AppInit(int argc, char *argv[])
 
 void App::AppQuit()
 {
+    watchdog_ = nullptr;
+    sfu_ = nullptr;
     StopConference();
+
+    // The threads that push events have stopped by now.
+    SetEventBus(nullptr);
+    event_bus_ = nullptr;
+    frame_export_ = nullptr;
+    audio_sender_ = nullptr;
+    audio_player_ = nullptr;
+
+    // The presentation feedback uses the Wayland display of the window, so
+    // it must go before SDL quits.
+    presentation_ = nullptr;
     linux::MfxLoader::DestroyInstance();
 }
 
 int App::AppEvent(const SDL_Event *event)
 {
+    // The SFU has no UI, and only needs to know when to quit.
+    if (sfu_) {
+        return event->type == SDL_EVENT_QUIT ? ShutdownEvent() : 0;
+    }
+
+    if (headless_) {
+        if (event->type == SDL_EVENT_USER) {
+            ProcessUserEvent(&event->user);
+        }
+        return event->type == SDL_EVENT_QUIT ? ShutdownEvent() : 0;
+    }
+
     ProcessUiEvent(event);
 
+    // Input and window events may change the UI. Dear ImGui needs a couple of
+    // frames to settle after input, e.g. to update hover state.
+    if (event->type != SDL_EVENT_USER) {
+        n_redraw_frames_ = kRedrawFramesOnInput;
+    }
+
     switch (event->type) {
     case SDL_EVENT_QUIT: {
         return ShutdownEvent();
@@ -123,6 +277,25 @@ int App::AppEvent(const SDL_Event *event)
         break;
     }
 
+    case SDL_EVENT_WINDOW_HIDDEN:
+    case SDL_EVENT_WINDOW_MINIMIZED:
+    case SDL_EVENT_WINDOW_OCCLUDED: {
+        if (event->window.windowID == SDL_GetWindowID(sdl_window_)) {
+            SetWindowVisible(false);
+        }
+        break;
+    }
+
+    case SDL_EVENT_WINDOW_SHOWN:
+    case SDL_EVENT_WINDOW_EXPOSED:
+    case SDL_EVENT_WINDOW_RESTORED:
+    case SDL_EVENT_WINDOW_MAXIMIZED: {
+        if (event->window.windowID == SDL_GetWindowID(sdl_window_)) {
+            SetWindowVisible(true);
+        }
+        break;
+    }
+
     case SDL_EVENT_USER: {
         ProcessUserEvent(&event->user);
         break;
@@ -182,6 +355,7 @@ int App::ShutdownEvent()
 void App::ProcessUserEvent(const SDL_UserEvent *user)
 {
     auto event = static_cast<Event>(user->code);
+    auto peer_id = static_cast<size_t>(reinterpret_cast<uintptr_t>(user->data1));
 
     switch (event) {
 
@@ -198,6 +372,13 @@ void App::ProcessUserEvent(const SDL_UserEvent *user)
             LOG_DEBUG << "[CameraStarted] Calling Camera::ExportBuffersToOpenGL() on render thread";
             camera_->ExportBuffersToOpenGL(sdl_renderer_);
         }
+        for (auto& invite : std::exchange(pending_invites_, {})) {
+            if (invite) {
+                JoinConference(invite);
+            } else {
+                CreateConference();
+            }
+        }
         break;
 
     case Event::CameraFailed: {
@@ -221,12 +402,17 @@ void App::ProcessUserEvent(const SDL_UserEvent *user)
         break;
 
     case Event::DecoderStarted:
-        decoder_codec_str_ = ToString(decoder_->Codec());
-        LOG_DEBUG << "[DecoderStarted] Started decoder (" << decoder_codec_str_ << ")";;
+        if (auto peer = FindPeer(peer_id)) {
+            peer->decoder_codec_str = ToString(peer->decoder->Codec());
+            LOG_DEBUG << std::format("[DecoderStarted] Started decoder for peer {} ({})",
+                                     peer_id, peer->decoder_codec_str);
+        }
         break;
 
     case Event::DecoderFailed:
-        LOG_FATAL << "[DecoderFailed]";
+        LOG_FATAL << "[DecoderFailed] Peer " << peer_id;
+        RemovePeer(peer_id);
+        UpdateReceiverScale();
         break;
 
     case Event::EncoderStarting:
@@ -242,19 +428,65 @@ void App::ProcessUserEvent(const SDL_UserEvent *user)
         LOG_FATAL << "[EncoderFailed]";
         break;
 
+    case Event::FirstFrameEncoded:
+        LOG_DEBUG << "[FirstFrameEncoded]";
+        break;
+
     case Event::NetworkStarting:
         LOG_DEBUG << "[NetworkStarting]";
         break;
 
-    case Event::NetworkStarted:
-        LOG_DEBUG << std::format("[NetworkStarted] Starting encoder ({}) and decoder ({})",
-                                 ToString(nh_->WantedEncoder()),
-                                 ToString(nh_->WantedDecoder()));
-        encoder_->StartThread(nh_->WantedEncoder(), camera_->GetCameraFormat());
-        decoder_->StartThread(nh_->WantedDecoder());
+    case Event::NetworkStarted: {
+        auto peer = FindPeer(peer_id);
+        if (!peer) {
+            LOG_DEBUG << "[NetworkStarted] Ignoring unknown peer " << peer_id;
+            break;
+        }
+
+        LOG_DEBUG << std::format("[NetworkStarted] Peer {} negotiated encoder ({}) and decoder ({})",
+                                 peer_id,
+                                 ToString(peer->nh->WantedEncoder()),
+                                 ToString(peer->nh->WantedDecoder()));
+
+        // The event bus has usually started the video already, without
+        // waiting for the render loop. If the bus was full, it starts here.
+        StartPeerVideo(peer_id, NegotiatedCodecs {
+            .encoder    = peer->nh->WantedEncoder(),
+            .decoder    = peer->nh->WantedDecoder(),
+        }, std::chrono::steady_clock::now());
+        if (file_source_) {
+            encoder_codec_str_ = ToString(file_source_->Codec());
+        }
+
+        // Until it reports its render size, the new peer gets the full
+        // resolution, and it may need more than the other peers.
+        UpdateReceiverScale();
         break;
+    }
 
     case Event::NetworkFailed:
+        LOG_DEBUG << "[NetworkFailed] Peer " << peer_id;
+        RemovePeer(peer_id);
+        UpdateReceiverScale();
+        break;
+
+    case Event::RemoteRenderSize:
+        UpdateReceiverScale();
+        break;
+
+    case Event::BandwidthProbed: {
+        std::lock_guard lock(pipeline_mutex_);
+        ApplyBandwidthProbe();
+        break;
+    }
+
+    case Event::DecodedFrameReady:
+        // Only wakes up AppIterate(), which redraws when the frame's playout
+        // time comes.
+        break;
+
+    case Event::PreviewFrameReady:
+        n_redraw_frames_ = std::max(n_redraw_frames_, 1);
         break;
 
     default:
@@ -264,27 +496,572 @@ void App::ProcessUserEvent(const SDL_UserEvent *user)
 
 int App::AppIterate()
 {
-    RenderFrame();
+    using namespace std::chrono_literals;
+
+    if (sfu_) {
+        WaitEventUntil(std::chrono::steady_clock::now() + 1s);
+        sfu_->Update();
+        return 0;
+    }
+
+    if (headless_) {
+        IterateHeadless();
+        return 0;
+    }
+
+    if (presentation_) {
+        presentation_->Dispatch();
+    }
+
+    // Nothing is drawn while the window can't be seen.
+    if (!window_visible_) {
+        ++stats_.n_idle_wait;
+        WaitEventUntil(std::chrono::steady_clock::now() + 1s);
+        UpdateLoad();
+        return 0;
+    }
+
+    // Keep the stats overlay current even when nothing else changes.
+    auto t_now = std::chrono::steady_clock::now();
+    if (enable_stats_overlay_ && t_now - t_last_redraw_ >= 1s) {
+        n_redraw_frames_ = std::max(n_redraw_frames_, 1);
+    }
+
+    // Redraw when the next remote frame of any peer is due, otherwise wake
+    // up in time for the earliest one.
+    ClearFrameReadyEvent(Event::DecodedFrameReady);
+    std::optional<std::chrono::time_point<std::chrono::steady_clock>> t_playout_wake;
+    auto t_deadline = PlayoutDeadline(t_now);
+    for (auto& peer : peers_) {
+        PullDecodedFrames(*peer);
+        if (peer->playout_queue.empty()) {
+            continue;
+        }
+        auto t_playout = peer->playout_queue.front().t_playout;
+        if (t_playout <= t_deadline) {
+            n_redraw_frames_ = std::max(n_redraw_frames_, 1);
+        } else {
+            auto t_wake = PlayoutWakeTime(t_playout);
+            t_playout_wake = t_playout_wake ? std::min(*t_playout_wake, t_wake) : t_wake;
+        }
+    }
+
+    std::optional<std::chrono::time_point<std::chrono::steady_clock>> t_render;
+    if (n_redraw_frames_ > 0) {
+        t_render = ScheduleRender(t_now);
+    }
+
+    if (n_redraw_frames_ > 0 && !t_render) {
+        --n_redraw_frames_;
+        ++stats_.n_redraw;
+        t_last_redraw_ = t_now;
+
+        // Clear the pending frame ready event before the queue is dequeued,
+        // so that a frame that arrives during the redraw pushes a new event.
+        ClearFrameReadyEvent(Event::PreviewFrameReady);
+        RenderFrame();
+
+        // Only one frame is taken off the preview queue per redraw. If more
+        // frames queued up in the meantime, redraw again rather than waiting
+        // for an event that won't come.
+        if (camera_ && preview_queue_->size_approx() > 0) {
+            n_redraw_frames_ = std::max(n_redraw_frames_, 1);
+        }
+    } else {
+        // Nothing to draw yet. Sleep until the next event arrives, but wake
+        // up in time for a scheduled redraw, the next stats redraw, and the
+        // degradation update.
+        ++stats_.n_idle_wait;
+        auto t_wake = t_now + 1s;
+        if (enable_stats_overlay_) {
+            t_wake = t_last_redraw_ + 1s;
+        }
+        if (t_render) {
+            t_wake = std::min(t_wake, *t_render);
+        }
+        if (t_playout_wake) {
+            t_wake = std::min(t_wake, *t_playout_wake);
+        }
+        WaitEventUntil(t_wake);
+    }
+
+    UpdateLoad();
 
     return 0;
 }
 
-bool App::InitVideoCodecs()
+std::optional<std::chrono::time_point<std::chrono::steady_clock>> App::ScheduleRender(
+    std::chrono::time_point<std::chrono::steady_clock> t_now)
+{
+    if (present_mode_ != linux::PresentMode::LowLatency || !presentation_) {
+        return std::nullopt;
+    }
+
+    // Aim for the first vertical blank that can still be made, and start
+    // rendering so that the commit lands just before it. Frames that arrive
+    // in the meantime are picked up by the same redraw.
+    if (!t_target_vblank_) {
+        auto render = s_render_time_.Result();
+        auto present = s_present_time_.Result();
+        auto cost = std::chrono::microseconds(static_cast<int64_t>(
+            render.mean + 2.0 * render.stdev + present.mean + 2.0 * present.stdev));
+        auto lead = cost + presentation_->Margin();
+
+        auto t_vblank = presentation_->NextVblank(t_now + lead);
+        if (!t_vblank) {
+            return std::nullopt;
+        }
+        t_target_vblank_ = t_vblank;
+        t_render_start_ = *t_vblank - lead;
+    }
+
+    if (t_now >= t_render_start_) {
+        return std::nullopt;
+    }
+    return t_render_start_;
+}
+
+void App::SetWindowVisible(bool visible)
+{
+    if (visible == window_visible_) {
+        return;
+    }
+    window_visible_ = visible;
+
+    // The decoder keeps decoding, so that the reference frames stay intact,
+    // but stops exporting and queueing frames, and the camera stops queueing
+    // preview frames.
+    video_output_enabled_->store(visible, std::memory_order_relaxed);
+
+    if (visible) {
+        LOG_DEBUG << "Window is visible, resuming rendering";
+        n_redraw_frames_ = std::max(n_redraw_frames_, kRedrawFramesOnInput);
+        return;
+    }
+
+    LOG_DEBUG << "Window is hidden, pausing rendering";
+
+    // Release the frames that are waiting to be shown, along with their
+    // decoder surfaces, textures and camera buffers.
+    while (preview_queue_->try_pop()) {}
+    for (auto& peer : peers_) {
+        while (peer->decoded_video_frame_queue->try_pop()) {}
+        peer->playout_queue.clear();
+        peer->decoded_frame = nullptr;
+    }
+    preview_cref_ = nullptr;
+}
+
+void App::PullDecodedFrames(Peer& peer)
+{
+    // Move the decoded frames into the playout queue as soon as they arrive,
+    // so that they are timed by their arrival rather than by when they are
+    // shown.
+    std::shared_ptr<linux::DecodedFrame> frame;
+    while (peer.decoded_video_frame_queue->try_dequeue(frame)) {
+        if (frame_export_) {
+            frame_export_->Publish(peer.id, frame);
+        }
+        auto t_playout = frame->t_decoded_;
+        if (enable_frame_pacing_) {
+            t_playout = peer.playout_clock.Update(frame->rtp_timestamp_, frame->t_decoded_) +
+                        peer.av_sync->VideoDelay();
+        }
+        peer.playout_queue.emplace_back(PlayoutFrame { .frame = std::move(frame), .t_playout = t_playout });
+    }
+
+    // Every queued frame holds on to a decoder surface, so don't let a long
+    // playout delay starve the decoder.
+    while (peer.playout_queue.size() > kMaxPlayoutFrames) {
+        peer.playout_queue.pop_front();
+        ++peer.stats.n_remote_skipped;
+    }
+}
+
+std::chrono::time_point<std::chrono::steady_clock> App::PlayoutDeadline(
+    std::chrono::time_point<std::chrono::steady_clock> t_now)
+{
+    // Frames are shown on the vertical blank nearest to their playout time,
+    // so a redraw for a vertical blank shows the frames that are due up to
+    // half a refresh interval after it.
+    if (presentation_ && presentation_->Refresh().count() > 0) {
+        auto t_vblank = t_target_vblank_;
+        if (!t_vblank) {
+            t_vblank = presentation_->NextVblank(t_now);
+        }
+        if (t_vblank) {
+            return *t_vblank + presentation_->Refresh() / 2;
+        }
+    }
+
+    return t_now;
+}
+
+std::chrono::time_point<std::chrono::steady_clock> App::PlayoutWakeTime(
+    std::chrono::time_point<std::chrono::steady_clock> t_playout)
+{
+    using namespace std::chrono_literals;
+
+    // Wake up one refresh interval before the vertical blank that the frame
+    // will be shown on, so that the redraw lands on it.
+    if (presentation_ && presentation_->Refresh().count() > 0) {
+        auto refresh = presentation_->Refresh();
+        if (auto t_vblank = presentation_->NextVblank(t_playout - refresh / 2)) {
+            return *t_vblank - refresh + 100us;
+        }
+    }
+
+    return t_playout;
+}
+
+void App::WaitEventUntil(std::chrono::time_point<std::chrono::steady_clock> t_wake)
+{
+    // SDL_WaitEventTimeout() has millisecond resolution, so sleep for the
+    // remainder.
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        t_wake - std::chrono::steady_clock::now());
+    if (remaining.count() >= 1) {
+        SDL_WaitEventTimeout(nullptr, static_cast<Sint32>(std::min<int64_t>(remaining.count(), 1000)));
+    } else {
+        std::this_thread::sleep_until(t_wake);
+    }
+}
+
+bool App::InitHeadless()
+{
+    // Like the SFU, only the events subsystem is needed. The camera, decoder
+    // and network threads push their events without a window.
+    if (SDL_Init(SDL_INIT_EVENTS) != 0) {
+        LOG_FATAL << "SDL_Init() failed: " << SDL_GetError();
+        return false;
+    }
+
+    enable_stats_overlay_ = false;
+    LOG_INFO << "Running headless";
+
+    return true;
+}
+
+void App::IterateHeadless()
+{
+    using namespace std::chrono_literals;
+
+    WaitEventUntil(std::chrono::steady_clock::now() + 1s);
+
+    // Nothing is shown, so the frames are handed to the frame export, if
+    // any, as soon as they are decoded.
+    ClearFrameReadyEvent(Event::DecodedFrameReady);
+    ClearFrameReadyEvent(Event::PreviewFrameReady);
+    for (auto& peer : peers_) {
+        std::shared_ptr<linux::DecodedFrame> frame;
+        while (peer->decoded_video_frame_queue->try_dequeue(frame)) {
+            ++peer->stats.n_remote;
+            if (frame_export_) {
+                frame_export_->Publish(peer->id, std::move(frame));
+            }
+        }
+    }
+
+    std::shared_ptr<linux::CameraBufferRef> cref;
+    while (preview_queue_->try_dequeue(cref)) {
+        if (frame_export_ && export_self_view_) {
+            frame_export_->Publish(std::move(cref));
+        }
+    }
+
+    UpdateLoad();
+
+    // Without the stats overlay, log a summary now and then.
+    auto t_now = std::chrono::steady_clock::now();
+    if (t_now - t_last_headless_report_ >= 10s) {
+        t_last_headless_report_ = t_now;
+        size_t n_send_skip = 0;
+        for (const auto& peer : peers_) {
+            n_send_skip += peer->nh->n_frames_send_skip_.load(std::memory_order_relaxed);
+        }
+        LOG_INFO << std::format("{} peers, camera {} (M:{}), encoded {} at {} Kbps, send skipped {}, decoded {} (F:{})",
+                                peers_.size(),
+                                linux::n_frames_camera_success  .load(std::memory_order_relaxed),
+                                linux::n_frames_camera_missed   .load(std::memory_order_relaxed),
+                                linux::n_frames_encode_success  .load(std::memory_order_relaxed),
+                                send_rate_.BitrateKbps(),
+                                n_send_skip,
+                                linux::n_frames_decode_success  .load(std::memory_order_relaxed),
+                                linux::n_frames_decode_fail     .load(std::memory_order_relaxed));
+    }
+}
+
+void App::UpdateLoad()
+{
+    using namespace std::chrono_literals;
+
+    // Sample the pipeline load about once per second.
+    auto t_now = std::chrono::steady_clock::now();
+    if (t_now - t_last_load_update_ < 1s) {
+        return;
+    }
+    t_last_load_update_ = t_now;
+
+    // The clock exchanges with the peers run at the same pace.
+    for (auto& peer : peers_) {
+        peer->nh->SendClockPing();
+    }
+
+    // The first sample only primes the sampler. The decoder threads of all
+    // the peers share a name, so their usage is summed.
+    if (!cpu_sampler_.Sample().empty()) {
+        auto& cost = peer_costs_[peers_.size()];
+        cost.s_cpu_percent.Update(cpu_sampler_.ProcessCpuPercent());
+        cost.s_decoder_cpu_percent.Update(cpu_sampler_.CpuPercent("VDecoderVideo"));
+    }
+
+    if (enable_degradation_) {
+        UpdateDegradation();
+    }
+    UpdateSendRate();
+}
+
+void App::UpdateDegradation()
+{
+    if (!encoder_ || !camera_ || encoder_codec_str_.empty()) {
+        return;
+    }
+
+    auto n_cpus = std::thread::hardware_concurrency();
+    auto inputs = DegradationInputs {
+        .camera_frame_rate          = camera_->GetCameraFormat().FrameRate(),
+        .encode_time                = encoder_->s_encode_time_.Result(),
+        .present_time               = s_present_time_.Result(),
+        .encoder_queue_depth        = encoder_queue_->size_approx(),
+        .outgoing_queue_depth       = outgoing_video_packet_queue_->size_approx(),
+        .n_camera_overflow_encoder  = linux::n_frames_camera_overflow_encoder.load(std::memory_order_relaxed),
+        .n_encode_stall             = linux::n_frames_encode_stall.load(std::memory_order_relaxed),
+        .encoder_cpu_percent        = cpu_sampler_.CpuPercent("VEncoderVideo"),
+        .process_cpu_percent        = cpu_sampler_.ProcessCpuPercent(),
+        .n_cpus                     = n_cpus > 0 ? n_cpus : 1,
+    };
+
+    if (degradation_.Update(inputs)) {
+        const auto& level = degradation_.CurrentLevel();
+        encoder_->SetDegradation(level.scale_percent, level.fps_divisor);
+    }
+}
+
+void App::UpdateSendRate()
+{
+    std::lock_guard lock(pipeline_mutex_);
+
+    if (!encoder_ || sending_codec_ == VideoCodec::UNKNOWN || file_source_) {
+        return;
+    }
+
+    // All peers get the same encoded video, so the bitrate follows the peer
+    // with the slowest link.
+    SendRateInputs inputs = {};
+    for (const auto& peer : peers_) {
+        inputs.backpressure         |= peer->nh->SendBackpressure();
+        inputs.n_frames_send_skip   += peer->nh->n_frames_send_skip_.load(std::memory_order_relaxed);
+        inputs.n_frames_send_fail   += peer->nh->n_frames_send_fail_.load(std::memory_order_relaxed);
+    }
+
+    if (send_rate_.Update(inputs)) {
+        encoder_->SetBitrate(send_rate_.BitrateKbps());
+    }
+}
+
+void App::ApplyBandwidthProbe()
+{
+    // Leave room for the audio, the packet overhead, and the keyframes,
+    // which are sent in bursts.
+    static const unsigned kProbeHeadroomPercent = 70;
+
+    if (!encoder_ || sending_codec_ == VideoCodec::UNKNOWN || file_source_) {
+        return;
+    }
+
+    // All peers get the same encoded video, so the bitrate follows the peer
+    // with the slowest link.
+    unsigned probe_kbps = 0;
+    for (const auto& peer : peers_) {
+        auto kbps = peer->nh->probe_kbps_.load(std::memory_order_relaxed);
+        if (kbps > 0 && (probe_kbps == 0 || kbps < probe_kbps)) {
+            probe_kbps = kbps;
+        }
+    }
+
+    // The probe only ever lowers the bitrate. Raising it is up to the send
+    // rate control, which takes over from here.
+    auto start_kbps = probe_kbps * kProbeHeadroomPercent / 100;
+    if (probe_kbps == 0 || start_kbps >= send_rate_.BitrateKbps()) {
+        return;
+    }
+
+    LOG_INFO << std::format("Lowering the video bitrate from {} to {} Kbps, for a probed bandwidth of {} Kbps",
+                            send_rate_.BitrateKbps(), start_kbps, probe_kbps);
+    auto max_kbps = args_.get<unsigned>("--video-encoder-bitrate");
+    send_rate_.Reset(start_kbps, max_kbps);
+    encoder_->SetBitrate(send_rate_.BitrateKbps());
+}
+
+void App::UpdateReceiverScale()
+{
+    // Steps of the receiver scale. Every change restarts the encoder with a
+    // keyframe, so small changes of the remote window size are ignored.
+    static const std::array<unsigned, 5> kScaleSteps = { 100, 75, 50, 33, 25 };
+
+    if (!encoder_ || !camera_ || encoder_codec_str_.empty()) {
+        return;
+    }
+
+    auto camera_width = camera_->GetCameraFormat().Width();
+    auto camera_height = camera_->GetCameraFormat().Height();
+    if (camera_width == 0 || camera_height == 0) {
+        return;
+    }
+
+    // All peers get the same encoded video, so it must be large enough for
+    // the peer that renders it the largest. A peer that hasn't reported its
+    // render size yet gets the full resolution.
+    unsigned wanted_percent = 0;
+    for (const auto& peer : peers_) {
+        auto [width, height] = peer->nh->RemoteRenderSize();
+        if (width == 0 || height == 0) {
+            wanted_percent = 100;
+            break;
+        }
+        wanted_percent = std::max({
+            wanted_percent,
+            (width * 100 + camera_width - 1) / camera_width,
+            (height * 100 + camera_height - 1) / camera_height,
+        });
+    }
+
+    auto scale_percent = kScaleSteps.front();
+    for (auto step : kScaleSteps) {
+        if (step >= wanted_percent) {
+            scale_percent = step;
+        }
+    }
+
+    LOG_DEBUG << std::format("Receivers need {}% of the camera resolution, encoding at {}%",
+                             std::min(wanted_percent, 100u), scale_percent);
+    encoder_->SetReceiverScale(scale_percent);
+}
+
+template <typename Queue>
+static std::string QueueDepth(const Queue& queue)
+{
+    return std::format("{}/{}", queue.size_approx(), queue.max_capacity());
+}
+
+void App::WatchCamera()
+{
+    if (!watchdog_) {
+        return;
+    }
+
+    watchdog_->AddStage(kWatchdogPipeline, "camera", [] {
+        return linux::n_frames_camera_success.load(std::memory_order_relaxed);
+    });
+    watchdog_->AddGauge(kWatchdogPipeline, "queues", "encoder", [q = encoder_queue_] { return QueueDepth(*q); });
+    watchdog_->AddGauge(kWatchdogPipeline, "queues", "preview", [q = preview_queue_] { return QueueDepth(*q); });
+    watchdog_->AddGauge(kWatchdogPipeline, "camera", "buffers held", [] {
+        return std::to_string(linux::n_camera_buffers_held.load(std::memory_order_relaxed));
+    });
+}
+
+void App::WatchSending()
 {
-    decoder_ = linux::Decoder::Create(linux::DecoderParams {
-        .incoming_video_packet_queue    = incoming_video_packet_queue_,
-        .decoded_video_frame_queue      = decoded_video_frame_queue_,
+    if (!watchdog_) {
+        return;
+    }
+
+    if (file_source_) {
+        watchdog_->AddStage(kWatchdogPipeline, "source", [] {
+            return linux::n_frames_source_success.load(std::memory_order_relaxed);
+        });
+    } else {
+        // Skipped and failed frames are progress too, the encoder isn't
+        // stuck on them.
+        watchdog_->AddStage(kWatchdogPipeline, "encode", [] {
+            return linux::n_frames_encode_success.load(std::memory_order_relaxed) +
+                   linux::n_frames_encode_fail.load(std::memory_order_relaxed) +
+                   linux::n_frames_encode_skip.load(std::memory_order_relaxed);
+        }, "camera");
+    }
+    watchdog_->AddStage(kWatchdogPipeline, "fan-out", [] {
+        return n_frames_fanout.load(std::memory_order_relaxed);
+    }, file_source_ ? "source" : "encode");
+
+    watchdog_->AddGauge(kWatchdogPipeline, "queues", "outgoing",
+                        [q = outgoing_video_packet_queue_] { return QueueDepth(*q); });
+    watchdog_->AddGauge(kWatchdogPipeline, "mfx", "encode", [] {
+        return linux::MfxStatusStr(linux::last_mfx_status_encode.load(std::memory_order_relaxed));
+    });
+    watchdog_->AddGauge(kWatchdogPipeline, "mfx", "decode", [] {
+        return linux::MfxStatusStr(linux::last_mfx_status_decode.load(std::memory_order_relaxed));
+    });
+}
+
+void App::WatchPeer(Peer& peer, bool sending)
+{
+    if (!watchdog_) {
+        return;
+    }
+
+    // The callbacks may point into the peer, because the peer's stages are
+    // removed before it is destroyed.
+    auto name = std::format("peer {}", peer.id);
+    auto nh = peer.nh;
+    auto decoder = peer.decoder.get();
+    auto stats = &peer.stats;
+
+    if (sending) {
+        watchdog_->AddStage(peer.id, name + " send", [nh] {
+            return nh->n_frames_sent_.load(std::memory_order_relaxed);
+        }, "fan-out");
+    }
+    watchdog_->AddStage(peer.id, name + " receive", [nh] {
+        return nh->n_frames_received_.load(std::memory_order_relaxed);
+    });
+
+    // While the window can't be seen, the decoded frames are released
+    // instead of being timed and shown. Those are only counted for all the
+    // peers at once, but count as progress of both the decoder and the
+    // renderer.
+    watchdog_->AddStage(peer.id, name + " decode", [decoder] {
+        return static_cast<size_t>(decoder->s_decode_time_.Result().count) +
+               linux::n_frames_decode_hidden.load(std::memory_order_relaxed);
+    }, name + " receive");
+    watchdog_->AddStage(peer.id, name + " render", [stats] {
+        return stats->n_remote.load(std::memory_order_relaxed) +
+               linux::n_frames_decode_hidden.load(std::memory_order_relaxed);
+    }, name + " decode");
+
+    watchdog_->AddGauge(peer.id, "queues", name + " incoming",
+                        [q = peer.incoming_video_packet_queue] { return QueueDepth(*q); });
+    watchdog_->AddGauge(peer.id, "queues", name + " decoded",
+                        [q = peer.decoded_video_frame_queue] { return QueueDepth(*q); });
+    watchdog_->AddGauge(peer.id, "network", name + " backpressure", [nh] {
+        return std::string(nh->SendBackpressure() ? "yes" : "no");
     });
-    if (!decoder_) {
+}
+
+bool App::InitVideoCodecs()
+{
+    // Every peer gets its own decoder. This one is only used to query the
+    // supported codecs.
+    auto decoder = linux::Decoder::Create(linux::DecoderParams {});
+    if (!decoder) {
         LOG_FATAL << "linux::Decoder::Create() failed!";
         return false;
     }
 
     if (auto force_str = args_.present("--video-force-decoder")) {
         VideoCodec force = FromString(*force_str);
-        decoder_codecs_ = decoder_->GetSupportedCodecs(force);
+        decoder_codecs_ = decoder->GetSupportedCodecs(force);
     } else {
-        decoder_codecs_ = decoder_->GetSupportedCodecs();
+        decoder_codecs_ = decoder->GetSupportedCodecs();
     }
 
     if (decoder_codecs_->empty()) {
@@ -295,10 +1072,37 @@ bool App::InitVideoCodecs()
         LOG_DEBUG << "Decoder supports: " << ToString(codec);
     }
 
+    // A pre-encoded file replaces both the camera and the encoder, and only
+    // its own codec can be offered to the peer.
+    if (auto path = args_.present("--video-source-file")) {
+        auto params = linux::FileSourceParams {
+            .path                           = *path,
+            .max_rate                       = args_["--video-source-max-rate"] == true,
+            .outgoing_video_packet_queue    = outgoing_video_packet_queue_,
+        };
+        if (auto force_str = args_.present("--video-force-encoder")) {
+            params.codec = FromString(*force_str);
+        }
+        if (auto fps = args_.present<double>("--video-source-fps")) {
+            params.frame_rate = *fps;
+            params.override_frame_rate = true;
+        }
+
+        file_source_ = linux::FileSource::Create(params);
+        if (!file_source_) {
+            LOG_FATAL << "linux::FileSource::Create() failed!";
+            return false;
+        }
+
+        encoder_codecs_ = std::make_shared<std::vector<VideoCodec>>(1, file_source_->Codec());
+        return true;
+    }
+
     encoder_ = linux::Encoder::Create(linux::EncoderParams {
         .bitrate_kbps                   = args_.get<unsigned>("--video-encoder-bitrate"),
         .encoder_queue                  = encoder_queue_,
         .outgoing_video_packet_queue    = outgoing_video_packet_queue_,
+        .keyframe_request               = keyframe_request_,
     });
     if (!encoder_) {
         LOG_FATAL << "linux::Encoder::Create() failed!";
@@ -323,107 +1127,504 @@ bool App::InitVideoCodecs()
     return true;
 }
 
-void App::StartNetworkHandler()
+Peer* App::AddPeer(std::shared_ptr<Invite> invite)
 {
-    if (nh_ || !invite_) {
-        LOG_FATAL << "NetworkHandler already exists or Invite not set, cannot start network handler";
-        return;
+    // The event bus thread may be starting the video of another peer.
+    std::lock_guard lock(pipeline_mutex_);
+
+    auto peer = std::make_unique<Peer>();
+    peer->id = next_peer_id_++;
+    peer->invite = invite;
+
+    peer->decoder = linux::Decoder::Create(linux::DecoderParams {
+        .peer_id                        = peer->id,
+        .incoming_video_packet_queue    = peer->incoming_video_packet_queue,
+        .decoded_video_frame_queue      = peer->decoded_video_frame_queue,
+        .output_enabled                 = video_output_enabled_,
+        .render_node                    = headless_ ? args_.get<std::string>("--headless-render-node") : "",
+    });
+    if (!peer->decoder) {
+        LOG_ERROR << "linux::Decoder::Create() failed!";
+        return nullptr;
+    }
+
+    // Recordings are created with the first peer, and started once the
+    // codecs are negotiated. The outgoing video is the same for every peer,
+    // while the incoming recording and the RTP capture only cover the first.
+    auto first = peers_.empty();
+    if (first) {
+        if (auto path = args_.present("--record-outgoing")) {
+            outgoing_recorder_ = linux::Recorder::Create(linux::RecorderParams {
+                .path   = *path,
+                .name   = "outgoing",
+            });
+        }
+        if (auto path = args_.present("--record-incoming")) {
+            incoming_recorder_ = linux::Recorder::Create(linux::RecorderParams {
+                .path   = *path,
+                .name   = "incoming",
+            });
+        }
+    }
+
+    // Once the encoder is running, it can't switch codecs for a new peer.
+    auto encoder_codecs = encoder_codecs_;
+    if (sending_codec_ != VideoCodec::UNKNOWN) {
+        encoder_codecs = std::make_shared<std::vector<VideoCodec>>(1, sending_codec_);
+    }
+
+    if (audio_player_) {
+        peer->incoming_audio_packet_queue = std::make_shared<AudioPacketQueue>(32);
+        peer->audio_receiver = AudioReceiver::Create(AudioReceiverParams {
+            .peer_id                        = peer->id,
+            .incoming_audio_packet_queue    = peer->incoming_audio_packet_queue,
+            .av_sync                        = peer->av_sync,
+        });
+        if (!peer->audio_receiver) {
+            LOG_ERROR << "AudioReceiver::Create() failed!";
+            return nullptr;
+        }
     }
 
     // Get network parameters.
     auto params = NetworkHandlerParams {
-        .invite                         = invite_,
+        .peer_id                        = peer->id,
+        .invite                         = invite,
         .stun_server                    = args_.get<std::string>("--network-stun-server"),
-        .outgoing_video_packet_queue    = outgoing_video_packet_queue_,
-        .incoming_video_packet_queue    = incoming_video_packet_queue_,
+        .incoming_video_packet_queue    = peer->incoming_video_packet_queue,
         .decoder_codecs                 = decoder_codecs_,
-        .encoder_codecs                 = encoder_codecs_,
+        .encoder_codecs                 = encoder_codecs,
+        .incoming_recorder              = first ? incoming_recorder_ : nullptr,
+        .rtp_capture                    = nullptr,
+        .incoming_audio_packet_queue    = peer->incoming_audio_packet_queue,
+        .av_sync                        = peer->av_sync,
+        .video_payload_format           = video_payload_format_,
+        .keyframe_request               = keyframe_request_,
+        .bandwidth_probe                = enable_bandwidth_probe_,
+        .transport                      = network_transport_,
     };
 
+    if (auto path = args_.present("--network-capture"); path && first) {
+        params.rtp_capture = RtpCaptureHandler::Create(*path);
+    }
+
     // Start the NetworkHandler.
-    nh_ = NetworkHandler::Create(params);
-    if (nh_) {
-        nh_->StartDrainThread();
-        nh_->StartConnectThread();
+    peer->nh = NetworkHandler::Create(params);
+    if (!peer->nh) {
+        LOG_ERROR << "NetworkHandler::Create() failed";
+        return nullptr;
+    }
+    peer->nh->StartConnectThread();
+
+    if (peer->audio_receiver) {
+        audio_player_->AddReceiver(peer->audio_receiver);
+    }
+
+    LOG_INFO << std::format("Added peer {} using invite {}", peer->id, invite->Encode());
+    invite_ = invite;
+    return peers_.emplace_back(std::move(peer)).get();
+}
+
+Peer* App::FindPeer(size_t id)
+{
+    auto it = std::find_if(peers_.begin(), peers_.end(), [id](const auto& peer) { return peer->id == id; });
+    return it != peers_.end() ? it->get() : nullptr;
+}
+
+void App::StartPeerVideo(size_t peer_id, const NegotiatedCodecs& codecs,
+                         std::chrono::time_point<std::chrono::steady_clock> t_network_started)
+{
+    std::lock_guard lock(pipeline_mutex_);
+
+    // Both the event bus and the render loop get NetworkStarted, and the
+    // first one starts the video.
+    auto peer = FindPeer(peer_id);
+    if (!peer || peer->video_started) {
+        return;
+    }
+    peer->video_started = true;
+
+    // The first peer to connect starts the encoder, or the file source,
+    // and the others share its output.
+    if (sending_codec_ == VideoCodec::UNKNOWN) {
+        t_sending_started_ = t_network_started;
+        StartVideoSending(codecs.encoder);
+    }
+    if (audio_sender_) {
+        audio_sender_->AddPeer(peer->nh);
+    }
+    if (codecs.encoder == sending_codec_) {
+        fanout_->AddPeer(peer->nh);
+    } else {
+        LOG_ERROR << std::format("Peer {} negotiated {}, but {} is already being sent, not sending video",
+                                 peer_id,
+                                 ToString(codecs.encoder),
+                                 ToString(sending_codec_));
+    }
+
+    peer->decoder->StartThread(codecs.decoder);
+    WatchPeer(*peer, codecs.encoder == sending_codec_);
+    if (incoming_recorder_ && peer == peers_.front().get()) {
+        incoming_recorder_->StartThread(codecs.decoder);
+    }
+}
+
+void App::ReportFirstFrame(std::chrono::time_point<std::chrono::steady_clock> t_encoded)
+{
+    std::lock_guard lock(pipeline_mutex_);
+
+    if (t_sending_started_ == decltype(t_sending_started_) {}) {
+        return;
+    }
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(t_encoded - t_sending_started_);
+    t_sending_started_ = {};
+    first_frame_latency_.store(latency, std::memory_order_relaxed);
+    LOG_INFO << std::format("First video frame encoded {:.1f} ms after the network started",
+                            latency.count() / 1000.0);
+}
+
+void App::StartVideoSending(VideoCodec codec)
+{
+    LOG_DEBUG << std::format("Starting {} ({}) and video fan-out",
+                             file_source_ ? "file source" : "encoder", ToString(codec));
+
+    sending_codec_ = codec;
+
+    fanout_ = VideoFanOut::Create(VideoFanOutParams {
+        .outgoing_video_packet_queue    = outgoing_video_packet_queue_,
+        .outgoing_recorder              = outgoing_recorder_,
+    });
+    fanout_->StartThread();
+
+    if (file_source_) {
+        file_source_->StartThread();
     } else {
-        LOG_DEBUG << "NetworkHandler::Create() failed";
+        auto bitrate_kbps = args_.get<unsigned>("--video-encoder-bitrate");
+        send_rate_.Reset(bitrate_kbps, bitrate_kbps);
+        ApplyBandwidthProbe();
+        encoder_->SetBitrate(send_rate_.BitrateKbps());
+        encoder_->StartThread(codec, camera_->GetCameraFormat());
     }
+    if (outgoing_recorder_) {
+        outgoing_recorder_->StartThread(codec);
+    }
+    WatchSending();
 }
 
-void App::StopNetworkHandler()
+void App::StopPeers()
 {
-    nh_ = nullptr;
+    // Called by StopConference(), with the pipeline mutex held.
+
+    // The fan-out thread sends to the network handlers, so stop it first.
+    // The audio threads keep running, for the next conference.
+    fanout_ = nullptr;
+    sending_codec_ = VideoCodec::UNKNOWN;
+    for (auto& peer : peers_) {
+        peer->nh->RequestStop();
+        if (audio_sender_) {
+            audio_sender_->RemovePeer(peer->nh);
+        }
+        if (audio_player_ && peer->audio_receiver) {
+            audio_player_->RemoveReceiver(peer->audio_receiver);
+        }
+    }
+
+    if (watchdog_) {
+        for (auto& peer : peers_) { watchdog_->Remove(peer->id); }
+    }
+
+    for (auto& peer : peers_) { peer->decoder->RequestStop(); }
+    for (auto& peer : peers_) { peer->decoder->Join(); }
+
+    // Free the frames, which reference the decoder surfaces, before the
+    // decoders.
+    for (auto& peer : peers_) {
+        while (peer->decoded_video_frame_queue->try_pop()) {}
+        while (peer->incoming_video_packet_queue->try_pop()) {}
+        peer->playout_queue.clear();
+        peer->decoded_frame = nullptr;
+        if (frame_export_) {
+            frame_export_->RemoveStream(peer->id);
+        }
+    }
+    peers_.clear();
     invite_ = nullptr;
+
+    // The network handler threads have stopped, so nothing else references
+    // the recorders. Destroying them drains their queues and closes the
+    // files.
+    outgoing_recorder_ = nullptr;
+    incoming_recorder_ = nullptr;
+}
+
+void App::RemovePeer(size_t id)
+{
+    std::lock_guard lock(pipeline_mutex_);
+
+    auto it = std::find_if(peers_.begin(), peers_.end(), [id](const auto& peer) { return peer->id == id; });
+    if (it == peers_.end()) {
+        return;
+    }
+    auto& peer = *it;
+    LOG_INFO << std::format("Removing peer {}", id);
+
+    // Stop the network handler from queuing packets for the decoder, which
+    // is about to go away.
+    peer->nh->RequestStop();
+
+    // Stop sending to the peer before its network handler goes away. The
+    // encoder keeps running for the other peers, or the next one to join.
+    if (fanout_) {
+        fanout_->RemovePeer(peer->nh);
+    }
+    if (audio_sender_) {
+        audio_sender_->RemovePeer(peer->nh);
+    }
+    if (audio_player_ && peer->audio_receiver) {
+        audio_player_->RemoveReceiver(peer->audio_receiver);
+    }
+    if (watchdog_) {
+        watchdog_->Remove(id);
+    }
+
+    peer->decoder->RequestStop();
+    peer->decoder->Join();
+
+    // Free the frames, which reference the decoder surfaces, before the
+    // decoder.
+    while (peer->decoded_video_frame_queue->try_pop()) {}
+    while (peer->incoming_video_packet_queue->try_pop()) {}
+    peer->playout_queue.clear();
+    peer->decoded_frame = nullptr;
+    if (frame_export_) {
+        frame_export_->RemoveStream(id);
+    }
+
+    // The incoming recording only covers the first peer, and ends with it.
+    bool first = it == peers_.begin();
+    peers_.erase(it);
+    if (first) {
+        incoming_recorder_ = nullptr;
+    }
+}
+
+bool App::ParseNetworkArgs()
+{
+    if (auto mtu = args_.present<unsigned>("--network-mtu")) {
+        if (*mtu < kMinMtu || *mtu > kMaxMtu) {
+            LOG_FATAL << std::format("MTU must be between {} and {} bytes", kMinMtu, kMaxMtu);
+            return false;
+        }
+        network_transport_.mtu = *mtu;
+    }
+
+    if (auto range = args_.present("--network-port-range")) {
+        unsigned begin = 0;
+        unsigned end = 0;
+        if (std::sscanf(range->c_str(), "%u-%u", &begin, &end) != 2 ||
+            begin == 0 || begin > end || end > 65535) {
+            LOG_FATAL << "Invalid port range " << *range;
+            return false;
+        }
+        network_transport_.port_range_begin = begin;
+        network_transport_.port_range_end = end;
+    }
+
+    network_transport_.bind_address = args_.present("--network-bind-address");
+
+    // The SCTP settings are global, and only matter for the data channels.
+    if (auto size = args_.present<unsigned>("--network-sctp-buffer-size")) {
+        rtc::SctpSettings settings = {};
+        settings.recvBufferSize = *size;
+        settings.sendBufferSize = *size;
+        rtc::SetSctpSettings(settings);
+    }
+
+    return true;
+}
+
+bool App::InitSfu()
+{
+    // Only the events subsystem is needed, for the network events and to
+    // quit on SIGINT and SIGTERM.
+    if (SDL_Init(SDL_INIT_EVENTS) != 0) {
+        LOG_FATAL << "SDL_Init() failed: " << SDL_GetError();
+        return false;
+    }
+
+    auto params = SfuParams {
+        .invites        = {},
+        .stun_server    = args_.get<std::string>("--network-stun-server"),
+        .transport      = network_transport_,
+        .codec          = FromString(args_.get<std::string>("--sfu-codec")),
+        .max_kbps       = args_.get<unsigned>("--sfu-max-kbps"),
+    };
+    if (params.codec == VideoCodec::UNKNOWN) {
+        LOG_FATAL << "Unknown SFU codec " << args_.get<std::string>("--sfu-codec");
+        return false;
+    }
+
+    for (const auto& invite_str : args_.get<std::vector<std::string>>("invite")) {
+        auto invite = Invite::Decode(invite_str);
+        if (!invite) {
+            LOG_FATAL << "Unable to decode invite: " << invite_str;
+            return false;
+        }
+        params.invites.emplace_back(invite);
+    }
+
+    for (unsigned i = 0; i < args_.get<unsigned>("--sfu-participants"); ++i) {
+        auto invite = Invite::Create(InviteParams {
+            .signaling_server   = vacon::kAppDefaultSignalingServer,
+            .description        = std::string(""),
+        });
+        if (!invite) {
+            LOG_FATAL << "Invite::Create() failed!";
+            return false;
+        }
+        LOG_INFO << std::format("Invite for SFU participant {}: {}", params.invites.size() + 1, invite->Encode());
+        params.invites.emplace_back(invite);
+    }
+
+    sfu_ = Sfu::Create(params);
+    if (!sfu_) {
+        LOG_FATAL << "Sfu::Create() failed!";
+        return false;
+    }
+    sfu_->Start();
+
+    return true;
+}
+
+bool App::InitAudio()
+{
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+        LOG_ERROR << "SDL_InitSubSystem(SDL_INIT_AUDIO) failed: " << SDL_GetError();
+        return false;
+    }
+
+    audio_player_ = AudioPlayer::Create();
+    if (!audio_player_) {
+        LOG_ERROR << "AudioPlayer::Create() failed!";
+        return false;
+    }
+
+    audio_sender_ = AudioSender::Create(AudioSenderParams {
+        .bitrate_kbps   = args_.get<unsigned>("--audio-encoder-bitrate"),
+    });
+    if (!audio_sender_) {
+        LOG_ERROR << "AudioSender::Create() failed!";
+        return false;
+    }
+    audio_sender_->SetMuted(!enable_my_microphone_);
+
+    audio_player_->StartThread();
+    audio_sender_->StartThread();
+    return true;
 }
 
 void App::StartVideoCamera()
 {
+    std::lock_guard lock(pipeline_mutex_);
+
     if (camera_) {
         return;
     }
+    // Headless bots usually run on machines without a camera.
+    auto device = args_.get<std::string>("--camera-device");
+    if (headless_ && !args_.is_used("--camera-device")) {
+        device = linux::kCameraSyntheticDevice;
+    }
     camera_ = linux::Camera::Create(linux::CameraParams {
-        .device         = args_.get<std::string>("--camera-device"),
-        .encoder_queue  = encoder_queue_,
-        .preview_queue  = preview_queue_,
+        .device             = device,
+        .encoder_queue      = encoder_queue_,
+        .preview_queue      = preview_queue_,
+        .preview_enabled    = video_output_enabled_,
     });
     if (!camera_) {
         LOG_FATAL << "linux::Camera::Create() failed!";
         return;
     }
     camera_->StartThread();
+    WatchCamera();
 }
 
 void App::StopConference()
 {
-    StopNetworkHandler();
+    std::lock_guard lock(pipeline_mutex_);
+
+    if (watchdog_) {
+        watchdog_->Remove(kWatchdogPipeline);
+    }
+    StopPeers();
 
     // Signal the background threads to stop.
     if (camera_)  { camera_ ->RequestStop(); }
-    if (decoder_) { decoder_->RequestStop(); }
     if (encoder_) { encoder_->RequestStop(); }
+    if (file_source_) { file_source_->RequestStop(); }
 
     // Wait for the background threads to stop.
     if (camera_)  { camera_ ->Join(); }
-    if (decoder_) { decoder_->Join(); }
     if (encoder_) { encoder_->Join(); }
+    if (file_source_) { file_source_->Join(); }
 
     // Drain the video queues.
     while (encoder_queue_->try_pop()) {}
     while (preview_queue_->try_pop()) {}
-    while (decoded_video_frame_queue_->try_pop()) {}
     while (outgoing_video_packet_queue_->try_pop()) {}
-    while (incoming_video_packet_queue_->try_pop()) {}
 
     // Free the cached frames that depend on resources allocated by the video
     // objects.
-    decoded_frame_  = nullptr;
     preview_cref_   = nullptr;
+    if (frame_export_) {
+        frame_export_->RemoveStream(linux::kFrameExportSelfView);
+    }
 
     // Free the video objects.
     camera_     = nullptr;
-    decoder_    = nullptr;
     encoder_    = nullptr;
+    file_source_ = nullptr;
+
+    // Everything that the conference allocated has been freed by now, so
+    // any resource still accounted for has leaked.
+    resource_leaks_.clear();
+    for (const auto& usage : GetResourceUsage()) {
+        if (usage.count > 0) {
+            LOG_ERROR << std::format("Leaked {} {}, {} bytes, after stopping the conference",
+                                     usage.count, ToString(usage.resource), usage.bytes);
+            resource_leaks_.push_back(usage);
+        }
+    }
 }
 
 void App::CreateConference()
 {
-    if (last_camera_event_ != Event::CameraStarted) {
-        LOG_FATAL << "Camera not started, cannot create conference";
+    // An invite connects to a single remote participant, so every new
+    // participant of a mesh conference needs a new invite.
+    auto invite = Invite::Create(InviteParams {
+        .signaling_server   = vacon::kAppDefaultSignalingServer,
+        .description        = std::string(""),
+    });
+    if (!invite) {
+        LOG_FATAL << "Invite::Create() failed!";
         return;
     }
 
-    if (!invite_) {
-        invite_ = Invite::Create(InviteParams {
-            .signaling_server   = vacon::kAppDefaultSignalingServer,
-            .description        = std::string(""),
-        });
+    JoinConference(invite);
+}
+
+void App::JoinConference(std::shared_ptr<Invite> invite)
+{
+    if (!file_source_ && last_camera_event_ != Event::CameraStarted) {
+        LOG_FATAL << "Camera not started, cannot create conference";
+        return;
     }
 
-    if (invite_) {
-        LOG_INFO << "Starting conference using invite " << invite_->Encode();
-        StartNetworkHandler();
-    } else {
-        LOG_FATAL << "Invite::Create() failed!";
+    LOG_INFO << std::format("{} using invite {}",
+                            peers_.empty() ? "Starting conference" : "Adding participant",
+                            invite->Encode());
+    if (!AddPeer(invite)) {
+        LOG_FATAL << "App::AddPeer() failed!";
     }
 }
 
@@ -462,10 +1663,10 @@ void App::JoinConferenceFromClipboard()
 {
     auto ctext = SDL_GetClipboardText();
     if (ctext && ctext[0] != '\0') {
-        invite_ = Invite::Decode(ctext);
+        auto invite = Invite::Decode(ctext);
         SDL_free(ctext);
-        if (invite_) {
-            CreateConference();
+        if (invite) {
+            JoinConference(invite);
         } else {
             LOG_ERROR << "Invite::Decode() failed!";
         }
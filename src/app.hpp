@@ -15,26 +15,54 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <csignal>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
 
 #include <SDL3/SDL.h>
 #include <argparse/argparse.hpp>
 
+#include "audio/audio_player.hpp"
+#include "audio/audio_sender.hpp"
 #include "codecs.hpp"
+#include "degradation.hpp"
 #include "event.hpp"
+#include "event_bus.hpp"
+#include "fanout.hpp"
 #include "invite.hpp"
 #include "linux/camera.hpp"
 #include "linux/decoder.hpp"
 #include "linux/encoder.hpp"
+#include "linux/file_source.hpp"
+#include "linux/frame_export.hpp"
+#include "linux/presentation.hpp"
+#include "linux/recorder.hpp"
+#include "linux/proc.hpp"
 #include "linux/typedefs.hpp"
 #include "network_handler.hpp"
+#include "peer.hpp"
+#include "rate_control.hpp"
+#include "resources.hpp"
+#include "rtp/payload_format.hpp"
+#include "sfu.hpp"
 #include "stats.hpp"
+#include "watchdog.hpp"
 
 namespace vacon {
 
 static const std::string kAppDefaultSignalingServer = "public.vacon.vc:30307";
 
+// Number of frames to redraw after an input or window event.
+static const int kRedrawFramesOnInput = 2;
+
+// Maximum number of decoded remote frames waiting for their playout time.
+static const size_t kMaxPlayoutFrames = 8;
+
 class App {
     public:
         int AppInit(int argc, char *argv[]);
@@ -46,13 +74,42 @@ class App {
         // app.cpp
         int ShutdownEvent();
         void ProcessUserEvent(const SDL_UserEvent*);
+        bool ParseNetworkArgs();
         bool InitVideoCodecs();
-        void StartNetworkHandler();
+        bool InitSfu();
+        bool InitAudio();
+        bool InitHeadless();
+        void IterateHeadless();
+        Peer* AddPeer(std::shared_ptr<Invite>);
+        Peer* FindPeer(size_t id);
+        void StartPeerVideo(size_t peer_id, const NegotiatedCodecs&,
+                            std::chrono::time_point<std::chrono::steady_clock> t_network_started);
+        void ReportFirstFrame(std::chrono::time_point<std::chrono::steady_clock> t_encoded);
+        void StartVideoSending(VideoCodec);
         void StartVideoCamera();
-        void StopNetworkHandler();
+        void StopPeers();
+        void RemovePeer(size_t id);
+        void UpdateLoad();
+        void UpdateDegradation();
+        void UpdateSendRate();
+        void ApplyBandwidthProbe();
+        void UpdateReceiverScale();
+        void WatchCamera();
+        void WatchSending();
+        void WatchPeer(Peer&, bool sending);
+        std::optional<std::chrono::time_point<std::chrono::steady_clock>>
+            ScheduleRender(std::chrono::time_point<std::chrono::steady_clock> t_now);
+        void WaitEventUntil(std::chrono::time_point<std::chrono::steady_clock> t_wake);
+        void SetWindowVisible(bool visible);
+        void PullDecodedFrames(Peer&);
+        std::chrono::time_point<std::chrono::steady_clock>
+            PlayoutDeadline(std::chrono::time_point<std::chrono::steady_clock> t_now);
+        std::chrono::time_point<std::chrono::steady_clock>
+            PlayoutWakeTime(std::chrono::time_point<std::chrono::steady_clock> t_playout);
 
         void StopConference();
         void CreateConference();
+        void JoinConference(std::shared_ptr<Invite>);
         void CopyInviteToClipboard();
         void JoinConferenceFromClipboard();
 
@@ -70,7 +127,13 @@ class App {
         void ShowMenu();
         void ShowStatsOverlay(bool*);
         void RenderFrame();
-        void ShowDecodedVideoFrame();
+        void ShowDecodedVideoFrames();
+        void ReportRenderSize(Peer&, const SDL_FRect& tile,
+                              std::chrono::time_point<std::chrono::steady_clock> t_now);
+        void ShowDecodedVideoFrame(Peer&, const SDL_FRect& tile,
+                                   std::chrono::time_point<std::chrono::steady_clock> t_deadline);
+        void UpdateCadence(Peer&, uint32_t rtp_timestamp,
+                           std::chrono::time_point<std::chrono::steady_clock> t_deadline);
         void ShowPreview();
         void ShowPreviewWindow();
         void ProcessUiEvent(const SDL_Event*);
@@ -87,7 +150,6 @@ class App {
         Event           last_camera_event_              = Event::Invalid;
 
         std::string     camera_format_str_              = "";
-        std::string     decoder_codec_str_              = "";
         std::string     encoder_codec_str_              = "";
 
         float           font_size_sans_                 = 14.0f;
@@ -95,6 +157,9 @@ class App {
         bool            enable_my_camera_               = true;
         bool            enable_my_microphone_           = true;
         bool            enable_stats_overlay_           = true;
+        bool            enable_degradation_             = true;
+        bool            enable_bandwidth_probe_         = true;
+        bool            enable_frame_pacing_            = true;
         bool            xxx_enable_imgui_demo_window_   = false;
 
         bool            enable_self_view_               = true;
@@ -109,55 +174,192 @@ class App {
         Welford         s_display_time_                 = {};
         Welford         s_present_time_                 = {};
         Welford         s_render_time_                  = {};
+        Welford         s_decode_to_present_            = {};
+
+        linux::PresentMode
+            present_mode_                               = linux::PresentMode::Vsync;
+
+        std::unique_ptr<linux::Presentation>
+            presentation_                               = nullptr;
+
+        // The vertical blank that the scheduled redraw is aiming for, and
+        // when to start rendering to make it, in low latency mode.
+        std::optional<std::chrono::time_point<std::chrono::steady_clock>>
+            t_target_vblank_                            = std::nullopt;
+
+        std::chrono::time_point<std::chrono::steady_clock>
+            t_render_start_                             = {};
+
+        // Decode time of the oldest new remote frame shown by the current
+        // redraw, if there is one.
+        std::optional<std::chrono::time_point<std::chrono::steady_clock>>
+            t_shown_decoded_                            = std::nullopt;
+
+        DegradationController
+            degradation_                                = {};
+
+        SendRateController
+            send_rate_                                  = {};
+
+        linux::ThreadCpuSampler
+            cpu_sampler_                                = {};
+
+        std::chrono::time_point<std::chrono::steady_clock>
+            t_last_load_update_                         = {};
+
+        // Process load sampled with a given number of peers, to report the
+        // marginal cost of each participant. There is no portable GPU load
+        // counter, so the per-peer decode time stands in for it.
+        struct PeerCost {
+            Welford     s_cpu_percent                   = {};
+            Welford     s_decoder_cpu_percent           = {};
+            Welford     s_render_time                   = {};
+        };
+
+        std::map<size_t, PeerCost>
+            peer_costs_                                 = {};
+
+        // Whether the window can be seen. While it can't, nothing is drawn,
+        // and the decoder and camera stop producing frames for display.
+        bool            window_visible_                 = true;
+
+        std::shared_ptr<std::atomic_bool>
+            video_output_enabled_                       = std::make_shared<std::atomic_bool>(true);
+
+        // Set by the network handlers to ask the encoder for a keyframe.
+        std::shared_ptr<std::atomic_bool>
+            keyframe_request_                           = std::make_shared<std::atomic_bool>(false);
+
+        // The window is only redrawn when there is a new frame, input, or a
+        // stats update. Start with a redraw, so that the window isn't empty.
+        int             n_redraw_frames_                = 1;
+
+        std::chrono::time_point<std::chrono::steady_clock>
+            t_last_redraw_                              = {};
 
         std::unique_ptr<linux::Camera>
             camera_                                     = nullptr;
 
-        std::unique_ptr<linux::Decoder>
-            decoder_                                    = nullptr;
+        // Set in headless mode, which runs the conference without a window,
+        // audio or rendering, e.g. for bots that load test calls.
+        bool            headless_                       = false;
+
+        std::chrono::time_point<std::chrono::steady_clock>
+            t_last_headless_report_                     = {};
+
+        // Invites to join once the camera has started.
+        std::vector<std::shared_ptr<Invite>>
+            pending_invites_                            = {};
+
+        // Set in SFU mode, which has no window, camera or codecs.
+        std::unique_ptr<Sfu>
+            sfu_                                        = nullptr;
 
         std::shared_ptr<std::vector<VideoCodec>>
             decoder_codecs_                             = nullptr;
 
+        PayloadFormat   video_payload_format_           = PayloadFormat::Standard;
+
+        NetworkTransportParams
+            network_transport_                          = {};
+
         std::unique_ptr<linux::Encoder>
             encoder_                                    = nullptr;
 
         std::shared_ptr<std::vector<VideoCodec>>
             encoder_codecs_                             = nullptr;
 
-        std::unique_ptr<NetworkHandler>
-            nh_                                         = nullptr;
+        std::unique_ptr<linux::FileSource>
+            file_source_                                = nullptr;
+
+        // Captures, encodes and sends the microphone to every peer, and
+        // mixes and plays the audio of every peer. Not set if audio is
+        // disabled or there is no audio device.
+        std::unique_ptr<AudioSender>
+            audio_sender_                               = nullptr;
+
+        std::unique_ptr<AudioPlayer>
+            audio_player_                               = nullptr;
+
+        // Publishes the decoded video to other local processes. Not set
+        // unless requested.
+        std::unique_ptr<linux::FrameExport>
+            frame_export_                               = nullptr;
+
+        bool            export_self_view_               = false;
+
+        // The remote participants, in the order they were added.
+        std::vector<std::unique_ptr<Peer>>
+            peers_                                      = {};
+
+        size_t          next_peer_id_                   = 1;
+
+        // Sends the encoded video to all the peers. The encoder, or the file
+        // source, is started with the first peer and shared by the others,
+        // which must use the same codec.
+        std::unique_ptr<VideoFanOut>
+            fanout_                                     = nullptr;
+
+        VideoCodec      sending_codec_                  = VideoCodec::UNKNOWN;
+
+        std::shared_ptr<linux::Recorder>
+            outgoing_recorder_                          = nullptr;
+
+        std::shared_ptr<linux::Recorder>
+            incoming_recorder_                          = nullptr;
 
         std::shared_ptr<linux::CameraBufferRef>
             preview_cref_                               = nullptr;
 
-        std::shared_ptr<linux::DecodedFrame>
-            decoded_frame_                              = nullptr;
-
         std::shared_ptr<linux::CameraBufferQueue>
             encoder_queue_                              = std::make_shared<linux::CameraBufferQueue>(2);
 
         std::shared_ptr<linux::CameraBufferQueue>
             preview_queue_                              = std::make_shared<linux::CameraBufferQueue>(2);
 
-        std::shared_ptr<linux::DecodedFrameQueue>
-            decoded_video_frame_queue_                  = std::make_shared<linux::DecodedFrameQueue>(4);
-
-        std::shared_ptr<RtcPacketQueue>
-            incoming_video_packet_queue_                = std::make_shared<RtcPacketQueue>(2);
-
         std::shared_ptr<linux::VideoPacketQueue>
             outgoing_video_packet_queue_                = std::make_shared<linux::VideoPacketQueue>(2);
 
+        // Resources still accounted for after the last conference stopped.
+        std::vector<ResourceUsage>
+            resource_leaks_                             = {};
+
         struct {
-            unsigned    n_remote                        = 0;
-            unsigned    n_remote_underflow              = 0;
             unsigned    n_preview                       = 0;
             unsigned    n_preview_underflow             = 0;
+            unsigned    n_redraw                        = 0;
+            unsigned    n_idle_wait                     = 0;
         } stats_;
 
+        // The invite of the most recently added peer, for copying to the
+        // clipboard.
         std::shared_ptr<Invite>
             invite_                                     = nullptr;
+
+        // Serializes the orchestration on the event bus thread with the
+        // changes that the main thread makes to the peers and the video
+        // objects. The main thread may read them without it, as the bus
+        // thread only starts the objects, and doesn't replace them.
+        std::mutex  pipeline_mutex_;
+
+        // When the peer that started the video connected, until its first
+        // encoded frame. Guarded by the pipeline mutex.
+        std::chrono::time_point<std::chrono::steady_clock>
+            t_sending_started_                          = {};
+
+        std::atomic<std::chrono::microseconds>
+            first_frame_latency_                        = std::chrono::microseconds(0);
+
+        // Runs the pipeline orchestration off the render loop. Declared after
+        // the state that its handlers touch.
+        std::unique_ptr<EventBus>
+            event_bus_                                  = nullptr;
+
+        // Logs the state of the pipeline when a stage stalls. Declared last,
+        // so that it stops before the state that it reads is destroyed. Not
+        // set if disabled.
+        std::unique_ptr<Watchdog>
+            watchdog_                                   = nullptr;
 };
 
 extern volatile std::sig_atomic_t gShuttingDown;
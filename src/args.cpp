@@ -17,6 +17,8 @@
 
 #include <cstdlib>
 #include <exception>
+#include <string>
+#include <vector>
 
 #include <argparse/argparse.hpp>
 
@@ -24,7 +26,10 @@ namespace vacon {
 
 static const char *kDefaultCameraDevice                 = "/dev/video0";
 static const unsigned kDefaultVideoEncoderBitrateKbps   = 10'000;
+static const unsigned kDefaultAudioEncoderBitrateKbps   = 32;
 static const char *kDefaultStunServer                   = "stun:stun.l.google.com:19302";
+static const char *kDefaultRenderNode                   = "/dev/dri/renderD128";
+static const unsigned kDefaultWatchdogTimeoutMs         = 2000;
 
 void App::ParseArgs(int argc, char *argv[])
 {
@@ -57,21 +62,152 @@ void App::ParseArgs(int argc, char *argv[])
          .metavar("CODEC")
          .help("force negotiation of video encoding codec");
 
+    args_.add_argument("--video-payload-format")
+         .metavar("FORMAT")
+         .help("video RTP payload format to offer: standard (RFC 6184, RFC 7798, AV1), generic-v1, or generic")
+         .default_value(std::string("standard"))
+         .nargs(1);
+
+    args_.add_argument("--video-source-file")
+         .metavar("FILE")
+         .help("send pre-encoded frames from an IVF or Annex-B file instead of the camera");
+
+    args_.add_argument("--video-source-fps")
+         .metavar("FPS")
+         .help("frame rate of the source file (default: from IVF timestamps, or 30)")
+         .scan<'g', double>();
+
+    args_.add_argument("--video-source-max-rate")
+         .help("send the source file frames as fast as possible")
+         .flag();
+
+    args_.add_argument("--video-no-degradation")
+         .help("disable reducing the encoded resolution and frame rate under load")
+         .flag();
+
+    args_.add_argument("--video-no-frame-pacing")
+         .help("show remote frames as soon as they are decoded, instead of at their capture spacing")
+         .flag();
+
+    args_.add_argument("--audio-encoder-bitrate")
+         .metavar("K")
+         .help("audio encoder bitrate (Kbps)")
+         .default_value(kDefaultAudioEncoderBitrateKbps)
+         .scan<'u', unsigned>()
+         .nargs(1);
+
+    args_.add_argument("--audio-disable")
+         .help("don't capture, send, receive or play audio")
+         .flag();
+
+    args_.add_argument("--present-mode")
+         .metavar("MODE")
+         .help("presentation mode: vsync, low-latency, mailbox, or immediate")
+         .default_value(std::string("vsync"))
+         .nargs(1);
+
+    args_.add_argument("--record-outgoing")
+         .metavar("FILE")
+         .help("record the outgoing video to FILE (IVF for AV1, Annex-B otherwise)");
+
+    args_.add_argument("--record-incoming")
+         .metavar("FILE")
+         .help("record the incoming video to FILE (IVF for AV1, Annex-B otherwise)");
+
+    args_.add_argument("--export-socket")
+         .metavar("PATH")
+         .help("publish the decoded remote video to local consumers on the Unix socket PATH");
+
+    args_.add_argument("--export-self-view")
+         .help("also publish the camera video on the export socket")
+         .flag();
+
     args_.add_argument("--network-stun-server")
          .metavar("STUN-URL")
          .help("STUN server to use")
          .default_value(kDefaultStunServer)
          .nargs(1);
 
+    args_.add_argument("--network-mtu")
+         .metavar("BYTES")
+         .help("MTU of the network path, to size the RTP packets (default: packets of 1350 bytes)")
+         .scan<'u', unsigned>()
+         .nargs(1);
+
+    args_.add_argument("--network-port-range")
+         .metavar("BEGIN-END")
+         .help("range of local UDP ports to use")
+         .nargs(1);
+
+    args_.add_argument("--network-bind-address")
+         .metavar("ADDRESS")
+         .help("local address to bind the UDP sockets to")
+         .nargs(1);
+
+    args_.add_argument("--network-sctp-buffer-size")
+         .metavar("BYTES")
+         .help("send and receive buffer size of the data channels")
+         .scan<'u', unsigned>()
+         .nargs(1);
+
+    args_.add_argument("--network-no-probe")
+         .help("don't probe the bandwidth at the start of a call to choose the starting video bitrate")
+         .flag();
+
+    args_.add_argument("--network-capture")
+         .metavar("FILE")
+         .help("capture incoming RTP packets to FILE, for replay with vacon-replay");
+
+    args_.add_argument("--headless")
+         .help("run without a window or audio, with a synthetic camera unless --camera-device or --video-source-file is given")
+         .flag();
+
+    args_.add_argument("--headless-render-node")
+         .metavar("DEVICE")
+         .help("DRM render node for decoding in headless mode")
+         .default_value(kDefaultRenderNode)
+         .nargs(1);
+
+    args_.add_argument("--sfu")
+         .help("run as a headless selective forwarding unit for the participants' invites")
+         .flag();
+
+    args_.add_argument("--sfu-codec")
+         .metavar("CODEC")
+         .help("video codec that all the SFU participants must use")
+         .default_value(std::string("AVC_8_420"))
+         .nargs(1);
+
+    args_.add_argument("--sfu-participants")
+         .metavar("N")
+         .help("create and log N new invites for the SFU participants")
+         .default_value(0u)
+         .scan<'u', unsigned>()
+         .nargs(1);
+
+    args_.add_argument("--sfu-max-kbps")
+         .metavar("K")
+         .help("bandwidth budget for each SFU participant (Kbps), 0 for unlimited")
+         .default_value(0u)
+         .scan<'u', unsigned>()
+         .nargs(1);
+
+    args_.add_argument("--watchdog-timeout")
+         .metavar("MS")
+         .help("log a dump of the pipeline state when a stage makes no progress for MS milliseconds, 0 to disable")
+         .default_value(kDefaultWatchdogTimeoutMs)
+         .scan<'u', unsigned>()
+         .nargs(1);
+
     args_.add_argument("--usr1")
          .help("setup simulated packet loss SIGUSR1 handler")
          .flag();
 
     args_.add_argument("invite")
          .metavar("INVITE-URL")
-         .help("Join conference using specified invite")
-         .default_value("")
-         .nargs(0, 1);
+         .help("Join conference using specified invites, one per remote participant")
+         .default_value(std::vector<std::string>{})
+         .nargs(argparse::nargs_pattern::any);
 
     try {
         args_.parse_args(argc, argv);
@@ -0,0 +1,79 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <readerwritercircularbuffer.h>
+
+namespace vacon {
+
+// Audio is mono at 48 kHz, Opus's native rate, in 10 ms frames, the shortest
+// Opus frame that still codes speech well.
+static const int kAudioSampleRate           = 48'000;
+static const int kAudioChannels             = 1;
+static const int kAudioFrameSamples         = kAudioSampleRate / 100;
+static const auto kAudioFrameDuration       = std::chrono::milliseconds(10);
+
+// Opus always uses a 48 kHz RTP clock.
+static const uint32_t kAudioRtpClockRate    = 48'000;
+static const int kAudioPayloadType          = 111;
+
+// Largest encoded frame, as recommended by the Opus documentation.
+static const size_t kAudioMaxPacketSize     = 1'276;
+
+// A frame of captured samples.
+struct AudioPcmFrame {
+    std::array<int16_t, kAudioFrameSamples * kAudioChannels>
+                        samples = {};
+
+    // When the first sample was captured.
+    std::chrono::time_point<std::chrono::steady_clock>
+                        t_captured = {};
+};
+
+// An encoded frame.
+struct AudioPacket {
+    std::vector<std::byte>
+                        data = {};
+
+    // The RTP timestamp. On the sending side, it doesn't include the random
+    // offset of the RTP stream, which the network handler adds.
+    uint32_t            rtp_timestamp = 0;
+    uint16_t            sequence = 0;
+
+    // When the first sample was captured, on the sending side, or when the
+    // packet arrived, on the receiving side.
+    std::chrono::time_point<std::chrono::steady_clock>
+                        t_captured = {};
+    std::chrono::time_point<std::chrono::steady_clock>
+                        t_arrival = {};
+};
+
+// Captured frames are passed by value, so that the audio callback doesn't
+// allocate.
+typedef moodycamel::BlockingReaderWriterCircularBuffer<AudioPcmFrame>
+    AudioPcmQueue;
+
+typedef moodycamel::BlockingReaderWriterCircularBuffer<std::shared_ptr<AudioPacket>>
+    AudioPacketQueue;
+
+} // namespace vacon
@@ -0,0 +1,167 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "audio/audio_player.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <SDL3/SDL.h>
+#include <plog/Log.h>
+
+#include "util.hpp"
+
+using namespace std::chrono_literals;
+
+namespace vacon {
+
+std::unique_ptr<AudioPlayer> AudioPlayer::Create()
+{
+    // Ask for a device buffer of one frame, rather than the default, which is
+    // tuned for music playback.
+    SDL_SetHint("SDL_AUDIO_DEVICE_SAMPLE_FRAMES", "480");
+
+    // The constructor is private and the object isn't movable, because of
+    // its mutex.
+    auto player = std::unique_ptr<AudioPlayer>(new AudioPlayer());
+
+    auto spec = SDL_AudioSpec {
+        .format     = SDL_AUDIO_S16,
+        .channels   = kAudioChannels,
+        .freq       = kAudioSampleRate,
+    };
+    player->stream_ = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_OUTPUT, &spec, nullptr, nullptr);
+    if (!player->stream_) {
+        LOG_ERROR << "SDL_OpenAudioDeviceStream() failed for playback: " << SDL_GetError();
+        return nullptr;
+    }
+
+    return player;
+}
+
+AudioPlayer::~AudioPlayer()
+{
+    RequestStop();
+    Join();
+
+    if (stream_) {
+        SDL_DestroyAudioStream(stream_);
+        stream_ = nullptr;
+    }
+}
+
+void AudioPlayer::StartThread()
+{
+    thread_ = std::jthread([&](std::stop_token st) { RunPlayout(st); });
+
+    if (SDL_ResumeAudioDevice(SDL_GetAudioStreamDevice(stream_)) != 0) {
+        LOG_ERROR << "SDL_ResumeAudioDevice() failed for playback: " << SDL_GetError();
+    }
+}
+
+void AudioPlayer::RequestStop()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Requesting stop of audio playout thread ID " << thread_.get_id();
+        thread_.request_stop();
+    }
+}
+
+void AudioPlayer::Join()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Joining audio playout thread ID " << thread_.get_id();
+        thread_.join();
+        thread_ = {};
+    }
+}
+
+void AudioPlayer::AddReceiver(std::shared_ptr<AudioReceiver> receiver)
+{
+    std::lock_guard lock(mutex_);
+    receivers_.emplace_back(std::move(receiver));
+}
+
+void AudioPlayer::RemoveReceiver(const std::shared_ptr<AudioReceiver>& receiver)
+{
+    std::lock_guard lock(mutex_);
+    std::erase(receivers_, receiver);
+}
+
+void AudioPlayer::RunPlayout(std::stop_token st)
+{
+    LOG_DEBUG << "Starting audio playout thread ID " << std::this_thread::get_id();
+    util::SetThreadName("VAudioPlayout");
+    if (!util::RaiseThreadPriority()) {
+        LOG_DEBUG << "Unable to raise the audio playout thread priority";
+    }
+
+    static const int kFrameBytes = kAudioFrameSamples * kAudioChannels * sizeof(int16_t);
+
+    std::array<int16_t, kAudioFrameSamples * kAudioChannels> pcm = {};
+    std::array<int32_t, kAudioFrameSamples * kAudioChannels> mix = {};
+    std::array<int16_t, kAudioFrameSamples * kAudioChannels> out = {};
+    std::vector<std::shared_ptr<AudioReceiver>> receivers;
+
+    while (!st.stop_requested()) {
+        auto queued = SDL_GetAudioStreamQueued(stream_);
+        if (queued < 0) {
+            LOG_ERROR << "SDL_GetAudioStreamQueued() failed: " << SDL_GetError();
+            std::this_thread::sleep_for(kAudioFrameDuration);
+            continue;
+        }
+        if (queued >= kAudioOutputFrames * kFrameBytes) {
+            std::this_thread::sleep_for(1ms);
+            continue;
+        }
+
+        // The new frame is played after the ones that are already queued.
+        auto queued_us = static_cast<int64_t>(queued) * 1'000'000 / (kFrameBytes * 100);
+        auto t_play = std::chrono::steady_clock::now() + std::chrono::microseconds(queued_us);
+        output_delay_us_.store(queued_us, std::memory_order_relaxed);
+
+        {
+            std::lock_guard lock(mutex_);
+            receivers = receivers_;
+        }
+        mix.fill(0);
+        for (auto& receiver : receivers) {
+            receiver->DecodeFrame(pcm, t_play);
+            std::transform(mix.begin(), mix.end(), pcm.begin(), mix.begin(), std::plus<int32_t>());
+        }
+        receivers.clear();
+
+        std::transform(mix.begin(), mix.end(), out.begin(), [](int32_t s) {
+            return static_cast<int16_t>(std::clamp<int32_t>(s,
+                                                            std::numeric_limits<int16_t>::min(),
+                                                            std::numeric_limits<int16_t>::max()));
+        });
+        if (SDL_PutAudioStreamData(stream_, out.data(), kFrameBytes) != 0) {
+            LOG_ERROR << "SDL_PutAudioStreamData() failed: " << SDL_GetError();
+        }
+    }
+
+    LOG_DEBUG << "Stopping audio playout thread ID " << std::this_thread::get_id();
+}
+
+} // namespace vacon
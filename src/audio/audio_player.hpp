@@ -0,0 +1,66 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include <SDL3/SDL.h>
+
+#include "audio/audio.hpp"
+#include "audio/audio_receiver.hpp"
+
+namespace vacon {
+
+// Frames queued to the audio device, on top of its own buffer. Enough to
+// cover the scheduling latency of the playout thread.
+static const int kAudioOutputFrames = 2;
+
+// Mixes the audio of all the peers and plays it. The playout thread keeps a
+// couple of frames queued to the audio device, so it runs off the device's
+// clock, and decodes each frame just before it's queued.
+class AudioPlayer {
+    public:
+        static std::unique_ptr<AudioPlayer> Create();
+        ~AudioPlayer();
+        void StartThread();
+        void RequestStop();
+        void Join();
+
+        void AddReceiver(std::shared_ptr<AudioReceiver>);
+        void RemoveReceiver(const std::shared_ptr<AudioReceiver>&);
+
+        // The audio queued to the device when the last frame was added.
+        std::atomic_int64_t output_delay_us_ = 0;
+
+    private:
+        AudioPlayer() = default;
+        void RunPlayout(std::stop_token);
+
+        SDL_AudioStream*    stream_ = nullptr;
+
+        std::mutex          mutex_;
+        std::vector<std::shared_ptr<AudioReceiver>>
+                            receivers_ = {};
+
+        std::jthread        thread_ = {};
+};
+
+} // namespace vacon
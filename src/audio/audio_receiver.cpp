@@ -0,0 +1,104 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "audio/audio_receiver.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+#include <opus.h>
+#include <plog/Log.h>
+
+namespace vacon {
+
+// Report the played audio to the A/V sync every 100 ms.
+static const size_t kFramesPerSyncUpdate = 10;
+
+std::unique_ptr<AudioReceiver> AudioReceiver::Create(const AudioReceiverParams& params)
+{
+    if (!params.incoming_audio_packet_queue) {
+        LOG_ERROR << "AudioReceiverParams.incoming_audio_packet_queue must be set";
+        return nullptr;
+    }
+
+    // The constructor is private and the object isn't movable, because of
+    // its atomics.
+    auto receiver = std::unique_ptr<AudioReceiver>(new AudioReceiver(params));
+
+    int err = OPUS_OK;
+    receiver->opus_ = opus_decoder_create(kAudioSampleRate, kAudioChannels, &err);
+    if (err != OPUS_OK) {
+        LOG_ERROR << "opus_decoder_create() failed: " << opus_strerror(err);
+        return nullptr;
+    }
+
+    return receiver;
+}
+
+AudioReceiver::~AudioReceiver()
+{
+    if (opus_) {
+        opus_decoder_destroy(opus_);
+        opus_ = nullptr;
+    }
+}
+
+void AudioReceiver::DecodeFrame(std::span<int16_t> pcm,
+                                std::chrono::time_point<std::chrono::steady_clock> t_play)
+{
+    std::shared_ptr<AudioPacket> packet;
+    while (params_.incoming_audio_packet_queue->try_dequeue(packet)) {
+        jitter_buffer_.Insert(std::move(packet));
+    }
+
+    if (params_.av_sync) {
+        jitter_buffer_.SetExtraDelay(params_.av_sync->AudioDelay());
+    }
+
+    auto result = jitter_buffer_.Pop(packet);
+    int n = 0;
+    if (result == AudioJitterBuffer::Result::Packet) {
+        n = opus_decode(opus_, reinterpret_cast<const unsigned char*>(packet->data.data()),
+                        static_cast<opus_int32>(packet->data.size()),
+                        pcm.data(), kAudioFrameSamples, 0 /* decode_fec */);
+        decoded_ = n > 0;
+
+        if (params_.av_sync && ++n_since_sync_ >= kFramesPerSyncUpdate) {
+            n_since_sync_ = 0;
+            params_.av_sync->OnAudioPlayed(packet->rtp_timestamp, t_play);
+        }
+    } else if (result == AudioJitterBuffer::Result::Conceal && decoded_) {
+        // Opus extrapolates from the previous frames.
+        n = opus_decode(opus_, nullptr, 0, pcm.data(), kAudioFrameSamples, 0 /* decode_fec */);
+    }
+
+    if (n < 0) {
+        LOG_DEBUG << "opus_decode() failed: " << opus_strerror(n);
+    }
+    if (n < kAudioFrameSamples) {
+        std::fill(pcm.begin() + std::max(n, 0) * kAudioChannels, pcm.end(), 0);
+    }
+
+    jitter_buffer_us_.store(jitter_buffer_.Delay().count(), std::memory_order_relaxed);
+    target_delay_us_.store(jitter_buffer_.TargetDelay().count(), std::memory_order_relaxed);
+    n_concealed_.store(jitter_buffer_.n_concealed_, std::memory_order_relaxed);
+    n_late_.store(jitter_buffer_.n_late_, std::memory_order_relaxed);
+    n_frames_.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace vacon
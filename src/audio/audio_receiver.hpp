@@ -0,0 +1,72 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+#include <opus.h>
+
+#include "audio/audio.hpp"
+#include "audio/jitter_buffer.hpp"
+#include "av_sync.hpp"
+
+namespace vacon {
+
+struct AudioReceiverParams {
+    size_t                                      peer_id = 0;
+    std::shared_ptr<AudioPacketQueue>           incoming_audio_packet_queue = nullptr;
+    std::shared_ptr<AvSync>                     av_sync = nullptr;
+};
+
+// The audio of one peer. The network handler queues the received packets,
+// and the audio playout thread pulls one decoded frame per 10 ms through the
+// jitter buffer, concealing the missing ones.
+class AudioReceiver {
+    public:
+        static std::unique_ptr<AudioReceiver> Create(const AudioReceiverParams&);
+        ~AudioReceiver();
+
+        // Decode the next frame into pcm, which holds kAudioFrameSamples
+        // samples and is played at t_play. Called by the audio playout
+        // thread only.
+        void DecodeFrame(std::span<int16_t> pcm, std::chrono::time_point<std::chrono::steady_clock> t_play);
+
+        size_t PeerId() const { return params_.peer_id; }
+
+        // Updated by the audio playout thread for the stats overlay.
+        std::atomic_int64_t jitter_buffer_us_ = 0;
+        std::atomic_int64_t target_delay_us_ = 0;
+        std::atomic_size_t  n_frames_ = 0;
+        std::atomic_size_t  n_concealed_ = 0;
+        std::atomic_size_t  n_late_ = 0;
+
+    private:
+        AudioReceiver(const AudioReceiverParams& params)
+            : params_(params) {};
+
+        AudioReceiverParams params_;
+        OpusDecoder*        opus_ = nullptr;
+        AudioJitterBuffer   jitter_buffer_ = {};
+        bool                decoded_ = false;
+        size_t              n_since_sync_ = 0;
+};
+
+} // namespace vacon
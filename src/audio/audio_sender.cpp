@@ -0,0 +1,221 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "audio/audio_sender.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <SDL3/SDL.h>
+#include <opus.h>
+#include <plog/Log.h>
+
+#include "util.hpp"
+
+using namespace std::chrono_literals;
+
+namespace vacon {
+
+std::unique_ptr<AudioSender> AudioSender::Create(const AudioSenderParams& params)
+{
+    // The constructor is private and the object isn't movable, because of
+    // its mutex.
+    auto sender = std::unique_ptr<AudioSender>(new AudioSender(params));
+
+    // Restricted low delay mode drops the speech-only SILK layer, and with it
+    // 2.5 ms of look-ahead.
+    int err = OPUS_OK;
+    sender->opus_ = opus_encoder_create(kAudioSampleRate, kAudioChannels,
+                                        OPUS_APPLICATION_RESTRICTED_LOWDELAY, &err);
+    if (err != OPUS_OK) {
+        LOG_ERROR << "opus_encoder_create() failed: " << opus_strerror(err);
+        return nullptr;
+    }
+    opus_encoder_ctl(sender->opus_, OPUS_SET_BITRATE(static_cast<opus_int32>(params.bitrate_kbps * 1000)));
+    opus_encoder_ctl(sender->opus_, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+
+    auto spec = SDL_AudioSpec {
+        .format     = SDL_AUDIO_S16,
+        .channels   = kAudioChannels,
+        .freq       = kAudioSampleRate,
+    };
+    sender->stream_ = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_CAPTURE, &spec,
+                                                &AudioSender::OnCapture, sender.get());
+    if (!sender->stream_) {
+        LOG_ERROR << "SDL_OpenAudioDeviceStream() failed for capture: " << SDL_GetError();
+        return nullptr;
+    }
+
+    return sender;
+}
+
+AudioSender::~AudioSender()
+{
+    RequestStop();
+    Join();
+
+    // Destroying the stream closes the device, after which the callback
+    // isn't called any more.
+    if (stream_) {
+        SDL_DestroyAudioStream(stream_);
+        stream_ = nullptr;
+    }
+    if (opus_) {
+        opus_encoder_destroy(opus_);
+        opus_ = nullptr;
+    }
+}
+
+void AudioSender::StartThread()
+{
+    thread_ = std::jthread([&](std::stop_token st) { RunEncoder(st); });
+
+    if (SDL_ResumeAudioDevice(SDL_GetAudioStreamDevice(stream_)) != 0) {
+        LOG_ERROR << "SDL_ResumeAudioDevice() failed for capture: " << SDL_GetError();
+    }
+}
+
+void AudioSender::RequestStop()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Requesting stop of audio encoder thread ID " << thread_.get_id();
+        thread_.request_stop();
+    }
+}
+
+void AudioSender::Join()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Joining audio encoder thread ID " << thread_.get_id();
+        thread_.join();
+        thread_ = {};
+    }
+}
+
+void AudioSender::AddPeer(std::shared_ptr<NetworkHandler> nh)
+{
+    std::lock_guard lock(mutex_);
+    peers_.emplace_back(std::move(nh));
+}
+
+void AudioSender::RemovePeer(const std::shared_ptr<NetworkHandler>& nh)
+{
+    std::lock_guard lock(mutex_);
+    std::erase(peers_, nh);
+}
+
+void SDLCALL AudioSender::OnCapture(void* userdata, SDL_AudioStream* stream,
+                                    [[maybe_unused]] int additional_amount,
+                                    [[maybe_unused]] int total_amount)
+{
+    static_cast<AudioSender*>(userdata)->Capture(stream);
+}
+
+void AudioSender::Capture(SDL_AudioStream* stream)
+{
+    // Runs on the SDL audio thread, so it must not block or allocate.
+    auto t_now = std::chrono::steady_clock::now();
+    while (true) {
+        auto want = static_cast<int>((partial_.samples.size() - n_partial_) * sizeof(int16_t));
+        auto got = SDL_GetAudioStreamData(stream, partial_.samples.data() + n_partial_, want);
+        if (got <= 0) {
+            break;
+        }
+        n_partial_ += got / sizeof(int16_t);
+        if (n_partial_ < partial_.samples.size()) {
+            break;
+        }
+
+        // The first sample of the frame was captured a frame, and whatever is
+        // still waiting in the stream, ago.
+        auto available = std::max(SDL_GetAudioStreamAvailable(stream), 0);
+        auto n_behind = static_cast<int64_t>(available / sizeof(int16_t) / kAudioChannels) + kAudioFrameSamples;
+        partial_.t_captured = t_now - std::chrono::microseconds(n_behind * 1'000'000 / kAudioSampleRate);
+
+        if (!pcm_queue_.try_enqueue(partial_)) {
+            n_capture_overflow_.fetch_add(1, std::memory_order_relaxed);
+        }
+        n_partial_ = 0;
+    }
+}
+
+void AudioSender::RunEncoder(std::stop_token st)
+{
+    LOG_DEBUG << "Starting audio encoder thread ID " << std::this_thread::get_id();
+    util::SetThreadName("VAudioEncoder");
+    if (!util::RaiseThreadPriority()) {
+        LOG_DEBUG << "Unable to raise the audio encoder thread priority";
+    }
+
+    std::vector<std::shared_ptr<NetworkHandler>> peers;
+    AudioPcmFrame frame;
+    while (!st.stop_requested()) {
+        if (!pcm_queue_.wait_dequeue_timed(frame, 250ms)) {
+            LOG_VERBOSE << "Stalled dequeuing frame from captured audio queue, retrying";
+            continue;
+        }
+
+        if (muted_) {
+            frame.samples.fill(0);
+        }
+
+        // The RTP timestamps advance by exactly one frame, so that the
+        // receiver sees no gaps. The first one is taken from the capture
+        // time, like the video's.
+        if (!has_rtp_timestamp_) {
+            has_rtp_timestamp_ = true;
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(frame.t_captured.time_since_epoch());
+            rtp_timestamp_ = static_cast<uint32_t>(us.count() * kAudioRtpClockRate / 1'000'000);
+        } else {
+            rtp_timestamp_ += kAudioFrameSamples;
+        }
+
+        auto packet = std::make_shared<AudioPacket>();
+        packet->data.resize(kAudioMaxPacketSize);
+        packet->rtp_timestamp = rtp_timestamp_;
+        packet->t_captured = frame.t_captured;
+
+        auto t_start = std::chrono::steady_clock::now();
+        auto n = opus_encode(opus_, frame.samples.data(), kAudioFrameSamples,
+                             reinterpret_cast<unsigned char*>(packet->data.data()),
+                             static_cast<opus_int32>(packet->data.size()));
+        if (n < 0) {
+            LOG_ERROR << "opus_encode() failed: " << opus_strerror(n);
+            continue;
+        }
+        packet->data.resize(n);
+        s_encode_time_.Update(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - t_start).count());
+
+        {
+            std::lock_guard lock(mutex_);
+            peers = peers_;
+        }
+        for (auto& nh : peers) {
+            nh->SendAudioFrame(packet);
+        }
+        peers.clear();
+    }
+
+    LOG_DEBUG << "Stopping audio encoder thread ID " << std::this_thread::get_id();
+}
+
+} // namespace vacon
@@ -0,0 +1,93 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include <SDL3/SDL.h>
+#include <opus.h>
+
+#include "audio/audio.hpp"
+#include "network_handler.hpp"
+#include "stats.hpp"
+
+namespace vacon {
+
+struct AudioSenderParams {
+    unsigned    bitrate_kbps = 32;
+};
+
+// Captures the microphone, encodes it to Opus in 10 ms frames, and sends
+// every frame to all the peers. SDL calls back on its audio thread with the
+// captured samples, which are cut into frames and passed to the encoder
+// thread over a lock-free queue.
+class AudioSender {
+    public:
+        static std::unique_ptr<AudioSender> Create(const AudioSenderParams&);
+        ~AudioSender();
+        void StartThread();
+        void RequestStop();
+        void Join();
+
+        void AddPeer(std::shared_ptr<NetworkHandler>);
+        void RemovePeer(const std::shared_ptr<NetworkHandler>&);
+
+        // Muted frames are encoded as silence, so that the stream and its
+        // timing carry on.
+        void SetMuted(bool muted) { muted_ = muted; }
+
+        Welford             s_encode_time_ = {};
+        std::atomic_size_t  n_capture_overflow_ = 0;
+
+    private:
+        AudioSender(const AudioSenderParams& params)
+            : params_(params) {};
+        static void SDLCALL OnCapture(void* userdata, SDL_AudioStream* stream,
+                                      int additional_amount, int total_amount);
+        void Capture(SDL_AudioStream* stream);
+        void RunEncoder(std::stop_token);
+
+        AudioSenderParams   params_;
+
+        SDL_AudioStream*    stream_ = nullptr;
+        OpusEncoder*        opus_ = nullptr;
+
+        // Filled by the SDL audio thread only.
+        AudioPcmFrame       partial_ = {};
+        size_t              n_partial_ = 0;
+
+        AudioPcmQueue       pcm_queue_ = AudioPcmQueue(8);
+        std::atomic_bool    muted_ = false;
+
+        // Only used by the encoder thread.
+        bool                has_rtp_timestamp_ = false;
+        uint32_t            rtp_timestamp_ = 0;
+
+        std::mutex          mutex_;
+        std::vector<std::shared_ptr<NetworkHandler>>
+                            peers_ = {};
+
+        std::jthread        thread_ = {};
+};
+
+} // namespace vacon
@@ -0,0 +1,183 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "audio/jitter_buffer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <memory>
+
+#include <plog/Log.h>
+
+namespace vacon {
+
+// Bounds for the jitter delay, not counting the extra delay.
+static const double kMinDelayMicros         = 10'000.0;
+static const double kMaxDelayMicros         = 200'000.0;
+
+// The target delay, in multiples of the interarrival jitter.
+static const double kJitterMultiple         = 3.0;
+
+// Frames between two adjustments of the buffer size.
+static const size_t kFramesPerAdjust        = 10;
+
+// Missing frames in a row after which the stream has stopped, and buffering
+// starts over.
+static const size_t kMaxMissingFrames       = 20;
+
+static const double kFrameMicros            = 1'000'000.0 * kAudioFrameSamples / kAudioSampleRate;
+
+void AudioJitterBuffer::Insert(std::shared_ptr<AudioPacket> packet)
+{
+    // Interarrival jitter, in microseconds.
+    auto arrival_us = static_cast<double>(
+        std::chrono::duration_cast<std::chrono::microseconds>(packet->t_arrival.time_since_epoch()).count());
+    auto media_us = static_cast<double>(packet->rtp_timestamp) * 1'000'000.0 / kAudioRtpClockRate;
+    auto transit_us = arrival_us - media_us;
+    if (has_transit_) {
+        auto d = std::fabs(transit_us - last_transit_us_);
+        // A large step is a timestamp wrap or a restart, not jitter.
+        if (d < kMaxDelayMicros) {
+            jitter_us_ += (d - jitter_us_) / 16.0;
+        }
+    }
+    has_transit_ = true;
+    last_transit_us_ = transit_us;
+
+    if (!primed_) {
+        primed_ = true;
+        next_sequence_ = packet->sequence;
+        end_sequence_ = packet->sequence;
+    }
+
+    auto offset = static_cast<int16_t>(packet->sequence - next_sequence_);
+    if (offset < 0) {
+        // Already played or concealed.
+        ++n_late_;
+        return;
+    }
+    if (static_cast<size_t>(offset) >= kSlots) {
+        LOG_DEBUG << std::format("Audio packet {} is too far ahead of {}, restarting the jitter buffer",
+                                 packet->sequence, next_sequence_);
+        Reset();
+        primed_ = true;
+        next_sequence_ = packet->sequence;
+        end_sequence_ = packet->sequence;
+    }
+
+    if (static_cast<int16_t>(packet->sequence + 1 - end_sequence_) > 0) {
+        end_sequence_ = packet->sequence + 1;
+    }
+    slots_[packet->sequence % kSlots] = std::move(packet);
+}
+
+AudioJitterBuffer::Result AudioJitterBuffer::Pop(std::shared_ptr<AudioPacket>& packet)
+{
+    if (!primed_) {
+        return Result::Silence;
+    }
+
+    auto target = TargetFrames();
+    if (!playing_) {
+        if (BufferedFrames() < target) {
+            return Result::Silence;
+        }
+        playing_ = true;
+        n_since_adjust_ = 0;
+        n_missing_ = 0;
+    }
+
+    ++n_since_adjust_;
+    auto adjust = n_since_adjust_ >= kFramesPerAdjust;
+
+    // Grow by concealing a frame without consuming one.
+    if (adjust && BufferedFrames() + 1 < target) {
+        n_since_adjust_ = 0;
+        ++n_concealed_;
+        return Result::Conceal;
+    }
+
+    // Shrink by dropping the next frame.
+    if (adjust && BufferedFrames() > target + 1) {
+        n_since_adjust_ = 0;
+        slots_[next_sequence_ % kSlots] = nullptr;
+        ++next_sequence_;
+        ++n_dropped_;
+    }
+
+    auto& slot = slots_[next_sequence_ % kSlots];
+    if (slot && slot->sequence == next_sequence_) {
+        packet = std::move(slot);
+        slot = nullptr;
+        ++next_sequence_;
+        n_missing_ = 0;
+        return Result::Packet;
+    }
+    slot = nullptr;
+
+    if (BufferedFrames() == 0 && ++n_missing_ >= kMaxMissingFrames) {
+        LOG_DEBUG << "Audio stream stopped, restarting the jitter buffer";
+        Reset();
+        return Result::Silence;
+    }
+
+    ++next_sequence_;
+    if (static_cast<int16_t>(end_sequence_ - next_sequence_) < 0) {
+        end_sequence_ = next_sequence_;
+    }
+    ++n_concealed_;
+    return Result::Conceal;
+}
+
+void AudioJitterBuffer::Reset()
+{
+    ++n_resets_;
+    slots_.fill(nullptr);
+    primed_ = false;
+    playing_ = false;
+    n_missing_ = 0;
+}
+
+size_t AudioJitterBuffer::BufferedFrames() const
+{
+    return static_cast<uint16_t>(end_sequence_ - next_sequence_);
+}
+
+size_t AudioJitterBuffer::TargetFrames() const
+{
+    auto delay_us = std::clamp(kJitterMultiple * jitter_us_, kMinDelayMicros, kMaxDelayMicros) +
+                    static_cast<double>(extra_delay_.count());
+    return static_cast<size_t>(std::ceil(delay_us / kFrameMicros));
+}
+
+std::chrono::microseconds AudioJitterBuffer::Delay() const
+{
+    return std::chrono::microseconds(std::llround(BufferedFrames() * kFrameMicros));
+}
+
+std::chrono::microseconds AudioJitterBuffer::TargetDelay() const
+{
+    return std::chrono::microseconds(std::llround(TargetFrames() * kFrameMicros));
+}
+
+std::chrono::microseconds AudioJitterBuffer::Jitter() const
+{
+    return std::chrono::microseconds(std::llround(jitter_us_));
+}
+
+} // namespace vacon
@@ -0,0 +1,87 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "audio/audio.hpp"
+
+namespace vacon {
+
+// Reorders the received audio packets by sequence number and releases one
+// per 10 ms of playout, once enough are buffered to ride out the network
+// jitter. The target delay follows the interarrival jitter, like the video
+// playout clock, plus an extra delay for lip sync. The buffer shrinks by
+// dropping a frame and grows by concealing one, at most one per 100 ms.
+//
+// Only used by the audio playout thread, so it isn't thread-safe.
+class AudioJitterBuffer {
+    public:
+        enum class Result {
+            Packet,     // Play the packet.
+            Conceal,    // The packet is missing, conceal it.
+            Silence,    // Not playing yet, or no longer.
+        };
+
+        void Insert(std::shared_ptr<AudioPacket>);
+        Result Pop(std::shared_ptr<AudioPacket>& packet);
+
+        void SetExtraDelay(std::chrono::microseconds delay) { extra_delay_ = delay; }
+
+        // The audio buffered right now, and the target.
+        std::chrono::microseconds Delay() const;
+        std::chrono::microseconds TargetDelay() const;
+        std::chrono::microseconds Jitter() const;
+
+        size_t              n_late_ = 0;
+        size_t              n_concealed_ = 0;
+        size_t              n_dropped_ = 0;
+        size_t              n_resets_ = 0;
+
+    private:
+        static constexpr size_t kSlots = 64;
+
+        size_t BufferedFrames() const;
+        size_t TargetFrames() const;
+        void Reset();
+
+        std::array<std::shared_ptr<AudioPacket>, kSlots>
+                            slots_ = {};
+
+        bool                primed_ = false;
+        bool                playing_ = false;
+        uint16_t            next_sequence_ = 0;
+        uint16_t            end_sequence_ = 0;
+
+        // Frames played since the buffer last grew or shrank, and concealed
+        // in a row.
+        size_t              n_since_adjust_ = 0;
+        size_t              n_missing_ = 0;
+
+        // Interarrival jitter, as in RFC 3550.
+        bool                has_transit_ = false;
+        double              last_transit_us_ = 0.0;
+        double              jitter_us_ = 0.0;
+
+        std::chrono::microseconds
+                            extra_delay_ = {};
+};
+
+} // namespace vacon
@@ -0,0 +1,165 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "av_sync.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <mutex>
+#include <optional>
+
+#include <plog/Log.h>
+
+#include "util.hpp"
+
+namespace vacon {
+
+// Skew that is too small to notice, and isn't corrected.
+static const int64_t kSkewToleranceMicros   = 15'000;
+
+// Largest correction per update, and the largest delay of either stream.
+static const int64_t kMaxStepMicros         = 10'000;
+static const int64_t kMaxDelayMicros        = 500'000;
+
+static const auto kUpdateInterval           = std::chrono::seconds(1);
+
+// Weight of a new sample in the smoothed offsets.
+static const double kOffsetSmoothing        = 1.0 / 16.0;
+
+void AvSync::OnSenderReport(Media media, uint64_t ntp_timestamp, uint32_t rtp_timestamp)
+{
+    std::lock_guard lock(mutex_);
+    auto& mapping = media == Media::Audio ? audio_sr_ : video_sr_;
+    mapping.valid = true;
+    mapping.ntp_timestamp = ntp_timestamp;
+    mapping.rtp_timestamp = rtp_timestamp;
+}
+
+void AvSync::SetClockOffset(std::chrono::microseconds offset)
+{
+    std::lock_guard lock(mutex_);
+    clock_offset_us_ = offset.count();
+}
+
+std::optional<AvSync::TimePoint> AvSync::CaptureTime(const Mapping& mapping, uint32_t rtp_timestamp) const
+{
+    if (!mapping.valid) {
+        return std::nullopt;
+    }
+    auto delta = static_cast<int32_t>(rtp_timestamp - mapping.rtp_timestamp);
+    auto delta_us = static_cast<int64_t>(delta) * 1'000'000 / mapping.clock_rate - clock_offset_us_;
+    return util::NtpToSteady(mapping.ntp_timestamp) + std::chrono::microseconds(delta_us);
+}
+
+std::optional<AvSync::TimePoint> AvSync::VideoCaptureTime(uint32_t rtp_timestamp) const
+{
+    std::lock_guard lock(mutex_);
+    return CaptureTime(video_sr_, rtp_timestamp);
+}
+
+static void UpdateOffset(std::optional<double>& offset_us, AvSync::TimePoint t_capture, AvSync::TimePoint t_local)
+{
+    auto sample = static_cast<double>(
+        std::chrono::duration_cast<std::chrono::microseconds>(t_local - t_capture).count());
+    if (!offset_us) {
+        offset_us = sample;
+    } else {
+        *offset_us += (sample - *offset_us) * kOffsetSmoothing;
+    }
+}
+
+void AvSync::OnVideoShown(uint32_t rtp_timestamp, TimePoint t_shown)
+{
+    std::lock_guard lock(mutex_);
+    if (auto t_capture = CaptureTime(video_sr_, rtp_timestamp)) {
+        UpdateOffset(video_offset_us_, *t_capture, t_shown);
+    }
+}
+
+void AvSync::OnAudioPlayed(uint32_t rtp_timestamp, TimePoint t_played)
+{
+    std::lock_guard lock(mutex_);
+    if (auto t_capture = CaptureTime(audio_sr_, rtp_timestamp)) {
+        UpdateOffset(audio_offset_us_, *t_capture, t_played);
+    }
+    UpdateDelays(t_played);
+}
+
+void AvSync::UpdateDelays(TimePoint t_now)
+{
+    if (!audio_offset_us_ || !video_offset_us_ || t_now - t_last_update_ < kUpdateInterval) {
+        return;
+    }
+    t_last_update_ = t_now;
+
+    // The offsets already include the current delays, so the skew is what
+    // remains to be corrected.
+    auto skew_us = std::llround(*audio_offset_us_ - *video_offset_us_);
+    if (std::abs(skew_us) < kSkewToleranceMicros) {
+        return;
+    }
+
+    auto step = std::clamp<int64_t>(-skew_us, -kMaxStepMicros, kMaxStepMicros);
+    relative_delay_us_ = std::clamp<int64_t>(relative_delay_us_ + step, -kMaxDelayMicros, kMaxDelayMicros);
+
+    LOG_VERBOSE << std::format("A/V skew {} us, audio delay {} us, video delay {} us",
+                               skew_us,
+                               std::max<int64_t>(relative_delay_us_, 0),
+                               std::max<int64_t>(-relative_delay_us_, 0));
+}
+
+std::chrono::microseconds AvSync::AudioDelay() const
+{
+    std::lock_guard lock(mutex_);
+    return std::chrono::microseconds(std::max<int64_t>(relative_delay_us_, 0));
+}
+
+std::chrono::microseconds AvSync::VideoDelay() const
+{
+    std::lock_guard lock(mutex_);
+    return std::chrono::microseconds(std::max<int64_t>(-relative_delay_us_, 0));
+}
+
+std::optional<std::chrono::microseconds> AvSync::Skew() const
+{
+    std::lock_guard lock(mutex_);
+    if (!audio_offset_us_ || !video_offset_us_) {
+        return std::nullopt;
+    }
+    return std::chrono::microseconds(std::llround(*audio_offset_us_ - *video_offset_us_));
+}
+
+std::optional<std::chrono::microseconds> AvSync::AudioLatency() const
+{
+    std::lock_guard lock(mutex_);
+    if (!audio_offset_us_) {
+        return std::nullopt;
+    }
+    return std::chrono::microseconds(std::llround(*audio_offset_us_));
+}
+
+std::optional<std::chrono::microseconds> AvSync::VideoLatency() const
+{
+    std::lock_guard lock(mutex_);
+    if (!video_offset_us_) {
+        return std::nullopt;
+    }
+    return std::chrono::microseconds(std::llround(*video_offset_us_));
+}
+
+} // namespace vacon
@@ -0,0 +1,98 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+
+namespace vacon {
+
+// Lines up the audio and video playout of a peer. The RTCP sender reports of
+// both streams map their RTP timestamps onto the sender's wall clock, so the
+// capture time of every shown video frame and played audio frame is known on
+// the sender's clock. Comparing the two against the local time at which they
+// are shown gives the lip sync skew, and the stream that is ahead is
+// delayed, in small steps so that neither playout jumps.
+//
+// The network threads report the sender reports, the render thread the shown
+// video frames and the audio thread the played audio frames. The audio
+// thread reports at most every 100 ms, so it doesn't contend for the mutex.
+class AvSync {
+    public:
+        typedef std::chrono::time_point<std::chrono::steady_clock> TimePoint;
+
+        enum class Media {
+            Audio,
+            Video,
+        };
+
+        void OnSenderReport(Media, uint64_t ntp_timestamp, uint32_t rtp_timestamp);
+
+        // The sender's wall clock minus the local one, from the ClockSync of
+        // the peer. The capture times are corrected by it.
+        void SetClockOffset(std::chrono::microseconds offset);
+        void OnVideoShown(uint32_t rtp_timestamp, TimePoint t_shown);
+        void OnAudioPlayed(uint32_t rtp_timestamp, TimePoint t_played);
+
+        // The extra playout delay of each stream.
+        std::chrono::microseconds AudioDelay() const;
+        std::chrono::microseconds VideoDelay() const;
+
+        // How much later the audio is played than the video that was captured
+        // with it. Negative if the audio is ahead.
+        std::optional<std::chrono::microseconds> Skew() const;
+
+        // The time from capture on the sender to playout here. Only
+        // meaningful if the wall clocks of both machines are synchronized,
+        // or the clock offset is set.
+        std::optional<std::chrono::microseconds> AudioLatency() const;
+        std::optional<std::chrono::microseconds> VideoLatency() const;
+
+        // The capture time of a video frame, on the local clock.
+        std::optional<TimePoint> VideoCaptureTime(uint32_t rtp_timestamp) const;
+
+    private:
+        struct Mapping {
+            bool            valid           = false;
+            uint64_t        ntp_timestamp   = 0;
+            uint32_t        rtp_timestamp   = 0;
+            uint32_t        clock_rate      = 0;
+        };
+
+        std::optional<TimePoint> CaptureTime(const Mapping&, uint32_t rtp_timestamp) const;
+        void UpdateDelays(TimePoint t_now);
+
+        mutable std::mutex  mutex_;
+
+        Mapping             audio_sr_ = { .clock_rate = 48'000 };
+        Mapping             video_sr_ = { .clock_rate = 90'000 };
+        int64_t             clock_offset_us_ = 0;
+
+        // Local playout time minus capture time, in microseconds, smoothed.
+        std::optional<double>
+                            audio_offset_us_ = std::nullopt;
+        std::optional<double>
+                            video_offset_us_ = std::nullopt;
+
+        // Audio delay minus video delay. Only one of the two is delayed.
+        int64_t             relative_delay_us_ = 0;
+
+        TimePoint           t_last_update_ = {};
+};
+
+} // namespace vacon
@@ -0,0 +1,108 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "clock_sync.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <mutex>
+#include <optional>
+
+#include <plog/Log.h>
+
+namespace vacon {
+
+// Number of exchanges to take the least delayed one from. At one exchange
+// per second, this follows the drift of the clocks within half a minute.
+static const size_t kClockSyncWindow = 32;
+
+// Difference of two NTP timestamps, in microseconds.
+static double NtpDiffMicros(uint64_t a, uint64_t b)
+{
+    return static_cast<double>(static_cast<int64_t>(a - b)) * 1e6 / 4294967296.0;
+}
+
+void ClockSync::OnExchange(uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4)
+{
+    auto rtt_us = NtpDiffMicros(t4, t1) - NtpDiffMicros(t3, t2);
+    if (rtt_us < 0.0) {
+        LOG_DEBUG << std::format("Ignoring clock exchange with negative round trip time {:.0f} us", rtt_us);
+        return;
+    }
+    auto offset_us = (NtpDiffMicros(t2, t1) + NtpDiffMicros(t3, t4)) / 2.0;
+
+    std::lock_guard lock(mutex_);
+    samples_.push_back({ .offset_us = offset_us, .rtt_us = rtt_us });
+    if (samples_.size() > kClockSyncWindow) {
+        samples_.pop_front();
+    }
+
+    auto best = Best();
+    delay_from_peer_us_ = NtpDiffMicros(t4, t3) + best->offset_us;
+    delay_to_peer_us_ = NtpDiffMicros(t2, t1) - best->offset_us;
+
+    LOG_VERBOSE << std::format("Clock offset {:.0f} us, RTT {:.0f} us, delay {:.0f} us from peer, {:.0f} us to peer",
+                               best->offset_us, best->rtt_us, delay_from_peer_us_, delay_to_peer_us_);
+}
+
+const ClockSync::Sample* ClockSync::Best() const
+{
+    if (samples_.empty()) {
+        return nullptr;
+    }
+    return &*std::min_element(samples_.begin(), samples_.end(),
+                              [](const Sample& a, const Sample& b) { return a.rtt_us < b.rtt_us; });
+}
+
+std::optional<std::chrono::microseconds> ClockSync::Offset() const
+{
+    std::lock_guard lock(mutex_);
+    if (auto best = Best()) {
+        return std::chrono::microseconds(std::llround(best->offset_us));
+    }
+    return std::nullopt;
+}
+
+std::optional<std::chrono::microseconds> ClockSync::MinRtt() const
+{
+    std::lock_guard lock(mutex_);
+    if (auto best = Best()) {
+        return std::chrono::microseconds(std::llround(best->rtt_us));
+    }
+    return std::nullopt;
+}
+
+std::optional<std::chrono::microseconds> ClockSync::DelayFromPeer() const
+{
+    std::lock_guard lock(mutex_);
+    if (samples_.empty()) {
+        return std::nullopt;
+    }
+    return std::chrono::microseconds(std::llround(delay_from_peer_us_));
+}
+
+std::optional<std::chrono::microseconds> ClockSync::DelayToPeer() const
+{
+    std::lock_guard lock(mutex_);
+    if (samples_.empty()) {
+        return std::nullopt;
+    }
+    return std::chrono::microseconds(std::llround(delay_to_peer_us_));
+}
+
+} // namespace vacon
@@ -0,0 +1,66 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace vacon {
+
+// Estimates the offset between the wall clock of a peer and the local one,
+// the way NTP does. Each exchange over the control channel gives four NTP
+// timestamps: t1 when the request was sent and t4 when the reply arrived,
+// on the local clock, and t2 when the request arrived and t3 when the reply
+// was sent, on the peer's clock. Queueing makes the delays of the two
+// directions differ, so the offset is taken from the exchange with the
+// smallest round trip time in a window, which is the least delayed. With
+// the offset, the delay of each direction of every exchange is known.
+//
+// The network threads report the exchanges, and the render thread reads
+// the results.
+class ClockSync {
+    public:
+        void OnExchange(uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4);
+
+        // The peer's wall clock minus the local one.
+        std::optional<std::chrono::microseconds> Offset() const;
+
+        // The round trip time of the exchange that the offset is taken from.
+        std::optional<std::chrono::microseconds> MinRtt() const;
+
+        // The delay from the peer to here, and from here to the peer, of the
+        // last exchange.
+        std::optional<std::chrono::microseconds> DelayFromPeer() const;
+        std::optional<std::chrono::microseconds> DelayToPeer() const;
+
+    private:
+        struct Sample {
+            double          offset_us;
+            double          rtt_us;
+        };
+
+        const Sample* Best() const;
+
+        mutable std::mutex  mutex_;
+        std::deque<Sample>  samples_ = {};
+        double              delay_from_peer_us_ = 0.0;
+        double              delay_to_peer_us_ = 0.0;
+};
+
+} // namespace vacon
@@ -0,0 +1,160 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "degradation.hpp"
+
+#include <format>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <plog/Log.h>
+
+#include "stats.hpp"
+
+namespace vacon {
+
+// Number of consecutive overloaded intervals before stepping down.
+static const unsigned kStepDownIntervals    = 2;
+
+// Number of consecutive healthy intervals before stepping back up. This is
+// much larger than kStepDownIntervals so that the controller doesn't
+// oscillate between two levels.
+static const unsigned kStepUpIntervals      = 10;
+
+// Number of intervals to ignore after a level change, while the encoder
+// and the queues settle.
+static const unsigned kHoldoffIntervals     = 3;
+
+const std::vector<DegradationLevel>& DegradationController::Ladder()
+{
+    static const std::vector<DegradationLevel> ladder = {
+        { "full",                       100, 1 },
+        { "3/4 resolution",              75, 1 },
+        { "1/2 resolution",              50, 1 },
+        { "1/2 resolution, 1/2 rate",    50, 2 },
+        { "1/3 resolution, 1/2 rate",    33, 2 },
+    };
+    return ladder;
+}
+
+double DegradationController::WindowMean(const Stats& now, const Stats& prev)
+{
+    auto n = now.count - prev.count;
+    if (n <= 0.0) {
+        return 0.0;
+    }
+    return (now.mean * now.count - prev.mean * prev.count) / n;
+}
+
+bool DegradationController::Update(const DegradationInputs& in)
+{
+    if (!primed_ || in.camera_frame_rate <= 0.0) {
+        primed_ = true;
+        last_ = in;
+        return false;
+    }
+
+    auto prev = last_;
+    last_ = in;
+
+    if (n_holdoff_ > 0) {
+        --n_holdoff_;
+        return false;
+    }
+
+    const auto& cur = CurrentLevel();
+    auto frame_budget_us = 1'000'000.0 / (in.camera_frame_rate / cur.fps_divisor);
+    auto encode_us = WindowMean(in.encode_time, prev.encode_time);
+    auto present_us = WindowMean(in.present_time, prev.present_time);
+    auto n_overflow = in.n_camera_overflow_encoder - prev.n_camera_overflow_encoder;
+    auto n_stall = in.n_encode_stall - prev.n_encode_stall;
+    auto process_cpu_limit = 90.0 * in.n_cpus;
+
+    // Frames dropped at the encoder queue are expected when the fps divisor
+    // is in effect, since the encoder deliberately skips camera frames, so
+    // only count overflows as overload at the full frame rate.
+    std::string reason;
+    if (encode_us > 0.85 * frame_budget_us) {
+        reason = std::format("encode time {:.0f} us exceeds 85% of frame budget {:.0f} us",
+                             encode_us, frame_budget_us);
+    } else if (cur.fps_divisor == 1 && n_overflow > 0) {
+        reason = std::format("{} camera frames overflowed the encoder queue", n_overflow);
+    } else if (n_stall > 0) {
+        reason = std::format("encoder stalled {} times on the outgoing queue", n_stall);
+    } else if (present_us > 1'000'000.0 / in.camera_frame_rate) {
+        reason = std::format("present time {:.0f} us exceeds camera frame time", present_us);
+    } else if (in.encoder_cpu_percent > 90.0) {
+        reason = std::format("encoder thread CPU usage {:.0f}%", in.encoder_cpu_percent);
+    } else if (in.process_cpu_percent > process_cpu_limit) {
+        reason = std::format("process CPU usage {:.0f}% of {} CPUs", in.process_cpu_percent, in.n_cpus);
+    }
+
+    bool healthy =
+        reason.empty() &&
+        encode_us < 0.5 * frame_budget_us &&
+        in.encoder_cpu_percent < 60.0 &&
+        in.process_cpu_percent < 0.6 * process_cpu_limit &&
+        in.encoder_queue_depth == 0 &&
+        in.outgoing_queue_depth == 0;
+
+    if (!reason.empty()) {
+        n_healthy_ = 0;
+        ++n_overloaded_;
+    } else if (healthy) {
+        n_overloaded_ = 0;
+        ++n_healthy_;
+    } else {
+        n_overloaded_ = 0;
+        n_healthy_ = 0;
+    }
+
+    auto old_level = level_;
+    if (n_overloaded_ >= kStepDownIntervals && level_ + 1 < Ladder().size()) {
+        ++level_;
+        n_steps_down_.fetch_add(1, std::memory_order_relaxed);
+    } else if (n_healthy_ >= kStepUpIntervals && level_ > 0) {
+        --level_;
+        n_steps_up_.fetch_add(1, std::memory_order_relaxed);
+        reason = std::format("healthy for {} intervals, encode time {:.0f} us", n_healthy_, encode_us);
+    } else {
+        return false;
+    }
+
+    n_overloaded_ = 0;
+    n_healthy_ = 0;
+    n_holdoff_ = kHoldoffIntervals;
+
+    auto decision = std::format("{} from level {} ({}) to level {} ({}): {}",
+                                level_ > old_level ? "Stepping down" : "Stepping up",
+                                old_level, Ladder().at(old_level).name,
+                                level_, CurrentLevel().name,
+                                reason);
+    LOG_INFO << "[Degradation] " << decision;
+    {
+        std::lock_guard lock(mutex_);
+        last_decision_ = decision;
+    }
+
+    return true;
+}
+
+std::string DegradationController::LastDecision()
+{
+    std::lock_guard lock(mutex_);
+    return last_decision_;
+}
+
+} // namespace vacon
@@ -0,0 +1,84 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "stats.hpp"
+
+namespace vacon {
+
+// One rung of the degradation ladder. The encoder output resolution is
+// scaled relative to the camera resolution and only every Nth camera frame
+// is encoded.
+struct DegradationLevel {
+    const char*     name;
+    unsigned        scale_percent;
+    unsigned        fps_divisor;
+};
+
+// A snapshot of the pipeline load, taken once per evaluation interval. The
+// Stats values and frame counters are cumulative; the controller derives
+// the per-interval values itself.
+struct DegradationInputs {
+    double          camera_frame_rate           = 0.0;
+    Stats           encode_time                 = {};
+    Stats           present_time                = {};
+    size_t          encoder_queue_depth         = 0;
+    size_t          outgoing_queue_depth        = 0;
+    size_t          n_camera_overflow_encoder   = 0;
+    size_t          n_encode_stall              = 0;
+    double          encoder_cpu_percent         = 0.0;
+    double          process_cpu_percent         = 0.0;
+    unsigned        n_cpus                      = 1;
+};
+
+class DegradationController {
+    public:
+        static const std::vector<DegradationLevel>& Ladder();
+
+        // Evaluate the pipeline load. Returns true if the current level
+        // changed and needs to be applied to the encoder.
+        bool Update(const DegradationInputs&);
+
+        size_t Level() const { return level_; }
+        const DegradationLevel& CurrentLevel() const { return Ladder().at(level_); }
+        std::string LastDecision();
+
+        std::atomic_size_t  n_steps_down_ = 0;
+        std::atomic_size_t  n_steps_up_ = 0;
+
+    private:
+        // Windowed mean of a cumulative Welford result, given the result at
+        // the start of the window.
+        static double WindowMean(const Stats& now, const Stats& prev);
+
+        size_t              level_ = 0;
+        bool                primed_ = false;
+        unsigned            n_overloaded_ = 0;
+        unsigned            n_healthy_ = 0;
+        unsigned            n_holdoff_ = 0;
+        DegradationInputs   last_ = {};
+
+        std::mutex          mutex_;
+        std::string         last_decision_ = {};
+};
+
+} // namespace vacon
@@ -13,14 +13,56 @@
 // You should have received a copy of the GNU General Public License
 // along with this program. If not, see <https://www.gnu.org/licenses/>.
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
 #include <SDL3/SDL.h>
 #include <plog/Log.h>
 
 #include "event.hpp"
+#include "event_bus.hpp"
 
 namespace vacon {
 
-void PushEvent(Event event_code)
+static std::atomic<EventBus*> s_event_bus = nullptr;
+
+static std::atomic_bool s_decoded_frame_ready_pending = false;
+static std::atomic_bool s_preview_frame_ready_pending = false;
+
+static std::atomic_bool* FrameReadyPending(Event event_code)
+{
+    switch (event_code) {
+    case Event::DecodedFrameReady:
+        return &s_decoded_frame_ready_pending;
+    case Event::PreviewFrameReady:
+        return &s_preview_frame_ready_pending;
+    default:
+        return nullptr;
+    }
+}
+
+void PushEvent(Event event_code, size_t peer_id, EventPayload payload)
+{
+    // If the bus is full, the render loop still gets the event, and handles
+    // what the bus handlers would have.
+    if (auto bus = s_event_bus.load(std::memory_order_acquire)) {
+        auto message = EventMessage {
+            .event      = event_code,
+            .peer_id    = peer_id,
+            .payload    = std::move(payload),
+            .t_push     = std::chrono::steady_clock::now(),
+        };
+        if (bus->Push(message)) {
+            return;
+        }
+    }
+    PushSdlEvent(event_code, peer_id);
+}
+
+void PushSdlEvent(Event event_code, size_t peer_id)
 {
     auto event = SDL_Event {
         .user = {
@@ -29,7 +71,7 @@ void PushEvent(Event event_code)
             .timestamp = 0,
             .windowID = 0,
             .code = static_cast<Sint32>(event_code),
-            .data1 = nullptr,
+            .data1 = reinterpret_cast<void*>(static_cast<uintptr_t>(peer_id)),
             .data2 = nullptr,
         }
     };
@@ -39,4 +81,27 @@ void PushEvent(Event event_code)
     }
 }
 
+void SetEventBus(EventBus* bus)
+{
+    s_event_bus.store(bus, std::memory_order_release);
+}
+
+void PushFrameReadyEvent(Event event_code)
+{
+    // If the push fails the event stays pending, and the render loop picks
+    // the frame up on its next redraw. The frames are only for the render
+    // loop, so the event bus is bypassed.
+    auto pending = FrameReadyPending(event_code);
+    if (pending && !pending->exchange(true, std::memory_order_acq_rel)) {
+        PushSdlEvent(event_code, 0);
+    }
+}
+
+void ClearFrameReadyEvent(Event event_code)
+{
+    if (auto pending = FrameReadyPending(event_code)) {
+        pending->store(false, std::memory_order_release);
+    }
+}
+
 } // namespace vacon
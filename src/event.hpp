@@ -15,8 +15,16 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstddef>
+#include <variant>
+
+#include "codecs.hpp"
+
 namespace vacon {
 
+class EventBus;
+
 enum class Event {
     Invalid,
 
@@ -32,12 +40,51 @@ enum class Event {
     EncoderStarting,
     EncoderStarted,
     EncoderFailed,
+    FirstFrameEncoded,
 
     NetworkStarting,
     NetworkStarted,
     NetworkFailed,
+
+    RemoteRenderSize,
+    BandwidthProbed,
+
+    DecodedFrameReady,
+    PreviewFrameReady,
+};
+
+// The codecs negotiated with a peer, carried by NetworkStarted.
+struct NegotiatedCodecs {
+    VideoCodec      encoder     = VideoCodec::UNKNOWN;
+    VideoCodec      decoder     = VideoCodec::UNKNOWN;
 };
 
-void PushEvent(Event event_code);
+using EventPayload = std::variant<std::monostate, NegotiatedCodecs>;
+
+struct EventMessage {
+    Event           event       = Event::Invalid;
+    size_t          peer_id     = 0;
+    EventPayload    payload     = {};
+    std::chrono::time_point<std::chrono::steady_clock>
+                    t_push      = {};
+};
+
+// Events from the per-peer objects carry the ID of the peer, in the data1
+// field of the SDL user event. With an event bus set, the events go through
+// its dispatcher thread first, and only its handlers see the payload.
+void PushEvent(Event event_code, size_t peer_id = 0, EventPayload payload = {});
+
+// Push the event to SDL only, for the render loop.
+void PushSdlEvent(Event event_code, size_t peer_id);
+
+// Route the events pushed from now on through the bus, or straight to SDL
+// if it is null. The bus must outlive the threads that push events.
+void SetEventBus(EventBus* bus);
+
+// Push a frame ready event, unless one with the same code is still pending.
+// The render loop calls ClearFrameReadyEvent() before it dequeues frames, so
+// a producer has at most one event in flight.
+void PushFrameReadyEvent(Event event_code);
+void ClearFrameReadyEvent(Event event_code);
 
 } // namespace vacon
@@ -0,0 +1,160 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "event_bus.hpp"
+
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+#include <plog/Log.h>
+
+#include "event.hpp"
+#include "util.hpp"
+
+namespace vacon {
+
+std::unique_ptr<EventBus> EventBus::Create(const EventBusParams& params)
+{
+    if (params.capacity < 2) {
+        LOG_ERROR << "EventBusParams.capacity must be at least 2";
+        return nullptr;
+    }
+
+    // The constructor is private and the object isn't movable, because of
+    // its atomics.
+    return std::unique_ptr<EventBus>(new EventBus(std::bit_ceil(params.capacity)));
+}
+
+EventBus::EventBus(size_t capacity)
+    : cells_(std::make_unique<Cell[]>(capacity)),
+      mask_(capacity - 1)
+{
+    for (size_t i = 0; i < capacity; ++i) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+EventBus::~EventBus()
+{
+    RequestStop();
+    Join();
+}
+
+void EventBus::StartThread()
+{
+    thread_ = std::jthread([&](std::stop_token st) { RunDispatcher(st); });
+}
+
+void EventBus::RequestStop()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Requesting stop of event bus thread ID " << thread_.get_id();
+        thread_.request_stop();
+        n_pending_.release();
+    }
+}
+
+void EventBus::Join()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Joining event bus thread ID " << thread_.get_id();
+        thread_.join();
+        thread_ = {};
+    }
+}
+
+void EventBus::Subscribe(Event event, Handler handler)
+{
+    handlers_[event].emplace_back(std::move(handler));
+}
+
+bool EventBus::Push(const EventMessage& message)
+{
+    auto pos = push_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+        auto& cell = cells_[pos & mask_];
+        auto sequence = cell.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            // The cell is free, claim it.
+            if (push_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.message = message;
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                n_pending_.release();
+                return true;
+            }
+        } else if (diff < 0) {
+            // The dispatcher hasn't popped the message pushed a lap ago.
+            n_overflow_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            // Another thread claimed the cell first.
+            pos = push_pos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool EventBus::Pop(EventMessage& message)
+{
+    auto& cell = cells_[pop_pos_ & mask_];
+    if (cell.sequence.load(std::memory_order_acquire) != pop_pos_ + 1) {
+        return false;
+    }
+    message = std::move(cell.message);
+    cell.sequence.store(pop_pos_ + mask_ + 1, std::memory_order_release);
+    ++pop_pos_;
+    return true;
+}
+
+void EventBus::Dispatch(const EventMessage& message)
+{
+    auto t_start = std::chrono::steady_clock::now();
+    s_dispatch_time_.Update(std::chrono::duration_cast<std::chrono::microseconds>(
+        t_start - message.t_push).count());
+
+    if (auto it = handlers_.find(message.event); it != handlers_.end()) {
+        for (const auto& handler : it->second) {
+            handler(message);
+        }
+    }
+    PushSdlEvent(message.event, message.peer_id);
+    n_dispatched_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void EventBus::RunDispatcher(std::stop_token st)
+{
+    LOG_DEBUG << "Starting event bus thread ID " << std::this_thread::get_id();
+    util::SetThreadName("VEventBus");
+
+    while (!st.stop_requested()) {
+        n_pending_.acquire();
+
+        // A message may still be in the middle of being pushed, behind one
+        // that is ready. Its push releases the semaphore again once it is
+        // done, so draining up to it is enough.
+        EventMessage message;
+        while (!st.stop_requested() && Pop(message)) {
+            Dispatch(message);
+        }
+    }
+
+    LOG_DEBUG << "Stopping event bus thread ID " << std::this_thread::get_id();
+}
+
+} // namespace vacon
@@ -0,0 +1,102 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <semaphore>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include "event.hpp"
+#include "stats.hpp"
+
+namespace vacon {
+
+struct EventBusParams {
+    // How many events may wait for the dispatcher, rounded up to a power of
+    // two.
+    size_t          capacity    = 256;
+};
+
+// Dispatches the pipeline events on its own thread, so that e.g. starting
+// the encoder when a peer connects doesn't wait for the render loop, which
+// may be blocked presenting a frame. The handlers run first, then every
+// event is forwarded to SDL, for the UI and the state that only the main
+// thread touches.
+//
+// The queue is a bounded multi-producer, single-consumer ring (after D.
+// Vyukov's bounded MPMC queue), so pushing never takes a lock.
+class EventBus {
+    public:
+        using Handler = std::function<void(const EventMessage&)>;
+
+        static std::unique_ptr<EventBus> Create(const EventBusParams&);
+        ~EventBus();
+        void StartThread();
+        void RequestStop();
+        void Join();
+
+        // The handlers of an event run on the dispatcher thread, in the order
+        // they were subscribed. Subscribe before StartThread().
+        void Subscribe(Event, Handler);
+
+        // Thread safe and lock free. Fails if the queue is full.
+        bool Push(const EventMessage&);
+
+        // From the push of an event to the start of its handlers.
+        Welford             s_dispatch_time_    = {};
+        std::atomic_size_t  n_dispatched_       = 0;
+        std::atomic_size_t  n_overflow_         = 0;
+
+    private:
+        EventBus(size_t capacity);
+        void RunDispatcher(std::stop_token);
+        bool Pop(EventMessage&);
+        void Dispatch(const EventMessage&);
+
+        struct Cell {
+            // The position the cell is ready to be pushed at, or that plus
+            // one once it holds a message to pop.
+            std::atomic_size_t
+                            sequence            = 0;
+            EventMessage    message             = {};
+        };
+
+        std::unique_ptr<Cell[]>
+                            cells_;
+        size_t              mask_;
+
+        alignas(64) std::atomic_size_t
+                            push_pos_           = 0;
+        alignas(64) size_t  pop_pos_            = 0;
+
+        // Released once per push, so it may count more events than are left
+        // after the dispatcher drained the queue.
+        std::counting_semaphore<>
+                            n_pending_{0};
+
+        std::map<Event, std::vector<Handler>>
+                            handlers_           = {};
+
+        std::jthread        thread_             = {};
+};
+
+} // namespace vacon
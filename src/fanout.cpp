@@ -0,0 +1,122 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "fanout.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <plog/Log.h>
+
+#include "linux/video_frame.hpp"
+#include "util.hpp"
+
+using namespace std::chrono_literals;
+
+namespace vacon {
+
+std::atomic_size_t n_frames_fanout = 0;
+
+std::unique_ptr<VideoFanOut> VideoFanOut::Create(const VideoFanOutParams& params)
+{
+    if (!params.outgoing_video_packet_queue) {
+        LOG_ERROR << "VideoFanOutParams.outgoing_video_packet_queue must be set";
+        return nullptr;
+    }
+
+    // The constructor is private and the object isn't movable, because of
+    // its mutex.
+    return std::unique_ptr<VideoFanOut>(new VideoFanOut(params));
+}
+
+VideoFanOut::~VideoFanOut()
+{
+    RequestStop();
+    Join();
+}
+
+void VideoFanOut::StartThread()
+{
+    thread_ = std::jthread([&](std::stop_token st) { RunFanOut(st); });
+}
+
+void VideoFanOut::RequestStop()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Requesting stop of video fan-out thread ID " << thread_.get_id();
+        thread_.request_stop();
+    }
+}
+
+void VideoFanOut::Join()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Joining video fan-out thread ID " << thread_.get_id();
+        thread_.join();
+        thread_ = {};
+    }
+}
+
+void VideoFanOut::AddPeer(std::shared_ptr<NetworkHandler> nh)
+{
+    std::lock_guard lock(mutex_);
+    peers_.emplace_back(std::move(nh));
+}
+
+void VideoFanOut::RemovePeer(const std::shared_ptr<NetworkHandler>& nh)
+{
+    std::lock_guard lock(mutex_);
+    std::erase(peers_, nh);
+}
+
+void VideoFanOut::RunFanOut(std::stop_token st)
+{
+    LOG_DEBUG << "Starting video fan-out thread ID " << std::this_thread::get_id();
+    util::SetThreadName("VOutVideo");
+
+    std::vector<std::shared_ptr<NetworkHandler>> peers;
+    while (!st.stop_requested()) {
+        std::shared_ptr<linux::VideoFrame> frame;
+        if (!params_.outgoing_video_packet_queue->wait_dequeue_timed(frame, 250ms)) {
+            LOG_VERBOSE << "Stalled dequeuing packet from outgoing video packet queue, retrying";
+            continue;
+        }
+
+        // Send to a snapshot of the peers, so that a slow send doesn't hold
+        // up adding or removing a peer.
+        {
+            std::lock_guard lock(mutex_);
+            peers = peers_;
+        }
+        for (auto& nh : peers) {
+            nh->SendVideoFrame(frame);
+        }
+        peers.clear();
+        n_frames_fanout.fetch_add(1, std::memory_order_relaxed);
+
+        if (params_.outgoing_recorder) {
+            params_.outgoing_recorder->Record(frame);
+        }
+    }
+
+    LOG_DEBUG << "Stopping video fan-out thread ID " << std::this_thread::get_id();
+}
+
+} // namespace vacon
@@ -0,0 +1,66 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include "linux/recorder.hpp"
+#include "linux/typedefs.hpp"
+#include "network_handler.hpp"
+
+namespace vacon {
+
+extern std::atomic_size_t n_frames_fanout;
+
+struct VideoFanOutParams {
+    std::shared_ptr<linux::VideoPacketQueue>    outgoing_video_packet_queue = nullptr;
+    std::shared_ptr<linux::Recorder>            outgoing_recorder = nullptr;
+};
+
+// Drains the outgoing video packet queue and hands every encoded frame to
+// all the peers. The frame is shared, not copied, so each additional peer
+// only adds the cost of packetizing and sending.
+class VideoFanOut {
+    public:
+        static std::unique_ptr<VideoFanOut> Create(const VideoFanOutParams&);
+        ~VideoFanOut();
+        void StartThread();
+        void RequestStop();
+        void Join();
+
+        void AddPeer(std::shared_ptr<NetworkHandler>);
+        void RemovePeer(const std::shared_ptr<NetworkHandler>&);
+
+    private:
+        VideoFanOut(const VideoFanOutParams& params)
+            : params_(params) {};
+        void RunFanOut(std::stop_token);
+
+        VideoFanOutParams   params_;
+
+        std::mutex          mutex_;
+        std::vector<std::shared_ptr<NetworkHandler>>
+                            peers_ = {};
+
+        std::jthread        thread_ = {};
+};
+
+} // namespace vacon
@@ -33,6 +33,7 @@
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <unistd.h>
 
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_egl.h>
@@ -51,6 +52,7 @@ std::atomic_size_t n_frames_camera_success          = 0;
 std::atomic_size_t n_frames_camera_missed           = 0;
 std::atomic_size_t n_frames_camera_overflow_encoder = 0;
 std::atomic_size_t n_frames_camera_overflow_preview = 0;
+std::atomic_size_t n_camera_buffers_held            = 0;
 
 static void LogV4L2RequestBuffers(const struct v4l2_requestbuffers *reqbuf)
 {
@@ -117,6 +119,7 @@ Camera::~Camera()
                                          ptr, len, errno, strerror(errno));
             }
             buf.mmap = {};
+            buf.mmap_lease.Reset();
         }
 
         // Close the V4L2 dmabuf fd.
@@ -127,6 +130,7 @@ Camera::~Camera()
                                          buf.expbuf.fd, errno, strerror(errno));
             }
             buf.expbuf.fd = -1;
+            buf.dmabuf_lease.Reset();
         }
     }
 
@@ -201,9 +205,14 @@ void Camera::RunCamera(std::stop_token st)
         }
 
         // Enqueue the camera frame onto the preview queue.
-        if (params_.preview_queue && !params_.preview_queue->try_enqueue(cref)) {
-            LOG_VERBOSE << "Failed to enqueue frame onto preview queue, discarding!";
-            n_frames_camera_overflow_preview.fetch_add(1, std::memory_order_relaxed);
+        if (params_.preview_queue &&
+            (!params_.preview_enabled || params_.preview_enabled->load(std::memory_order_relaxed))) {
+            if (params_.preview_queue->try_enqueue(cref)) {
+                PushFrameReadyEvent(Event::PreviewFrameReady);
+            } else {
+                LOG_VERBOSE << "Failed to enqueue frame onto preview queue, discarding!";
+                n_frames_camera_overflow_preview.fetch_add(1, std::memory_order_relaxed);
+            }
         }
     }
 
@@ -212,6 +221,10 @@ void Camera::RunCamera(std::stop_token st)
 
 bool Camera::InitCamera()
 {
+    if (params_.device == kCameraSyntheticDevice) {
+        return InitSynthetic();
+    }
+
     auto t_start = std::chrono::steady_clock::now();
     LOG_INFO << std::format("Initializing V4L2 device {}", params_.device);
 
@@ -576,6 +589,8 @@ bool Camera::InitBuffers()
             .fmt    = pixfmt_,
             .mmap   = std::span<const std::byte>(static_cast<const std::byte*>(data),
                                                  static_cast<size_t>(buf.length)),
+            .mmap_lease     = ResourceLease(Resource::CameraMmap, buf.length),
+            .dmabuf_lease   = ResourceLease(Resource::DmabufFd, buf.length),
         });
     }
 
@@ -587,6 +602,12 @@ bool Camera::InitBuffers()
 
 bool Camera::ExportBuffersToOpenGL(SDL_Renderer* sdl_renderer)
 {
+    // The synthetic buffers are memfds, which EGL can't import.
+    if (synthetic_) {
+        LOG_INFO << "The synthetic camera has no self-view";
+        return false;
+    }
+
     switch (pixfmt_.pixelformat) {
     case V4L2_PIX_FMT_NV12: [[fallthrough]];
     case V4L2_PIX_FMT_UYVY: [[fallthrough]];
@@ -774,6 +795,10 @@ bool Camera::StartCapturing()
 
 std::shared_ptr<CameraBufferRef> Camera::NextFrame()
 {
+    if (synthetic_) {
+        return NextSyntheticFrame();
+    }
+
     struct v4l2_buffer buf  = {};
     buf.type                = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     buf.memory              = V4L2_MEMORY_MMAP;
@@ -817,19 +842,161 @@ std::shared_ptr<CameraBufferRef> Camera::NextFrame()
     }
 }
 
+bool Camera::InitSynthetic()
+{
+    synthetic_ = true;
+
+    pixfmt_                 = {};
+    pixfmt_.width           = params_.synthetic_width;
+    pixfmt_.height          = params_.synthetic_height;
+    pixfmt_.pixelformat     = V4L2_PIX_FMT_NV12;
+    pixfmt_.field           = V4L2_FIELD_NONE;
+    pixfmt_.bytesperline    = pixfmt_.width;
+    pixfmt_.sizeimage       = pixfmt_.width * pixfmt_.height * 3 / 2;
+
+    format_ = {};
+    format_.fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format_.fmt.fmt.pix = pixfmt_;
+    format_.parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format_.parm.parm.capture.timeperframe.numerator = 1;
+    format_.parm.parm.capture.timeperframe.denominator = params_.synthetic_frame_rate;
+
+    // Back the buffers with memfds, so that they can be shared like the
+    // dmabufs of a real camera.
+    for (unsigned index = 0; index < params_.n_kernel_buffers; ++index) {
+        auto fd = memfd_create("vacon-synthetic-camera", MFD_CLOEXEC);
+        if (fd == -1) {
+            LOG_ERROR << std::format("memfd_create() failed: {} ({})", errno, strerror(errno));
+            return false;
+        }
+        if (ftruncate(fd, pixfmt_.sizeimage) == -1) {
+            LOG_ERROR << std::format("ftruncate() failed: {} ({})", errno, strerror(errno));
+            close(fd);
+            return false;
+        }
+        auto data = mmap(nullptr, pixfmt_.sizeimage, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            LOG_ERROR << std::format("mmap() failed: {} ({})", errno, strerror(errno));
+            close(fd);
+            return false;
+        }
+
+        // The chroma planes stay grey.
+        memset(static_cast<std::byte*>(data) + pixfmt_.width * pixfmt_.height, 128,
+               pixfmt_.width * pixfmt_.height / 2);
+
+        struct v4l2_buffer buf  = {};
+        buf.type                = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory              = V4L2_MEMORY_MMAP;
+        buf.index               = index;
+        buf.length              = pixfmt_.sizeimage;
+        buf.bytesused           = pixfmt_.sizeimage;
+
+        struct v4l2_exportbuffer expbuf = {};
+        expbuf.type             = buf.type;
+        expbuf.index            = index;
+        expbuf.fd               = fd;
+
+        bufs_.emplace_back(CameraBuffer {
+            .vbuf   = buf,
+            .expbuf = expbuf,
+            .fmt    = pixfmt_,
+            .mmap   = std::span<const std::byte>(static_cast<const std::byte*>(data),
+                                                 static_cast<size_t>(buf.length)),
+            .mmap_lease     = ResourceLease(Resource::CameraMmap, buf.length),
+            .dmabuf_lease   = ResourceLease(Resource::DmabufFd, buf.length),
+        });
+    }
+    synthetic_refs_.resize(bufs_.size());
+
+    t_last_ = std::chrono::steady_clock::now();
+    t_next_synthetic_ = t_last_;
+    LOG_INFO << std::format("Initialized synthetic camera with format {}", std::string(format_));
+
+    return true;
+}
+
+std::shared_ptr<CameraBufferRef> Camera::NextSyntheticFrame()
+{
+    std::this_thread::sleep_until(t_next_synthetic_);
+
+    // Like a real camera, drop frames rather than catching up after a stall.
+    auto t_now = std::chrono::steady_clock::now();
+    auto frame_time = std::chrono::microseconds(1'000'000 / params_.synthetic_frame_rate);
+    t_next_synthetic_ += frame_time;
+    if (t_next_synthetic_ < t_now) {
+        t_next_synthetic_ = t_now + frame_time;
+    }
+
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(t_now - t_last_).count();
+    s_capture_time_.Update(micros);
+    t_last_ = t_now;
+
+    // The sequence number advances even if there is no free buffer, so that
+    // the frame is counted as missed.
+    ++synthetic_sequence_;
+    auto it = std::find_if(synthetic_refs_.begin(), synthetic_refs_.end(),
+                           [](const auto& ref) { return ref.expired(); });
+    if (it == synthetic_refs_.end()) {
+        LOG_VERBOSE << "No free synthetic camera buffer, dropping frame";
+        return nullptr;
+    }
+    auto& buf = bufs_.at(it - synthetic_refs_.begin());
+
+    // steady_clock is CLOCK_MONOTONIC, like the V4L2 timestamps.
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(t_now.time_since_epoch()).count();
+    buf.vbuf.sequence = synthetic_sequence_;
+    buf.vbuf.timestamp.tv_sec = us / 1'000'000;
+    buf.vbuf.timestamp.tv_usec = us % 1'000'000;
+    DrawSyntheticFrame(buf);
+
+    auto cref = CameraBufferRef::Create(buf, -1);
+    *it = cref;
+    return cref;
+}
+
+void Camera::DrawSyntheticFrame(CameraBuffer& buf)
+{
+    // A diagonal gradient that scrolls by a few pixels per frame, so that
+    // the encoder sees motion, with a bright bar sweeping across it.
+    auto luma = reinterpret_cast<uint8_t*>(const_cast<std::byte*>(buf.mmap.data()));
+    auto width = pixfmt_.width;
+    auto height = pixfmt_.height;
+    auto shift = synthetic_sequence_ * 4;
+    auto bar_x = (synthetic_sequence_ * 8) % width;
+    auto bar_width = std::min(width / 32 + 1, width - bar_x);
+    for (uint32_t y = 0; y < height; ++y) {
+        auto row = luma + y * pixfmt_.bytesperline;
+        for (uint32_t x = 0; x < width; ++x) {
+            row[x] = static_cast<uint8_t>(x + y + shift);
+        }
+        memset(row + bar_x, 235, bar_width);
+    }
+}
+
 std::shared_ptr<CameraBufferRef> CameraBufferRef::Create(CameraBuffer& buf, int v4l2_fd)
 {
     return std::make_shared<CameraBufferRef>(CameraBufferRef(buf, v4l2_fd));
 }
 
+CameraBufferRef::CameraBufferRef(CameraBuffer& buf, int v4l2_fd)
+    : buf_(buf), v4l2_fd_(v4l2_fd)
+{
+    n_camera_buffers_held.fetch_add(1, std::memory_order_relaxed);
+}
+
 CameraBufferRef::CameraBufferRef(CameraBufferRef&& src)
-    : buf_(src.buf_), v4l2_fd_(src.v4l2_fd_)
+    : buf_(src.buf_), v4l2_fd_(src.v4l2_fd_), held_(src.held_)
 {
     src.v4l2_fd_ = -1;
+    src.held_ = false;
 }
 
 CameraBufferRef::~CameraBufferRef()
 {
+    if (held_) {
+        n_camera_buffers_held.fetch_sub(1, std::memory_order_relaxed);
+    }
     if (v4l2_fd_ != -1 && ioctl(v4l2_fd_, VIDIOC_QBUF, &buf_.vbuf) == -1) {
         LOG_FATAL << std::format("ioctl(VIDIOC_QBUF) on fd {}, buffer {} failed: {} ({})",
                                  v4l2_fd_, buf_.vbuf.index, errno, strerror(errno));
@@ -21,6 +21,7 @@
 #include <cstdint>
 #include <memory>
 #include <span>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -29,6 +30,7 @@
 #include <SDL3/SDL.h>
 
 #include "linux/typedefs.hpp"
+#include "resources.hpp"
 #include "stats.hpp"
 #include "util.hpp"
 
@@ -40,13 +42,30 @@ extern std::atomic_size_t n_frames_camera_missed;
 extern std::atomic_size_t n_frames_camera_overflow_encoder;
 extern std::atomic_size_t n_frames_camera_overflow_preview;
 
+// Number of camera buffers currently referenced by a CameraBufferRef, i.e.
+// held by the encoder, the preview or a queue, rather than by the driver.
+extern std::atomic_size_t n_camera_buffers_held;
+
+// Camera device that generates a moving test pattern instead of capturing
+// from a V4L2 device, e.g. for headless bots.
+static const std::string kCameraSyntheticDevice = "synthetic";
+
 struct CameraParams {
     std::string device;
     std::shared_ptr<CameraBufferQueue> encoder_queue = nullptr;
     std::shared_ptr<CameraBufferQueue> preview_queue = nullptr;
 
+    // While false, e.g. while the window is hidden, frames aren't queued
+    // for the preview.
+    std::shared_ptr<std::atomic_bool> preview_enabled = nullptr;
+
     uint32_t n_kernel_buffers = 8;
     uint32_t n_initial_stream_skip_frames = 15;
+
+    // Format of the synthetic test pattern, which is always NV12.
+    uint32_t synthetic_width = 1280;
+    uint32_t synthetic_height = 720;
+    uint32_t synthetic_frame_rate = 30;
 };
 
 enum class ChromaFormat {
@@ -101,6 +120,8 @@ struct CameraBuffer {
     v4l2_pix_format             fmt = {};
     SDL_Texture*                texture = nullptr;
     std::span<const std::byte>  mmap = {};
+    ResourceLease               mmap_lease = {};
+    ResourceLease               dmabuf_lease = {};
 
     uint64_t PtsMicros() const {
         return vbuf.timestamp.tv_sec * 1'000'000 + vbuf.timestamp.tv_usec;
@@ -116,10 +137,10 @@ class CameraBufferRef {
         const CameraBuffer& buf_;
 
     private:
-        CameraBufferRef(CameraBuffer& buf, int v4l2_fd)
-            : buf_(buf), v4l2_fd_(v4l2_fd) {};
+        CameraBufferRef(CameraBuffer& buf, int v4l2_fd);
 
         int v4l2_fd_ = -1;
+        bool held_ = true;
 };
 
 class Camera {
@@ -150,6 +171,10 @@ class Camera {
 
         std::shared_ptr<CameraBufferRef> NextFrame();
 
+        bool InitSynthetic();
+        std::shared_ptr<CameraBufferRef> NextSyntheticFrame();
+        void DrawSyntheticFrame(CameraBuffer&);
+
         CameraParams                params_ = {};
         CameraFormat                format_ = {};
         int                         fd_ = -1;
@@ -160,6 +185,15 @@ class Camera {
 
         std::chrono::time_point<std::chrono::steady_clock>
                                     t_last_ = {};
+
+        // The synthetic buffers aren't queued to a kernel driver, so the
+        // camera tracks which ones are still referenced.
+        bool                        synthetic_ = false;
+        uint32_t                    synthetic_sequence_ = 0;
+        std::vector<std::weak_ptr<CameraBufferRef>>
+                                    synthetic_refs_ = {};
+        std::chrono::time_point<std::chrono::steady_clock>
+                                    t_next_synthetic_ = {};
 };
 
 } // namespace linux
@@ -19,6 +19,7 @@
 #include <atomic>
 #include <cerrno>
 #include <chrono>
+#include <cstring>
 #include <format>
 #include <memory>
 #include <optional>
@@ -29,13 +30,16 @@
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_egl.h>
 #include <SDL3/SDL_opengles2.h>
+#include <fcntl.h>
 #include <libdrm/drm_fourcc.h>
 #include <mfx.h>
 #include <plog/Log.h>
 #include <va/va.h>
+#include <va/va_drm.h>
 #include <va/va_drmcommon.h>
 #include <va/va_str.h>
 #include <va/va_wayland.h>
+#include <unistd.h>
 #include <wayland-client.h>
 
 #include "codecs.hpp"
@@ -53,6 +57,9 @@ namespace linux {
 std::atomic_size_t n_frames_decode_success  = 0;
 std::atomic_size_t n_frames_decode_fail     = 0;
 std::atomic_size_t n_frames_decode_overflow = 0;
+std::atomic_size_t n_frames_decode_hidden   = 0;
+
+std::atomic<mfxStatus> last_mfx_status_decode = MFX_ERR_NONE;
 
 std::unique_ptr<Decoder> Decoder::Create(const DecoderParams& params)
 {
@@ -95,6 +102,12 @@ Decoder::~Decoder()
         wl_display_disconnect(wl_display_);
         wl_display_ = nullptr;
     }
+
+    if (drm_fd_ != -1) {
+        LOG_VERBOSE << std::format("Closing DRM render node {} (fd {})", params_.render_node, drm_fd_);
+        close(drm_fd_);
+        drm_fd_ = -1;
+    }
 }
 
 void Decoder::StartThread(VideoCodec codec)
@@ -174,12 +187,12 @@ void Decoder::RunDecoder(std::stop_token st)
     LOG_DEBUG << "Starting video decoder thread ID " << std::this_thread::get_id();
     util::SetThreadName("VDecoderVideo");
 
-    PushEvent(Event::DecoderStarting);
+    PushEvent(Event::DecoderStarting, params_.peer_id);
 
     auto codec_id = ToMfxCodec(codec_);
     if (codec_id == 0) {
         LOG_ERROR << std::format("Cannot convert codec ID {} to MFX codec value", (int)codec_);
-        PushEvent(Event::DecoderFailed);
+        PushEvent(Event::DecoderFailed, params_.peer_id);
         return;
     }
 
@@ -188,11 +201,11 @@ void Decoder::RunDecoder(std::stop_token st)
 
     if (!InitVaapi()) {
         LOG_ERROR << "InitVaapi() failed";
-        PushEvent(Event::DecoderFailed);
+        PushEvent(Event::DecoderFailed, params_.peer_id);
         return;
     }
 
-    PushEvent(Event::DecoderStarted);
+    PushEvent(Event::DecoderStarted, params_.peer_id);
 
     while (!st.stop_requested()) {
         std::shared_ptr<RtcPacket> packet;
@@ -209,18 +222,33 @@ void Decoder::RunDecoder(std::stop_token st)
 
 bool Decoder::InitVaapi()
 {
-    // Connect to the Wayland compositor.
-    wl_display_ = wl_display_connect(nullptr);
-    if (!wl_display_) {
-        LOG_ERROR << "wl_display_connect() failed";
-        return false;
-    }
+    if (!params_.render_node.empty()) {
+        // Get a VADisplay from the DRM render node, without a compositor.
+        drm_fd_ = open(params_.render_node.c_str(), O_RDWR | O_CLOEXEC);
+        if (drm_fd_ < 0) {
+            LOG_ERROR << std::format("Unable to open DRM render node {}: {}",
+                                     params_.render_node, strerror(errno));
+            return false;
+        }
+        va_display_ = vaGetDisplayDRM(drm_fd_);
+        if (!va_display_) {
+            LOG_ERROR << "vaGetDisplayDRM() failed";
+            return false;
+        }
+    } else {
+        // Connect to the Wayland compositor.
+        wl_display_ = wl_display_connect(nullptr);
+        if (!wl_display_) {
+            LOG_ERROR << "wl_display_connect() failed";
+            return false;
+        }
 
-    // Get a VADisplay from the Wayland compositor.
-    va_display_ = vaGetDisplayWl(wl_display_);
-    if (!va_display_) {
-        LOG_ERROR << "vaGetDisplayWl() failed";
-        return false;
+        // Get a VADisplay from the Wayland compositor.
+        va_display_ = vaGetDisplayWl(wl_display_);
+        if (!va_display_) {
+            LOG_ERROR << "vaGetDisplayWl() failed";
+            return false;
+        }
     }
 
     // Initialize the VADisplay.
@@ -290,6 +318,7 @@ void Decoder::DecodePacket(std::shared_ptr<RtcPacket> rtc_packet)
         } else {
             LOG_DEBUG << "MFXVideoDECODE_DecodeHeader() failed: " << MfxStatusStr(status);
             n_frames_decode_fail.fetch_add(1, std::memory_order_relaxed);
+        n_frames_fail_.fetch_add(1, std::memory_order_relaxed);
             return;
         }
     }
@@ -303,6 +332,7 @@ void Decoder::DecodePacket(std::shared_ptr<RtcPacket> rtc_packet)
                                         nullptr,
                                         &frame->surface_,
                                         &syncp);
+    last_mfx_status_decode.store(status, std::memory_order_relaxed);
     if (status == MFX_WRN_VIDEO_PARAM_CHANGED) {
         // Submit the bitstream to be decoded *again*.
         status =
@@ -311,6 +341,7 @@ void Decoder::DecodePacket(std::shared_ptr<RtcPacket> rtc_packet)
                                             nullptr,
                                             &frame->surface_,
                                             &syncp);
+        last_mfx_status_decode.store(status, std::memory_order_relaxed);
         if (status != MFX_ERR_NONE) {
             // Terminate the decoding operation and re-initialize it next time.
             LOG_ERROR << std::format("MFXVideoDECODE_DecodeFrameAsync() failed with {}"
@@ -322,22 +353,33 @@ void Decoder::DecodePacket(std::shared_ptr<RtcPacket> rtc_packet)
         }
     } else if (status != MFX_ERR_NONE) {
         n_frames_decode_fail.fetch_add(1, std::memory_order_relaxed);
+        n_frames_fail_.fetch_add(1, std::memory_order_relaxed);
         LOG_ERROR << "MFXVideoDECODE_DecodeFrameAsync() failed: " << MfxStatusStr(status);
         return;
     }
 
+    frame->TrackSurface();
+
     // Wait for the decoding request to complete and return the decoded frame.
     do {
         status = MFXVideoCORE_SyncOperation(mfx_session_, syncp, 10 /* wait ms */);
+        last_mfx_status_decode.store(status, std::memory_order_relaxed);
     } while (status == MFX_WRN_IN_EXECUTION);
     if (status == MFX_ERR_NONE) {
         n_frames_decode_success.fetch_add(1, std::memory_order_relaxed);
     } else {
         n_frames_decode_fail.fetch_add(1, std::memory_order_relaxed);
+        n_frames_fail_.fetch_add(1, std::memory_order_relaxed);
         LOG_ERROR << "MFXVideoCORE_SyncOperation() failed: " << MfxStatusStr(status);
         return;
     }
 
+    // Nobody is looking, so release the surface right away.
+    if (params_.output_enabled && !params_.output_enabled->load(std::memory_order_relaxed)) {
+        n_frames_decode_hidden.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
     // Export the decoded frame to a VAAPI surface.
     mfxSurfaceHeader export_header      = {};
     export_header.SurfaceType           = MFX_SURFACE_TYPE_VAAPI;
@@ -362,6 +404,7 @@ void Decoder::DecodePacket(std::shared_ptr<RtcPacket> rtc_packet)
                                  vaStatusStr(va_status), va_status);
         return;
     }
+    frame->TrackPrime();
 
     // vaSyncSurface() must be called before reading from the exported surface.
     va_status = vaSyncSurface(frame->exported_surface_->vaDisplay,
@@ -376,10 +419,15 @@ void Decoder::DecodePacket(std::shared_ptr<RtcPacket> rtc_packet)
     auto micros = std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count();
     s_decode_time_.Update(micros);
     LOG_VERBOSE << std::format("Decoded video packet in {} us", micros);
+    frame->t_decoded_ = t_end;
+    frame->rtp_timestamp_ = rtc_packet->frame_info_.timestamp;
+    frame->t_received_ = rtc_packet->t_received_;
 
     // Enqueue the decoded video frame onto the queue for the renderer.
     if (params_.decoded_video_frame_queue) {
-        if (!params_.decoded_video_frame_queue->try_enqueue(frame)) {
+        if (params_.decoded_video_frame_queue->try_enqueue(frame)) {
+            PushFrameReadyEvent(Event::DecodedFrameReady);
+        } else {
             LOG_DEBUG << "Failed to enqueue frame onto decoder output queue, discarding!";
             n_frames_decode_overflow.fetch_add(1, std::memory_order_relaxed);
         }
@@ -392,6 +440,11 @@ DecodedFrame::DecodedFrame(DecodedFrame&& src)
     exported_surface_       = src.exported_surface_;
     prime_                  = src.prime_;
     texture_                = src.texture_;
+    surface_lease_          = std::move(src.surface_lease_);
+    prime_lease_            = std::move(src.prime_lease_);
+    t_decoded_              = src.t_decoded_;
+    rtp_timestamp_          = src.rtp_timestamp_;
+    t_received_             = src.t_received_;
 
     src.surface_            = nullptr;
     src.exported_surface_   = nullptr;
@@ -420,6 +473,7 @@ DecodedFrame::~DecodedFrame()
         }
     }
     prime_ = {};
+    prime_lease_.Reset();
 
     if (exported_surface_) {
         LOG_VERBOSE << "Releasing VASurfaceID " << exported_surface_->vaSurfaceID;
@@ -437,6 +491,23 @@ DecodedFrame::~DecodedFrame()
         }
         surface_ = nullptr;
     }
+    surface_lease_.Reset();
+}
+
+void DecodedFrame::TrackSurface()
+{
+    if (surface_) {
+        surface_lease_ = ResourceLease(Resource::VplSurface, MfxSurfaceBytes(surface_->Info));
+    }
+}
+
+void DecodedFrame::TrackPrime()
+{
+    size_t bytes = 0;
+    for (uint32_t i = 0; i < prime_.num_objects; ++i) {
+        bytes += prime_.objects[i].size;
+    }
+    prime_lease_ = ResourceLease(Resource::DmabufFd, bytes, prime_.num_objects);
 }
 
 bool DecodedFrame::ExportToOpenGL(SDL_Renderer *sdl_renderer)
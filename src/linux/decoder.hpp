@@ -16,9 +16,12 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <stop_token>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -30,6 +33,7 @@
 
 #include "codecs.hpp"
 #include "linux/typedefs.hpp"
+#include "resources.hpp"
 #include "rtc_packet.hpp"
 #include "stats.hpp"
 
@@ -39,10 +43,24 @@ namespace linux {
 extern std::atomic_size_t n_frames_decode_success;
 extern std::atomic_size_t n_frames_decode_fail;
 extern std::atomic_size_t n_frames_decode_overflow;
+extern std::atomic_size_t n_frames_decode_hidden;
+
+// The status of the last decode or sync call of any decoder, for diagnosing
+// stalls.
+extern std::atomic<mfxStatus> last_mfx_status_decode;
 
 struct DecoderParams {
+    size_t                              peer_id = 0;
     std::shared_ptr<RtcPacketQueue>     incoming_video_packet_queue = nullptr;
     std::shared_ptr<DecodedFrameQueue>  decoded_video_frame_queue = nullptr;
+
+    // While false, e.g. while the window is hidden, frames are still decoded
+    // to keep the reference frames intact, but not exported or queued.
+    std::shared_ptr<std::atomic_bool>   output_enabled = nullptr;
+
+    // If set, VAAPI is opened on this DRM render node instead of through the
+    // Wayland compositor, e.g. "/dev/dri/renderD128" when running headless.
+    std::string                         render_node = "";
 };
 
 class DecodedFrame {
@@ -52,10 +70,27 @@ class DecodedFrame {
         ~DecodedFrame();
         bool ExportToOpenGL(SDL_Renderer*);
 
+        // Account for the surface and the PRIME fds, once they're assigned.
+        void TrackSurface();
+        void TrackPrime();
+
         mfxFrameSurface1*               surface_ = nullptr;
         mfxSurfaceVAAPI*                exported_surface_ = nullptr;
         VADRMPRIMESurfaceDescriptor     prime_ = {};
         SDL_Texture*                    texture_ = nullptr;
+        ResourceLease                   surface_lease_ = {};
+        ResourceLease                   prime_lease_ = {};
+
+        // When decoding finished, for measuring decode to display latency.
+        std::chrono::time_point<std::chrono::steady_clock>
+                                        t_decoded_ = {};
+
+        // RTP timestamp of the packet, for pacing the playout.
+        uint32_t                        rtp_timestamp_ = 0;
+
+        // When the packet arrived, for measuring the receive latency.
+        std::chrono::time_point<std::chrono::steady_clock>
+                                        t_received_ = {};
 };
 
 class Decoder {
@@ -74,6 +109,10 @@ class Decoder {
 
         Welford             s_decode_time_ = {};
 
+        // Frames that this decoder failed to decode. n_frames_decode_fail
+        // counts those of all the decoders.
+        std::atomic_size_t  n_frames_fail_ = 0;
+
     private:
         Decoder() = default;
         Decoder(const DecoderParams& params)
@@ -93,6 +132,7 @@ class Decoder {
 
         VADisplay           va_display_ = {};
         wl_display*         wl_display_ = nullptr;
+        int                 drm_fd_ = -1;
 };
 
 } // namespace linux
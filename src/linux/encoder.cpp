@@ -28,6 +28,8 @@
 #include <set>
 #include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <mfx.h>
 #include <plog/Log.h>
@@ -48,6 +50,9 @@ namespace linux {
 std::atomic_size_t n_frames_encode_success  = 0;
 std::atomic_size_t n_frames_encode_fail     = 0;
 std::atomic_size_t n_frames_encode_stall    = 0;
+std::atomic_size_t n_frames_encode_skip     = 0;
+
+std::atomic<mfxStatus> last_mfx_status_encode = MFX_ERR_NONE;
 
 std::unique_ptr<Encoder> Encoder::Create(const EncoderParams& params)
 {
@@ -112,6 +117,29 @@ void Encoder::Join()
     }
 }
 
+void Encoder::SetDegradation(unsigned scale_percent, unsigned fps_divisor)
+{
+    settings_.scale_percent = std::clamp(scale_percent, 10u, 100u);
+    settings_.fps_divisor = std::max(fps_divisor, 1u);
+    settings_.changed = true;
+}
+
+void Encoder::SetReceiverScale(unsigned scale_percent)
+{
+    scale_percent = std::clamp(scale_percent, 10u, 100u);
+    if (settings_.receiver_scale_percent.exchange(scale_percent) != scale_percent) {
+        settings_.changed = true;
+    }
+}
+
+void Encoder::SetBitrate(unsigned bitrate_kbps)
+{
+    bitrate_kbps = std::max(bitrate_kbps, 1u);
+    if (settings_.bitrate_kbps.exchange(bitrate_kbps) != bitrate_kbps) {
+        settings_.changed = true;
+    }
+}
+
 std::shared_ptr<std::vector<VideoCodec>> Encoder::GetSupportedCodecs(std::optional<VideoCodec> force)
 {
     supported_pixel_formats_.clear();
@@ -190,10 +218,26 @@ void Encoder::RunEncoder(std::stop_token st)
 
     util::SetThreadName("VEncoderVideo");
 
+    bool first_frame = true;
     while (!st.stop_requested()) {
+        // Apply any settings changed by other threads before encoding the
+        // next frame.
+        if (settings_.changed.exchange(false) && !ApplySettings()) {
+            LOG_ERROR << "ApplySettings() failed";
+            PushEvent(Event::EncoderFailed);
+            return;
+        }
+
         // Get the next camera frame from the queue.
         std::shared_ptr<CameraBufferRef> cref = nullptr;
         if (params_.encoder_queue->wait_dequeue_timed(cref, 10ms)) {
+            // Skip camera frames if the encoded frame rate is reduced.
+            if (fps_divisor_ > 1 && n_frames_in_++ % fps_divisor_ != 0) {
+                cref = nullptr;
+                n_frames_encode_skip.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
             // Encode the camera frame.
             auto video_frame = EncodeCameraBuffer(*cref);
 
@@ -208,6 +252,9 @@ void Encoder::RunEncoder(std::stop_token st)
             }
 
             n_frames_encode_success.fetch_add(1, std::memory_order_relaxed);
+            if (std::exchange(first_frame, false)) {
+                PushEvent(Event::FirstFrameEncoded);
+            }
 
             // Enqueue the compressed video frame for network transport.
             if (params_.outgoing_video_packet_queue) {
@@ -242,6 +289,7 @@ bool Encoder::InitMfxEncoder()
             LOG_ERROR << "MFXVideoVPP_Init() failed: " << MfxStatusStr(status);
             return false;
         }
+        vpp_initialized_ = true;
     }
 
     auto status = MFXVideoENCODE_Query(mfx_session_, &mfx_videoparam_encode_, &mfx_videoparam_encode_);
@@ -256,6 +304,125 @@ bool Encoder::InitMfxEncoder()
     return true;
 }
 
+bool Encoder::ApplySettings()
+{
+    auto bitrate_kbps = settings_.bitrate_kbps.load();
+    if (bitrate_kbps != 0 && bitrate_kbps != mfx_videoparam_encode_.mfx.TargetKbps &&
+        !ApplyBitrate(bitrate_kbps)) {
+        return false;
+    }
+
+    auto scale_percent = std::min(settings_.scale_percent.load(),
+                                  settings_.receiver_scale_percent.load());
+    auto fps_divisor = settings_.fps_divisor.load();
+
+    // Output dimensions must be even for the 4:2:0 and 4:2:2 formats.
+    mfxU16 crop_w = (camera_format_.Width() * scale_percent / 100) & ~1u;
+    mfxU16 crop_h = (camera_format_.Height() * scale_percent / 100) & ~1u;
+
+    auto& fi = mfx_videoparam_encode_.mfx.FrameInfo;
+    if (crop_w == fi.CropW && crop_h == fi.CropH && fps_divisor == fps_divisor_) {
+        return true;
+    }
+
+    LOG_INFO << std::format("Reconfiguring encoder from {}x{} at 1/{} rate to {}x{} at 1/{} rate",
+                            fi.CropW, fi.CropH, fps_divisor_,
+                            crop_w, crop_h, fps_divisor);
+
+    // Downscaling is done by VPP. If the encoder was encoding directly from
+    // the camera surfaces, VPP needs to be enabled with the same input and
+    // output frame info as the encoder.
+    if (!need_vpp_scaling_) {
+        mfx_videoparam_vpp_.vpp.In = fi;
+        mfx_videoparam_vpp_.vpp.Out = fi;
+        need_vpp_scaling_ = true;
+    }
+
+    mfx_videoparam_vpp_.vpp.Out.CropW = fi.CropW = crop_w;
+    mfx_videoparam_vpp_.vpp.Out.CropH = fi.CropH = crop_h;
+    mfx_videoparam_vpp_.vpp.Out.Width = fi.Width = VACON_ALIGN16(crop_w);
+    mfx_videoparam_vpp_.vpp.Out.Height = fi.Height = VACON_ALIGN16(crop_h);
+
+    // Skipped frames are dropped before VPP, so only the encoder needs to
+    // know about the reduced frame rate, for its rate control.
+    fi.FrameRateExtN = camera_format_.FrameRateN();
+    fi.FrameRateExtD = camera_format_.FrameRateD() * fps_divisor;
+    fps_divisor_ = fps_divisor;
+    n_frames_in_ = 0;
+
+    return ResetMfxEncoder();
+}
+
+bool Encoder::ApplyBitrate(unsigned bitrate_kbps)
+{
+    LOG_INFO << std::format("Changing encoder bitrate from {} to {} Kbps",
+                            mfx_videoparam_encode_.mfx.TargetKbps, bitrate_kbps);
+
+    mfx_videoparam_encode_.mfx.TargetKbps = bitrate_kbps;
+    mfx_videoparam_encode_.mfx.MaxKbps = bitrate_kbps;
+
+    // The rate control takes the new bitrate without starting a new
+    // sequence, so there's no IDR frame.
+    auto status = MFXVideoENCODE_Reset(mfx_session_, &mfx_videoparam_encode_);
+    if (status < MFX_ERR_NONE) {
+        LOG_ERROR << "MFXVideoENCODE_Reset() failed: " << MfxStatusStr(status);
+        return false;
+    }
+
+    return true;
+}
+
+bool Encoder::ResetMfxEncoder()
+{
+    if (vpp_initialized_) {
+        auto status = MFXVideoVPP_Reset(mfx_session_, &mfx_videoparam_vpp_);
+        if (status < MFX_ERR_NONE) {
+            // Not all resolution changes can be done with a reset, so fall
+            // back to a full re-initialization.
+            LOG_DEBUG << "MFXVideoVPP_Reset() failed, re-initializing: " << MfxStatusStr(status);
+            MFXVideoVPP_Close(mfx_session_);
+            vpp_initialized_ = false;
+        }
+    }
+
+    if (!vpp_initialized_) {
+        auto status = MFXVideoVPP_Init(mfx_session_, &mfx_videoparam_vpp_);
+        if (status != MFX_ERR_NONE) {
+            LOG_ERROR << "MFXVideoVPP_Init() failed: " << MfxStatusStr(status);
+            return false;
+        }
+        vpp_initialized_ = true;
+    }
+
+    // A resolution change requires the encoder to start a new sequence with
+    // an IDR frame.
+    mfxExtEncoderResetOption reset_option = {};
+    reset_option.Header.BufferId = MFX_EXTBUFF_ENCODER_RESET_OPTION;
+    reset_option.Header.BufferSz = sizeof(reset_option);
+    reset_option.StartNewSequence = MFX_CODINGOPTION_ON;
+
+    std::vector<mfxExtBuffer*> ext_params(mfx_videoparam_encode_.ExtParam,
+                                          mfx_videoparam_encode_.ExtParam + mfx_videoparam_encode_.NumExtParam);
+    ext_params.push_back((mfxExtBuffer*)&reset_option);
+
+    auto videoparam = mfx_videoparam_encode_;
+    videoparam.ExtParam = ext_params.data();
+    videoparam.NumExtParam = ext_params.size();
+
+    auto status = MFXVideoENCODE_Reset(mfx_session_, &videoparam);
+    if (status < MFX_ERR_NONE) {
+        LOG_DEBUG << "MFXVideoENCODE_Reset() failed, re-initializing: " << MfxStatusStr(status);
+        MFXVideoENCODE_Close(mfx_session_);
+        status = MFXVideoENCODE_Init(mfx_session_, &mfx_videoparam_encode_);
+        if (status != MFX_ERR_NONE) {
+            LOG_ERROR << "MFXVideoENCODE_Init() failed: " << MfxStatusStr(status);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool Encoder::InitMfxVideoParams()
 {
     // Upload the surface data for the VPP input from system memory and put the
@@ -307,11 +474,15 @@ bool Encoder::InitMfxVideoParams()
 
     // For CBR and VCM, used to estimate the targeted frame size by dividing
     // the frame rate by the bitrate.
-    mfx_videoparam_encode_.mfx.TargetKbps = params_.bitrate_kbps;
+    auto bitrate_kbps = settings_.bitrate_kbps.load();
+    if (bitrate_kbps == 0) {
+        bitrate_kbps = params_.bitrate_kbps;
+    }
+    mfx_videoparam_encode_.mfx.TargetKbps = bitrate_kbps;
 
     // "The maximum bitrate at which the encoded data enters the Video Buffering
     // Verifier (VBV) buffer."
-    mfx_videoparam_encode_.mfx.MaxKbps = params_.bitrate_kbps;
+    mfx_videoparam_encode_.mfx.MaxKbps = bitrate_kbps;
 
     // Frame rate numerator.
     mfx_videoparam_vpp_.vpp.In.FrameRateExtN =
@@ -614,14 +785,25 @@ std::shared_ptr<VideoFrame> Encoder::EncodeCameraBuffer(const CameraBufferRef& c
         }
     }
 
+    frame->TrackMfxSurface();
+
+    // Force a keyframe, if a peer asked for one.
+    mfxEncodeCtrl ctrl = {};
+    mfxEncodeCtrl *encode_ctrl = nullptr;
+    if (params_.keyframe_request && params_.keyframe_request->exchange(false, std::memory_order_relaxed)) {
+        ctrl.FrameType = MFX_FRAMETYPE_I | MFX_FRAMETYPE_REF | MFX_FRAMETYPE_IDR;
+        encode_ctrl = &ctrl;
+    }
+
     // Issue the encoding request to the GPU.
     mfxSyncPoint syncp = {};
     auto status =
         MFXVideoENCODE_EncodeFrameAsync(mfx_session_,
-                                        nullptr,
+                                        encode_ctrl,
                                         frame->surface,
                                         &frame->bitstream,
                                         &syncp);
+    last_mfx_status_encode.store(status, std::memory_order_relaxed);
     if (status != MFX_ERR_NONE) {
         LOG_ERROR << "MFXVideoENCODE_EncodeFrameAsync() failed: " << MfxStatusStr(status);
         return nullptr;
@@ -637,6 +819,7 @@ std::shared_ptr<VideoFrame> Encoder::EncodeCameraBuffer(const CameraBufferRef& c
     bool stalled = false;
     do {
         status = MFXVideoCORE_SyncOperation(mfx_session_, syncp, 10 /* ms */);
+        last_mfx_status_encode.store(status, std::memory_order_relaxed);
         if (status == MFX_WRN_IN_EXECUTION) {
             stalled = true;
         }
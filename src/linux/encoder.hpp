@@ -38,6 +38,10 @@ namespace linux {
 extern std::atomic_size_t n_frames_encode_success;
 extern std::atomic_size_t n_frames_encode_fail;
 extern std::atomic_size_t n_frames_encode_stall;
+extern std::atomic_size_t n_frames_encode_skip;
+
+// The status of the last encode or sync call, for diagnosing stalls.
+extern std::atomic<mfxStatus> last_mfx_status_encode;
 
 struct EncoderParams {
     uint32_t bitrate_kbps;
@@ -47,6 +51,41 @@ struct EncoderParams {
 
     std::shared_ptr<VideoPacketQueue>
         outgoing_video_packet_queue = nullptr;
+
+    // Set by other threads to ask for a keyframe. The encoder clears it when
+    // it encodes the next frame as one.
+    std::shared_ptr<std::atomic_bool>
+        keyframe_request = nullptr;
+};
+
+// Encoder settings that may be changed by other threads while the encoder
+// thread is running. The encoder thread applies them between frames.
+struct EncoderSettings {
+    EncoderSettings() = default;
+
+    EncoderSettings(EncoderSettings&& src)
+    {
+        scale_percent   = src.scale_percent.load();
+        receiver_scale_percent = src.receiver_scale_percent.load();
+        fps_divisor     = src.fps_divisor.load();
+        bitrate_kbps    = src.bitrate_kbps.load();
+        changed         = src.changed.load();
+    }
+
+    // Encoder output resolution, as a percentage of the camera resolution.
+    std::atomic_uint    scale_percent   = 100;
+
+    // The largest resolution that the receivers render, as a percentage of
+    // the camera resolution. The encoder uses the smaller of the two.
+    std::atomic_uint    receiver_scale_percent = 100;
+
+    // Encode only every Nth camera frame.
+    std::atomic_uint    fps_divisor     = 1;
+
+    // Target bitrate, or 0 for EncoderParams::bitrate_kbps.
+    std::atomic_uint    bitrate_kbps    = 0;
+
+    std::atomic_bool    changed         = false;
 };
 
 class Encoder {
@@ -63,6 +102,19 @@ class Encoder {
 
         VideoCodec Codec() const { return codec_; }
 
+        // Downscale the encoder output to a percentage of the camera
+        // resolution and encode only every Nth camera frame. Used by the
+        // degradation controller when the machine is overloaded.
+        void SetDegradation(unsigned scale_percent, unsigned fps_divisor);
+
+        // Downscale the encoder output to a percentage of the camera
+        // resolution, because the receivers don't render it any larger.
+        void SetReceiverScale(unsigned scale_percent);
+
+        // Change the target bitrate. Used by the send rate control when the
+        // network can't keep up.
+        void SetBitrate(unsigned bitrate_kbps);
+
         Welford             s_encode_size_ = {};
         Welford             s_encode_time_ = {};
 
@@ -72,6 +124,9 @@ class Encoder {
             : params_(params) {};
         void RunEncoder(std::stop_token);
         bool InitMfxEncoder();
+        bool ApplySettings();
+        bool ApplyBitrate(unsigned bitrate_kbps);
+        bool ResetMfxEncoder();
         bool InitMfxVideoParams();
         bool SetMfxCodec();
         bool SetMfxCodecAV1();
@@ -90,6 +145,11 @@ class Encoder {
         VideoCodec          codec_ = VideoCodec::UNKNOWN;
         CameraFormat        camera_format_ = {};
         bool                need_vpp_scaling_ = false;
+        bool                vpp_initialized_ = false;
+
+        EncoderSettings     settings_ = {};
+        unsigned            fps_divisor_ = 1;
+        size_t              n_frames_in_ = 0;
 
         std::jthread        thread_ = {};
 
@@ -0,0 +1,420 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "linux/file_source.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <thread>
+
+#include <plog/Log.h>
+
+#include "codecs.hpp"
+#include "event.hpp"
+#include "linux/proc.hpp"
+#include "linux/video_frame.hpp"
+#include "util.hpp"
+
+using namespace std::chrono_literals;
+
+namespace vacon {
+namespace linux {
+
+std::atomic_size_t n_frames_source_success  = 0;
+std::atomic_size_t n_frames_source_stall    = 0;
+
+static uint16_t ReadLE16(const std::byte* p)
+{
+    return static_cast<uint16_t>(p[0]) | static_cast<uint16_t>(p[1]) << 8;
+}
+
+static uint32_t ReadLE32(const std::byte* p)
+{
+    return static_cast<uint32_t>(ReadLE16(p)) | static_cast<uint32_t>(ReadLE16(p + 2)) << 16;
+}
+
+static uint64_t ReadLE64(const std::byte* p)
+{
+    return static_cast<uint64_t>(ReadLE32(p)) | static_cast<uint64_t>(ReadLE32(p + 4)) << 32;
+}
+
+std::unique_ptr<FileSource> FileSource::Create(const FileSourceParams& params)
+{
+    if (!params.outgoing_video_packet_queue) {
+        LOG_ERROR << "FileSource VideoPacketQueue must be provided";
+        return nullptr;
+    }
+
+    auto src = std::make_unique<FileSource>(FileSource(params));
+    if (!src->ReadFile()) {
+        LOG_ERROR << "FileSource::ReadFile() failed";
+        return nullptr;
+    }
+
+    if (src->frames_.empty()) {
+        LOG_ERROR << "No frames found in " << params.path;
+        return nullptr;
+    }
+
+    if (src->codec_ == VideoCodec::UNKNOWN) {
+        LOG_ERROR << "Unable to determine the codec of " << params.path;
+        return nullptr;
+    }
+
+    LOG_INFO << std::format("Read {} frames of {} from {}, {} bytes, {:.3f} s per loop",
+                            src->frames_.size(),
+                            ToString(src->codec_),
+                            params.path,
+                            src->data_.size(),
+                            src->duration_ / 1'000'000.0);
+
+    return src;
+}
+
+FileSource::~FileSource()
+{
+    RequestStop();
+    Join();
+}
+
+void FileSource::StartThread()
+{
+    thread_ = std::jthread([&](std::stop_token st) { RunFileSource(st); });
+}
+
+void FileSource::RequestStop()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Requesting stop of file source thread ID " << thread_.get_id();
+        thread_.request_stop();
+    }
+}
+
+void FileSource::Join()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Joining file source thread ID " << thread_.get_id();
+        thread_.join();
+        thread_ = {};
+    }
+}
+
+bool FileSource::ReadFile()
+{
+    std::ifstream f(params_.path, std::ios::binary);
+    if (!f) {
+        LOG_ERROR << "Unable to open " << params_.path;
+        return false;
+    }
+
+    // Pipes and other streams that can't seek have no size.
+    f.seekg(0, std::ios::end);
+    auto size = f.tellg();
+    if (!f || size < 0) {
+        LOG_ERROR << "Unable to get the size of " << params_.path;
+        return false;
+    }
+    data_.resize(static_cast<size_t>(size));
+    f.seekg(0, std::ios::beg);
+    if (!f.read(reinterpret_cast<char*>(data_.data()), data_.size())) {
+        LOG_ERROR << "Unable to read " << params_.path;
+        return false;
+    }
+
+    if (data_.size() >= 4 && memcmp(data_.data(), "DKIF", 4) == 0) {
+        if (!ParseIvf()) {
+            return false;
+        }
+    } else {
+        // Raw elementary streams carry no codec information, so it has to
+        // come from the caller or the file name.
+        if (params_.codec) {
+            codec_ = *params_.codec;
+        } else {
+            auto ext = std::filesystem::path(params_.path).extension().string();
+            if (ext == ".h264" || ext == ".264" || ext == ".avc") {
+                codec_ = VideoCodec::AVC_8_420;
+            } else if (ext == ".h265" || ext == ".265" || ext == ".hevc") {
+                codec_ = VideoCodec::HEVC_8_420;
+            }
+        }
+
+        switch (codec_) {
+            case VideoCodec::AVC_8_420:
+                is_hevc_ = false;
+                break;
+            case VideoCodec::HEVC_8_420:
+            case VideoCodec::HEVC_10_420:
+                is_hevc_ = true;
+                break;
+            default:
+                LOG_ERROR << std::format("Codec {} is not supported for Annex-B files, use IVF",
+                                         ToString(codec_));
+                return false;
+        }
+
+        if (!ParseAnnexB()) {
+            return false;
+        }
+    }
+
+    // Normalize the timestamps to start at zero and compute the duration of
+    // one loop through the file, including the duration of the last frame.
+    if (!frames_.empty()) {
+        auto pts_first = frames_.front().pts;
+        for (auto& frame : frames_) {
+            frame.pts -= pts_first;
+        }
+        auto pts_last = frames_.back().pts;
+        auto interval = frames_.size() > 1 ? pts_last / (frames_.size() - 1) : 0;
+        if (interval == 0) {
+            interval = static_cast<uint64_t>(1'000'000.0 / params_.frame_rate);
+        }
+        duration_ = pts_last + interval;
+    }
+
+    return true;
+}
+
+bool FileSource::ParseIvf()
+{
+    // IVF file header, all values little-endian:
+    //
+    //  0   "DKIF"
+    //  4   version (16 bits)
+    //  6   header length in bytes (16 bits)
+    //  8   codec FourCC
+    //  12  width, height (16 bits each)
+    //  16  time base denominator (32 bits)
+    //  20  time base numerator (32 bits)
+    //  24  number of frames (32 bits)
+    //  28  unused
+    //
+    // Each frame is preceded by a 12 byte header containing the frame size
+    // (32 bits) and the timestamp in time base units (64 bits).
+    if (data_.size() < 32) {
+        LOG_ERROR << "Truncated IVF file header";
+        return false;
+    }
+
+    const auto d = data_.data();
+    auto header_length = ReadLE16(d + 6);
+    auto fourcc = std::string(reinterpret_cast<const char*>(d + 8), 4);
+    auto den = ReadLE32(d + 16);
+    auto num = ReadLE32(d + 20);
+
+    if (params_.codec) {
+        codec_ = *params_.codec;
+    } else if (fourcc == "AV01") {
+        codec_ = VideoCodec::AV1_8_420;
+    } else if (fourcc == "H264" || fourcc == "AVC1") {
+        codec_ = VideoCodec::AVC_8_420;
+    } else if (fourcc == "H265" || fourcc == "HEVC") {
+        codec_ = VideoCodec::HEVC_8_420;
+    } else {
+        LOG_ERROR << "Unhandled IVF codec FourCC " << fourcc;
+        return false;
+    }
+
+    bool use_timestamps = den > 0 && num > 0 && !params_.override_frame_rate;
+
+    size_t pos = header_length;
+    while (pos + 12 <= data_.size()) {
+        auto length = ReadLE32(d + pos);
+        auto ts = ReadLE64(d + pos + 4);
+        pos += 12;
+
+        if (pos + length > data_.size()) {
+            LOG_ERROR << std::format("Truncated IVF frame {} at offset {}, ignoring the rest of the file",
+                                     frames_.size(), pos);
+            break;
+        }
+
+        auto pts = use_timestamps
+            ? ts * 1'000'000 * num / den
+            : static_cast<uint64_t>(frames_.size() * 1'000'000.0 / params_.frame_rate);
+        frames_.emplace_back(Frame { .offset = pos, .length = length, .pts = pts });
+        pos += length;
+    }
+
+    return true;
+}
+
+bool FileSource::ParseAnnexB()
+{
+    const auto d = reinterpret_cast<const uint8_t*>(data_.data());
+    const auto n = data_.size();
+
+    size_t au_start = 0;
+    bool au_has_vcl = false;
+    bool first = true;
+
+    auto add_frame = [&](size_t end) {
+        auto pts = static_cast<uint64_t>(frames_.size() * 1'000'000.0 / params_.frame_rate);
+        frames_.emplace_back(Frame { .offset = au_start, .length = end - au_start, .pts = pts });
+    };
+
+    // Split the stream into access units at the first NAL unit of each
+    // picture, i.e. at parameter sets, SEI or access unit delimiters that
+    // follow a coded slice, or at a slice that starts a new picture.
+    for (size_t i = 0; i + 3 < n; ) {
+        if (d[i] != 0 || d[i + 1] != 0 || d[i + 2] != 1) {
+            ++i;
+            continue;
+        }
+
+        auto nal_start = (i > 0 && d[i - 1] == 0) ? i - 1 : i;
+        auto payload = i + 3;
+        i = payload;
+
+        bool is_vcl = false;
+        bool starts_au = false;
+        if (is_hevc_) {
+            if (payload + 2 >= n) {
+                break;
+            }
+            auto type = (d[payload] >> 1) & 0x3f;
+            if (type <= 31) {
+                is_vcl = true;
+                starts_au = au_has_vcl && (d[payload + 2] & 0x80);
+            } else if ((type >= 32 && type <= 35) || type == 39 || (type >= 41 && type <= 44)) {
+                starts_au = au_has_vcl;
+            }
+        } else {
+            if (payload + 1 >= n) {
+                break;
+            }
+            auto type = d[payload] & 0x1f;
+            if (type >= 1 && type <= 5) {
+                is_vcl = true;
+                starts_au = au_has_vcl && (d[payload + 1] & 0x80);
+            } else if ((type >= 6 && type <= 9) || (type >= 14 && type <= 18)) {
+                starts_au = au_has_vcl;
+            }
+        }
+
+        if (first) {
+            au_start = nal_start;
+            first = false;
+        } else if (starts_au) {
+            add_frame(nal_start);
+            au_start = nal_start;
+            au_has_vcl = false;
+        }
+        au_has_vcl |= is_vcl;
+    }
+
+    if (!first && au_has_vcl) {
+        add_frame(n);
+    }
+
+    return true;
+}
+
+void FileSource::RunFileSource(std::stop_token st)
+{
+    LOG_DEBUG << "Starting file source thread ID " << std::this_thread::get_id();
+    util::SetThreadName("VFileSource");
+
+    ThreadCpuSampler cpu_sampler;
+    cpu_sampler.Sample();
+
+    auto t_start = std::chrono::steady_clock::now();
+    auto t_last = t_start;
+    size_t n_bytes = 0;
+    size_t n_frames = 0;
+    size_t n_loops = 0;
+    size_t idx = 0;
+
+    while (!st.stop_requested()) {
+        const auto& f = frames_[idx];
+        auto pts = n_loops * duration_ + f.pts;
+
+        // Wait until the frame is due, in short steps so that stop requests
+        // are honored.
+        if (!params_.max_rate) {
+            auto t_due = t_start + std::chrono::microseconds(pts);
+            while (!st.stop_requested() && std::chrono::steady_clock::now() < t_due) {
+                std::this_thread::sleep_until(std::min(t_due, std::chrono::steady_clock::now() + 10ms));
+            }
+        }
+
+        // Sized to the frame, so that the cost of allocating and clearing
+        // the bitstream doesn't add much to the measured CPU.
+        auto frame = std::make_shared<VideoFrame>(static_cast<uint32_t>(std::max<size_t>(f.length, 1)));
+        memcpy(frame->bitstream.Data, data_.data() + f.offset, f.length);
+        frame->bitstream.DataLength = f.length;
+        frame->pts = pts;
+
+        bool queued = false;
+        while (!st.stop_requested()) {
+            if (params_.outgoing_video_packet_queue->wait_enqueue_timed(frame, 10ms)) {
+                queued = true;
+                break;
+            } else {
+                LOG_VERBOSE << "Stalled enqueuing packet onto outgoing video packet queue, retrying";
+                n_frames_source_stall.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (!queued) {
+            break;
+        }
+
+        n_frames_source_success.fetch_add(1, std::memory_order_relaxed);
+        if (n_loops == 0 && idx == 0) {
+            // The frames are encoded already, so the first one sent counts
+            // as the first encoded frame.
+            PushEvent(Event::FirstFrameEncoded);
+        }
+        n_bytes += f.length;
+        ++n_frames;
+
+        if (++idx == frames_.size()) {
+            idx = 0;
+            ++n_loops;
+        }
+
+        // Stats.
+        auto t_now = std::chrono::steady_clock::now();
+        auto t_dur = t_now - t_last;
+        if (t_dur >= 1s) {
+            auto seconds = std::chrono::duration<double>(t_dur).count();
+            auto mbps = n_bytes * 8.0 / seconds / 1'000'000.0;
+            s_send_mbps_.Update(mbps);
+
+            cpu_sampler.Sample();
+            auto cpu = cpu_sampler.ProcessCpuPercent();
+            LOG_INFO << std::format("[FileSource] Sent {} frames in {:.3f} s, {:.3f} fps, {:.2f} Mbit/s, "
+                                    "process CPU {:.1f}%, {:.2f}% per Mbit/s",
+                                    n_frames, seconds, n_frames / seconds, mbps,
+                                    cpu, mbps > 0.0 ? cpu / mbps : 0.0);
+
+            t_last = t_now;
+            n_bytes = 0;
+            n_frames = 0;
+        }
+    }
+
+    LOG_DEBUG << "Stopping file source thread ID " << std::this_thread::get_id();
+}
+
+} // namespace linux
+} // namespace vacon
@@ -0,0 +1,102 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "codecs.hpp"
+#include "linux/typedefs.hpp"
+#include "stats.hpp"
+
+namespace vacon {
+namespace linux {
+
+extern std::atomic_size_t n_frames_source_success;
+extern std::atomic_size_t n_frames_source_stall;
+
+struct FileSourceParams {
+    // Path to an IVF file or to a raw H.264/HEVC Annex-B elementary stream.
+    std::string path;
+
+    // Codec of the bitstream. If not set, the codec is derived from the IVF
+    // header or from the file name extension, assuming 8-bit 4:2:0.
+    std::optional<VideoCodec> codec = std::nullopt;
+
+    // Frame rate for Annex-B files, which carry no timing information.
+    // Ignored for IVF files unless override_frame_rate is set.
+    double frame_rate = 30.0;
+    bool override_frame_rate = false;
+
+    // Send the frames as fast as the outgoing video packet queue accepts
+    // them instead of at the frame rate of the file.
+    bool max_rate = false;
+
+    std::shared_ptr<VideoPacketQueue>
+        outgoing_video_packet_queue = nullptr;
+};
+
+// Feeds pre-encoded frames from a file into the outgoing video packet queue
+// in place of the camera and the encoder, looping at the end of the file.
+// The whole file is read into memory up front so that disk I/O doesn't
+// disturb measurements of the network stack.
+class FileSource {
+    public:
+        static std::unique_ptr<FileSource> Create(const FileSourceParams&);
+        FileSource(FileSource&&) = default;
+        ~FileSource();
+        void StartThread();
+        void RequestStop();
+        void Join();
+
+        VideoCodec Codec() const { return codec_; }
+
+        Welford             s_send_mbps_ = {};
+
+    private:
+        struct Frame {
+            size_t          offset;
+            size_t          length;
+            uint64_t        pts;
+        };
+
+        FileSource() = default;
+        FileSource(const FileSourceParams& params)
+            : params_(params) {};
+        void RunFileSource(std::stop_token);
+        bool ReadFile();
+        bool ParseIvf();
+        bool ParseAnnexB();
+
+        FileSourceParams    params_ = {};
+        VideoCodec          codec_ = VideoCodec::UNKNOWN;
+        bool                is_hevc_ = false;
+        std::vector<std::byte>
+                            data_ = {};
+        std::vector<Frame>  frames_ = {};
+        uint64_t            duration_ = 0;
+
+        std::jthread        thread_ = {};
+};
+
+} // namespace linux
+} // namespace vacon
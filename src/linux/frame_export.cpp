@@ -0,0 +1,446 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "linux/frame_export.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <plog/Log.h>
+
+#include "linux/camera.hpp"
+#include "linux/decoder.hpp"
+#include "util.hpp"
+
+namespace vacon {
+namespace linux {
+
+// Number of frames per stream that are held on to for the consumers. The
+// decoder and the camera only have a few buffers to spare.
+static const size_t kFrameExportRetained = 2;
+
+// Maximum number of consumers.
+static const size_t kFrameExportMaxClients = 8;
+
+// How often the export thread checks for a stop request.
+static const int kFrameExportPollMillis = 100;
+
+static ssize_t SendWithFds(int sock, const void* data, size_t length, const int* fds, size_t n_fds)
+{
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kFrameExportMaxObjects)] = {};
+    iovec iov = { .iov_base = const_cast<void*>(data), .iov_len = length };
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (n_fds > 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
+        auto cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n_fds);
+    }
+    return sendmsg(sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+std::unique_ptr<FrameExport> FrameExport::Create(const FrameExportParams& params)
+{
+    // The constructor is private and the object isn't movable, because of
+    // its mutex.
+    auto fe = std::unique_ptr<FrameExport>(new FrameExport(params));
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (params.path.empty() || params.path.size() >= sizeof(addr.sun_path)) {
+        LOG_ERROR << std::format("Invalid frame export socket path \"{}\"", params.path);
+        return nullptr;
+    }
+    memcpy(addr.sun_path, params.path.c_str(), params.path.size());
+
+    // Replace a stale socket from a previous run, but nothing else.
+    struct stat st = {};
+    if (lstat(params.path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            LOG_ERROR << std::format("{} exists and isn't a socket", params.path);
+            return nullptr;
+        }
+        unlink(params.path.c_str());
+    }
+
+    fe->listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fe->listen_fd_ < 0) {
+        LOG_ERROR << std::format("socket() failed: {}", strerror(errno));
+        return nullptr;
+    }
+    if (bind(fe->listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        LOG_ERROR << std::format("Unable to bind frame export socket {}: {}", params.path, strerror(errno));
+        close(fe->listen_fd_);
+        fe->listen_fd_ = -1;
+        return nullptr;
+    }
+    if (listen(fe->listen_fd_, kFrameExportMaxClients) != 0) {
+        LOG_ERROR << std::format("listen() failed: {}", strerror(errno));
+        return nullptr;
+    }
+
+    // The metadata ring lives in a sealed memfd, which the consumers map
+    // read-only.
+    fe->ring_fd_ = memfd_create("vacon-frame-export", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fe->ring_fd_ < 0) {
+        LOG_ERROR << std::format("memfd_create() failed: {}", strerror(errno));
+        return nullptr;
+    }
+    if (ftruncate(fe->ring_fd_, sizeof(FrameExportRing)) != 0) {
+        LOG_ERROR << std::format("ftruncate() failed: {}", strerror(errno));
+        return nullptr;
+    }
+    auto mem = mmap(nullptr, sizeof(FrameExportRing), PROT_READ | PROT_WRITE, MAP_SHARED, fe->ring_fd_, 0);
+    if (mem == MAP_FAILED) {
+        LOG_ERROR << std::format("mmap() failed: {}", strerror(errno));
+        return nullptr;
+    }
+    fe->ring_ = new (mem) FrameExportRing {};
+    fe->ring_->magic = kFrameExportMagic;
+    fe->ring_->version = kFrameExportVersion;
+    fe->ring_->n_slots = kFrameExportRingSlots;
+    fe->ring_->slot_size = sizeof(FrameExportSlot);
+
+    int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+#if defined(F_SEAL_FUTURE_WRITE)
+    seals |= F_SEAL_FUTURE_WRITE;
+#endif
+    if (fcntl(fe->ring_fd_, F_ADD_SEALS, seals) != 0) {
+        LOG_WARNING << std::format("Unable to seal the frame export ring: {}", strerror(errno));
+    }
+
+    LOG_INFO << std::format("Exporting video frames on {}", params.path);
+
+    return fe;
+}
+
+FrameExport::~FrameExport()
+{
+    RequestStop();
+    Join();
+    ReleaseAll();
+
+    for (auto fd : client_fds_) {
+        close(fd);
+    }
+    client_fds_.clear();
+
+    if (ring_) {
+        munmap(ring_, sizeof(FrameExportRing));
+        ring_ = nullptr;
+    }
+    if (ring_fd_ >= 0) {
+        close(ring_fd_);
+        ring_fd_ = -1;
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        unlink(params_.path.c_str());
+    }
+}
+
+void FrameExport::StartThread()
+{
+    thread_ = std::jthread([&](std::stop_token st) { RunFrameExport(st); });
+}
+
+void FrameExport::RequestStop()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Requesting stop of frame export thread ID " << thread_.get_id();
+        thread_.request_stop();
+    }
+}
+
+void FrameExport::Join()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Joining frame export thread ID " << thread_.get_id();
+        thread_.join();
+        thread_ = {};
+    }
+}
+
+void FrameExport::RunFrameExport(std::stop_token st)
+{
+    LOG_DEBUG << "Starting frame export thread ID " << std::this_thread::get_id();
+    util::SetThreadName("VFrameExport");
+
+    std::vector<pollfd> pfds;
+    while (!st.stop_requested()) {
+        // The client list is only changed by this thread, so it can be read
+        // without the lock.
+        pfds.clear();
+        pfds.push_back(pollfd { .fd = listen_fd_, .events = POLLIN, .revents = 0 });
+        for (auto fd : client_fds_) {
+            pfds.push_back(pollfd { .fd = fd, .events = POLLIN, .revents = 0 });
+        }
+
+        auto ret = poll(pfds.data(), pfds.size(), kFrameExportPollMillis);
+        if (ret < 0) {
+            if (errno != EINTR) {
+                LOG_ERROR << std::format("poll() failed: {}", strerror(errno));
+                break;
+            }
+            continue;
+        }
+
+        // Consumers aren't expected to send anything, so anything readable
+        // is a hangup or junk.
+        for (size_t i = 1; i < pfds.size(); ++i) {
+            if (pfds[i].revents & (POLLHUP | POLLERR)) {
+                CloseClient(pfds[i].fd);
+            } else if (pfds[i].revents & POLLIN) {
+                char buf[64];
+                auto n = recv(pfds[i].fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    CloseClient(pfds[i].fd);
+                }
+            }
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            AcceptClient();
+        }
+    }
+
+    LOG_DEBUG << "Stopping frame export thread ID " << std::this_thread::get_id();
+}
+
+void FrameExport::AcceptClient()
+{
+    auto fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            LOG_ERROR << std::format("accept4() failed: {}", strerror(errno));
+        }
+        return;
+    }
+
+    if (client_fds_.size() >= kFrameExportMaxClients) {
+        LOG_WARNING << "Too many frame export consumers, refusing a new one";
+        close(fd);
+        return;
+    }
+
+    FrameExportHello hello = {
+        .magic      = kFrameExportMagic,
+        .version    = kFrameExportVersion,
+        .ring_size  = sizeof(FrameExportRing),
+    };
+    if (SendWithFds(fd, &hello, sizeof(hello), &ring_fd_, 1) != sizeof(hello)) {
+        LOG_ERROR << std::format("Unable to send the frame export ring: {}", strerror(errno));
+        close(fd);
+        return;
+    }
+
+    {
+        std::lock_guard lock(clients_mutex_);
+        client_fds_.push_back(fd);
+    }
+    n_clients_.store(client_fds_.size(), std::memory_order_relaxed);
+    LOG_INFO << std::format("Frame export consumer connected ({} total)", client_fds_.size());
+}
+
+void FrameExport::CloseClient(int fd)
+{
+    {
+        std::lock_guard lock(clients_mutex_);
+        std::erase(client_fds_, fd);
+    }
+    close(fd);
+    n_clients_.store(client_fds_.size(), std::memory_order_relaxed);
+    LOG_INFO << std::format("Frame export consumer disconnected ({} left)", client_fds_.size());
+}
+
+void FrameExport::Publish(size_t peer_id, std::shared_ptr<DecodedFrame> frame)
+{
+    if (!HasClients()) {
+        ReleaseAll();
+        return;
+    }
+
+    const auto& prime = frame->prime_;
+    if (prime.num_objects == 0 || prime.num_layers == 0) {
+        return;
+    }
+
+    FrameExportDescriptor desc = {};
+    desc.stream_id      = peer_id;
+    desc.pts_us         = std::chrono::duration_cast<std::chrono::microseconds>(
+                              frame->t_decoded_.time_since_epoch()).count();
+    desc.rtp_timestamp  = frame->rtp_timestamp_;
+    desc.fourcc         = prime.fourcc;
+    desc.width          = prime.width;
+    desc.height         = prime.height;
+
+    int fds[kFrameExportMaxObjects] = {};
+    desc.num_objects = std::min(prime.num_objects, kFrameExportMaxObjects);
+    for (uint32_t i = 0; i < desc.num_objects; ++i) {
+        fds[i] = prime.objects[i].fd;
+        desc.objects[i].size        = prime.objects[i].size;
+        desc.objects[i].modifier    = prime.objects[i].drm_format_modifier;
+    }
+
+    // The surface is exported with composed layers, i.e. a single layer
+    // holding all the planes.
+    const auto& layer = prime.layers[0];
+    desc.num_planes = std::min(layer.num_planes, kFrameExportMaxPlanes);
+    for (uint32_t i = 0; i < desc.num_planes; ++i) {
+        desc.planes[i].object_index = layer.object_index[i];
+        desc.planes[i].offset       = layer.offset[i];
+        desc.planes[i].pitch        = layer.pitch[i];
+    }
+
+    PublishFrame(std::move(frame), desc, fds);
+}
+
+void FrameExport::Publish(std::shared_ptr<CameraBufferRef> cref)
+{
+    if (!HasClients()) {
+        ReleaseAll();
+        return;
+    }
+
+    const auto& buf = cref->buf_;
+    if (buf.expbuf.fd < 0) {
+        return;
+    }
+
+    FrameExportDescriptor desc = {};
+    desc.stream_id      = kFrameExportSelfView;
+    desc.pts_us         = static_cast<int64_t>(buf.PtsMicros());
+    desc.fourcc         = buf.fmt.pixelformat;
+    desc.width          = buf.fmt.width;
+    desc.height         = buf.fmt.height;
+    desc.num_objects    = 1;
+    desc.objects[0]     = { .size = buf.vbuf.length, .modifier = 0 /* DRM_FORMAT_MOD_LINEAR */ };
+    desc.num_planes     = 1;
+    desc.planes[0]      = { .object_index = 0, .offset = 0, .pitch = buf.fmt.bytesperline };
+    if (buf.fmt.pixelformat == V4L2_PIX_FMT_NV12) {
+        desc.num_planes = 2;
+        desc.planes[1]  = { .object_index = 0,
+                            .offset = buf.fmt.bytesperline * buf.fmt.height,
+                            .pitch = buf.fmt.bytesperline };
+    }
+
+    int fds[kFrameExportMaxObjects] = { buf.expbuf.fd };
+    PublishFrame(std::move(cref), desc, fds);
+}
+
+void FrameExport::PublishFrame(std::shared_ptr<const void> owner,
+                               const FrameExportDescriptor& desc, const int* fds)
+{
+    auto frame_id = next_frame_id_++;
+    auto slot_index = next_slot_;
+    next_slot_ = (next_slot_ + 1) % kFrameExportRingSlots;
+
+    auto& slot = ring_->slots[slot_index];
+    auto seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // With many streams, a slot can be reused while its frame is still
+    // retained. The odd sequence number already invalidates that frame.
+    for (auto& [_, frames] : retained_) {
+        std::erase_if(frames, [slot_index](const Retained& r) { return r.slot == slot_index; });
+    }
+
+    slot.frame_id = frame_id;
+    slot.desc = desc;
+    slot.seq.store(seq + 2, std::memory_order_release);
+    ring_->last_frame_id.store(frame_id, std::memory_order_release);
+
+    FrameExportNotify notify = {
+        .frame_id   = frame_id,
+        .slot       = slot_index,
+        .num_fds    = desc.num_objects,
+    };
+    {
+        std::lock_guard lock(clients_mutex_);
+        for (auto fd : client_fds_) {
+            if (SendWithFds(fd, &notify, sizeof(notify), fds, desc.num_objects) < 0) {
+                // A full socket buffer means that the consumer is behind, so
+                // it misses this frame. Hangups are handled by the export
+                // thread.
+                n_frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+                LOG_VERBOSE << std::format("Frame export to consumer fd {} failed: {}", fd, strerror(errno));
+            }
+        }
+    }
+    n_frames_published_.fetch_add(1, std::memory_order_relaxed);
+
+    auto& frames = retained_[desc.stream_id];
+    frames.push_back(Retained { .owner = std::move(owner), .slot = slot_index, .frame_id = frame_id });
+    while (frames.size() > kFrameExportRetained) {
+        Release(frames.front());
+        frames.pop_front();
+    }
+}
+
+void FrameExport::Release(const Retained& r)
+{
+    // Bump the sequence number, so that consumers still reading the frame
+    // know that its buffer may have been reused.
+    auto& slot = ring_->slots[r.slot];
+    if (slot.frame_id == r.frame_id) {
+        slot.seq.fetch_add(2, std::memory_order_release);
+    }
+}
+
+void FrameExport::RemoveStream(uint64_t stream_id)
+{
+    if (auto it = retained_.find(stream_id); it != retained_.end()) {
+        for (const auto& r : it->second) {
+            Release(r);
+        }
+        retained_.erase(it);
+    }
+}
+
+void FrameExport::ReleaseAll()
+{
+    for (const auto& [_, frames] : retained_) {
+        for (const auto& r : frames) {
+            Release(r);
+        }
+    }
+    retained_.clear();
+}
+
+} // namespace linux
+} // namespace vacon
@@ -0,0 +1,191 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "linux/typedefs.hpp"
+
+namespace vacon {
+namespace linux {
+
+// The frame export protocol. Consumers connect to a SOCK_SEQPACKET Unix
+// socket and first receive a FrameExportHello together with a memfd holding
+// the FrameExportRing, which they map read-only. Then, for every published
+// frame, they receive a FrameExportNotify together with one DMABUF fd per
+// buffer object of the frame. The frame's metadata is in the ring slot named
+// by the notification.
+//
+// The ring slots are written with a sequence lock: the sequence number is
+// odd while a slot is being written. A frame stays valid only while the
+// sequence number of its slot is unchanged, since the slot is also bumped
+// when the frame's buffer is handed back to the decoder or the camera. So a
+// consumer reads the sequence number, imports or copies the frame, and then
+// checks that the sequence number is still the same.
+static const uint32_t kFrameExportMagic         = 0x58465656; // "VVFX"
+static const uint32_t kFrameExportVersion       = 1;
+static const uint32_t kFrameExportRingSlots     = 16;
+static const uint32_t kFrameExportMaxObjects    = 4;
+static const uint32_t kFrameExportMaxPlanes     = 4;
+
+// Stream ID of the self-view. Remote video uses the peer ID.
+static const uint64_t kFrameExportSelfView      = 0;
+
+struct FrameExportDescriptor {
+    uint64_t    stream_id = 0;
+
+    // Capture time of self-view frames, and decode time of remote frames,
+    // in CLOCK_MONOTONIC microseconds.
+    int64_t     pts_us = 0;
+
+    // RTP timestamp of remote frames (90 kHz).
+    uint32_t    rtp_timestamp = 0;
+
+    // DRM fourcc of decoded frames, V4L2 fourcc of self-view frames.
+    uint32_t    fourcc = 0;
+    uint32_t    width = 0;
+    uint32_t    height = 0;
+
+    uint32_t    num_objects = 0;
+    struct {
+        uint32_t    size;
+        uint64_t    modifier;
+    }           objects[kFrameExportMaxObjects] = {};
+
+    uint32_t    num_planes = 0;
+    struct {
+        uint32_t    object_index;
+        uint32_t    offset;
+        uint32_t    pitch;
+    }           planes[kFrameExportMaxPlanes] = {};
+};
+
+struct FrameExportSlot {
+    std::atomic_uint64_t    seq;
+    uint64_t                frame_id;
+    FrameExportDescriptor   desc;
+};
+
+struct FrameExportRing {
+    uint32_t                magic;
+    uint32_t                version;
+    uint32_t                n_slots;
+    uint32_t                slot_size;
+
+    // ID of the most recently published frame.
+    std::atomic_uint64_t    last_frame_id;
+
+    FrameExportSlot         slots[kFrameExportRingSlots];
+};
+
+static_assert(std::atomic_uint64_t::is_always_lock_free,
+              "the ring is shared between processes and must be lock-free");
+
+struct FrameExportHello {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    ring_size;
+};
+
+struct FrameExportNotify {
+    uint64_t    frame_id;
+    uint32_t    slot;
+    uint32_t    num_fds;
+};
+
+struct FrameExportParams {
+    std::string path;
+};
+
+// Publishes decoded remote video, and optionally the self-view, to other
+// local processes without copying the frames, see the protocol above.
+//
+// The export thread only accepts and drops consumers. Publish() is called
+// on the render thread, which also releases the frames, since a decoded
+// frame may own an SDL texture. The notifications are sent with
+// non-blocking writes, and only the last kFrameExportRetained frames of each
+// stream are held on to, so that a slow consumer misses frames instead of
+// holding up the pipeline or starving the decoder and the camera.
+class FrameExport {
+    public:
+        static std::unique_ptr<FrameExport> Create(const FrameExportParams&);
+        ~FrameExport();
+        void StartThread();
+        void RequestStop();
+        void Join();
+
+        void Publish(size_t peer_id, std::shared_ptr<DecodedFrame>);
+        void Publish(std::shared_ptr<CameraBufferRef>);
+
+        // Release the frames of a stream, before its decoder or camera is
+        // destroyed.
+        void RemoveStream(uint64_t stream_id);
+
+        // Whether anyone is listening, so that callers can skip the work.
+        bool HasClients() const { return n_clients_.load(std::memory_order_relaxed) > 0; }
+
+        std::atomic_size_t  n_clients_ = 0;
+        std::atomic_size_t  n_frames_published_ = 0;
+        std::atomic_size_t  n_frames_dropped_ = 0;
+
+    private:
+        struct Retained {
+            std::shared_ptr<const void> owner;
+            uint32_t                    slot;
+            uint64_t                    frame_id;
+        };
+
+        FrameExport(const FrameExportParams& params)
+            : params_(params) {};
+        void RunFrameExport(std::stop_token);
+        void AcceptClient();
+        void CloseClient(int fd);
+        void PublishFrame(std::shared_ptr<const void> owner,
+                          const FrameExportDescriptor&, const int* fds);
+        void Release(const Retained&);
+        void ReleaseAll();
+
+        FrameExportParams   params_ = {};
+        int                 listen_fd_ = -1;
+        int                 ring_fd_ = -1;
+        FrameExportRing*    ring_ = nullptr;
+
+        // Only used by the render thread.
+        uint64_t            next_frame_id_ = 1;
+        uint32_t            next_slot_ = 0;
+        std::map<uint64_t, std::deque<Retained>>
+                            retained_ = {};
+
+        // Only closed by the export thread, and guarded by the mutex against
+        // the render thread sending to them.
+        std::mutex          clients_mutex_ = {};
+        std::vector<int>    client_fds_ = {};
+
+        std::jthread        thread_ = {};
+};
+
+} // namespace linux
+} // namespace vacon
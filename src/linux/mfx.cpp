@@ -169,5 +169,17 @@ std::string MfxStatusStr(mfxStatus status)
     return std::format("{} ({})", MfxStatusStringConstant(status), static_cast<int>(status));
 }
 
+size_t MfxSurfaceBytes(const mfxFrameInfo& info)
+{
+    size_t bits_per_pixel;
+    switch (info.FourCC) {
+    case MFX_FOURCC_NV12:   bits_per_pixel = 12; break;
+    case MFX_FOURCC_P010:   bits_per_pixel = 24; break;
+    case MFX_FOURCC_YUY2:   bits_per_pixel = 16; break;
+    default:                bits_per_pixel = 32; break;
+    }
+    return static_cast<size_t>(info.Width) * info.Height * bits_per_pixel / 8;
+}
+
 } // namespace linux
 } // namespace vacon
@@ -15,6 +15,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <tuple>
@@ -35,6 +36,10 @@ bool SetMfxLoaderConfigFiltersCombined(mfxLoader loader, mfxConfigFilters filter
 const char* MfxStatusStringConstant(mfxStatus status);
 std::string MfxStatusStr(mfxStatus status);
 
+// Approximate size of a surface's pixel data, for resource accounting. The
+// driver may pad it further.
+size_t MfxSurfaceBytes(const mfxFrameInfo& info);
+
 constexpr VideoCodec FromMfxCodecAndFormat(mfxU32 codec, mfxU32 fmt)
 {
     if (codec == MFX_CODEC_AVC) {
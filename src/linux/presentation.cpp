@@ -0,0 +1,307 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "linux/presentation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <time.h>
+
+#include <SDL3/SDL.h>
+#include <plog/Log.h>
+#include <wayland-client.h>
+
+#include "presentation-time-client-protocol.h"
+
+namespace vacon {
+namespace linux {
+
+// Bounds for the learned commit margin.
+static const auto kMinMargin = std::chrono::microseconds(500);
+static const auto kMarginStepUp = std::chrono::milliseconds(1);
+static const auto kMarginStepDown = std::chrono::microseconds(50);
+
+std::optional<PresentMode> PresentModeFromString(const std::string& s)
+{
+    if (s == "vsync") {
+        return PresentMode::Vsync;
+    } else if (s == "low-latency") {
+        return PresentMode::LowLatency;
+    } else if (s == "mailbox") {
+        return PresentMode::Mailbox;
+    } else if (s == "immediate") {
+        return PresentMode::Immediate;
+    }
+    return std::nullopt;
+}
+
+const char* ToString(PresentMode mode)
+{
+    switch (mode) {
+    case PresentMode::Vsync:        return "vsync";
+    case PresentMode::LowLatency:   return "low-latency";
+    case PresentMode::Mailbox:      return "mailbox";
+    case PresentMode::Immediate:    return "immediate";
+    }
+    return "unknown";
+}
+
+std::unique_ptr<Presentation> Presentation::Create(SDL_Window* window)
+{
+    static const wl_registry_listener registry_listener = {
+        .global         = &Presentation::OnRegistryGlobal,
+        .global_remove  = &Presentation::OnRegistryGlobalRemove,
+    };
+    static const wp_presentation_listener presentation_listener = {
+        .clock_id       = &Presentation::OnClockId,
+    };
+
+    auto props = SDL_GetWindowProperties(window);
+    auto display = static_cast<wl_display*>(SDL_GetProperty(props, SDL_PROP_WINDOW_WAYLAND_DISPLAY_POINTER, nullptr));
+    auto surface = static_cast<wl_surface*>(SDL_GetProperty(props, SDL_PROP_WINDOW_WAYLAND_SURFACE_POINTER, nullptr));
+    if (!display || !surface) {
+        LOG_INFO << "Not a Wayland window, presentation feedback is not available";
+        return nullptr;
+    }
+
+    // The constructor is private and the object isn't movable, because its
+    // address is registered with the Wayland listeners.
+    auto p = std::unique_ptr<Presentation>(new Presentation());
+    p->display_ = display;
+    p->surface_ = surface;
+
+    // Use a separate event queue, so that the feedback events are dispatched
+    // by Dispatch() rather than by SDL. SDL still reads the events from the
+    // display connection when it pumps its own events.
+    p->queue_ = wl_display_create_queue(display);
+    if (!p->queue_) {
+        LOG_ERROR << "wl_display_create_queue() failed";
+        return nullptr;
+    }
+
+    auto wrapper = static_cast<wl_display*>(wl_proxy_create_wrapper(display));
+    if (!wrapper) {
+        LOG_ERROR << "wl_proxy_create_wrapper() failed";
+        return nullptr;
+    }
+    wl_proxy_set_queue(reinterpret_cast<wl_proxy*>(wrapper), p->queue_);
+    p->registry_ = wl_display_get_registry(wrapper);
+    wl_proxy_wrapper_destroy(wrapper);
+    if (!p->registry_) {
+        LOG_ERROR << "wl_display_get_registry() failed";
+        return nullptr;
+    }
+
+    wl_registry_add_listener(p->registry_, &registry_listener, p.get());
+    if (wl_display_roundtrip_queue(display, p->queue_) < 0) {
+        LOG_ERROR << "wl_display_roundtrip_queue() failed";
+        return nullptr;
+    }
+
+    if (!p->presentation_) {
+        LOG_INFO << "Compositor doesn't support wp_presentation, presentation feedback is not available";
+        return nullptr;
+    }
+
+    // Wait for the clock ID.
+    wp_presentation_add_listener(p->presentation_, &presentation_listener, p.get());
+    if (wl_display_roundtrip_queue(display, p->queue_) < 0) {
+        LOG_ERROR << "wl_display_roundtrip_queue() failed";
+        return nullptr;
+    }
+
+    LOG_DEBUG << std::format("Using wp_presentation feedback, clock ID {}", p->clock_id_);
+
+    return p;
+}
+
+Presentation::~Presentation()
+{
+    for (auto& fb : feedback_) {
+        if (fb.feedback) {
+            wp_presentation_feedback_destroy(fb.feedback);
+        }
+    }
+    feedback_.clear();
+
+    if (presentation_) {
+        wp_presentation_destroy(presentation_);
+        presentation_ = nullptr;
+    }
+
+    if (registry_) {
+        wl_registry_destroy(registry_);
+        registry_ = nullptr;
+    }
+
+    if (queue_) {
+        wl_event_queue_destroy(queue_);
+        queue_ = nullptr;
+    }
+}
+
+void Presentation::RequestFeedback(std::optional<TimePoint> t_decoded, std::optional<TimePoint> t_target)
+{
+    static const wp_presentation_feedback_listener feedback_listener = {
+        .sync_output    = &Presentation::OnSyncOutput,
+        .presented      = &Presentation::OnPresented,
+        .discarded      = &Presentation::OnDiscarded,
+    };
+
+    auto feedback = wp_presentation_feedback(presentation_, surface_);
+    if (!feedback) {
+        LOG_ERROR << "wp_presentation_feedback() failed";
+        return;
+    }
+
+    auto& fb = feedback_.emplace_back(Feedback {
+        .self       = this,
+        .feedback   = feedback,
+        .t_decoded  = t_decoded,
+        .t_target   = t_target,
+    });
+    wp_presentation_feedback_add_listener(feedback, &feedback_listener, &fb);
+}
+
+void Presentation::Dispatch()
+{
+    if (wl_display_dispatch_queue_pending(display_, queue_) < 0) {
+        LOG_ERROR << "wl_display_dispatch_queue_pending() failed";
+    }
+}
+
+std::optional<Presentation::TimePoint> Presentation::NextVblank(TimePoint t) const
+{
+    if (!t_last_vblank_ || refresh_.count() <= 0) {
+        return std::nullopt;
+    }
+
+    if (t <= *t_last_vblank_) {
+        return t_last_vblank_;
+    }
+
+    // Round up to a whole number of refresh intervals after the last
+    // presentation.
+    auto n = (t - *t_last_vblank_ + refresh_ - std::chrono::nanoseconds(1)) / refresh_;
+    return *t_last_vblank_ + n * refresh_;
+}
+
+Presentation::TimePoint Presentation::ToSteadyClock(uint64_t sec, uint32_t nsec) const
+{
+    auto t = std::chrono::nanoseconds(sec * 1'000'000'000ull + nsec);
+    if (clock_id_ == CLOCK_MONOTONIC) {
+        // std::chrono::steady_clock is CLOCK_MONOTONIC.
+        return TimePoint(std::chrono::duration_cast<TimePoint::duration>(t));
+    }
+
+    // Map other clocks through the current offset between the two.
+    timespec ts = {};
+    clock_gettime(clock_id_, &ts);
+    auto t_now_clock = std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+    auto t_now = std::chrono::steady_clock::now();
+    return t_now - std::chrono::duration_cast<TimePoint::duration>(t_now_clock - t);
+}
+
+void Presentation::Presented(Feedback* fb, TimePoint t_presented, uint32_t refresh_ns)
+{
+    ++n_presented_;
+    t_last_vblank_ = t_presented;
+    if (refresh_ns > 0) {
+        refresh_ = std::chrono::nanoseconds(refresh_ns);
+    }
+
+    if (fb->t_decoded) {
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(t_presented - *fb->t_decoded);
+        s_decode_to_photon_.Update(latency.count());
+    }
+
+    // A commit that missed its target vertical blank means that the
+    // compositor needs it earlier than we thought. Back off quickly, and
+    // creep closer to the vertical blank again while targets are met.
+    if (fb->t_target) {
+        if (t_presented > *fb->t_target + refresh_ / 2) {
+            ++n_missed_;
+            margin_ = std::min(margin_ + kMarginStepUp, std::max(refresh_, kMarginStepUp));
+            LOG_VERBOSE << std::format("Missed target vblank by {} us, margin now {} us",
+                                       std::chrono::duration_cast<std::chrono::microseconds>(
+                                           t_presented - *fb->t_target).count(),
+                                       std::chrono::duration_cast<std::chrono::microseconds>(margin_).count());
+        } else {
+            margin_ = std::max<std::chrono::nanoseconds>(margin_ - kMarginStepDown, kMinMargin);
+        }
+    }
+}
+
+void Presentation::Finish(Feedback* fb)
+{
+    wp_presentation_feedback_destroy(fb->feedback);
+    feedback_.remove_if([fb](const Feedback& f) { return &f == fb; });
+}
+
+void Presentation::OnRegistryGlobal(void* data, wl_registry* registry, uint32_t name,
+                                    const char* interface, [[maybe_unused]] uint32_t version)
+{
+    auto self = static_cast<Presentation*>(data);
+    if (strcmp(interface, wp_presentation_interface.name) == 0) {
+        self->presentation_ =
+            static_cast<wp_presentation*>(wl_registry_bind(registry, name, &wp_presentation_interface, 1));
+    }
+}
+
+void Presentation::OnRegistryGlobalRemove([[maybe_unused]] void* data,
+                                          [[maybe_unused]] wl_registry* registry,
+                                          [[maybe_unused]] uint32_t name)
+{
+}
+
+void Presentation::OnClockId(void* data, [[maybe_unused]] wp_presentation* presentation, uint32_t clk_id)
+{
+    static_cast<Presentation*>(data)->clock_id_ = static_cast<clockid_t>(clk_id);
+}
+
+void Presentation::OnSyncOutput([[maybe_unused]] void* data,
+                                [[maybe_unused]] wp_presentation_feedback* feedback,
+                                [[maybe_unused]] wl_output* output)
+{
+}
+
+void Presentation::OnPresented(void* data, [[maybe_unused]] wp_presentation_feedback* feedback,
+                               uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec,
+                               uint32_t refresh, [[maybe_unused]] uint32_t seq_hi,
+                               [[maybe_unused]] uint32_t seq_lo, [[maybe_unused]] uint32_t flags)
+{
+    auto fb = static_cast<Feedback*>(data);
+    auto self = fb->self;
+    auto sec = (static_cast<uint64_t>(tv_sec_hi) << 32) | tv_sec_lo;
+    self->Presented(fb, self->ToSteadyClock(sec, tv_nsec), refresh);
+    self->Finish(fb);
+}
+
+void Presentation::OnDiscarded(void* data, [[maybe_unused]] wp_presentation_feedback* feedback)
+{
+    auto fb = static_cast<Feedback*>(data);
+    auto self = fb->self;
+    ++self->n_discarded_;
+    self->Finish(fb);
+}
+
+} // namespace linux
+} // namespace vacon
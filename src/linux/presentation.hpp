@@ -0,0 +1,137 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <SDL3/SDL.h>
+#include <wayland-client.h>
+
+#include "stats.hpp"
+
+struct wp_presentation;
+struct wp_presentation_feedback;
+
+namespace vacon {
+namespace linux {
+
+// How rendered frames are handed to the display.
+//
+// Vsync:       SDL_RenderPresent() waits for the vertical blank.
+// LowLatency:  vsync is off, and rendering is scheduled just before the
+//              predicted vertical blank, using the render cost and the
+//              presentation feedback.
+// Mailbox:     vsync is off, and frames are rendered as soon as they arrive.
+//              The compositor shows the newest one at the vertical blank.
+// Immediate:   like Mailbox, but the window is made fullscreen, so that it
+//              can be scanned out directly and may tear.
+enum class PresentMode {
+    Vsync,
+    LowLatency,
+    Mailbox,
+    Immediate,
+};
+
+std::optional<PresentMode> PresentModeFromString(const std::string&);
+const char* ToString(PresentMode);
+
+// Display timing from the Wayland presentation time protocol
+// (wp_presentation). Feedback is requested for every commit of the window
+// surface, and used to predict the next vertical blank and to measure when
+// a decoded frame actually reached the display. All methods must be called
+// on the render thread.
+class Presentation {
+    public:
+        typedef std::chrono::time_point<std::chrono::steady_clock> TimePoint;
+
+        // Returns nullptr if the window isn't a Wayland window, or if the
+        // compositor doesn't support wp_presentation.
+        static std::unique_ptr<Presentation> Create(SDL_Window*);
+        ~Presentation();
+
+        // Request feedback for the next commit of the window surface, i.e.
+        // for the next SDL_RenderPresent(). t_decoded is the decode time of
+        // the remote video frame, if the commit shows a new one, and
+        // t_target the vertical blank that the commit is aiming for.
+        void RequestFeedback(std::optional<TimePoint> t_decoded,
+                             std::optional<TimePoint> t_target);
+
+        // Dispatch the feedback events received since the last call.
+        void Dispatch();
+
+        // Predicted time of the first vertical blank at or after t, or
+        // std::nullopt if nothing has been presented yet.
+        std::optional<TimePoint> NextVblank(TimePoint t) const;
+
+        // How long before the vertical blank a commit must be made to be
+        // shown on it, as learned from missed targets.
+        std::chrono::nanoseconds Margin() const { return margin_; }
+
+        std::chrono::nanoseconds Refresh() const { return refresh_; }
+
+        Welford             s_decode_to_photon_ = {};
+        size_t              n_presented_ = 0;
+        size_t              n_discarded_ = 0;
+        size_t              n_missed_ = 0;
+
+    private:
+        struct Feedback {
+            Presentation*               self = nullptr;
+            wp_presentation_feedback*   feedback = nullptr;
+            std::optional<TimePoint>    t_decoded = std::nullopt;
+            std::optional<TimePoint>    t_target = std::nullopt;
+        };
+
+        Presentation() = default;
+        TimePoint ToSteadyClock(uint64_t sec, uint32_t nsec) const;
+        void Presented(Feedback*, TimePoint t_presented, uint32_t refresh_ns);
+        void Finish(Feedback*);
+
+        static void OnRegistryGlobal(void*, wl_registry*, uint32_t name, const char* interface, uint32_t version);
+        static void OnRegistryGlobalRemove(void*, wl_registry*, uint32_t name);
+        static void OnClockId(void*, wp_presentation*, uint32_t clk_id);
+        static void OnSyncOutput(void*, wp_presentation_feedback*, wl_output*);
+        static void OnPresented(void*, wp_presentation_feedback*,
+                                uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec,
+                                uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo, uint32_t flags);
+        static void OnDiscarded(void*, wp_presentation_feedback*);
+
+        wl_display*             display_ = nullptr;
+        wl_surface*             surface_ = nullptr;
+        wl_event_queue*         queue_ = nullptr;
+        wl_registry*            registry_ = nullptr;
+        wp_presentation*        presentation_ = nullptr;
+        clockid_t               clock_id_ = CLOCK_MONOTONIC;
+
+        std::list<Feedback>     feedback_ = {};
+
+        std::optional<TimePoint>
+                                t_last_vblank_ = std::nullopt;
+        std::chrono::nanoseconds
+                                refresh_ = {};
+        std::chrono::nanoseconds
+                                margin_ = std::chrono::milliseconds(1);
+};
+
+} // namespace linux
+} // namespace vacon
@@ -0,0 +1,214 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "linux/proc.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <plog/Log.h>
+
+namespace vacon {
+namespace linux {
+
+static bool ParseThreadStat(const std::string& line, ThreadStat& ts)
+{
+    // The thread name is enclosed in parentheses and may itself contain
+    // spaces or parentheses, so find the last closing parenthesis.
+    auto open = line.find('(');
+    auto close = line.rfind(')');
+    if (open == std::string::npos || close == std::string::npos || close < open) {
+        return false;
+    }
+    ts.tid = std::atoi(line.c_str());
+    ts.name = line.substr(open + 1, close - open - 1);
+
+    // Fields following the thread name, starting at field 3 ("state").
+    std::istringstream iss(line.substr(close + 1));
+    std::vector<std::string> fields{std::istream_iterator<std::string>(iss),
+                                    std::istream_iterator<std::string>()};
+    if (fields.size() < 13) {
+        return false;
+    }
+    ts.state = fields[0].empty() ? '?' : fields[0][0];
+    ts.minflt = std::strtoull(fields[7].c_str(), nullptr, 10);
+    ts.majflt = std::strtoull(fields[9].c_str(), nullptr, 10);
+    ts.utime = std::strtoull(fields[11].c_str(), nullptr, 10);
+    ts.stime = std::strtoull(fields[12].c_str(), nullptr, 10);
+
+    // The scheduling fields were added in Linux 2.5.19.
+    if (fields.size() > 38) {
+        ts.rt_priority = std::strtoul(fields[37].c_str(), nullptr, 10);
+        ts.policy = std::strtoul(fields[38].c_str(), nullptr, 10);
+    }
+
+    return true;
+}
+
+// The context switch counts are only in /proc/self/task/<tid>/status.
+static void ReadThreadStatus(const char* tid, ThreadStat& ts)
+{
+    std::ifstream f(std::format("/proc/self/task/{}/status", tid));
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.starts_with("voluntary_ctxt_switches:")) {
+            ts.nvcsw = std::strtoull(line.c_str() + line.find(':') + 1, nullptr, 10);
+        } else if (line.starts_with("nonvoluntary_ctxt_switches:")) {
+            ts.nivcsw = std::strtoull(line.c_str() + line.find(':') + 1, nullptr, 10);
+        }
+    }
+}
+
+const char* SchedPolicyName(unsigned policy)
+{
+    switch (policy) {
+    case SCHED_OTHER:   return "OTHER";
+    case SCHED_FIFO:    return "FIFO";
+    case SCHED_RR:      return "RR";
+    case SCHED_BATCH:   return "BATCH";
+    case SCHED_IDLE:    return "IDLE";
+    default:            return "?";
+    }
+}
+
+std::vector<ThreadStat> ReadThreadStats()
+{
+    std::vector<ThreadStat> stats;
+
+    auto dir = opendir("/proc/self/task");
+    if (!dir) {
+        LOG_DEBUG << std::format("opendir(/proc/self/task) failed: {} ({})", errno, strerror(errno));
+        return stats;
+    }
+
+    while (auto ent = readdir(dir)) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+
+        std::ifstream f(std::format("/proc/self/task/{}/stat", ent->d_name));
+        std::string line;
+        if (!f || !std::getline(f, line)) {
+            // The thread exited in the meantime.
+            continue;
+        }
+
+        ThreadStat ts;
+        if (ParseThreadStat(line, ts)) {
+            ReadThreadStatus(ent->d_name, ts);
+            stats.emplace_back(std::move(ts));
+        }
+    }
+
+    closedir(dir);
+
+    return stats;
+}
+
+ThreadCpuSampler::ThreadCpuSampler()
+{
+    auto ticks = sysconf(_SC_CLK_TCK);
+    if (ticks > 0) {
+        ticks_per_second_ = static_cast<double>(ticks);
+    }
+}
+
+std::vector<ThreadCpuUsage> ThreadCpuSampler::Sample()
+{
+    auto t_now = std::chrono::steady_clock::now();
+    auto stats = ReadThreadStats();
+
+    std::map<pid_t, ThreadStat> by_tid;
+    for (const auto& ts : stats) {
+        by_tid[ts.tid] = ts;
+    }
+
+    std::vector<ThreadCpuUsage> usage;
+    if (t_last_ != decltype(t_last_){}) {
+        auto seconds = std::chrono::duration<double>(t_now - t_last_).count();
+        auto per_second = [seconds](uint64_t cur, uint64_t prev) {
+            return (seconds > 0.0 && cur >= prev) ? static_cast<double>(cur - prev) / seconds : 0.0;
+        };
+        double total_ticks = 0.0;
+
+        std::map<std::string, ThreadCpuUsage> by_name;
+        for (const auto& ts : stats) {
+            // Threads that started since the last sample are accounted from
+            // zero, which slightly overestimates their first interval.
+            ThreadStat prev = {};
+            if (auto it = last_stats_.find(ts.tid); it != last_stats_.end()) {
+                prev = it->second;
+            }
+            auto cur = ts.utime + ts.stime;
+            auto prev_ticks = prev.utime + prev.stime;
+            auto delta = static_cast<double>(cur >= prev_ticks ? cur - prev_ticks : 0);
+            total_ticks += delta;
+
+            auto& u = by_name[ts.name];
+            u.name = ts.name;
+            u.n_threads += 1;
+            u.cpu_percent += (seconds > 0.0) ? 100.0 * delta / ticks_per_second_ / seconds : 0.0;
+            u.vcsw_per_s += per_second(ts.nvcsw, prev.nvcsw);
+            u.ivcsw_per_s += per_second(ts.nivcsw, prev.nivcsw);
+            u.minflt_per_s += per_second(ts.minflt, prev.minflt);
+            u.majflt_per_s += per_second(ts.majflt, prev.majflt);
+            if (u.n_threads == 1 || ts.rt_priority > u.rt_priority) {
+                u.policy = ts.policy;
+                u.rt_priority = ts.rt_priority;
+            }
+        }
+
+        for (auto& [_, u] : by_name) {
+            usage.emplace_back(std::move(u));
+        }
+        std::sort(usage.begin(), usage.end(),
+                  [](const ThreadCpuUsage& a, const ThreadCpuUsage& b) { return a.cpu_percent > b.cpu_percent; });
+
+        process_cpu_percent_ = (seconds > 0.0) ? 100.0 * total_ticks / ticks_per_second_ / seconds : 0.0;
+    }
+
+    last_stats_ = std::move(by_tid);
+    t_last_ = t_now;
+    last_usage_ = usage;
+
+    return usage;
+}
+
+double ThreadCpuSampler::CpuPercent(const std::string& name) const
+{
+    for (const auto& u : last_usage_) {
+        if (u.name == name) {
+            return u.cpu_percent;
+        }
+    }
+    return 0.0;
+}
+
+} // namespace linux
+} // namespace vacon
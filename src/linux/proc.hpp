@@ -0,0 +1,100 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace vacon {
+namespace linux {
+
+// The subset of the fields in /proc/self/task/<tid>/stat and status that
+// are of interest. CPU times are in clock ticks.
+struct ThreadStat {
+    pid_t           tid     = 0;
+    std::string     name    = {};
+    char            state   = '?';
+    uint64_t        minflt  = 0;
+    uint64_t        majflt  = 0;
+    uint64_t        utime   = 0;
+    uint64_t        stime   = 0;
+    unsigned        rt_priority = 0;
+    unsigned        policy  = 0;
+    uint64_t        nvcsw   = 0;
+    uint64_t        nivcsw  = 0;
+};
+
+std::vector<ThreadStat> ReadThreadStats();
+
+// Name of a scheduling policy, e.g. "FIFO" for SCHED_FIFO.
+const char* SchedPolicyName(unsigned policy);
+
+// CPU usage of a thread, or of all the threads sharing the same name, over
+// the interval between two calls to ThreadCpuSampler::Sample(). Usage is in
+// percent of a single CPU, so a busy group of threads can exceed 100%. The
+// context switches and page faults are per second. Voluntary context
+// switches are waits, e.g. for a queue or the GPU, while involuntary ones
+// are preemptions by other threads.
+struct ThreadCpuUsage {
+    std::string     name        = {};
+    unsigned        n_threads   = 0;
+    double          cpu_percent = 0.0;
+    double          vcsw_per_s  = 0.0;
+    double          ivcsw_per_s = 0.0;
+    double          minflt_per_s = 0.0;
+    double          majflt_per_s = 0.0;
+
+    // Scheduling policy and real-time priority of the group's threads, or
+    // of its highest priority thread if they differ.
+    unsigned        policy      = 0;
+    unsigned        rt_priority = 0;
+};
+
+class ThreadCpuSampler {
+    public:
+        ThreadCpuSampler();
+
+        // Read the per-thread CPU times and compute the CPU usage of each
+        // thread name since the previous call. The first call only primes
+        // the sampler and returns an empty vector.
+        std::vector<ThreadCpuUsage> Sample();
+
+        // Total CPU usage of the process over the last sampling interval.
+        double ProcessCpuPercent() const { return process_cpu_percent_; }
+
+        // CPU usage of the named thread group over the last sampling
+        // interval, or 0 if there is no such thread.
+        double CpuPercent(const std::string& name) const;
+
+        // The usage of every thread group over the last sampling interval,
+        // busiest first.
+        const std::vector<ThreadCpuUsage>& LastUsage() const { return last_usage_; }
+
+    private:
+        double                                              ticks_per_second_ = 100.0;
+        std::map<pid_t, ThreadStat>                         last_stats_ = {};
+        std::chrono::time_point<std::chrono::steady_clock>  t_last_ = {};
+        std::vector<ThreadCpuUsage>                         last_usage_ = {};
+        double                                              process_cpu_percent_ = 0.0;
+};
+
+} // namespace linux
+} // namespace vacon
@@ -0,0 +1,482 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "linux/recorder.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <optional>
+#include <span>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <plog/Log.h>
+
+#include "codecs.hpp"
+#include "rtp/av1_payload.hpp"
+#include "util.hpp"
+
+using namespace std::chrono_literals;
+
+namespace vacon {
+namespace linux {
+
+// Size of each write buffer. Writes are issued in multiples of this size,
+// except for the final one.
+static const size_t kRecorderBufferSize = 4 * 1024 * 1024;
+static const size_t kRecorderBufferAlignment = 4096;
+
+static void PutLE16(std::byte* p, uint16_t v)
+{
+    p[0] = static_cast<std::byte>(v);
+    p[1] = static_cast<std::byte>(v >> 8);
+}
+
+static void PutLE32(std::byte* p, uint32_t v)
+{
+    PutLE16(p, static_cast<uint16_t>(v));
+    PutLE16(p + 2, static_cast<uint16_t>(v >> 16));
+}
+
+static void PutLE64(std::byte* p, uint64_t v)
+{
+    PutLE32(p, static_cast<uint32_t>(v));
+    PutLE32(p + 4, static_cast<uint32_t>(v >> 32));
+}
+
+namespace {
+
+// Reads the fixed-width fields of an AV1 header, most significant bit first.
+// Reading past the end yields zeros and sets the overrun flag.
+class BitReader {
+    public:
+        BitReader(std::span<const std::byte> data) : data_(data) {};
+
+        uint32_t Read(unsigned n)
+        {
+            uint32_t value = 0;
+            for (unsigned i = 0; i < n; ++i, ++pos_) {
+                if (pos_ / 8 >= data_.size()) {
+                    overrun_ = true;
+                    value <<= 1;
+                    continue;
+                }
+                auto byte = std::to_integer<uint8_t>(data_[pos_ / 8]);
+                value = (value << 1) | ((byte >> (7 - pos_ % 8)) & 1);
+            }
+            return value;
+        }
+
+        bool Overrun() const { return overrun_; }
+
+    private:
+        std::span<const std::byte>  data_;
+        size_t                      pos_ = 0;
+        bool                        overrun_ = false;
+};
+
+} // namespace
+
+// Returns the maximum frame size from the sequence header OBU of an AV1
+// temporal unit, if it has one (AV1 spec, section 5.5.1).
+static std::optional<std::pair<unsigned, unsigned>> Av1MaxFrameSize(std::span<const std::byte> data)
+{
+    while (!data.empty()) {
+        auto header = std::to_integer<uint8_t>(data[0]);
+        size_t header_size = (header & kAv1ObuExtensionFlag) ? 2 : 1;
+        if (data.size() < header_size) {
+            return std::nullopt;
+        }
+        auto payload_size = data.size() - header_size;
+        if (header & kAv1ObuHasSizeField) {
+            auto leb = ReadLeb128(data.subspan(header_size));
+            if (!leb || leb->first > data.size() - header_size - leb->second) {
+                return std::nullopt;
+            }
+            header_size += leb->second;
+            payload_size = leb->first;
+        }
+        auto payload = data.subspan(header_size, payload_size);
+        data = data.subspan(header_size + payload_size);
+
+        if (Av1ObuType(std::byte(header)) != kAv1ObuSequenceHeader) {
+            continue;
+        }
+
+        BitReader br(payload);
+        br.Read(3);                                     // seq_profile
+        br.Read(1);                                     // still_picture
+        if (br.Read(1)) {                               // reduced_still_picture_header
+            br.Read(5);                                 // seq_level_idx[0]
+        } else {
+            bool decoder_model_info_present = false;
+            unsigned buffer_delay_length = 0;
+            if (br.Read(1)) {                           // timing_info_present_flag
+                br.Read(32);                            // num_units_in_display_tick
+                br.Read(32);                            // time_scale
+                if (br.Read(1)) {                       // equal_picture_interval
+                    // num_ticks_per_picture_minus_1, uvlc().
+                    unsigned leading_zeros = 0;
+                    while (!br.Overrun() && !br.Read(1)) {
+                        ++leading_zeros;
+                    }
+                    if (leading_zeros >= 32) {
+                        return std::nullopt;
+                    }
+                    br.Read(leading_zeros);
+                }
+                decoder_model_info_present = br.Read(1);
+                if (decoder_model_info_present) {
+                    buffer_delay_length = br.Read(5) + 1;
+                    br.Read(32);                        // num_units_in_decoding_tick
+                    br.Read(5);                         // buffer_removal_time_length_minus_1
+                    br.Read(5);                         // frame_presentation_time_length_minus_1
+                }
+            }
+            bool initial_display_delay_present = br.Read(1);
+            auto n_operating_points = br.Read(5) + 1;
+            for (unsigned i = 0; i < n_operating_points; ++i) {
+                br.Read(12);                            // operating_point_idc
+                if (br.Read(5) > 7) {                   // seq_level_idx
+                    br.Read(1);                         // seq_tier
+                }
+                if (decoder_model_info_present && br.Read(1)) {
+                    br.Read(buffer_delay_length);       // decoder_buffer_delay
+                    br.Read(buffer_delay_length);       // encoder_buffer_delay
+                    br.Read(1);                         // low_delay_mode_flag
+                }
+                if (initial_display_delay_present && br.Read(1)) {
+                    br.Read(4);                         // initial_display_delay_minus_1
+                }
+            }
+        }
+        auto width_bits = br.Read(4) + 1;
+        auto height_bits = br.Read(4) + 1;
+        auto width = br.Read(width_bits) + 1;
+        auto height = br.Read(height_bits) + 1;
+        if (br.Overrun()) {
+            return std::nullopt;
+        }
+        return std::make_pair(width, height);
+    }
+    return std::nullopt;
+}
+
+std::unique_ptr<Recorder> Recorder::Create(const RecorderParams& params)
+{
+    // The constructor is private and the recorder isn't movable, because of
+    // its atomic counters.
+    auto rec = std::unique_ptr<Recorder>(new Recorder(params));
+
+    rec->fd_ = open(params.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (rec->fd_ < 0) {
+        LOG_ERROR << std::format("Unable to open {} recording {}: {}",
+                                 params.name, params.path, strerror(errno));
+        return nullptr;
+    }
+
+    for (auto& buf : rec->buffers_) {
+        buf.reset(static_cast<std::byte*>(aligned_alloc(kRecorderBufferAlignment, kRecorderBufferSize)));
+        if (!buf) {
+            LOG_ERROR << "aligned_alloc() failed";
+            return nullptr;
+        }
+    }
+
+#if defined(HAVE_LIBURING)
+    rec->ring_ = std::make_unique<io_uring>();
+    auto ret = io_uring_queue_init(4, rec->ring_.get(), 0);
+    if (ret < 0) {
+        LOG_DEBUG << std::format("io_uring_queue_init() failed, using write(): {}", strerror(-ret));
+        rec->ring_ = nullptr;
+    }
+#endif
+
+    LOG_INFO << std::format("Recording {} video to {}", params.name, params.path);
+
+    return rec;
+}
+
+Recorder::~Recorder()
+{
+    RequestStop();
+    Join();
+    Close();
+
+#if defined(HAVE_LIBURING)
+    if (ring_) {
+        io_uring_queue_exit(ring_.get());
+    }
+#endif
+}
+
+void Recorder::StartThread(VideoCodec codec)
+{
+    codec_ = codec;
+    thread_ = std::jthread([&](std::stop_token st) { RunRecorder(st); });
+}
+
+void Recorder::RequestStop()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Requesting stop of recorder thread ID " << thread_.get_id();
+        thread_.request_stop();
+    }
+}
+
+void Recorder::Join()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Joining recorder thread ID " << thread_.get_id();
+        thread_.join();
+        thread_ = {};
+    }
+}
+
+void Recorder::Record(std::shared_ptr<VideoFrame> frame)
+{
+    auto data = frame->CompressedData();
+    auto length = frame->CompressedDataLength();
+    auto pts = frame->pts;
+    Enqueue(Item { .owner = std::move(frame), .data = data, .length = length, .pts = pts });
+}
+
+void Recorder::Record(std::shared_ptr<RtcPacket> packet)
+{
+    // Extend the 32-bit RTP timestamp so that it survives wraparound.
+    auto ts = packet->frame_info_.timestamp;
+    if (n_frames_recorded_ + n_frames_dropped_ == 0) {
+        rtp_timestamp_ext_ = ts;
+    } else {
+        rtp_timestamp_ext_ += static_cast<int32_t>(ts - last_rtp_timestamp_);
+    }
+    last_rtp_timestamp_ = ts;
+
+    auto data = packet->msg_.data();
+    auto length = packet->msg_.size();
+    auto pts = rtp_timestamp_ext_ * 100 / 9;
+    Enqueue(Item { .owner = std::move(packet), .data = data, .length = length, .pts = pts });
+}
+
+void Recorder::Enqueue(Item&& item)
+{
+    if (queue_->try_enqueue(std::move(item))) {
+        n_frames_recorded_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        n_frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+        LOG_VERBOSE << std::format("Recorder queue for {} video is full, dropping frame", params_.name);
+    }
+}
+
+void Recorder::RunRecorder(std::stop_token st)
+{
+    LOG_DEBUG << "Starting recorder thread ID " << std::this_thread::get_id();
+    util::SetThreadName("VRecorder");
+
+    ivf_ = codec_ == VideoCodec::AV1_8_420 || codec_ == VideoCodec::AV1_10_420;
+    if (ivf_) {
+        // IVF file header. The frame size and count are filled in when the
+        // file is closed. Timestamps are in microseconds.
+        std::byte header[32] = {};
+        memcpy(header, "DKIF", 4);
+        PutLE16(header + 4, 0);
+        PutLE16(header + 6, sizeof(header));
+        memcpy(header + 8, "AV01", 4);
+        PutLE32(header + 16, 1'000'000);
+        PutLE32(header + 20, 1);
+        Append(header, sizeof(header));
+    }
+
+    // Keep draining the queue after a stop request so that the frames that
+    // were already handed to the recorder end up in the file.
+    Item item;
+    while (!st.stop_requested() || queue_->size_approx() > 0) {
+        if (queue_->wait_dequeue_timed(item, 100ms)) {
+            WriteItem(item);
+            item = {};
+        }
+    }
+
+    LOG_DEBUG << "Stopping recorder thread ID " << std::this_thread::get_id();
+}
+
+void Recorder::WriteItem(const Item& item)
+{
+    if (failed_) {
+        return;
+    }
+
+    if (n_frames_written_++ == 0) {
+        first_pts_ = item.pts;
+    }
+
+    if (ivf_) {
+        // The frame size in the file header is the maximum one of the
+        // first sequence header.
+        if (frame_width_ == 0) {
+            if (auto size = Av1MaxFrameSize(std::span(item.data, item.length))) {
+                std::tie(frame_width_, frame_height_) = *size;
+            }
+        }
+
+        std::byte header[12];
+        PutLE32(header, static_cast<uint32_t>(item.length));
+        PutLE64(header + 4, item.pts - first_pts_);
+        Append(header, sizeof(header));
+    }
+
+    Append(item.data, item.length);
+}
+
+void Recorder::Append(const void* data, size_t length)
+{
+    auto src = static_cast<const std::byte*>(data);
+    while (length > 0 && !failed_) {
+        auto n = std::min(length, kRecorderBufferSize - fill_length_);
+        memcpy(buffers_[fill_idx_].get() + fill_length_, src, n);
+        fill_length_ += n;
+        src += n;
+        length -= n;
+
+        if (fill_length_ == kRecorderBufferSize && !Flush()) {
+            failed_ = true;
+        }
+    }
+}
+
+bool Recorder::Flush()
+{
+    if (fill_length_ == 0) {
+        return true;
+    }
+
+#if defined(HAVE_LIBURING)
+    if (ring_) {
+        // Wait for the write of the other buffer, then submit this buffer
+        // and switch to the other one.
+        if (!WaitForWrite()) {
+            return false;
+        }
+
+        auto sqe = io_uring_get_sqe(ring_.get());
+        if (!sqe) {
+            LOG_ERROR << "io_uring_get_sqe() failed";
+            return false;
+        }
+        io_uring_prep_write(sqe, fd_, buffers_[fill_idx_].get(), fill_length_, file_offset_);
+        auto ret = io_uring_submit(ring_.get());
+        if (ret < 0) {
+            LOG_ERROR << "io_uring_submit() failed: " << strerror(-ret);
+            return false;
+        }
+
+        write_in_flight_ = true;
+        write_in_flight_length_ = fill_length_;
+        file_offset_ += fill_length_;
+        fill_idx_ ^= 1;
+        fill_length_ = 0;
+        return true;
+    }
+#endif
+
+    auto p = buffers_[fill_idx_].get();
+    auto remaining = fill_length_;
+    while (remaining > 0) {
+        auto ret = pwrite(fd_, p, remaining, file_offset_);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR << std::format("Writing {} recording failed: {}", params_.name, strerror(errno));
+            return false;
+        }
+        p += ret;
+        remaining -= ret;
+        file_offset_ += ret;
+    }
+    fill_length_ = 0;
+
+    return true;
+}
+
+bool Recorder::WaitForWrite()
+{
+#if defined(HAVE_LIBURING)
+    if (ring_ && write_in_flight_) {
+        write_in_flight_ = false;
+
+        io_uring_cqe *cqe = nullptr;
+        auto ret = io_uring_wait_cqe(ring_.get(), &cqe);
+        if (ret < 0) {
+            LOG_ERROR << "io_uring_wait_cqe() failed: " << strerror(-ret);
+            return false;
+        }
+        auto res = cqe->res;
+        io_uring_cqe_seen(ring_.get(), cqe);
+
+        if (res < 0 || static_cast<size_t>(res) != write_in_flight_length_) {
+            LOG_ERROR << std::format("Writing {} recording failed: {}",
+                                     params_.name, res < 0 ? strerror(-res) : "short write");
+            return false;
+        }
+    }
+#endif
+
+    return true;
+}
+
+void Recorder::Close()
+{
+    if (fd_ < 0) {
+        return;
+    }
+
+    if (!failed_) {
+        failed_ = !Flush() || !WaitForWrite();
+    }
+
+    // Fill in the frame size and the number of frames in the IVF file
+    // header.
+    if (ivf_ && !failed_) {
+        std::byte size[4];
+        PutLE16(size, static_cast<uint16_t>(frame_width_));
+        PutLE16(size + 2, static_cast<uint16_t>(frame_height_));
+        std::byte count[4];
+        PutLE32(count, static_cast<uint32_t>(n_frames_written_));
+        if (pwrite(fd_, size, sizeof(size), 12) != sizeof(size) ||
+            pwrite(fd_, count, sizeof(count), 24) != sizeof(count)) {
+            LOG_ERROR << std::format("Unable to update {} recording IVF header: {}",
+                                     params_.name, strerror(errno));
+        }
+    }
+
+    close(fd_);
+    fd_ = -1;
+
+    LOG_INFO << std::format("Recorded {} {} video frames, {} bytes, to {} ({} dropped)",
+                            n_frames_written_, params_.name, file_offset_, params_.path,
+                            n_frames_dropped_.load(std::memory_order_relaxed));
+}
+
+} // namespace linux
+} // namespace vacon
@@ -0,0 +1,127 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+
+#if defined(HAVE_LIBURING)
+#include <liburing.h>
+#endif
+
+#include <readerwritercircularbuffer.h>
+
+#include "codecs.hpp"
+#include "linux/video_frame.hpp"
+#include "rtc_packet.hpp"
+
+namespace vacon {
+namespace linux {
+
+struct RecorderParams {
+    std::string path;
+
+    // Name used in log messages, e.g. "outgoing" or "incoming".
+    std::string name;
+};
+
+// Writes compressed frames to an IVF file (AV1) or to a raw Annex-B
+// elementary stream (AVC, HEVC) without re-encoding.
+//
+// The frames are not copied: Record() only takes a reference on the frame
+// and hands it to the writer thread, which batches the frame data into
+// large aligned buffers. When the writer thread falls behind, frames are
+// dropped rather than blocking the caller, so recording never adds latency
+// to the live pipeline.
+class Recorder {
+    public:
+        static std::unique_ptr<Recorder> Create(const RecorderParams&);
+        ~Recorder();
+        void StartThread(VideoCodec);
+        void RequestStop();
+        void Join();
+
+        // Queue an outgoing encoded frame. The frame pts is in microseconds.
+        void Record(std::shared_ptr<VideoFrame>);
+
+        // Queue an incoming reassembled frame. The RTP timestamp is assumed
+        // to use the 90 kHz video clock.
+        void Record(std::shared_ptr<RtcPacket>);
+
+        std::atomic_size_t  n_frames_recorded_ = 0;
+        std::atomic_size_t  n_frames_dropped_ = 0;
+
+    private:
+        struct Item {
+            std::shared_ptr<const void> owner;
+            const std::byte*            data;
+            size_t                      length;
+            uint64_t                    pts;
+        };
+
+        typedef moodycamel::BlockingReaderWriterCircularBuffer<Item>
+            ItemQueue;
+
+        Recorder(const RecorderParams& params)
+            : params_(params) {};
+        void Enqueue(Item&&);
+        void RunRecorder(std::stop_token);
+        void WriteItem(const Item&);
+        void Append(const void*, size_t);
+        bool Flush();
+        bool WaitForWrite();
+        void Close();
+
+        RecorderParams      params_ = {};
+        VideoCodec          codec_ = VideoCodec::UNKNOWN;
+        bool                ivf_ = false;
+        int                 fd_ = -1;
+        bool                failed_ = false;
+
+        std::unique_ptr<ItemQueue>
+                            queue_ = std::make_unique<ItemQueue>(256);
+
+        // Double buffering: one buffer is filled by the writer thread while
+        // the other one may be in flight.
+        std::unique_ptr<std::byte, decltype(&free)>
+                            buffers_[2] = { { nullptr, free }, { nullptr, free } };
+        size_t              fill_idx_ = 0;
+        size_t              fill_length_ = 0;
+        uint64_t            file_offset_ = 0;
+        uint64_t            first_pts_ = 0;
+        uint32_t            last_rtp_timestamp_ = 0;
+        uint64_t            rtp_timestamp_ext_ = 0;
+        size_t              n_frames_written_ = 0;
+        unsigned            frame_width_ = 0;
+        unsigned            frame_height_ = 0;
+
+#if defined(HAVE_LIBURING)
+        std::unique_ptr<io_uring>
+                            ring_ = nullptr;
+        bool                write_in_flight_ = false;
+        size_t              write_in_flight_length_ = 0;
+#endif
+
+        std::jthread        thread_ = {};
+};
+
+} // namespace linux
+} // namespace vacon
@@ -19,9 +19,13 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <utility>
 
 #include <mfx.h>
 
+#include "linux/mfx.hpp"
+#include "resources.hpp"
+
 namespace vacon {
 namespace linux {
 
@@ -30,17 +34,23 @@ struct VideoFrame {
     mfxBitstream bitstream = {};
     mfxFrameSurface1 *surface = nullptr;
 
+    ResourceLease bitstream_lease = {};
+    ResourceLease surface_lease = {};
+
     VideoFrame(uint32_t max_length = 262144)
     {
         bitstream.MaxLength = (mfxU32)max_length;
         bitstream.Data = (mfxU8*)calloc(bitstream.MaxLength, 1);
         assert(bitstream.Data);
+        bitstream_lease = ResourceLease(Resource::Bitstream, bitstream.MaxLength);
     }
 
     VideoFrame(VideoFrame&& src)
     {
         bitstream           = src.bitstream;
         surface             = src.surface;
+        bitstream_lease     = std::move(src.bitstream_lease);
+        surface_lease       = std::move(src.surface_lease);
 
         src.bitstream       = {};
         src.surface         = nullptr;
@@ -64,6 +74,15 @@ struct VideoFrame {
             surface->FrameInterface->Release(surface);
             surface = nullptr;
         }
+        surface_lease.Reset();
+    }
+
+    // Account for the surface, once one has been assigned.
+    void TrackMfxSurface()
+    {
+        if (surface) {
+            surface_lease = ResourceLease(Resource::VplSurface, MfxSurfaceBytes(surface->Info));
+        }
     }
 
     const std::byte* CompressedData()
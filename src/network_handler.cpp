@@ -32,10 +32,13 @@
 #include "app.hpp"
 #include "codecs.hpp"
 #include "event.hpp"
+#include "linux/video_frame.hpp"
 #include "rtc_packet.hpp"
 #include "rtc_utils.hpp"
-#include "rtp/generic_depacketizer.hpp"
 #include "rtp/generic_packetizer.hpp"
+#include "rtp/payload_format.hpp"
+#include "rtp/probe.hpp"
+#include "rtp/rtcp_sr.hpp"
 #include "util.hpp"
 
 using namespace std::chrono_literals;
@@ -46,6 +49,22 @@ namespace vacon {
 
 static const rtc::SSRC kFixedSsrc = 42;
 
+static const char* kControlChannelLabel = "control";
+
+// The transport doesn't buffer media: it drops the packets that it can't
+// send right away. After a drop, frames are skipped for a while, so that the
+// link can drain rather than drop parts of every frame.
+static const auto kSendFailBackoff = 100ms;
+
+// The bandwidth probe sends a few bursts of back-to-back packets of the
+// largest size, and the receiver measures how fast each burst arrives.
+static const uint8_t kProbeBursts = 5;
+static const uint8_t kProbePacketsPerBurst = 10;
+static const auto kProbeBurstInterval = 30ms;
+
+// How long the probe waits for the outgoing video track to open.
+static const auto kProbeStartTimeout = 5s;
+
 std::unique_ptr<NetworkHandler> NetworkHandler::Create(const NetworkHandlerParams& params)
 {
     if (!params.invite) {
@@ -53,16 +72,11 @@ std::unique_ptr<NetworkHandler> NetworkHandler::Create(const NetworkHandlerParam
         return nullptr;
     }
 
-    if (!params.incoming_video_packet_queue) {
+    if (!params.incoming_video_packet_queue && !params.sfu_router) {
         LOG_ERROR << "NetworkHandlerParams.incoming_video_packet_queue must be set";
         return nullptr;
     }
 
-    if (!params.outgoing_video_packet_queue) {
-        LOG_ERROR << "NetworkHandlerParams.outgoing_video_packet_queue must be set";
-        return nullptr;
-    }
-
     if (!params.decoder_codecs || params.decoder_codecs->empty()) {
         LOG_ERROR << "NetworkHandlerParams.decoder_codecs must be set and support at least one codec";
         return nullptr;
@@ -73,16 +87,45 @@ std::unique_ptr<NetworkHandler> NetworkHandler::Create(const NetworkHandlerParam
         return nullptr;
     }
 
-    auto nh = std::make_unique<NetworkHandler>(NetworkHandler {});
+    // The constructor is private and the object isn't movable, because of
+    // its mutex.
+    auto nh = std::unique_ptr<NetworkHandler>(new NetworkHandler());
     nh->params_ = params;
     nh->config_.iceServers.emplace_back(nh->params_.stun_server);
+    nh->config_.portRangeBegin = params.transport.port_range_begin;
+    nh->config_.portRangeEnd = params.transport.port_range_end;
+    nh->config_.bindAddress = params.transport.bind_address;
+    if (params.transport.mtu) {
+        nh->config_.mtu = params.transport.mtu;
+    }
 
     return nh;
 }
 
 NetworkHandler::~NetworkHandler()
 {
+    if (params_.sfu_router) {
+        params_.sfu_router->RemoveParticipant(params_.peer_id);
+    }
+
+    std::jthread probe_thread;
+    {
+        std::lock_guard lock(control_mutex_);
+        if (control_) {
+            control_->resetCallbacks();
+            control_ = nullptr;
+        }
+        probe_started_ = true;
+        probe_thread = std::move(probe_thread_);
+    }
+    if (probe_thread.joinable()) {
+        probe_thread.request_stop();
+        probe_thread.join();
+    }
+
+    RequestStop();
     if (threads_.size() == 0) {
+        ClosePeerConnection();
         return;
     }
 
@@ -102,14 +145,37 @@ NetworkHandler::~NetworkHandler()
     }
 
     threads_.clear();
-    peer_ = nullptr;
-    track_recv_ = nullptr;
-    track_send_ = nullptr;
+    ClosePeerConnection();
+}
+
+void NetworkHandler::RequestStop()
+{
+    stop_requested_.store(true, std::memory_order_relaxed);
 }
 
-void NetworkHandler::StartDrainThread()
+void NetworkHandler::ClosePeerConnection()
 {
-    threads_.emplace_back(std::jthread { [&](std::stop_token st) { RunOutgoingDrain(st); } });
+    // The callbacks capture this, and libdatachannel may still call them
+    // from its threads, so remove them before closing the connection.
+    if (ws_) {
+        ws_->resetCallbacks();
+    }
+    if (track_recv_) {
+        track_recv_->onFrame(nullptr);
+        track_recv_->resetCallbacks();
+    }
+    if (track_audio_recv_) {
+        track_audio_recv_->resetCallbacks();
+    }
+    if (peer_) {
+        peer_->resetCallbacks();
+        peer_->close();
+    }
+    peer_ = nullptr;
+    track_recv_ = nullptr;
+    track_send_ = nullptr;
+    track_audio_recv_ = nullptr;
+    track_audio_send_ = nullptr;
 }
 
 void NetworkHandler::StartConnectThread()
@@ -127,7 +193,7 @@ void NetworkHandler::RunConnect(std::stop_token st)
     LOG_DEBUG << "Starting WebRTC connection thread ID " << std::this_thread::get_id();
     util::SetThreadName("VWebRtcConnect");
 
-    PushEvent(Event::NetworkStarting);
+    PushEvent(Event::NetworkStarting, params_.peer_id);
 
     // Start connecting to the signaling server and the WebRTC peer.
     ConnectWebRTC();
@@ -139,7 +205,10 @@ void NetworkHandler::RunConnect(std::stop_token st)
 
     if (IsConnectedToPeer() && !vacon::gShuttingDown) {
         LOG_FATAL << "PEER-TO-PEER CONNECTION IS READY !!!";
-        PushEvent(Event::NetworkStarted);
+        PushEvent(Event::NetworkStarted, params_.peer_id, NegotiatedCodecs {
+            .encoder    = WantedEncoder(),
+            .decoder    = WantedDecoder(),
+        });
     }
 
     // WebRTC peer connection is up, or we are shutting down, so close the
@@ -149,38 +218,60 @@ void NetworkHandler::RunConnect(std::stop_token st)
     LOG_DEBUG << "Stopping WebRTC connection thread ID " << std::this_thread::get_id();
 }
 
-void NetworkHandler::RunOutgoingDrain(std::stop_token st)
+void NetworkHandler::SendVideoFrame(const std::shared_ptr<linux::VideoFrame>& frame)
 {
-    LOG_DEBUG << "Starting outgoing video packet queue drain thread ID " << std::this_thread::get_id();
-    util::SetThreadName("VOutVideo");
-
-    while (!st.stop_requested()) {
-        auto t_now = std::chrono::steady_clock::now();
-
-        std::shared_ptr<linux::VideoFrame> frame;
-        if (params_.outgoing_video_packet_queue->wait_dequeue_timed(frame, 250ms)) {
-            SendVideoPacket(frame->CompressedData(), frame->CompressedDataLength(), frame->pts);
+    auto t_now = std::chrono::steady_clock::now();
 
-            // Stats.
-            if (stats_.n_frames_send++ == -1) [[unlikely]] {
-                stats_.t_last_send = t_now;
+    // Frames from a file source have no frame type.
+    auto frame_type = frame->bitstream.FrameType;
+    bool keyframe = (frame_type & (MFX_FRAMETYPE_I | MFX_FRAMETYPE_IDR)) != 0;
+    bool reference = frame_type != MFX_FRAMETYPE_UNKNOWN && (frame_type & MFX_FRAMETYPE_REF);
+
+    {
+        std::lock_guard lock(send_mutex_);
+        // The frames after a skipped or partly dropped reference frame can't
+        // be decoded. Frames from a file source are assumed to be references.
+        bool needed = reference || frame_type == MFX_FRAMETYPE_UNKNOWN;
+        if (SkipVideoFrame(keyframe, needed, t_now)) {
+            n_frames_send_skip_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            // The frame flags are only carried by the generic payload, version 1.
+            if (generic_packetizer_) {
+                generic_packetizer_->SetNextFrame(GenericFrameFlags {
+                    .keyframe       = keyframe,
+                    .discardable    = frame_type != MFX_FRAMETYPE_UNKNOWN && !reference,
+                });
             }
-            auto t_dur = t_now - stats_.t_last_send;
-            if (t_dur >= 1s) {
-                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t_dur).count();
-                auto fps = stats_.n_frames_send / std::chrono::duration<double>(t_dur).count();
-                s_send_fps_.Update(fps);
-                LOG_VERBOSE << std::format("Processed {} outgoing video packets in {} ms, {:.3f} fps",
-                                           stats_.n_frames_send, ms, fps);
-                stats_.t_last_send = t_now;
-                stats_.n_frames_send = 0;
+
+            if (!SendVideoPacket(frame->CompressedData(), frame->CompressedDataLength(), frame->pts)) {
+                OnVideoSendFailed(needed, t_now);
             }
-        } else {
-            LOG_VERBOSE << "Stalled dequeuing packet from outgoing video packet queue, retrying";
         }
     }
+    n_frames_sent_.fetch_add(1, std::memory_order_relaxed);
+
+    // Frames whose capture time isn't on the steady clock, like those of a
+    // file source, are ignored.
+    auto send_latency = t_now - std::chrono::time_point<std::chrono::steady_clock>(
+                                    std::chrono::microseconds(frame->pts));
+    if (send_latency >= 0s && send_latency < 10s) {
+        s_send_latency_.Update(std::chrono::duration_cast<std::chrono::microseconds>(send_latency).count());
+    }
 
-    LOG_DEBUG << "Stopping outgoing video packet queue drain thread ID " << std::this_thread::get_id();
+    // Stats.
+    if (stats_.n_frames_send++ == -1) [[unlikely]] {
+        stats_.t_last_send = t_now;
+    }
+    auto t_dur = t_now - stats_.t_last_send;
+    if (t_dur >= 1s) {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t_dur).count();
+        auto fps = stats_.n_frames_send / std::chrono::duration<double>(t_dur).count();
+        s_send_fps_.Update(fps);
+        LOG_VERBOSE << std::format("Processed {} outgoing video packets for peer {} in {} ms, {:.3f} fps",
+                                   stats_.n_frames_send, params_.peer_id, ms, fps);
+        stats_.t_last_send = t_now;
+        stats_.n_frames_send = 0;
+    }
 }
 
 void NetworkHandler::ConnectWebRTC()
@@ -258,6 +349,7 @@ void NetworkHandler::OnWsMessage(json message)
         LogDescriptionVideo(desc, "[OnWsMessage, incoming answer]");
         peer_->setRemoteDescription(desc);
         FinishSetupVideoTracksFromAnswer(desc);
+        FinishSetupAudioTracksFromAnswer(desc);
     } else {
         LOG_DEBUG << std::format("Unknown message type '{}'", type);
     }
@@ -290,6 +382,29 @@ void NetworkHandler::CreatePeerConnection(std::optional<rtc::Description> offer)
         }
     });
 
+    // Tell the App once when the peer leaves or the connection fails, so that
+    // it can remove the peer.
+    peer_->onStateChange([&](rtc::PeerConnection::State state) {
+        if (state == rtc::PeerConnection::State::Disconnected ||
+            state == rtc::PeerConnection::State::Failed ||
+            state == rtc::PeerConnection::State::Closed) {
+            if (!peer_lost_.exchange(true)) {
+                LOG_INFO << std::format("Connection to peer {} lost", params_.peer_id);
+                PushEvent(Event::NetworkFailed, params_.peer_id);
+            }
+        }
+    });
+
+    // The offering side creates the control data channel, and the answering
+    // side receives it.
+    peer_->onDataChannel([&](std::shared_ptr<rtc::DataChannel> dc) {
+        if (dc->label() == kControlChannelLabel) {
+            SetupControlChannel(dc);
+        } else {
+            LOG_DEBUG << "Ignoring unknown data channel " << dc->label();
+        }
+    });
+
     if (offer) {
         peer_->onLocalDescription([](rtc::Description desc) {
             auto type = desc.typeString();
@@ -307,6 +422,7 @@ void NetworkHandler::CreatePeerConnection(std::optional<rtc::Description> offer)
         // the answer.
 
         auto answer = SetupVideoTracksFromOffer(offer.value());
+        SetupAudioTracksFromOffer(answer);
         LogDescriptionVideo(answer, "[CreatePeerConnection, answer]");
         peer_->setRemoteDescription(answer);
     } else {
@@ -324,6 +440,7 @@ void NetworkHandler::CreatePeerConnection(std::optional<rtc::Description> offer)
                 video.addVideoCodec(video_payload_type++, codec_name);
                 video.addSSRC(kFixedSsrc, codec_name);
             }
+            SetDescriptionPayloadFormat(&video, LocalPayloadFormat());
             track_send_ = peer_->addTrack(video);
         }
         // Add the AnswerVideo track. This is the remote peer's incoming video.
@@ -334,12 +451,238 @@ void NetworkHandler::CreatePeerConnection(std::optional<rtc::Description> offer)
                 video.addVideoCodec(video_payload_type++, codec_name);
                 video.addSSRC(kFixedSsrc + 1, codec_name);
             }
+            SetDescriptionPayloadFormat(&video, LocalPayloadFormat());
             track_recv_ = peer_->addTrack(video);
         }
+        AddAudioTracksToOffer();
+        SetupControlChannel(peer_->createDataChannel(kControlChannelLabel));
         peer_->setLocalDescription();
     }
 }
 
+void NetworkHandler::SetupControlChannel(std::shared_ptr<rtc::DataChannel> dc)
+{
+    dc->onOpen([this]() {
+        LOG_DEBUG << std::format("Control channel to peer {} is open", params_.peer_id);
+
+        // Ask the peer to probe the bandwidth of its video to us. The SFU
+        // forwards the video of others, so it has nothing to measure.
+        if (!params_.sfu_router) {
+            SendControlMessage({ { "type", "probe-request" } });
+        }
+    });
+
+    dc->onMessage([this](std::variant<rtc::binary, rtc::string> data) {
+        if (!std::holds_alternative<rtc::string>(data)) {
+            LOG_DEBUG << "Expecting string control channel data but received binary data instead";
+            return;
+        }
+        auto message = json::parse(std::get<rtc::string>(data), nullptr, false /* allow_exceptions */);
+        if (message.is_discarded()) {
+            LOG_ERROR << "Failed to parse control channel message";
+            return;
+        }
+        OnControlMessage(message);
+    });
+
+    std::lock_guard lock(control_mutex_);
+    control_ = std::move(dc);
+}
+
+void NetworkHandler::OnControlMessage(const json& message)
+{
+    LOG_VERBOSE << "Received control message: " << message.dump();
+
+    auto type = message.value("type", std::string());
+    if (type == "render-size") {
+        auto width = message.value("width", 0u);
+        auto height = message.value("height", 0u);
+        {
+            std::lock_guard lock(control_mutex_);
+            if (width == remote_render_width_ && height == remote_render_height_) {
+                return;
+            }
+            remote_render_width_ = width;
+            remote_render_height_ = height;
+        }
+        LOG_DEBUG << std::format("Peer {} renders our video at {}x{}, scale {}",
+                                 params_.peer_id, width, height, message.value("scale", 1.0));
+        PushEvent(Event::RemoteRenderSize, params_.peer_id);
+    } else if (type == "probe-request") {
+        StartProbe();
+    } else if (type == "probe-result") {
+        OnProbeResult(message);
+    } else if (type == "clock-ping") {
+        OnClockPing(message);
+    } else if (type == "clock-pong") {
+        OnClockPong(message);
+    } else {
+        LOG_DEBUG << std::format("Unknown control message type '{}'", type);
+    }
+}
+
+bool NetworkHandler::SendRenderSize(unsigned width, unsigned height, float scale)
+{
+    return SendControlMessage({
+        { "type", "render-size" },
+        { "width", width },
+        { "height", height },
+        { "scale", scale },
+    });
+}
+
+bool NetworkHandler::SendControlMessage(const json& message)
+{
+    std::lock_guard lock(control_mutex_);
+    if (!control_ || !control_->isOpen()) {
+        return false;
+    }
+    try {
+        return control_->send(message.dump());
+    } catch (const std::exception &e) {
+        LOG_INFO << "Unable to send control message: " << e.what();
+        return false;
+    }
+}
+
+std::pair<unsigned, unsigned> NetworkHandler::RemoteRenderSize()
+{
+    std::lock_guard lock(control_mutex_);
+    return { remote_render_width_, remote_render_height_ };
+}
+
+void NetworkHandler::SendClockPing()
+{
+    SendControlMessage({
+        { "type", "clock-ping" },
+        { "t1", util::SteadyToNtp(std::chrono::steady_clock::now()) },
+    });
+}
+
+void NetworkHandler::OnClockPing(const json& message)
+{
+    auto t2 = util::SteadyToNtp(std::chrono::steady_clock::now());
+
+    // The reply also tells the peer how long our video takes from capture
+    // to send, so that it can tell that apart from the network delay.
+    auto send_latency_us = static_cast<int64_t>(s_send_latency_.Result().mean);
+    SendControlMessage({
+        { "type", "clock-pong" },
+        { "t1", message.value("t1", uint64_t(0)) },
+        { "t2", t2 },
+        { "t3", util::SteadyToNtp(std::chrono::steady_clock::now()) },
+        { "send_latency_us", send_latency_us },
+    });
+}
+
+void NetworkHandler::OnClockPong(const json& message)
+{
+    auto t4 = util::SteadyToNtp(std::chrono::steady_clock::now());
+    auto t1 = message.value("t1", uint64_t(0));
+    auto t2 = message.value("t2", uint64_t(0));
+    auto t3 = message.value("t3", uint64_t(0));
+    if (t1 == 0 || t2 == 0 || t3 == 0) {
+        LOG_DEBUG << "Ignoring incomplete clock-pong message";
+        return;
+    }
+
+    clock_sync_.OnExchange(t1, t2, t3, t4);
+    remote_send_latency_us_ = message.value("send_latency_us", int64_t(0));
+    if (auto offset = clock_sync_.Offset(); offset && params_.av_sync) {
+        params_.av_sync->SetClockOffset(*offset);
+    }
+}
+
+void NetworkHandler::StartProbe()
+{
+    if (!params_.bandwidth_probe || !probe_sender_) {
+        return;
+    }
+
+    std::lock_guard lock(control_mutex_);
+    if (probe_started_) {
+        return;
+    }
+    probe_started_ = true;
+    probe_thread_ = std::jthread { [this](std::stop_token st) { RunProbe(st); } };
+}
+
+void NetworkHandler::RunProbe(std::stop_token st)
+{
+    LOG_DEBUG << "Starting bandwidth probe thread ID " << std::this_thread::get_id();
+    util::SetThreadName("VNetProbe");
+
+    // The peer asks for the probe as soon as the control channel is open,
+    // which may be before the video track is.
+    auto t_deadline = std::chrono::steady_clock::now() + kProbeStartTimeout;
+    while (!st.stop_requested() && !track_send_->isOpen()) {
+        if (std::chrono::steady_clock::now() >= t_deadline) {
+            LOG_INFO << std::format("Outgoing video track to peer {} didn't open, not probing", params_.peer_id);
+            return;
+        }
+        std::this_thread::sleep_for(10ms);
+    }
+
+    {
+        std::lock_guard lock(control_mutex_);
+        t_probe_start_ = std::chrono::steady_clock::now();
+    }
+
+    for (uint8_t burst = 0; burst < kProbeBursts && !st.stop_requested(); ++burst) {
+        if (burst > 0) {
+            std::this_thread::sleep_for(kProbeBurstInterval);
+        }
+
+        // The packetizers make no packets of an empty frame, so only the
+        // burst is sent.
+        std::lock_guard lock(send_mutex_);
+        probe_sender_->QueueBurst(burst, kProbeBursts, kProbePacketsPerBurst);
+        try {
+            track_send_->send(rtc::binary());
+        } catch (const std::exception &e) {
+            LOG_INFO << "Unable to send probe: " << e.what();
+            break;
+        }
+    }
+
+    LOG_DEBUG << "Stopping bandwidth probe thread ID " << std::this_thread::get_id();
+}
+
+void NetworkHandler::SendProbeResult(const ProbeResult& result)
+{
+    LOG_DEBUG << std::format("Bandwidth probe from peer {}: {} Kbps, {} bursts, {} of {} packets",
+                             params_.peer_id, result.kbps, result.n_bursts,
+                             result.n_packets, result.n_expected);
+    SendControlMessage({
+        { "type", "probe-result" },
+        { "kbps", result.kbps },
+        { "packets", result.n_packets },
+        { "expected", result.n_expected },
+    });
+}
+
+void NetworkHandler::OnProbeResult(const json& message)
+{
+    auto kbps = message.value("kbps", 0u);
+    std::chrono::steady_clock::duration elapsed;
+    {
+        std::lock_guard lock(control_mutex_);
+        elapsed = std::chrono::steady_clock::now() - t_probe_start_;
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+
+    LOG_INFO << std::format("Bandwidth probe to peer {} took {} ms, {} of {} packets arrived, estimate {} Kbps",
+                            params_.peer_id, ms,
+                            message.value("packets", 0u), message.value("expected", 0u),
+                            kbps);
+
+    probe_ms_ = static_cast<unsigned>(ms);
+    probe_kbps_ = kbps;
+    if (kbps > 0) {
+        PushEvent(Event::BandwidthProbed, params_.peer_id);
+    }
+}
+
 rtc::Description NetworkHandler::SetupVideoTracksFromOffer(rtc::Description& offer)
 {
     // The answer is being created in response to the remote peer's offer.
@@ -353,14 +696,13 @@ rtc::Description NetworkHandler::SetupVideoTracksFromOffer(rtc::Description& off
     if (auto offer_video = DescriptionMediaByMid(answer, "OfferVideo")) {
         if (auto best = SelectBestVideoCodec(offer_video.value(), params_.decoder_codecs)) {
             wanted_decoder_ = best.value();
+            recv_payload_format_ = NegotiatePayloadFormat(offer_video.value());
             auto codec_name = ToString(wanted_decoder_);
-            LOG_INFO << "Wanted decoder is " << codec_name;
+            LOG_INFO << std::format("Wanted decoder is {}, {} payload",
+                                    codec_name, ToString(recv_payload_format_));
 
             track_recv_ = peer_->addTrack(offer_video.value()->reciprocate());
-            track_recv_->chainMediaHandler(std::make_shared<GenericRtpDepacketizer>());
-            track_recv_->onFrame([&](rtc::binary msg, rtc::FrameInfo frame_info) {
-                ReceiveVideoPacket(msg, frame_info);
-            });
+            SetupIncomingVideoTrack();
         } else {
             LOG_WARNING << "Couldn't negotiate a compatible codec for OfferVideo";
         }
@@ -372,8 +714,10 @@ rtc::Description NetworkHandler::SetupVideoTracksFromOffer(rtc::Description& off
     if (auto answer_video = DescriptionMediaByMid(answer, "AnswerVideo")) {
         if (auto best = SelectBestVideoCodec(answer_video.value(), params_.encoder_codecs)) {
             wanted_encoder_ = best.value();
+            send_payload_format_ = NegotiatePayloadFormat(answer_video.value());
             auto codec_name = ToString(wanted_encoder_);
-            LOG_INFO << "Wanted encoder is " << codec_name;
+            LOG_INFO << std::format("Wanted encoder is {}, {} payload",
+                                    codec_name, ToString(send_payload_format_));
 
             auto video = (*answer_video.value()).reciprocate();
             track_send_ = peer_->addTrack(video);
@@ -382,7 +726,7 @@ rtc::Description NetworkHandler::SetupVideoTracksFromOffer(rtc::Description& off
                  codec_name,
                  DescriptionMediaPayloadTypeByFormat(&video, codec_name),
                  GenericRtpPacketizer::defaultClockRate);
-            track_send_->chainMediaHandler(std::make_shared<GenericRtpPacketizer>(rtp_config_));
+            SetupOutgoingVideoTrack();
         } else {
             LOG_WARNING << "Couldn't negotiate a compatible codec for AnswerVideo";
         }
@@ -411,8 +755,10 @@ void NetworkHandler::FinishSetupVideoTracksFromAnswer(rtc::Description& answer)
         return;
     }
     wanted_encoder_ = DescriptionVideoCodec(offer_video.value());
+    send_payload_format_ = DescriptionPayloadFormat(offer_video.value());
     auto encoder_name = ToString(wanted_encoder_);
-    LOG_INFO << "Wanted encoder is " << encoder_name;
+    LOG_INFO << std::format("Wanted encoder is {}, {} payload",
+                            encoder_name, ToString(send_payload_format_));
     auto payload_type = DescriptionMediaPayloadTypeByFormat(offer_video.value(), encoder_name);
     if (payload_type == -1) {
         LOG_ERROR << "Could not find payload type for codec {} in OfferVideo";
@@ -420,7 +766,7 @@ void NetworkHandler::FinishSetupVideoTracksFromAnswer(rtc::Description& answer)
     }
     rtp_config_ = std::make_shared<rtc::RtpPacketizationConfig>
         (kFixedSsrc, encoder_name, payload_type, GenericRtpPacketizer::defaultClockRate);
-    track_send_->setMediaHandler(std::make_shared<GenericRtpPacketizer>(rtp_config_));
+    SetupOutgoingVideoTrack();
 
     // Set up the AnswerVideo track. This is the remote peer's incoming video.
     auto answer_video = DescriptionMediaByMid(answer, "AnswerVideo");
@@ -429,30 +775,282 @@ void NetworkHandler::FinishSetupVideoTracksFromAnswer(rtc::Description& answer)
         return;
     }
     wanted_decoder_ = DescriptionVideoCodec(answer_video.value());;
+    recv_payload_format_ = DescriptionPayloadFormat(answer_video.value());
     auto decoder_name = ToString(wanted_decoder_);
-    LOG_INFO << "Wanted decoder is " << decoder_name;
-    track_recv_->chainMediaHandler(std::make_shared<GenericRtpDepacketizer>());
+    LOG_INFO << std::format("Wanted decoder is {}, {} payload",
+                            decoder_name, ToString(recv_payload_format_));
+    SetupIncomingVideoTrack();
+}
+
+PayloadFormat NetworkHandler::LocalPayloadFormat() const
+{
+    // The router forwards the packets between participants as they are, and
+    // parses the generic payload descriptor.
+    if (params_.sfu_router) {
+        return PayloadFormat::Generic;
+    }
+    return params_.video_payload_format;
+}
+
+PayloadFormat NetworkHandler::NegotiatePayloadFormat(rtc::Description::Media* media)
+{
+    // Every format that the offerer knows is supported here too, so the
+    // offered one is accepted, unless only the generic format is wanted.
+    auto format = PayloadFormat::Generic;
+    if (LocalPayloadFormat() != PayloadFormat::Generic) {
+        format = DescriptionPayloadFormat(media);
+    }
+    SetDescriptionPayloadFormat(media, format);
+    return format;
+}
+
+void NetworkHandler::SetupIncomingVideoTrack()
+{
+    if (params_.sfu_router) {
+        track_recv_->chainMediaHandler(std::make_shared<SfuForwarder>(params_.sfu_router, params_.peer_id));
+        return;
+    }
+
+    track_recv_->chainMediaHandler(CreateVideoDepacketizer(wanted_decoder_, recv_payload_format_));
+    if (params_.av_sync) {
+        track_recv_->chainMediaHandler(std::make_shared<RtcpSrReceiver>(
+            [av_sync = params_.av_sync](uint64_t ntp_timestamp, uint32_t rtp_timestamp) {
+                av_sync->OnSenderReport(AvSync::Media::Video, ntp_timestamp, rtp_timestamp);
+            }));
+    }
+    if (params_.rtp_capture) {
+        // Chained late, so that it sees the packets before the depacketizer.
+        track_recv_->chainMediaHandler(params_.rtp_capture);
+    }
+    // Chained last, so that the probe packets are neither captured nor
+    // depacketized.
+    track_recv_->chainMediaHandler(std::make_shared<ProbeReceiver>([this](const ProbeResult& result) {
+        SendProbeResult(result);
+    }));
     track_recv_->onFrame([&](rtc::binary msg, rtc::FrameInfo frame_info) {
         ReceiveVideoPacket(msg, frame_info);
     });
 }
 
+void NetworkHandler::SetupOutgoingVideoTrack()
+{
+    if (!params_.sfu_router) {
+        sender_reporter_ = std::make_shared<RtcpSrSender>(rtp_config_->ssrc);
+        auto max_payload_size = MaxPayloadSizeForMtu(params_.transport.mtu);
+        LOG_DEBUG << std::format("Video RTP payloads of up to {} bytes for peer {}",
+                                 max_payload_size, params_.peer_id);
+        auto packetizer = CreateVideoPacketizer(wanted_encoder_, send_payload_format_, rtp_config_,
+                                                max_payload_size);
+        generic_packetizer_ = std::dynamic_pointer_cast<GenericRtpPacketizer>(packetizer);
+        probe_sender_ = std::make_shared<ProbeSender>(rtp_config_, max_payload_size + sizeof(rtc::RtpHeader));
+        track_send_->chainMediaHandler(packetizer);
+        track_send_->chainMediaHandler(sender_reporter_);
+        track_send_->chainMediaHandler(probe_sender_);
+        return;
+    }
+
+    // The router sends complete RTP packets, rewritten for this track.
+    params_.sfu_router->AddParticipant(
+        params_.peer_id, rtp_config_->ssrc, rtp_config_->payloadType,
+        [wtrack = std::weak_ptr<rtc::Track>(track_send_)](rtc::binary&& packet) {
+            auto track = wtrack.lock();
+            if (!track || !track->isOpen()) {
+                return;
+            }
+            try {
+                track->send(std::move(packet));
+            } catch (const std::exception &e) {
+                LOG_INFO << "Unable to send packet: " << e.what();
+            }
+        });
+}
+
+void NetworkHandler::AddAudioTracksToOffer()
+{
+    if (!params_.incoming_audio_packet_queue) {
+        return;
+    }
+
+    // Add the OfferAudio track. This is the local peer's outgoing audio.
+    {
+        rtc::Description::Audio audio("OfferAudio", rtc::Description::Direction::SendOnly);
+        audio.addOpusCodec(kAudioPayloadType);
+        audio.addSSRC(kFixedSsrc + 2, "audio");
+        track_audio_send_ = peer_->addTrack(audio);
+    }
+    // Add the AnswerAudio track. This is the remote peer's incoming audio.
+    {
+        rtc::Description::Audio audio("AnswerAudio", rtc::Description::Direction::RecvOnly);
+        audio.addOpusCodec(kAudioPayloadType);
+        audio.addSSRC(kFixedSsrc + 3, "audio");
+        track_audio_recv_ = peer_->addTrack(audio);
+    }
+}
+
+void NetworkHandler::SetupAudioTracksFromOffer(rtc::Description& offer)
+{
+    if (!params_.incoming_audio_packet_queue) {
+        return;
+    }
+
+    // Add the OfferAudio track. This is the remote peer's incoming audio.
+    if (auto offer_audio = DescriptionMediaByMid(offer, "OfferAudio")) {
+        track_audio_recv_ = peer_->addTrack(offer_audio.value()->reciprocate());
+        SetupIncomingAudioTrack();
+    } else {
+        LOG_WARNING << "Didn't get OfferAudio, not receiving audio";
+    }
+
+    // Add the AnswerAudio track. This is the local peer's outgoing audio.
+    if (auto answer_audio = DescriptionMediaByMid(offer, "AnswerAudio")) {
+        auto audio = (*answer_audio.value()).reciprocate();
+        auto payload_type = DescriptionMediaPayloadTypeByFormat(&audio, "opus");
+        if (payload_type == -1) {
+            LOG_WARNING << "Couldn't negotiate Opus for AnswerAudio";
+            return;
+        }
+        track_audio_send_ = peer_->addTrack(audio);
+        SetupOutgoingAudioTrack(payload_type, kFixedSsrc + 3);
+    } else {
+        LOG_WARNING << "Didn't get AnswerAudio, not sending audio";
+    }
+}
+
+void NetworkHandler::FinishSetupAudioTracksFromAnswer(rtc::Description& answer)
+{
+    if (!track_audio_send_ || !track_audio_recv_) {
+        return;
+    }
+
+    // Set up the OfferAudio track. This is the local peer's outgoing audio.
+    if (auto offer_audio = DescriptionMediaByMid(answer, "OfferAudio")) {
+        auto payload_type = DescriptionMediaPayloadTypeByFormat(offer_audio.value(), "opus");
+        if (payload_type != -1) {
+            SetupOutgoingAudioTrack(payload_type, kFixedSsrc + 2);
+        }
+    } else {
+        LOG_WARNING << "No media description for mid OfferAudio in answer, not sending audio";
+    }
+
+    // Set up the AnswerAudio track. This is the remote peer's incoming audio.
+    if (DescriptionMediaByMid(answer, "AnswerAudio")) {
+        SetupIncomingAudioTrack();
+    } else {
+        LOG_WARNING << "No media description for mid AnswerAudio in answer, not receiving audio";
+    }
+}
+
+void NetworkHandler::SetupIncomingAudioTrack()
+{
+    if (params_.av_sync) {
+        track_audio_recv_->chainMediaHandler(std::make_shared<RtcpSrReceiver>(
+            [av_sync = params_.av_sync](uint64_t ntp_timestamp, uint32_t rtp_timestamp) {
+                av_sync->OnSenderReport(AvSync::Media::Audio, ntp_timestamp, rtp_timestamp);
+            }));
+    }
+
+    // Opus frames fit in a single RTP packet, so there is no depacketizer,
+    // and the track delivers the raw RTP and RTCP packets.
+    track_audio_recv_->onMessage([&](std::variant<rtc::binary, rtc::string> data) {
+        if (std::holds_alternative<rtc::binary>(data)) {
+            ReceiveAudioPacket(std::get<rtc::binary>(data));
+        }
+    });
+}
+
+void NetworkHandler::SetupOutgoingAudioTrack(int payload_type, rtc::SSRC ssrc)
+{
+    audio_rtp_config_ = std::make_shared<rtc::RtpPacketizationConfig>
+        (ssrc, "audio", static_cast<uint8_t>(payload_type), kAudioRtpClockRate);
+    audio_sender_reporter_ = std::make_shared<RtcpSrSender>(ssrc);
+    track_audio_send_->chainMediaHandler(std::make_shared<rtc::OpusRtpPacketizer>(audio_rtp_config_));
+    track_audio_send_->chainMediaHandler(audio_sender_reporter_);
+}
+
+void NetworkHandler::ReceiveAudioPacket(const rtc::binary& msg)
+{
+    if (stop_requested_.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    // RTCP packet types are 192 to 223, which RTP payload types with the
+    // marker bit set don't reach, as long as the payload type is above 95.
+    if (msg.size() < sizeof(rtc::RtpHeader)) {
+        return;
+    }
+    auto packet_type = std::to_integer<uint8_t>(msg[1]);
+    if (packet_type >= 192 && packet_type <= 223) {
+        return;
+    }
+
+    auto rtp = reinterpret_cast<const rtc::RtpHeader*>(msg.data());
+    auto header_size = rtp->getSize() + rtp->getExtensionHeaderSize();
+    if (header_size >= msg.size()) {
+        return;
+    }
+
+    auto packet = std::make_shared<AudioPacket>();
+    packet->data.assign(msg.begin() + header_size, msg.end());
+    packet->rtp_timestamp = rtp->timestamp();
+    packet->sequence = rtp->seqNumber();
+    packet->t_arrival = std::chrono::steady_clock::now();
+
+    // The playout thread drains the queue every 10 ms, so it only fills up if
+    // audio playout has stopped. Drop rather than stall the network thread.
+    if (!params_.incoming_audio_packet_queue->try_enqueue(std::move(packet))) {
+        LOG_VERBOSE << "Incoming audio packet queue is full, dropping packet";
+    }
+}
+
+void NetworkHandler::SendAudioFrame(const std::shared_ptr<AudioPacket>& packet)
+{
+    // Only send the packet if the connection is open.
+    if (!track_audio_send_ || !audio_rtp_config_ || !track_audio_send_->isOpen()) {
+        return;
+    }
+
+    audio_rtp_config_->timestamp = audio_rtp_config_->startTimestamp + packet->rtp_timestamp;
+    audio_sender_reporter_->SetCaptureTime(audio_rtp_config_->timestamp, packet->t_captured);
+
+    try {
+        track_audio_send_->send(packet->data.data(), packet->data.size());
+    } catch (const std::exception &e) {
+        LOG_INFO << "Unable to send audio packet: " << e.what();
+    }
+}
+
 void NetworkHandler::ReceiveVideoPacket(rtc::binary msg, rtc::FrameInfo frame_info)
 {
+    if (stop_requested_.load(std::memory_order_relaxed)) {
+        return;
+    }
+
     auto t_now = std::chrono::steady_clock::now();
     auto packet = RtcPacket::Create(msg, frame_info);
+    packet->t_received_ = t_now;
+
+    // The capture time is only on our clock once the clock offset is known.
+    if (params_.av_sync && clock_sync_.Offset()) {
+        if (auto t_capture = params_.av_sync->VideoCaptureTime(frame_info.timestamp)) {
+            s_recv_latency_.Update(std::chrono::duration_cast<std::chrono::microseconds>(t_now - *t_capture).count());
+        }
+    }
 
     LOG_VERBOSE << std::format("Received video packet, size {}, timestamp {}",
                                msg.size(), frame_info.timestamp);
 
-    // Enqueue the incoming video packet.
-    while (!vacon::gShuttingDown) {
-        if (params_.incoming_video_packet_queue->wait_enqueue_timed(packet, 250ms)) {
-            break;
-        } else {
-            LOG_DEBUG << "Stalled enqueuing packet onto incoming video packet queue, retrying";
-        }
+    if (params_.incoming_recorder) {
+        params_.incoming_recorder->Record(packet);
+    }
+
+    // Enqueue the incoming video packet. The network thread is shared by all
+    // peers, so drop rather than wait for a decoder that is behind or gone.
+    if (!params_.incoming_video_packet_queue->try_enqueue(packet)) {
+        LOG_VERBOSE << "Incoming video packet queue is full, dropping packet";
+        n_frames_recv_drop_.fetch_add(1, std::memory_order_relaxed);
+        return;
     }
+    n_frames_received_.fetch_add(1, std::memory_order_relaxed);
 
     // Stats.
     if (stats_.n_frames_recv++ == -1) [[unlikely]] {
@@ -471,17 +1069,17 @@ void NetworkHandler::ReceiveVideoPacket(rtc::binary msg, rtc::FrameInfo frame_in
     }
 }
 
-void NetworkHandler::SendVideoPacket(const std::byte *data, size_t size, uint64_t pts)
+bool NetworkHandler::SendVideoPacket(const std::byte *data, size_t size, uint64_t pts)
 {
     // Only send the packet if the connection is open.
     if (!track_send_ || !track_send_->isOpen()) {
-        return;
+        return true;
     }
 
     // Consistency check.
     if (!data || size == 0) {
         LOG_DEBUG << std::format("Called with no data or zero length data at PTS {}, ignoring", pts);
-        return;
+        return true;
     }
 
     // Sample time is in microseconds, convert it to seconds.
@@ -493,21 +1091,62 @@ void NetworkHandler::SendVideoPacket(const std::byte *data, size_t size, uint64_
     // Set new timestamp.
     rtp_config_->timestamp = rtp_config_->startTimestamp + elapsedTimestamp;
 
-    // Get elapsed time in clock rate from last RTCP sender report.
-    // auto reportElapsedTimestamp = rtp_config_->timestamp - sender_reporter_->lastReportedTimestamp();
-
-    // Check if last report was at least 1 second ago.
-    // if (rtp_config_->timestampToSeconds(reportElapsedTimestamp) > 1) {
-        // sender_reporter_->setNeedsToReport();
-    // }
+    // Camera timestamps are on the steady clock, so the sender reports can
+    // map them to the wall clock.
+    if (sender_reporter_) {
+        sender_reporter_->SetCaptureTime(rtp_config_->timestamp,
+                                         std::chrono::time_point<std::chrono::steady_clock>(
+                                             std::chrono::microseconds(pts)));
+    }
 
-    // Send the packet.
+    // Send the packet. The transport drops the packets that it can't
+    // buffer, and then returns false.
     try {
         LOG_VERBOSE << std::format("Sending packet @ {}, size {}", (void*)data, size);
-        track_send_->send(data, size);
+        if (track_send_->send(data, size)) {
+            return true;
+        }
     } catch (const std::exception &e) {
         LOG_INFO << "Unable to send packet: " << e.what();
     }
+    n_frames_send_fail_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void NetworkHandler::OnVideoSendFailed(bool reference,
+                                       std::chrono::time_point<std::chrono::steady_clock> t_now)
+{
+    t_send_fail_ = t_now;
+    if (!send_backpressure_.exchange(true)) {
+        LOG_DEBUG << std::format("Transport of peer {} dropped outgoing video, skipping frames",
+                                 params_.peer_id);
+    }
+    send_need_keyframe_ |= reference;
+}
+
+bool NetworkHandler::SkipVideoFrame(bool keyframe, bool reference,
+                                    std::chrono::time_point<std::chrono::steady_clock> t_now)
+{
+    if (send_backpressure_) {
+        if (t_now - t_send_fail_ < kSendFailBackoff) {
+            send_need_keyframe_ |= reference;
+            return true;
+        }
+        send_backpressure_ = false;
+
+        // Ask for a keyframe now, rather than wait for the next one of the
+        // GOP. The encoder is shared, so all the peers get it.
+        if (send_need_keyframe_ && !keyframe && params_.keyframe_request) {
+            LOG_DEBUG << std::format("Asking for a keyframe to resume sending to peer {}", params_.peer_id);
+            params_.keyframe_request->store(true, std::memory_order_relaxed);
+        }
+    }
+
+    if (send_need_keyframe_ && !keyframe) {
+        return true;
+    }
+    send_need_keyframe_ = false;
+    return false;
 }
 
 } // namespace vacon
@@ -15,43 +15,116 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <stop_token>
 #include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include <nlohmann/json_fwd.hpp>
 #include <rtc/rtc.hpp>
 
+#include "audio/audio.hpp"
+#include "av_sync.hpp"
+#include "clock_sync.hpp"
 #include "codecs.hpp"
 #include "invite.hpp"
+#include "linux/recorder.hpp"
 #include "linux/typedefs.hpp"
+#include "rtp/rtcp_sr.hpp"
+#include "rtp/generic_packetizer.hpp"
+#include "rtp/payload_format.hpp"
+#include "rtp/probe.hpp"
+#include "rtp/rtp_capture.hpp"
+#include "rtp/sfu_router.hpp"
 #include "stats.hpp"
 
 namespace vacon {
 
+// Transport settings of the peer connections.
+struct NetworkTransportParams {
+    // MTU of the path, or 0 if it isn't known. Sizes the RTP packets.
+    size_t                      mtu = 0;
+
+    // Range of the local UDP ports, and the local address to bind to.
+    uint16_t                    port_range_begin = 1024;
+    uint16_t                    port_range_end = 65535;
+    std::optional<std::string>  bind_address = std::nullopt;
+};
+
 struct NetworkHandlerParams {
+    size_t peer_id = 0;
     std::shared_ptr<Invite> invite;
     std::string stun_server;
-    std::shared_ptr<linux::VideoPacketQueue> outgoing_video_packet_queue;
     std::shared_ptr<RtcPacketQueue> incoming_video_packet_queue;
     std::shared_ptr<std::vector<VideoCodec>> decoder_codecs;
     std::shared_ptr<std::vector<VideoCodec>> encoder_codecs;
+    std::shared_ptr<linux::Recorder> incoming_recorder = nullptr;
+    std::shared_ptr<RtpCaptureHandler> rtp_capture = nullptr;
+
+    // Audio is negotiated only if the incoming audio queue is set. The
+    // sender reports of both streams are passed to the A/V sync.
+    std::shared_ptr<AudioPacketQueue> incoming_audio_packet_queue = nullptr;
+    std::shared_ptr<AvSync> av_sync = nullptr;
+
+    // In SFU mode, the incoming RTP packets are passed to the router instead
+    // of being depacketized and queued, and the router sends RTP packets on
+    // the outgoing track, which has no packetizer.
+    std::shared_ptr<SfuRouter> sfu_router = nullptr;
+
+    // The video payload format to offer or accept. The generic format is
+    // used if the peer doesn't support this one, and always in SFU mode.
+    PayloadFormat video_payload_format = PayloadFormat::Standard;
+
+    // Set to ask the encoder for a keyframe, when sending resumes after
+    // reference frames were dropped. Not set for the SFU.
+    std::shared_ptr<std::atomic_bool> keyframe_request = nullptr;
+
+    // Send a burst of probe packets when the peer asks for them at the start
+    // of the call, so that it can estimate the bandwidth to it.
+    bool bandwidth_probe = true;
+
+    NetworkTransportParams transport = {};
 };
 
 class NetworkHandler {
     public:
         static std::unique_ptr<NetworkHandler> Create(const NetworkHandlerParams& params);
-        NetworkHandler(NetworkHandler&&) = default;
         ~NetworkHandler();
-        void StartDrainThread();
         void StartConnectThread();
 
+        // Stop passing incoming packets on, before the peer's decoder and
+        // queues are freed.
+        void RequestStop();
+
+        // Send an encoded frame to the peer. Called by the VideoFanOut
+        // thread for every peer, with the same frame.
+        void SendVideoFrame(const std::shared_ptr<linux::VideoFrame>& frame);
+
+        // Send an encoded audio frame to the peer. Called by the AudioSender
+        // thread for every peer, with the same frame.
+        void SendAudioFrame(const std::shared_ptr<AudioPacket>& packet);
+
+        // Tell the peer the size, in pixels, at which its video is rendered,
+        // and the display scale. Sent over the control data channel, and
+        // returns false if it isn't open yet.
+        bool SendRenderSize(unsigned width, unsigned height, float scale);
+
+        // The size at which the peer renders our video, or 0x0 if it hasn't
+        // reported one. Event::RemoteRenderSize is pushed when it changes.
+        std::pair<unsigned, unsigned> RemoteRenderSize();
+
+        // Start a clock exchange with the peer over the control data
+        // channel. Called about once per second.
+        void SendClockPing();
+
         VideoCodec WantedDecoder()
         {
             return wanted_decoder_;
@@ -62,36 +135,128 @@ class NetworkHandler {
             return wanted_encoder_;
         };
 
+        // True while outgoing frames are skipped, after the transport dropped
+        // some of the outgoing video.
+        bool SendBackpressure() const
+        {
+            return send_backpressure_.load(std::memory_order_relaxed);
+        }
+
         Welford                                         s_recv_fps_ = {};
         Welford                                         s_send_fps_ = {};
 
+        // Outgoing frames handled by SendVideoFrame(), and incoming frames
+        // queued for the decoder, for the watchdog.
+        std::atomic_size_t                              n_frames_sent_ = 0;
+        std::atomic_size_t                              n_frames_received_ = 0;
+
+        // Outgoing frames skipped because of backpressure, and frames that
+        // the transport didn't accept.
+        std::atomic_size_t                              n_frames_send_skip_ = 0;
+        std::atomic_size_t                              n_frames_send_fail_ = 0;
+
+        // Incoming frames dropped because the decoder fell behind, or is
+        // gone.
+        std::atomic_size_t                              n_frames_recv_drop_ = 0;
+
+        // The bandwidth to the peer estimated by the probe, and how long the
+        // probe took, or 0 if there was none. Event::BandwidthProbed is
+        // pushed when the result arrives.
+        std::atomic_uint                                probe_kbps_ = 0;
+        std::atomic_uint                                probe_ms_ = 0;
+
+        // The peer's clock, and the latencies measured with it: from
+        // capture to send of the outgoing video, from capture on the peer to
+        // arrival here of the incoming video, and from capture to send on
+        // the peer, as reported by it.
+        ClockSync                                       clock_sync_ = {};
+        Welford                                         s_send_latency_ = {};
+        Welford                                         s_recv_latency_ = {};
+        std::atomic_int64_t                             remote_send_latency_us_ = 0;
+
     private:
         NetworkHandler() = default;
         void ConnectWebRTC();
         void CloseWebSocket();
+        void ClosePeerConnection();
         bool IsConnectedToPeer();
         void RunConnect(std::stop_token);
-        void RunOutgoingDrain(std::stop_token);
         void OnWsMessage(nlohmann::json message);
         void CreatePeerConnection(std::optional<rtc::Description> offer = std::nullopt);
         void FinishSetupVideoTracksFromAnswer(rtc::Description&);
         void ReceiveVideoPacket(rtc::binary msg, rtc::FrameInfo frame_info);
-        void SendVideoPacket(const std::byte *data, size_t size, uint64_t pts);
+        bool SendVideoPacket(const std::byte *data, size_t size, uint64_t pts);
+        void OnVideoSendFailed(bool reference, std::chrono::time_point<std::chrono::steady_clock> t_now);
+        bool SkipVideoFrame(bool keyframe, bool reference,
+                            std::chrono::time_point<std::chrono::steady_clock> t_now);
         rtc::Description SetupVideoTracksFromOffer(rtc::Description&);
+        void SetupControlChannel(std::shared_ptr<rtc::DataChannel>);
+        void OnControlMessage(const nlohmann::json& message);
+        bool SendControlMessage(const nlohmann::json& message);
+        void StartProbe();
+        void RunProbe(std::stop_token);
+        void SendProbeResult(const ProbeResult&);
+        void OnProbeResult(const nlohmann::json& message);
+        void OnClockPing(const nlohmann::json& message);
+        void OnClockPong(const nlohmann::json& message);
+        PayloadFormat LocalPayloadFormat() const;
+        PayloadFormat NegotiatePayloadFormat(rtc::Description::Media*);
+        void SetupIncomingVideoTrack();
+        void SetupOutgoingVideoTrack();
+        void AddAudioTracksToOffer();
+        void SetupAudioTracksFromOffer(rtc::Description&);
+        void FinishSetupAudioTracksFromAnswer(rtc::Description&);
+        void SetupIncomingAudioTrack();
+        void SetupOutgoingAudioTrack(int payload_type, rtc::SSRC ssrc);
+        void ReceiveAudioPacket(const rtc::binary& msg);
 
         NetworkHandlerParams                            params_ = {};
         bool                                            starting_ = false;
+        std::atomic_bool                                stop_requested_ = false;
         std::vector<std::jthread>                       threads_ = {};
         rtc::Configuration                              config_ = {};
         std::shared_ptr<rtc::WebSocket>                 ws_ = nullptr;
         std::shared_ptr<rtc::PeerConnection>            peer_ = nullptr;
-        std::shared_ptr<rtc::RtcpSrReporter>            sender_reporter_ = nullptr;
+        std::atomic_bool                                peer_lost_ = false;
+        std::shared_ptr<RtcpSrSender>                   sender_reporter_ = nullptr;
+        std::shared_ptr<GenericRtpPacketizer>           generic_packetizer_ = nullptr;
+        std::shared_ptr<ProbeSender>                    probe_sender_ = nullptr;
         std::shared_ptr<rtc::RtpPacketizationConfig>    rtp_config_ = nullptr;
         std::shared_ptr<rtc::Track>                     track_recv_ = nullptr;
         std::shared_ptr<rtc::Track>                     track_send_ = nullptr;
+        std::shared_ptr<RtcpSrSender>                   audio_sender_reporter_ = nullptr;
+        std::shared_ptr<rtc::RtpPacketizationConfig>    audio_rtp_config_ = nullptr;
+        std::shared_ptr<rtc::Track>                     track_audio_recv_ = nullptr;
+        std::shared_ptr<rtc::Track>                     track_audio_send_ = nullptr;
         std::vector<std::shared_ptr<rtc::Track>>        tracks_ = {};
+
+        // The control data channel, and the state it carries, are accessed
+        // from both the libdatachannel threads and the render thread.
+        std::mutex                                      control_mutex_;
+        std::shared_ptr<rtc::DataChannel>               control_ = nullptr;
+        unsigned                                        remote_render_width_ = 0;
+        unsigned                                        remote_render_height_ = 0;
+        bool                                            probe_started_ = false;
+        std::jthread                                    probe_thread_ = {};
+        std::chrono::time_point<std::chrono::steady_clock>
+                                                        t_probe_start_ = {};
+
+        // The bandwidth probe sends on the outgoing video track from its own
+        // thread, and the packetizers aren't thread safe.
+        std::mutex                                      send_mutex_;
+
         VideoCodec                                      wanted_decoder_ = VideoCodec::UNKNOWN;
         VideoCodec                                      wanted_encoder_ = VideoCodec::UNKNOWN;
+        PayloadFormat                                   recv_payload_format_ = PayloadFormat::Generic;
+        PayloadFormat                                   send_payload_format_ = PayloadFormat::Generic;
+
+        // Set by the fan-out thread when the transport drops outgoing video,
+        // and cleared by it once the backoff is over. Once a reference frame
+        // is dropped or skipped, sending resumes with a keyframe.
+        std::atomic_bool                                send_backpressure_ = false;
+        bool                                            send_need_keyframe_ = false;
+        std::chrono::time_point<std::chrono::steady_clock>
+                                                        t_send_fail_ = {};
 
         struct {
             ssize_t                                     n_frames_recv = -1;
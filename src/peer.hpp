@@ -0,0 +1,124 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "audio/audio.hpp"
+#include "audio/audio_receiver.hpp"
+#include "av_sync.hpp"
+#include "invite.hpp"
+#include "linux/decoder.hpp"
+#include "linux/typedefs.hpp"
+#include "network_handler.hpp"
+#include "playout.hpp"
+#include "rtc_packet.hpp"
+#include "stats.hpp"
+
+namespace vacon {
+
+// A decoded remote frame waiting for its playout time.
+struct PlayoutFrame {
+    std::shared_ptr<linux::DecodedFrame>                frame;
+    std::chrono::time_point<std::chrono::steady_clock>  t_playout;
+};
+
+// A remote participant in a mesh conference. Every peer has its own peer
+// connection, incoming queues, decoder and playout state, and is shown in its
+// own tile. The encoded outgoing video is shared by all peers.
+struct Peer {
+    size_t          id                                  = 0;
+
+    std::shared_ptr<Invite>
+        invite                                          = nullptr;
+
+    std::shared_ptr<NetworkHandler>
+        nh                                              = nullptr;
+
+    std::unique_ptr<linux::Decoder>
+        decoder                                         = nullptr;
+
+    std::string     decoder_codec_str                   = "";
+
+    // Set once the decoder is started and the video sent, under the App's
+    // pipeline mutex.
+    bool            video_started                       = false;
+
+    // Incoming frames are dropped when the queue is full, so it has room for
+    // a keyframe that takes the decoder longer than usual.
+    std::shared_ptr<RtcPacketQueue>
+        incoming_video_packet_queue                     = std::make_shared<RtcPacketQueue>(8);
+
+    std::shared_ptr<linux::DecodedFrameQueue>
+        decoded_video_frame_queue                       = std::make_shared<linux::DecodedFrameQueue>(4);
+
+    // Set if audio is enabled.
+    std::shared_ptr<AudioPacketQueue>
+        incoming_audio_packet_queue                     = nullptr;
+
+    std::shared_ptr<AudioReceiver>
+        audio_receiver                                  = nullptr;
+
+    std::shared_ptr<AvSync>
+        av_sync                                         = std::make_shared<AvSync>();
+
+    // The frame shown in the peer's tile.
+    std::shared_ptr<linux::DecodedFrame>
+        decoded_frame                                   = nullptr;
+
+    PlayoutClock    playout_clock                       = PlayoutClock();
+
+    std::deque<PlayoutFrame>
+        playout_queue                                   = {};
+
+    // Judder is the difference between the interval at which two
+    // consecutive remote frames are shown and the interval at which they
+    // were captured. Cadence counts the refresh intervals that each remote
+    // frame stays on screen.
+    Welford         s_judder                            = {};
+    std::array<unsigned, 4>
+                    cadence                             = {};
+    uint32_t        last_shown_rtp_timestamp            = 0;
+    std::chrono::time_point<std::chrono::steady_clock>
+                    t_last_shown                        = {};
+
+    // From the arrival of a remote frame to when it is shown.
+    Welford         s_receive_latency                   = {};
+
+    // The size of the peer's tile in pixels, as last reported to the peer so
+    // that it doesn't send a larger resolution than is shown.
+    unsigned        render_width                        = 0;
+    unsigned        render_height                       = 0;
+    std::chrono::time_point<std::chrono::steady_clock>
+                    t_render_size_sent                  = {};
+
+    // The number of remote frames shown is also read by the watchdog.
+    struct {
+        std::atomic_uint
+                    n_remote                            = 0;
+        unsigned    n_remote_underflow                  = 0;
+        unsigned    n_remote_skipped                    = 0;
+    } stats;
+};
+
+} // namespace vacon
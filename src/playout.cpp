@@ -0,0 +1,120 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "playout.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <format>
+
+#include <plog/Log.h>
+
+namespace vacon {
+
+// Bounds for the jitter buffer delay.
+static const double kMinDelayMicros         = 2'000.0;
+static const double kMaxDelayMicros         = 200'000.0;
+
+// The target delay, in multiples of the interarrival jitter.
+static const double kJitterMultiple         = 3.0;
+
+// A jump in the RTP timestamps larger than this, in seconds, restarts the
+// mapping.
+static const int64_t kMaxTimestampJumpSecs  = 5;
+
+PlayoutClock::TimePoint PlayoutClock::Update(uint32_t rtp_timestamp, TimePoint t_arrival)
+{
+    auto restart = !primed_;
+    if (primed_) {
+        auto delta = static_cast<int32_t>(rtp_timestamp - last_rtp_timestamp_);
+        if (std::abs(static_cast<int64_t>(delta)) > kMaxTimestampJumpSecs * clock_rate_) {
+            LOG_DEBUG << std::format("RTP timestamp jumped by {}, restarting the playout clock", delta);
+            ++n_resets_;
+            restart = true;
+        } else {
+            ext_rtp_timestamp_ += delta;
+        }
+    }
+    if (restart) {
+        ext_rtp_timestamp_ = rtp_timestamp;
+    }
+    last_rtp_timestamp_ = rtp_timestamp;
+
+    auto arrival_us = static_cast<double>(
+        std::chrono::duration_cast<std::chrono::microseconds>(t_arrival.time_since_epoch()).count());
+    auto media_us = static_cast<double>(ext_rtp_timestamp_) * 1'000'000.0 / clock_rate_;
+    auto transit_us = arrival_us - media_us;
+
+    if (restart) {
+        primed_ = true;
+        base_transit_us_ = transit_us;
+        last_transit_us_ = transit_us;
+        jitter_us_ = 0.0;
+        delay_us_ = kMinDelayMicros;
+    }
+
+    // Interarrival jitter, as in RFC 3550.
+    jitter_us_ += (std::fabs(transit_us - last_transit_us_) - jitter_us_) / 16.0;
+    last_transit_us_ = transit_us;
+
+    // Follow the fastest frame down immediately, and creep up slowly so that
+    // drift between the sender's capture clock and ours is tracked.
+    if (transit_us < base_transit_us_) {
+        base_transit_us_ = transit_us;
+    } else {
+        base_transit_us_ += (transit_us - base_transit_us_) / 1024.0;
+    }
+
+    // A frame that arrives after its playout time would be shown late, so
+    // grow the delay at once to cover it. Otherwise, move the delay towards
+    // the target in small steps, since every change disturbs the cadence.
+    auto target_us = std::clamp(kJitterMultiple * jitter_us_, kMinDelayMicros, kMaxDelayMicros);
+    auto late_us = transit_us - base_transit_us_ - delay_us_;
+    if (late_us > 0.0) {
+        ++n_late_;
+        delay_us_ = std::min(delay_us_ + late_us, kMaxDelayMicros);
+    } else {
+        delay_us_ += (target_us - delay_us_) / 64.0;
+    }
+
+    auto playout_us = media_us + base_transit_us_ + delay_us_;
+    return TimePoint(std::chrono::microseconds(std::llround(playout_us)));
+}
+
+void PlayoutClock::Reset()
+{
+    primed_ = false;
+    ext_rtp_timestamp_ = 0;
+}
+
+std::chrono::microseconds PlayoutClock::Interval(uint32_t from, uint32_t to) const
+{
+    auto delta = static_cast<int32_t>(to - from);
+    return std::chrono::microseconds(static_cast<int64_t>(delta) * 1'000'000 / clock_rate_);
+}
+
+std::chrono::microseconds PlayoutClock::Delay() const
+{
+    return std::chrono::microseconds(std::llround(delay_us_));
+}
+
+std::chrono::microseconds PlayoutClock::Jitter() const
+{
+    return std::chrono::microseconds(std::llround(jitter_us_));
+}
+
+} // namespace vacon
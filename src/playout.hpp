@@ -0,0 +1,68 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace vacon {
+
+// Maps the RTP timestamps of received frames, which the sender derives from
+// the camera capture timestamps, onto the local clock, so that frames are
+// shown with the spacing they were captured with. The mapping follows the
+// smallest observed transit time, i.e. the network and decode delay of the
+// fastest frame, plus a jitter buffer delay that adapts to the observed
+// interarrival jitter.
+class PlayoutClock {
+    public:
+        typedef std::chrono::time_point<std::chrono::steady_clock> TimePoint;
+
+        explicit PlayoutClock(uint32_t clock_rate = 90'000)
+            : clock_rate_(clock_rate) {};
+
+        // Returns when the frame with the given RTP timestamp, which became
+        // available at t_arrival, should be shown.
+        TimePoint Update(uint32_t rtp_timestamp, TimePoint t_arrival);
+
+        // Forget the mapping, e.g. when the remote stream restarts.
+        void Reset();
+
+        // Interval between two RTP timestamps.
+        std::chrono::microseconds Interval(uint32_t from, uint32_t to) const;
+
+        std::chrono::microseconds Delay() const;
+        std::chrono::microseconds Jitter() const;
+
+        size_t              n_late_ = 0;
+        size_t              n_resets_ = 0;
+
+    private:
+        uint32_t            clock_rate_;
+
+        bool                primed_ = false;
+        uint32_t            last_rtp_timestamp_ = 0;
+        int64_t             ext_rtp_timestamp_ = 0;
+
+        // Transit times are the arrival time minus the media time, in
+        // microseconds.
+        double              base_transit_us_ = 0.0;
+        double              last_transit_us_ = 0.0;
+        double              jitter_us_ = 0.0;
+        double              delay_us_ = 0.0;
+};
+
+} // namespace vacon
@@ -0,0 +1,116 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "rate_control.hpp"
+
+#include <algorithm>
+#include <format>
+#include <mutex>
+#include <string>
+
+#include <plog/Log.h>
+
+namespace vacon {
+
+// The bitrate is never cut below this.
+static const unsigned kMinBitrateKbps       = 150;
+
+// Multiplicative decrease and increase, in percent of the current bitrate.
+static const unsigned kDecreasePercent      = 75;
+static const unsigned kIncreasePercent      = 110;
+
+// Number of consecutive intervals without backpressure before raising the
+// bitrate. A lower bitrate takes effect at once, so there's no such delay
+// before cutting it again.
+static const unsigned kIncreaseIntervals    = 5;
+
+// Number of intervals to ignore after a decrease, while the link drains.
+static const unsigned kHoldoffIntervals     = 2;
+
+void SendRateController::Reset(unsigned start_kbps, unsigned max_kbps)
+{
+    max_kbps_ = std::max(max_kbps, kMinBitrateKbps);
+    bitrate_kbps_ = std::clamp(start_kbps, kMinBitrateKbps, max_kbps_);
+    primed_ = false;
+    n_healthy_ = 0;
+    n_holdoff_ = 0;
+}
+
+bool SendRateController::Update(const SendRateInputs& in)
+{
+    if (!primed_ || max_kbps_ == 0) {
+        primed_ = true;
+        last_ = in;
+        return false;
+    }
+
+    auto prev = last_;
+    last_ = in;
+
+    if (n_holdoff_ > 0) {
+        --n_holdoff_;
+        return false;
+    }
+
+    // The counters are summed over the peers, so they go down when a peer
+    // leaves.
+    auto delta = [](size_t now, size_t prev) { return now > prev ? now - prev : 0; };
+    auto n_skip = delta(in.n_frames_send_skip, prev.n_frames_send_skip);
+    auto n_fail = delta(in.n_frames_send_fail, prev.n_frames_send_fail);
+    auto old_kbps = BitrateKbps();
+    auto new_kbps = old_kbps;
+
+    std::string reason;
+    if (in.backpressure || n_skip > 0 || n_fail > 0) {
+        n_healthy_ = 0;
+        new_kbps = std::max(old_kbps * kDecreasePercent / 100, kMinBitrateKbps);
+        reason = std::format("sending backed off, {} frames skipped, {} frames not sent", n_skip, n_fail);
+    } else if (++n_healthy_ >= kIncreaseIntervals) {
+        n_healthy_ = 0;
+        new_kbps = std::min(old_kbps * kIncreasePercent / 100, max_kbps_);
+        reason = std::format("no backpressure for {} intervals", kIncreaseIntervals);
+    }
+
+    if (new_kbps == old_kbps) {
+        return false;
+    }
+
+    bitrate_kbps_ = new_kbps;
+    if (new_kbps < old_kbps) {
+        n_decreases_.fetch_add(1, std::memory_order_relaxed);
+        n_holdoff_ = kHoldoffIntervals;
+    } else {
+        n_increases_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    auto decision = std::format("{} bitrate from {} to {} Kbps: {}",
+                                new_kbps < old_kbps ? "Decreasing" : "Increasing",
+                                old_kbps, new_kbps, reason);
+    LOG_INFO << "[Rate control] " << decision;
+    {
+        std::lock_guard lock(mutex_);
+        last_decision_ = decision;
+    }
+
+    return true;
+}
+
+std::string SendRateController::LastDecision()
+{
+    std::lock_guard lock(mutex_);
+    return last_decision_;
+}
+
+} // namespace vacon
@@ -0,0 +1,65 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+namespace vacon {
+
+// A snapshot of the send path of all the peers, taken once per evaluation
+// interval. The frame counters are cumulative; the controller derives the
+// per-interval values itself.
+struct SendRateInputs {
+    bool            backpressure                = false;
+    size_t          n_frames_send_skip          = 0;
+    size_t          n_frames_send_fail          = 0;
+};
+
+// Adjusts the encoder bitrate to what the transport can send. The bitrate
+// is cut as soon as the transport drops outgoing video, which is long before
+// any feedback from the receivers arrives, and raised again slowly while it
+// sends everything.
+class SendRateController {
+    public:
+        // Start over at the given bitrate, never going above max_kbps.
+        void Reset(unsigned start_kbps, unsigned max_kbps);
+
+        // Evaluate the send path. Returns true if the bitrate changed and
+        // needs to be applied to the encoder.
+        bool Update(const SendRateInputs&);
+
+        unsigned BitrateKbps() const { return bitrate_kbps_.load(std::memory_order_relaxed); }
+        std::string LastDecision();
+
+        std::atomic_size_t  n_decreases_ = 0;
+        std::atomic_size_t  n_increases_ = 0;
+
+    private:
+        std::atomic_uint    bitrate_kbps_ = 0;
+        unsigned            max_kbps_ = 0;
+        bool                primed_ = false;
+        unsigned            n_healthy_ = 0;
+        unsigned            n_holdoff_ = 0;
+        SendRateInputs      last_ = {};
+
+        std::mutex          mutex_;
+        std::string         last_decision_ = {};
+};
+
+} // namespace vacon
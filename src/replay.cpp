@@ -0,0 +1,299 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+// vacon-replay feeds an RTP capture written with --network-capture through
+// the depacketizer and the decoder, either with the recorded packet timing
+// or as fast as possible, and reports the reassembly and decode throughput
+// and latency.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <argparse/argparse.hpp>
+#include <plog/Log.h>
+#include <rtc/rtc.hpp>
+
+#include "codecs.hpp"
+#include "linux/decoder.hpp"
+#include "linux/mfx_loader.hpp"
+#include "linux/typedefs.hpp"
+#include "rtc_packet.hpp"
+#include "rtp/payload_format.hpp"
+#include "rtp/rtp_capture.hpp"
+#include "stats.hpp"
+#include "util.hpp"
+
+using namespace std::chrono_literals;
+using namespace vacon;
+
+typedef std::chrono::time_point<std::chrono::steady_clock> TimePoint;
+
+static void PrintStats(const char* name, Welford& w)
+{
+    auto s = w.Result();
+    std::cout << std::format("{:<16} {:>10.1f} ± {:>9.1f} µs [{:.1f}, {:.1f}] n={}\n",
+                             name, s.mean, s.stdev, s.min, s.max, static_cast<size_t>(s.count));
+}
+
+int main(int argc, char *argv[])
+{
+    int verbosity = 0;
+
+    argparse::ArgumentParser args("vacon-replay", PROJECT_VERSION);
+
+    args.add_argument("-v", "--verbose")
+        .help("increase logging verbosity")
+        .action([&](const auto &) { ++verbosity; })
+        .append()
+        .default_value(false)
+        .implicit_value(true)
+        .nargs(0);
+
+    args.add_argument("--codec")
+        .metavar("CODEC")
+        .help("video codec of the captured stream")
+        .required();
+
+    args.add_argument("--payload-format")
+        .metavar("FORMAT")
+        .help("RTP payload format of the captured stream: generic, generic-v1, or standard")
+        .default_value(std::string("generic"))
+        .nargs(1);
+
+    args.add_argument("--flat-out")
+        .help("feed the packets as fast as possible instead of with the recorded timing")
+        .flag();
+
+    args.add_argument("--repeat")
+        .metavar("N")
+        .help("number of times to replay the capture")
+        .default_value(1u)
+        .scan<'u', unsigned>()
+        .nargs(1);
+
+    args.add_argument("capture")
+        .metavar("CAPTURE")
+        .help("RTP capture file written with --network-capture");
+
+    try {
+        args.parse_args(argc, argv);
+    } catch (const std::exception& err) {
+        std::cerr << "vacon-replay: Error parsing arguments: " << err.what() << "\n\n" << args;
+        return EXIT_FAILURE;
+    }
+
+    util::SetupLogging(verbosity);
+
+    auto codec = FromString(args.get<std::string>("--codec"));
+    if (codec == VideoCodec::UNKNOWN) {
+        LOG_FATAL << "Unknown codec " << args.get<std::string>("--codec");
+        return EXIT_FAILURE;
+    }
+
+    auto payload_format = PayloadFormatFromString(args.get<std::string>("--payload-format"));
+    if (!payload_format) {
+        LOG_FATAL << "Unknown payload format " << args.get<std::string>("--payload-format");
+        return EXIT_FAILURE;
+    }
+
+    auto packets = ReadRtpCapture(args.get<std::string>("capture"));
+    if (!packets || packets->empty()) {
+        LOG_FATAL << "No packets to replay";
+        return EXIT_FAILURE;
+    }
+
+    auto flat_out = args["--flat-out"] == true;
+    auto n_repeat = args.get<unsigned>("--repeat");
+
+    auto incoming_queue = std::make_shared<RtcPacketQueue>(64);
+    auto decoded_queue = std::make_shared<linux::DecodedFrameQueue>(64);
+
+    auto decoder = linux::Decoder::Create(linux::DecoderParams {
+        .incoming_video_packet_queue    = incoming_queue,
+        .decoded_video_frame_queue      = decoded_queue,
+    });
+    if (!decoder) {
+        LOG_FATAL << "linux::Decoder::Create() failed!";
+        return EXIT_FAILURE;
+    }
+    if (decoder->GetSupportedCodecs(codec)->empty()) {
+        LOG_FATAL << "Decoder doesn't support codec " << ToString(codec);
+        return EXIT_FAILURE;
+    }
+    decoder->StartThread(codec);
+
+    // Reassembled frames waiting to be decoded, by RTP timestamp, with the
+    // time at which they were queued for the decoder. Frames that the
+    // decoder drops stay here.
+    std::mutex pending_mutex;
+    std::unordered_map<uint32_t, TimePoint> pending;
+
+    Welford s_reassembly_time = {};
+    Welford s_reassembly_latency = {};
+    Welford s_decode_latency = {};
+    std::atomic_size_t n_decoded = 0;
+
+    // Drain the decoded frames, releasing their surfaces immediately.
+    auto drain = std::jthread([&](std::stop_token st) {
+        util::SetThreadName("VReplayDrain");
+        while (!st.stop_requested()) {
+            std::shared_ptr<linux::DecodedFrame> frame;
+            if (!decoded_queue->wait_dequeue_timed(frame, 10ms)) {
+                continue;
+            }
+            auto t_now = std::chrono::steady_clock::now();
+            auto ts = frame->rtp_timestamp_;
+            frame = nullptr;
+
+            std::lock_guard lock(pending_mutex);
+            if (auto it = pending.find(ts); it != pending.end()) {
+                auto latency = std::chrono::duration_cast<std::chrono::microseconds>(t_now - it->second);
+                s_decode_latency.Update(latency.count());
+                pending.erase(it);
+            }
+            n_decoded.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    auto depacketizer = CreateVideoDepacketizer(codec, *payload_format);
+    std::unordered_map<uint32_t, TimePoint> t_last_packet;
+    size_t n_packets = 0;
+    size_t n_frames = 0;
+    size_t n_bytes = 0;
+
+    // The frames of every repeat are queued with their RTP timestamps moved
+    // past those of the previous repeat, so that the decoded frames can be
+    // told apart.
+    uint32_t ts_span = 0;
+    std::optional<uint32_t> ts_first;
+    for (const auto& packet : *packets) {
+        if (packet.data.size() >= sizeof(rtc::RtpHeader)) {
+            auto ts = reinterpret_cast<const rtc::RtpHeader*>(packet.data.data())->timestamp();
+            if (!ts_first) {
+                ts_first = ts;
+            }
+            if (auto d = static_cast<int32_t>(ts - *ts_first); d > 0) {
+                ts_span = std::max(ts_span, static_cast<uint32_t>(d));
+            }
+        }
+    }
+
+    auto t_start = std::chrono::steady_clock::now();
+    for (unsigned repeat = 0; repeat < n_repeat; ++repeat) {
+        auto t_repeat_start = std::chrono::steady_clock::now();
+        uint32_t ts_offset = repeat * (ts_span + 1);
+        auto t_first_arrival = packets->front().t_arrival_ns;
+
+        for (const auto& packet : *packets) {
+            if (!flat_out) {
+                std::this_thread::sleep_until(t_repeat_start +
+                                              std::chrono::nanoseconds(packet.t_arrival_ns - t_first_arrival));
+            }
+
+            auto t_feed = std::chrono::steady_clock::now();
+            if (packet.data.size() >= sizeof(rtc::RtpHeader)) {
+                auto rtp = reinterpret_cast<const rtc::RtpHeader*>(packet.data.data());
+                t_last_packet[rtp->timestamp()] = t_feed;
+            }
+
+            rtc::message_vector messages;
+            messages.emplace_back(rtc::make_message(packet.data.begin(), packet.data.end()));
+            depacketizer->incoming(messages, [](rtc::message_ptr) {});
+            ++n_packets;
+
+            auto t_emit = std::chrono::steady_clock::now();
+            if (!messages.empty()) {
+                s_reassembly_time.Update(std::chrono::duration_cast<std::chrono::microseconds>(t_emit - t_feed).count());
+            }
+
+            for (auto& message : messages) {
+                if (message->type == rtc::Message::Control || !message->frameInfo) {
+                    continue;
+                }
+
+                // Time from the last packet of the frame to the reassembled
+                // frame, which includes waiting for the next frame to start.
+                auto ts = message->frameInfo->timestamp;
+                if (auto it = t_last_packet.find(ts); it != t_last_packet.end()) {
+                    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(t_emit - it->second);
+                    s_reassembly_latency.Update(latency.count());
+                    t_last_packet.erase(it);
+                }
+
+                ++n_frames;
+                n_bytes += message->size();
+
+                auto frame_info = *message->frameInfo;
+                frame_info.timestamp += ts_offset;
+                auto rtc_packet = RtcPacket::Create(rtc::binary(message->begin(), message->end()),
+                                                    frame_info);
+                {
+                    std::lock_guard lock(pending_mutex);
+                    pending[frame_info.timestamp] = std::chrono::steady_clock::now();
+                }
+                while (!incoming_queue->wait_enqueue_timed(rtc_packet, 100ms)) {
+                    LOG_DEBUG << "Stalled enqueuing packet onto incoming video packet queue, retrying";
+                }
+            }
+        }
+    }
+
+    // Wait for the decoder to finish the queued frames.
+    auto n_done = [&]() {
+        return n_decoded.load() + decoder->n_frames_fail_.load();
+    };
+    size_t n_last = 0;
+    do {
+        n_last = n_done();
+        std::this_thread::sleep_for(100ms);
+    } while (incoming_queue->size_approx() > 0 || n_done() != n_last);
+    auto t_end = std::chrono::steady_clock::now();
+
+    drain.request_stop();
+    drain.join();
+    decoder->RequestStop();
+    decoder->Join();
+
+    auto seconds = std::chrono::duration<double>(t_end - t_start).count();
+    std::cout << std::format("Replayed {} packets, {} frames, {} bytes in {:.3f} s ({})\n",
+                             n_packets, n_frames, n_bytes, seconds,
+                             flat_out ? "flat out" : "recorded timing");
+    std::cout << std::format("Reassembly:      {:.1f} packets/s, {:.1f} frames/s, {:.2f} Mbit/s\n",
+                             n_packets / seconds, n_frames / seconds, n_bytes * 8.0 / seconds / 1'000'000.0);
+    std::cout << std::format("Decode:          {} frames, {} failed, {} never output, {:.1f} frames/s\n",
+                             n_decoded.load(), decoder->n_frames_fail_.load(), pending.size(),
+                             n_decoded.load() / seconds);
+    PrintStats("Reassembly time", s_reassembly_time);
+    PrintStats("Reassembly lat.", s_reassembly_latency);
+    PrintStats("Decode time", decoder->s_decode_time_);
+    PrintStats("Decode latency", s_decode_latency);
+
+    decoder = nullptr;
+    linux::MfxLoader::DestroyInstance();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "resources.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace vacon {
+
+struct ResourceCounters {
+    std::atomic_size_t  count       = 0;
+    std::atomic_size_t  bytes       = 0;
+    std::atomic_size_t  peak_count  = 0;
+    std::atomic_size_t  peak_bytes  = 0;
+};
+
+static std::array<ResourceCounters, kResourceCount> g_resources;
+
+static void RaisePeak(std::atomic_size_t& peak, size_t value)
+{
+    auto prev = peak.load(std::memory_order_relaxed);
+    while (prev < value && !peak.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {}
+}
+
+const char* ToString(Resource resource)
+{
+    switch (resource) {
+    case Resource::VplSurface:  return "VPL surfaces";
+    case Resource::DmabufFd:    return "DMABUF fds";
+    case Resource::CameraMmap:  return "Camera mmaps";
+    case Resource::Bitstream:   return "Bitstreams";
+    }
+    return "?";
+}
+
+ResourceUsage GetResourceUsage(Resource resource)
+{
+    const auto& c = g_resources[static_cast<size_t>(resource)];
+    return ResourceUsage {
+        .resource   = resource,
+        .count      = c.count.load(std::memory_order_relaxed),
+        .bytes      = c.bytes.load(std::memory_order_relaxed),
+        .peak_count = c.peak_count.load(std::memory_order_relaxed),
+        .peak_bytes = c.peak_bytes.load(std::memory_order_relaxed),
+    };
+}
+
+std::vector<ResourceUsage> GetResourceUsage()
+{
+    std::vector<ResourceUsage> usage;
+    for (size_t i = 0; i < kResourceCount; ++i) {
+        usage.emplace_back(GetResourceUsage(static_cast<Resource>(i)));
+    }
+    return usage;
+}
+
+ResourceLease::ResourceLease(Resource resource, size_t bytes, size_t count)
+    : resource_(resource), bytes_(bytes), count_(count), held_(true)
+{
+    auto& c = g_resources[static_cast<size_t>(resource_)];
+    RaisePeak(c.peak_count, c.count.fetch_add(count_, std::memory_order_relaxed) + count_);
+    RaisePeak(c.peak_bytes, c.bytes.fetch_add(bytes_, std::memory_order_relaxed) + bytes_);
+}
+
+ResourceLease::ResourceLease(ResourceLease&& src) noexcept
+    : resource_(src.resource_), bytes_(src.bytes_), count_(src.count_),
+      held_(std::exchange(src.held_, false))
+{
+}
+
+ResourceLease& ResourceLease::operator=(ResourceLease&& src) noexcept
+{
+    if (this != &src) {
+        Reset();
+        resource_ = src.resource_;
+        bytes_ = src.bytes_;
+        count_ = src.count_;
+        held_ = std::exchange(src.held_, false);
+    }
+    return *this;
+}
+
+ResourceLease::~ResourceLease()
+{
+    Reset();
+}
+
+void ResourceLease::Reset()
+{
+    if (held_) {
+        auto& c = g_resources[static_cast<size_t>(resource_)];
+        c.count.fetch_sub(count_, std::memory_order_relaxed);
+        c.bytes.fetch_sub(bytes_, std::memory_order_relaxed);
+        held_ = false;
+    }
+}
+
+} // namespace vacon
@@ -0,0 +1,75 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace vacon {
+
+// Categories of memory and file descriptors held by the video pipeline.
+enum class Resource {
+    // Surfaces from libvpl, held by the encoded and decoded frames.
+    VplSurface,
+    // DRM PRIME fds of the decoded frames, and the camera's dmabuf fds.
+    DmabufFd,
+    // Camera buffers mapped into memory.
+    CameraMmap,
+    // Buffers of the encoded frames.
+    Bitstream,
+};
+
+static const size_t kResourceCount = 4;
+
+const char* ToString(Resource);
+
+// The live count and size of a resource category, and their high-water
+// marks since the start.
+struct ResourceUsage {
+    Resource        resource    = Resource::VplSurface;
+    size_t          count       = 0;
+    size_t          bytes       = 0;
+    size_t          peak_count  = 0;
+    size_t          peak_bytes  = 0;
+};
+
+ResourceUsage GetResourceUsage(Resource);
+std::vector<ResourceUsage> GetResourceUsage();
+
+// Accounts for a resource, or a few of the same category, from when it is
+// acquired until the lease is reset or destroyed. Held next to the resource
+// by the object that owns it, and moved along with it.
+class ResourceLease {
+    public:
+        ResourceLease() = default;
+        ResourceLease(Resource, size_t bytes, size_t count = 1);
+        ResourceLease(ResourceLease&&) noexcept;
+        ResourceLease& operator=(ResourceLease&&) noexcept;
+        ~ResourceLease();
+
+        void Reset();
+        explicit operator bool() const { return held_; }
+
+    private:
+        Resource        resource_   = Resource::VplSurface;
+        size_t          bytes_      = 0;
+        size_t          count_      = 0;
+        bool            held_       = false;
+};
+
+} // namespace vacon
@@ -15,6 +15,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <utility>
 
@@ -30,7 +31,7 @@ class RtcPacket {
         };
 
         RtcPacket(RtcPacket&& src)
-            : frame_info_(src.frame_info_)
+            : frame_info_(src.frame_info_), t_received_(src.t_received_)
         {
             msg_ = std::move(src.msg_);
         };
@@ -40,6 +41,10 @@ class RtcPacket {
         rtc::binary msg_;
         rtc::FrameInfo frame_info_;
 
+        // When the last packet of the frame arrived, if it came from the
+        // network.
+        std::chrono::time_point<std::chrono::steady_clock> t_received_ = {};
+
     private:
         RtcPacket(rtc::binary msg, rtc::FrameInfo frame_info)
             : msg_(std::move(msg)), frame_info_(frame_info) {};
@@ -16,8 +16,10 @@
 #include "rtc_utils.hpp"
 
 #include <algorithm>
+#include <format>
 #include <memory>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -25,6 +27,7 @@
 #include <plog/Log.h>
 
 #include "codecs.hpp"
+#include "rtp/payload_format.hpp"
 
 namespace vacon {
 
@@ -61,6 +64,59 @@ VideoCodec DescriptionVideoCodec(rtc::Description::Media* desc)
     return FromString(desc->rtpMap(payload_types.front())->format);
 }
 
+// Returns the value of the payload format parameter, or an empty string.
+static std::string_view PayloadFormatParameter(std::string_view fmtp)
+{
+    while (!fmtp.empty()) {
+        auto end = fmtp.find(';');
+        auto param = fmtp.substr(0, end);
+        while (param.starts_with(' ')) {
+            param.remove_prefix(1);
+        }
+        if (param.starts_with(kPayloadFormatFmtp) && param.size() > kPayloadFormatFmtp.size() &&
+            param[kPayloadFormatFmtp.size()] == '=') {
+            return param.substr(kPayloadFormatFmtp.size() + 1);
+        }
+        if (end == std::string_view::npos) {
+            break;
+        }
+        fmtp.remove_prefix(end + 1);
+    }
+    return {};
+}
+
+PayloadFormat DescriptionPayloadFormat(rtc::Description::Media* media)
+{
+    std::optional<PayloadFormat> format = std::nullopt;
+
+    for (auto ptype : media->payloadTypes()) {
+        std::optional<PayloadFormat> codec_format = std::nullopt;
+        for (const auto& fmtp : media->rtpMap(ptype)->fmtps) {
+            if (auto value = PayloadFormatParameter(fmtp); !value.empty()) {
+                codec_format = PayloadFormatFromString(std::string(value));
+            }
+        }
+        // All codecs must agree, unknown formats are taken for generic.
+        if (!codec_format || (format && format != codec_format)) {
+            return PayloadFormat::Generic;
+        }
+        format = codec_format;
+    }
+
+    return format.value_or(PayloadFormat::Generic);
+}
+
+void SetDescriptionPayloadFormat(rtc::Description::Media* media, PayloadFormat format)
+{
+    for (auto ptype : media->payloadTypes()) {
+        auto& fmtps = media->rtpMap(ptype)->fmtps;
+        std::erase_if(fmtps, [](const auto& fmtp) { return !PayloadFormatParameter(fmtp).empty(); });
+        if (format != PayloadFormat::Generic) {
+            fmtps.emplace_back(std::format("{}={}", kPayloadFormatFmtp, ToString(format)));
+        }
+    }
+}
+
 void LogDescriptionVideo(rtc::Description& desc, std::optional<std::string_view> extra)
 {
     if (extra) {
@@ -77,9 +133,10 @@ void LogDescriptionVideo(rtc::Description& desc, std::optional<std::string_view>
             for (auto payload_type : payload_types) {
                 const auto rtp_map = media->rtpMap(payload_type);
                 LOG_DEBUG <<
-                    std::format("Video #{}, mid {}, payload type {}, format {}, direction {}",
+                    std::format("Video #{}, mid {}, payload type {}, format {}, direction {}, payload {}",
                                 i, media->mid(), payload_type, rtp_map->format,
-                                ToString(media->direction()));
+                                ToString(media->direction()),
+                                ToString(DescriptionPayloadFormat(media)));
             }
         }
     }
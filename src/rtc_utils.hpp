@@ -24,6 +24,7 @@
 #include <rtc/rtc.hpp>
 
 #include "codecs.hpp"
+#include "rtp/payload_format.hpp"
 
 namespace vacon {
 
@@ -33,6 +34,14 @@ int DescriptionMediaPayloadTypeByFormat(rtc::Description::Media* media, std::str
 
 VideoCodec DescriptionVideoCodec(rtc::Description::Media* desc);
 
+// The payload format of the media's codecs, Generic unless all of them carry
+// the same payload format parameter.
+PayloadFormat DescriptionPayloadFormat(rtc::Description::Media* media);
+
+// Sets the payload format parameter of all of the media's codecs, or removes
+// it for Generic.
+void SetDescriptionPayloadFormat(rtc::Description::Media* media, PayloadFormat format);
+
 void LogDescriptionVideo(rtc::Description& desc,
                          std::optional<std::string_view> extra = std::nullopt);
 
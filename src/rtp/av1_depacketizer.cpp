@@ -0,0 +1,129 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "rtp/av1_depacketizer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <span>
+
+#include <rtc/rtc.hpp>
+#include <plog/Log.h>
+
+#include "rtp/av1_payload.hpp"
+
+namespace vacon {
+
+namespace {
+
+void AppendObu(rtc::binary& out, const rtc::binary& obu)
+{
+    auto header = std::to_integer<uint8_t>(obu[0]);
+    size_t header_size = (header & kAv1ObuExtensionFlag) ? 2 : 1;
+    if (obu.size() < header_size || Av1ObuType(obu[0]) == kAv1ObuTemporalDelimiter) {
+        return;
+    }
+
+    out.push_back(std::byte(header | kAv1ObuHasSizeField));
+    if (header_size == 2) {
+        out.push_back(obu[1]);
+    }
+    AppendLeb128(out, obu.size() - header_size);
+    out.insert(out.end(), obu.begin() + header_size, obu.end());
+}
+
+} // namespace
+
+rtc::binary Av1RtpDepacketizer::ReassembleFrame(std::span<const Packet> packets)
+{
+    static const std::byte kTemporalDelimiter[] = {
+        std::byte((kAv1ObuTemporalDelimiter << 3) | kAv1ObuHasSizeField), std::byte{0},
+    };
+
+    rtc::binary out(std::begin(kTemporalDelimiter), std::end(kTemporalDelimiter));
+    rtc::binary obu = {};
+    auto obu_started = false;
+    uint16_t obu_next_seq = 0;
+
+    for (const auto& packet : packets) {
+        auto payload = packet.payload;
+        if (payload.size() < 2) {
+            continue;
+        }
+
+        auto aggregation_header = std::to_integer<uint8_t>(payload[0]);
+        auto z = (aggregation_header & kAv1AggregationZ) != 0;
+        auto y = (aggregation_header & kAv1AggregationY) != 0;
+        size_t w = (aggregation_header & kAv1AggregationWMask) >> kAv1AggregationWShift;
+
+        if (obu_started && (!z || packet.seq != obu_next_seq)) {
+            LOG_DEBUG << std::format("Gap in sequence number (expected {}, current {}), dropped OBU fragment",
+                                     obu_next_seq, packet.seq);
+            obu_started = false;
+        }
+
+        size_t offset = 1;
+        for (size_t i = 0; offset < payload.size(); ++i) {
+            // The last of W elements has no size, it fills the packet.
+            size_t size = payload.size() - offset;
+            if (w == 0 || i + 1 < w) {
+                auto leb = ReadLeb128(payload.subspan(offset));
+                if (!leb || offset + leb->second + leb->first > payload.size()) {
+                    LOG_DEBUG << "Invalid OBU element size";
+                    break;
+                }
+                offset += leb->second;
+                size = leb->first;
+            }
+            auto element = payload.subspan(offset, size);
+            offset += size;
+            auto last = (w != 0 && i + 1 == w) || offset == payload.size();
+
+            if (i == 0 && z) {
+                // The continuation of the previous packet's last OBU.
+                if (!obu_started) {
+                    if (last && y) {
+                        break;
+                    }
+                    continue;
+                }
+                obu.insert(obu.end(), element.begin(), element.end());
+            } else {
+                obu.assign(element.begin(), element.end());
+                obu_started = !obu.empty();
+            }
+
+            if (last && y) {
+                obu_next_seq = packet.seq + 1;
+                break;
+            }
+            if (obu_started) {
+                AppendObu(out, obu);
+                obu_started = false;
+            }
+            if (last) {
+                break;
+            }
+        }
+    }
+
+    if (out.size() == std::size(kTemporalDelimiter)) {
+        return {};
+    }
+    return out;
+}
+
+} // namespace vacon
@@ -0,0 +1,37 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <span>
+
+#include <rtc/rtc.hpp>
+
+#include "rtp/frame_depacketizer.hpp"
+
+namespace vacon {
+
+// Depacketizes the AV1 RTP payload format into a low-overhead bitstream
+// temporal unit, starting with a temporal delimiter and with the size field
+// of every OBU set. A lost packet only costs the OBUs it carried.
+class Av1RtpDepacketizer final : public FrameRtpDepacketizer {
+    public:
+        Av1RtpDepacketizer() = default;
+
+    protected:
+        rtc::binary ReassembleFrame(std::span<const Packet> packets) override;
+};
+
+} // namespace vacon
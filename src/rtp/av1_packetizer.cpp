@@ -0,0 +1,179 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "rtp/av1_packetizer.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <rtc/rtc.hpp>
+#include <plog/Log.h>
+
+#include "rtp/av1_payload.hpp"
+
+namespace vacon {
+
+namespace {
+
+struct Obu {
+    // The OBU header with obu_has_size_field cleared, and the extension
+    // header if there is one.
+    std::byte                   header[2];
+    size_t                      header_size;
+    std::span<const std::byte>  payload;
+
+    size_t size() const { return header_size + payload.size(); }
+};
+
+std::vector<Obu> ParseObus(std::span<const std::byte> data, bool& has_sequence_header)
+{
+    std::vector<Obu> obus;
+    size_t offset = 0;
+
+    while (offset < data.size()) {
+        Obu obu = {};
+        auto header = std::to_integer<uint8_t>(data[offset]);
+        obu.header[0] = std::byte(header & ~kAv1ObuHasSizeField);
+        obu.header_size = (header & kAv1ObuExtensionFlag) ? 2 : 1;
+        if (offset + obu.header_size > data.size()) {
+            break;
+        }
+        if (obu.header_size == 2) {
+            obu.header[1] = data[offset + 1];
+        }
+        offset += obu.header_size;
+
+        size_t size = data.size() - offset;
+        if (header & kAv1ObuHasSizeField) {
+            auto leb = ReadLeb128(data.subspan(offset));
+            if (!leb || offset + leb->second + leb->first > data.size()) {
+                LOG_DEBUG << "Invalid OBU size";
+                break;
+            }
+            offset += leb->second;
+            size = leb->first;
+        }
+        obu.payload = data.subspan(offset, size);
+        offset += size;
+
+        auto type = Av1ObuType(obu.header[0]);
+        if (type == kAv1ObuTemporalDelimiter || type == kAv1ObuTileList || type == kAv1ObuPadding) {
+            continue;
+        }
+        if (type == kAv1ObuSequenceHeader) {
+            has_sequence_header = true;
+        }
+        obus.push_back(obu);
+    }
+
+    return obus;
+}
+
+} // namespace
+
+void Av1RtpPacketizer::outgoing(rtc::message_vector& messages,
+                                [[maybe_unused]] const rtc::message_callback& send)
+{
+    rtc::message_vector result;
+
+    for (const auto& message : messages) {
+        auto has_sequence_header = false;
+        auto obus = ParseObus(*message, has_sequence_header);
+        if (obus.empty()) {
+            LOG_VERBOSE << "No OBUs in frame, size=" << message->size();
+            continue;
+        }
+
+        // Size the packets alike, rather than filling them up and leaving a
+        // small one at the end.
+        size_t total_size = 0;
+        for (const auto& obu : obus) {
+            total_size += Leb128Size(obu.size()) + obu.size();
+        }
+        auto packet_count = (total_size + max_payload_size_ - 2) / (max_payload_size_ - 1);
+        auto max_size = std::min(max_payload_size_, 1 + (total_size + packet_count - 1) / packet_count + 2);
+
+        std::vector<std::shared_ptr<rtc::binary>> payloads;
+        std::shared_ptr<rtc::binary> payload;
+        uint8_t aggregation_header = 0;
+
+        auto start_packet = [&]() {
+            payload = std::make_shared<rtc::binary>();
+            payload->reserve(max_size);
+            payload->push_back(std::byte(aggregation_header));
+        };
+        auto finish_packet = [&]() {
+            payloads.push_back(payload);
+            payload = nullptr;
+        };
+
+        // The first packet of a coded video sequence has N set, and every
+        // OBU element is preceded by its size (W is 0).
+        aggregation_header = has_sequence_header ? kAv1AggregationN : 0;
+        start_packet();
+        aggregation_header = 0;
+
+        for (const auto& obu : obus) {
+            size_t offset = 0;
+            while (offset < obu.size()) {
+                auto room = max_size - payload->size();
+                if (room <= Leb128Size(room)) {
+                    finish_packet();
+                    start_packet();
+                    room = max_size - payload->size();
+                }
+
+                auto size = std::min(obu.size() - offset, room - Leb128Size(room));
+                AppendLeb128(*payload, size);
+                auto end = offset + size;
+                for (; offset < std::min(end, obu.header_size); ++offset) {
+                    payload->push_back(obu.header[offset]);
+                }
+                if (end > offset) {
+                    payload->insert(payload->end(),
+                                    obu.payload.begin() + (offset - obu.header_size),
+                                    obu.payload.begin() + (end - obu.header_size));
+                    offset = end;
+                }
+
+                if (offset < obu.size()) {
+                    // The OBU continues in the next packet: Y is set on this
+                    // one, and Z on the next.
+                    (*payload)[0] |= std::byte{kAv1AggregationY};
+                    finish_packet();
+                    aggregation_header = kAv1AggregationZ;
+                    start_packet();
+                    aggregation_header = 0;
+                }
+            }
+        }
+        if (payload->size() > 1) {
+            finish_packet();
+        }
+
+        for (size_t i = 0; i < payloads.size(); ++i) {
+            result.push_back(packetize(payloads[i], i + 1 == payloads.size()));
+        }
+    }
+
+    messages.swap(result);
+}
+
+} // namespace vacon
@@ -0,0 +1,45 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include <rtc/rtc.hpp>
+
+namespace vacon {
+
+// Packetizes an AV1 low-overhead bitstream according to the AV1 RTP payload
+// format. Temporal delimiter, tile list and padding OBUs are dropped, the
+// other OBUs are sent without their size field, packed into as few packets
+// as possible, and split across packets where they don't fit.
+class Av1RtpPacketizer final : public rtc::RtpPacketizer {
+    public:
+        inline static const size_t defaultMaxPayloadSize = 1350;
+
+        Av1RtpPacketizer(std::shared_ptr<rtc::RtpPacketizationConfig> rtpConfig,
+                         uint16_t max_payload_size = defaultMaxPayloadSize)
+        : RtpPacketizer(std::move(rtpConfig)), max_payload_size_(max_payload_size) {}
+
+        void outgoing(rtc::message_vector& messages, const rtc::message_callback& send) override;
+
+    private:
+        const size_t    max_payload_size_;
+};
+
+} // namespace vacon
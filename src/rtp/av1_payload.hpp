@@ -0,0 +1,84 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+
+#include <rtc/rtc.hpp>
+
+namespace vacon {
+
+// The AV1 RTP payload format (AOMedia, "RTP Payload Format For AV1"). Every
+// packet starts with an aggregation header: Z(1) Y(1) W(2) N(1) reserved(3).
+static const uint8_t kAv1AggregationZ       = 0x80;
+static const uint8_t kAv1AggregationY       = 0x40;
+static const uint8_t kAv1AggregationWMask   = 0x30;
+static const unsigned kAv1AggregationWShift = 4;
+static const uint8_t kAv1AggregationN       = 0x08;
+
+// OBU header: forbidden(1) type(4) extension_flag(1) has_size_field(1)
+// reserved(1).
+static const uint8_t kAv1ObuExtensionFlag   = 0x04;
+static const uint8_t kAv1ObuHasSizeField    = 0x02;
+
+static const uint8_t kAv1ObuSequenceHeader  = 1;
+static const uint8_t kAv1ObuTemporalDelimiter = 2;
+static const uint8_t kAv1ObuTileList        = 8;
+static const uint8_t kAv1ObuPadding         = 15;
+
+constexpr uint8_t Av1ObuType(std::byte header)
+{
+    return (std::to_integer<uint8_t>(header) >> 3) & 0x0f;
+}
+
+constexpr size_t Leb128Size(uint64_t value)
+{
+    size_t n = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++n;
+    }
+    return n;
+}
+
+inline void AppendLeb128(rtc::binary& out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<std::byte>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<std::byte>(value));
+}
+
+// Returns the value and the number of bytes it took up.
+inline std::optional<std::pair<uint64_t, size_t>> ReadLeb128(std::span<const std::byte> data)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < data.size() && i < 8; ++i) {
+        auto b = std::to_integer<uint8_t>(data[i]);
+        value |= static_cast<uint64_t>(b & 0x7f) << (7 * i);
+        if (!(b & 0x80)) {
+            return std::make_pair(value, i + 1);
+        }
+    }
+    return std::nullopt;
+}
+
+} // namespace vacon
@@ -0,0 +1,136 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "rtp/frame_depacketizer.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <rtc/rtc.hpp>
+#include <plog/Log.h>
+
+namespace vacon {
+
+namespace {
+
+// How far back, in 90 kHz units, a timestamp may be and still be taken for a
+// late packet rather than for a restarted stream.
+const int32_t kMaxLateTimestamp = 10 * 90000;
+
+int32_t TimestampDiff(uint32_t a, uint32_t b)
+{
+    return static_cast<int32_t>(a - b);
+}
+
+} // namespace
+
+void FrameRtpDepacketizer::incoming(rtc::message_vector& messages, const rtc::message_callback&)
+{
+    rtc::message_vector out = {};
+
+    for (auto& message : messages) {
+        if (message->type == rtc::Message::Control) {
+            out.push_back(std::move(message));
+            continue;
+        }
+
+        if (message->size() < sizeof(rtc::RtpHeader)) {
+            LOG_VERBOSE << "RTP packet is too small, size=" << message->size();
+            continue;
+        }
+
+        auto rtp = reinterpret_cast<const rtc::RtpHeader *>(message->data());
+        auto timestamp = rtp->timestamp();
+
+        if (last_emitted_timestamp_ &&
+            TimestampDiff(timestamp, *last_emitted_timestamp_) <= 0 &&
+            TimestampDiff(timestamp, *last_emitted_timestamp_) > -kMaxLateTimestamp) {
+            LOG_VERBOSE << std::format("Dropped late RTP packet {} of timestamp {}",
+                                       rtp->seqNumber(), timestamp);
+            continue;
+        }
+
+        if (!rtp_buffer_.empty() && timestamp != buffer_timestamp_) {
+            if (TimestampDiff(timestamp, buffer_timestamp_) < 0 &&
+                TimestampDiff(timestamp, buffer_timestamp_) > -kMaxLateTimestamp) {
+                LOG_VERBOSE << std::format("Dropped late RTP packet {} of timestamp {}",
+                                           rtp->seqNumber(), timestamp);
+                continue;
+            }
+            // The marker packet of the buffered frame was lost, or the
+            // stream was restarted.
+            EmitFrame(out);
+        }
+
+        auto marker = rtp->marker();
+        buffer_timestamp_ = timestamp;
+        rtp_buffer_.push_back(std::move(message));
+
+        if (marker) {
+            EmitFrame(out);
+        }
+    }
+
+    messages.swap(out);
+}
+
+void FrameRtpDepacketizer::EmitFrame(rtc::message_vector& out)
+{
+    // Order the packets by sequence number, allowing for wraparound.
+    auto first_seq = reinterpret_cast<const rtc::RtpHeader *>(rtp_buffer_.front()->data())->seqNumber();
+    std::vector<Packet> packets;
+    packets.reserve(rtp_buffer_.size());
+
+    for (const auto& message : rtp_buffer_) {
+        auto rtp = reinterpret_cast<const rtc::RtpHeader *>(message->data());
+        size_t header_size = rtp->getSize() + rtp->getExtensionHeaderSize();
+        size_t end = message->size();
+        if (rtp->padding() && end > header_size) {
+            end -= std::min(end - header_size, static_cast<size_t>(message->back()));
+        }
+        if (end <= header_size) {
+            continue;
+        }
+        packets.push_back({
+            .seq        = rtp->seqNumber(),
+            .payload    = std::span<const std::byte>(message->data() + header_size, end - header_size),
+        });
+    }
+
+    std::stable_sort(packets.begin(), packets.end(), [first_seq](const Packet& a, const Packet& b) {
+        return static_cast<int16_t>(a.seq - first_seq) < static_cast<int16_t>(b.seq - first_seq);
+    });
+    packets.erase(std::unique(packets.begin(), packets.end(),
+                              [](const Packet& a, const Packet& b) { return a.seq == b.seq; }),
+                  packets.end());
+
+    auto frame = ReassembleFrame(packets);
+    if (!frame.empty()) {
+        auto frame_info = std::make_shared<rtc::FrameInfo>(0, buffer_timestamp_);
+        out.emplace_back(make_message(frame.begin(), frame.end(),
+                                      rtc::Message::Binary, 0, nullptr, frame_info));
+    }
+
+    last_emitted_timestamp_ = buffer_timestamp_;
+    rtp_buffer_.clear();
+}
+
+} // namespace vacon
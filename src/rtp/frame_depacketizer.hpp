@@ -0,0 +1,57 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <rtc/rtc.hpp>
+
+namespace vacon {
+
+// Base of the codec-aware depacketizers. Collects the RTP packets of a frame
+// and hands them, ordered by sequence number, to the payload format's
+// reassembly. A frame is emitted as soon as its marker packet arrives, or,
+// if that was lost, when a packet with a newer timestamp arrives. Packets
+// that arrive after their frame was emitted are dropped.
+class FrameRtpDepacketizer : public rtc::MediaHandler {
+    public:
+        virtual ~FrameRtpDepacketizer() = default;
+
+        void incoming(rtc::message_vector& messages, const rtc::message_callback& send) override;
+
+    protected:
+        struct Packet {
+            uint16_t                    seq;
+            std::span<const std::byte>  payload;
+        };
+
+        // Reassembles the bitstream of a frame from its packets. Whatever is
+        // missing because of lost packets is left out, and an empty buffer is
+        // returned if nothing of the frame can be decoded.
+        virtual rtc::binary ReassembleFrame(std::span<const Packet> packets) = 0;
+
+    private:
+        void EmitFrame(rtc::message_vector& out);
+
+        std::vector<rtc::message_ptr>   rtp_buffer_ = {};
+        uint32_t                        buffer_timestamp_ = 0;
+        std::optional<uint32_t>         last_emitted_timestamp_ = std::nullopt;
+};
+
+} // namespace vacon
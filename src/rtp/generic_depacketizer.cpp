@@ -28,11 +28,15 @@
 #include <format>
 #include <limits>
 #include <memory>
+#include <span>
 #include <utility>
 
 #include <rtc/rtc.hpp>
 #include <plog/Log.h>
 
+#include "rtp/generic_payload.hpp"
+#include "util.hpp"
+
 namespace vacon {
 
 rtc::message_vector GenericRtpDepacketizer::ReassemblePackets(rtc::message_vector::iterator begin,
@@ -49,16 +53,16 @@ rtc::message_vector GenericRtpDepacketizer::ReassemblePackets(rtc::message_vecto
         auto rtp = it->get();
         auto rtp_parsed = reinterpret_cast<const rtc::RtpHeader *>(rtp->data());
         auto rtp_header_size = rtp_parsed->getSize() + rtp_parsed->getExtensionHeaderSize();
-        auto fragment_header = rtp->at(rtp_header_size);
+        auto fragment_header = GenericFragment(rtp->at(rtp_header_size));
 
-        if (fragment_header == std::byte{1}) {
+        if (fragment_header == kGenericFragmentStart) {
             // Start fragment.
             if (frag_sequence_started) {
                 LOG_DEBUG << "Got start fragment header, but fragment sequence already started?";
                 return out;
             }
             frag_sequence_started = true;
-        } else if (fragment_header == std::byte{2}) {
+        } else if (fragment_header == kGenericFragmentMiddle) {
             // Middle fragment.
             if (!frag_sequence_started) {
                 // Start fragment wasn't seen.
@@ -69,7 +73,7 @@ rtc::message_vector GenericRtpDepacketizer::ReassemblePackets(rtc::message_vecto
                 LOG_DEBUG << std::format("Gap in sequence number (last {}, current {}), dropped fragment?", last_sequence, rtp_parsed->seqNumber());
                 return out;
             }
-        } else if (fragment_header == std::byte{3}) {
+        } else if (fragment_header == kGenericFragmentEnd) {
             // End fragment.
             frag_sequence_started = false;
             if (last_sequence + 1 != rtp_parsed->seqNumber()) {
@@ -101,8 +105,134 @@ rtc::message_vector GenericRtpDepacketizer::ReassemblePackets(rtc::message_vecto
     return out;
 }
 
+void GenericRtpDepacketizer::IncomingV1(rtc::message_ptr message, rtc::message_vector& out)
+{
+    auto rtp = reinterpret_cast<const rtc::RtpHeader *>(message->data());
+    auto rtp_header_size = rtp->getSize() + rtp->getExtensionHeaderSize();
+    if (message->size() <= rtp_header_size) {
+        return;
+    }
+    auto header = ParseGenericV1Header(std::span<const std::byte>(*message).subspan(rtp_header_size));
+    if (!header) {
+        LOG_DEBUG << "Invalid generic payload header";
+        return;
+    }
+
+    // Frame IDs tell late packets apart even after the timestamp wraps.
+    if (last_frame_id_ && static_cast<int16_t>(header->frame_id - *last_frame_id_) <= 0) {
+        LOG_VERBOSE << std::format("Dropped late fragment {} of frame {}",
+                                   header->fragment_index, header->frame_id);
+        return;
+    }
+
+    auto it = std::find_if(pending_.begin(), pending_.end(),
+                           [&](const auto& f) { return f.frame_id == header->frame_id; });
+    if (it == pending_.end()) {
+        if (pending_.size() == kMaxPendingFrames) {
+            if (static_cast<int16_t>(header->frame_id - pending_.front().frame_id) < 0) {
+                LOG_VERBOSE << std::format("Dropped late fragment {} of frame {}",
+                                           header->fragment_index, header->frame_id);
+                return;
+            }
+            DropFrameV1(pending_.front());
+            last_frame_id_ = pending_.front().frame_id;
+            pending_.pop_front();
+        }
+        it = pending_.insert(std::upper_bound(pending_.begin(), pending_.end(), header->frame_id,
+                                              [](uint16_t id, const auto& f) {
+                                                  return static_cast<int16_t>(id - f.frame_id) < 0;
+                                              }),
+                             PendingFrame {
+                                 .frame_id      = header->frame_id,
+                                 .timestamp     = rtp->timestamp(),
+                                 .descriptor    = header->descriptor,
+                                 .crc           = 0,
+                                 .n_received    = 0,
+                                 .fragments     = std::vector<rtc::message_ptr>(header->fragment_count),
+                             });
+    }
+
+    auto& frame = *it;
+    if (header->fragment_count != frame.fragments.size() || frame.fragments[header->fragment_index]) {
+        LOG_VERBOSE << std::format("Dropped duplicate or inconsistent fragment {} of frame {}",
+                                   header->fragment_index, header->frame_id);
+        return;
+    }
+    if (header->fragment_index == 0) {
+        frame.crc = header->crc;
+    }
+    frame.fragments[header->fragment_index] = std::move(message);
+    if (++frame.n_received < frame.fragments.size()) {
+        return;
+    }
+
+    // The frame is complete. Frames before it are given up on, so that the
+    // frames reach the decoder in order.
+    while (pending_.front().frame_id != frame.frame_id) {
+        DropFrameV1(pending_.front());
+        pending_.pop_front();
+    }
+    EmitFrameV1(pending_.front(), out);
+    last_frame_id_ = pending_.front().frame_id;
+    pending_.pop_front();
+}
+
+void GenericRtpDepacketizer::EmitFrameV1(const PendingFrame& frame, rtc::message_vector& out)
+{
+    auto buf = rtc::binary{};
+    for (size_t i = 0; i < frame.fragments.size(); ++i) {
+        const auto& rtp = frame.fragments[i];
+        auto rtp_parsed = reinterpret_cast<const rtc::RtpHeader *>(rtp->data());
+        auto header_size = rtp_parsed->getSize() + rtp_parsed->getExtensionHeaderSize() +
+                           (i == 0 ? kGenericV1FirstHeaderSize : kGenericV1HeaderSize);
+        buf.insert(buf.end(), rtp->begin() + header_size, rtp->end());
+    }
+
+    // Corrupt frames can crash or wedge the decoder, so they are rejected
+    // here.
+    auto crc = util::Crc32c(buf.data(), buf.size());
+    if (crc != frame.crc) {
+        LOG_WARNING << std::format("CRC mismatch in frame {} (expected {:08x}, got {:08x}), dropped it",
+                                   frame.frame_id, frame.crc, crc);
+        return;
+    }
+
+    auto frame_info = std::make_shared<rtc::FrameInfo>(0, frame.timestamp);
+    out.emplace_back(make_message(buf.begin(), buf.end(),
+                                  rtc::Message::Binary, 0, nullptr, frame_info));
+}
+
+void GenericRtpDepacketizer::DropFrameV1(const PendingFrame& frame)
+{
+    // Losing a discardable frame costs nothing else, losing any other frame
+    // may cost artifacts until the next keyframe.
+    if ((frame.descriptor & kGenericDiscardable) != std::byte{0}) {
+        LOG_VERBOSE << std::format("Dropped incomplete discardable frame {}, {} of {} fragments",
+                                   frame.frame_id, frame.n_received, frame.fragments.size());
+    } else {
+        LOG_DEBUG << std::format("Dropped incomplete {}frame {}, {} of {} fragments",
+                                 (frame.descriptor & kGenericKeyframe) != std::byte{0} ? "key" : "",
+                                 frame.frame_id, frame.n_received, frame.fragments.size());
+    }
+}
+
 void GenericRtpDepacketizer::incoming(rtc::message_vector& messages, const rtc::message_callback&)
 {
+    if (version_ != 0) {
+        rtc::message_vector out = {};
+        for (auto& message : messages) {
+            if (message->type == rtc::Message::Control) {
+                out.push_back(std::move(message));
+            } else if (message->size() < sizeof(rtc::RtpHeader)) {
+                LOG_VERBOSE << "RTP packet is too small, size=" << message->size();
+            } else {
+                IncomingV1(std::move(message), out);
+            }
+        }
+        messages.swap(out);
+        return;
+    }
+
     messages.erase(std::remove_if(messages.begin(), messages.end(),
                                   [&](rtc::message_ptr message) {
                                       if (message->type == rtc::Message::Control) {
@@ -15,7 +15,10 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <optional>
 #include <vector>
 
 #include <rtc/rtc.hpp>
@@ -24,17 +27,37 @@ namespace vacon {
 
 class GenericRtpDepacketizer : public rtc::MediaHandler {
     public:
-        GenericRtpDepacketizer() = default;
+        GenericRtpDepacketizer(unsigned version = 0)
+        : version_(version) {}
         virtual ~GenericRtpDepacketizer() = default;
 
         void incoming(rtc::message_vector& messages, const rtc::message_callback& send) override;
 
     private:
+        // A version 1 frame whose fragments are still arriving.
+        struct PendingFrame {
+            uint16_t                        frame_id;
+            uint32_t                        timestamp;
+            std::byte                       descriptor;
+            uint32_t                        crc;
+            size_t                          n_received;
+            std::vector<rtc::message_ptr>   fragments;
+        };
+
+        // How many incomplete frames are kept waiting for reordered packets.
+        inline static const size_t kMaxPendingFrames = 3;
+
+        const unsigned version_;
         std::vector<rtc::message_ptr> rtp_buffer_;
+        std::deque<PendingFrame> pending_ = {};
+        std::optional<uint16_t> last_frame_id_ = std::nullopt;
 
         rtc::message_vector ReassemblePackets(rtc::message_vector::iterator first_frag,
                                               rtc::message_vector::iterator last_frag,
                                               uint32_t timestamp);
+        void IncomingV1(rtc::message_ptr message, rtc::message_vector& out);
+        void EmitFrameV1(const PendingFrame& frame, rtc::message_vector& out);
+        void DropFrameV1(const PendingFrame& frame);
 };
 
 } // namespace vacon
@@ -18,10 +18,15 @@
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <format>
 #include <iterator>
 #include <memory>
 
 #include <rtc/rtc.hpp>
+#include <plog/Log.h>
+
+#include "rtp/generic_payload.hpp"
+#include "util.hpp"
 
 namespace vacon {
 
@@ -30,33 +35,78 @@ void GenericRtpPacketizer::outgoing(rtc::message_vector& messages,
 {
     rtc::message_vector result;
 
+    // Version 1 leaves room for the CRC in every fragment, so that the
+    // fragments can be sized alike.
+    auto header_size = version_ == 0 ? kGenericHeaderSize : kGenericV1FirstHeaderSize;
+    auto max_data_size = max_fragment_size_ - header_size;
+
+    auto flags = std::byte(next_frame_.temporal_layer << kGenericTemporalLayerShift);
+    if (version_ != 0) {
+        flags |= kGenericExtended;
+        if (next_frame_.keyframe) {
+            flags |= kGenericKeyframe;
+        }
+        if (next_frame_.discardable) {
+            flags |= kGenericDiscardable;
+        }
+    }
+    next_frame_ = {};
+
     for (const auto& message : messages) {
+        if (message->empty()) {
+            continue;
+        }
+        auto fragment_count = (message->size() + max_data_size - 1) / max_data_size;
+        if (version_ != 0 && fragment_count > kGenericV1MaxFragments) {
+            LOG_ERROR << std::format("Frame of {} bytes is too large to packetize", message->size());
+            continue;
+        }
+        auto frame_id = next_frame_id_++;
+        auto crc = version_ == 0 ? 0 : util::Crc32c(message->data(), message->size());
+
+        // Spread the frame evenly over the fragments, rather than filling
+        // them up and leaving a small one at the end.
+        auto base_size = fragment_count ? message->size() / fragment_count : 0;
+        auto n_larger = fragment_count ? message->size() % fragment_count : 0;
         size_t offset = 0;
 
-        while (offset < message->size()) {
-            auto remaining_bytes = message->size() - offset;
-            auto fragment_size = std::min(remaining_bytes, max_fragment_size_);
+        for (size_t fragment_index = 0; fragment_index < fragment_count; ++fragment_index) {
+            auto fragment_size = base_size + (fragment_index < n_larger ? 1 : 0);
             auto fragment = std::make_shared<rtc::binary>();
-            fragment->reserve(fragment_size + 1);
+            fragment->reserve(fragment_size + header_size);
 
-            if (offset == 0) {
+            if (fragment_index == 0) {
                 // Start fragment.
-                fragment->emplace_back(std::byte{1});;
-            } else if (offset + max_fragment_size_ < message->size()) {
+                fragment->emplace_back(kGenericFragmentStart | flags);
+            } else if (fragment_index + 1 < fragment_count) {
                 // Middle fragment.
-                fragment->emplace_back(std::byte{2});;
+                fragment->emplace_back(kGenericFragmentMiddle | flags);
             } else {
                 // End fragment.
-                fragment->emplace_back(std::byte{3});;
+                fragment->emplace_back(kGenericFragmentEnd | flags);
+            }
+
+            if (version_ != 0) {
+                auto put16 = [&](uint16_t v) {
+                    fragment->emplace_back(std::byte(v >> 8));
+                    fragment->emplace_back(std::byte(v & 0xff));
+                };
+                put16(frame_id);
+                put16(fragment_index);
+                put16(fragment_count);
+                if (fragment_index == 0) {
+                    put16(crc >> 16);
+                    put16(crc & 0xffff);
+                }
             }
 
             std::copy(message->begin() + offset,
                       message->begin() + offset + fragment_size,
                       std::back_inserter(*fragment));
 
-            result.push_back(packetize(fragment, false));
-
             offset += fragment_size;
+
+            result.push_back(packetize(fragment, fragment_index + 1 == fragment_count));
         }
     }
 
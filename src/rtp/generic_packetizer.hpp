@@ -15,11 +15,14 @@
 
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <utility>
 
 #include <rtc/rtc.hpp>
 
+#include "rtp/generic_payload.hpp"
+
 namespace vacon {
 
 class GenericRtpPacketizer final : public rtc::RtpPacketizer {
@@ -28,13 +31,21 @@ class GenericRtpPacketizer final : public rtc::RtpPacketizer {
         inline static const size_t defaultMaxFragmentSize = 1350;
 
         GenericRtpPacketizer(std::shared_ptr<rtc::RtpPacketizationConfig> rtpConfig,
-                             uint16_t max_fragment_size = defaultMaxFragmentSize)
-        : RtpPacketizer(std::move(rtpConfig)), max_fragment_size_(max_fragment_size - 1) {}
+                             uint16_t max_fragment_size = defaultMaxFragmentSize,
+                             unsigned version = 0)
+        : RtpPacketizer(std::move(rtpConfig)), max_fragment_size_(max_fragment_size), version_(version) {}
 
         void outgoing(rtc::message_vector& messages, const rtc::message_callback& send) override;
 
+        // Set the flags of the next frame. Called on the thread that sends
+        // the frame, right before sending it.
+        void SetNextFrame(const GenericFrameFlags& flags) { next_frame_ = flags; }
+
     private:
-        const size_t max_fragment_size_;
+        const size_t        max_fragment_size_;
+        const unsigned      version_;
+        GenericFrameFlags   next_frame_ = {};
+        uint16_t            next_frame_id_ = 0;
 };
 
 } // namespace vacon
@@ -0,0 +1,119 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+namespace vacon {
+
+// The generic RTP payload starts with a one byte descriptor:
+//
+//   bits 0-1:  fragment, start (1), middle (2) or end (3)
+//   bits 2-4:  temporal layer ID, 0 if the stream has no temporal layers
+//   bits 5-7:  reserved, 0
+//
+// A frame is sent as a start fragment, any number of middle fragments, and an
+// end fragment, with consecutive sequence numbers and the same timestamp.
+//
+// Version 1 of the payload, negotiated as the generic-v1 payload format, uses
+// the reserved bits and extends the descriptor, in network byte order:
+//
+//   bit 5:     1, the extension follows
+//   bit 6:     keyframe
+//   bit 7:     discardable, no other frame references this one
+//   16 bits:   frame ID, incremented for every frame
+//   16 bits:   fragment index
+//   16 bits:   fragment count
+//   32 bits:   CRC-32C of the frame, in the first fragment only
+//
+// so that the receiver knows when a frame is complete without waiting for the
+// next one, and can tell frames apart after timestamp wraparound. The first
+// byte stays compatible with version 0, for the SFU router.
+static const std::byte kGenericFragmentStart        = std::byte{1};
+static const std::byte kGenericFragmentMiddle       = std::byte{2};
+static const std::byte kGenericFragmentEnd          = std::byte{3};
+static const std::byte kGenericFragmentMask         = std::byte{0x03};
+
+static const unsigned kGenericTemporalLayerShift    = 2;
+static const unsigned kGenericMaxTemporalLayers     = 8;
+
+static const std::byte kGenericExtended             = std::byte{0x20};
+static const std::byte kGenericKeyframe             = std::byte{0x40};
+static const std::byte kGenericDiscardable          = std::byte{0x80};
+
+static const size_t kGenericHeaderSize              = 1;
+static const size_t kGenericV1HeaderSize            = 7;
+static const size_t kGenericV1FirstHeaderSize       = 11;
+static const size_t kGenericV1MaxFragments          = 0xffff;
+
+constexpr std::byte GenericFragment(std::byte descriptor)
+{
+    return descriptor & kGenericFragmentMask;
+}
+
+constexpr unsigned GenericTemporalLayer(std::byte descriptor)
+{
+    return (std::to_integer<unsigned>(descriptor) >> kGenericTemporalLayerShift) & (kGenericMaxTemporalLayers - 1);
+}
+
+// Flags of the frame that is about to be packetized.
+struct GenericFrameFlags {
+    bool        keyframe = false;
+    bool        discardable = false;
+    unsigned    temporal_layer = 0;
+};
+
+struct GenericV1Header {
+    std::byte   descriptor;
+    uint16_t    frame_id;
+    uint16_t    fragment_index;
+    uint16_t    fragment_count;
+    uint32_t    crc;
+};
+
+constexpr std::optional<GenericV1Header> ParseGenericV1Header(std::span<const std::byte> payload)
+{
+    auto u16 = [&](size_t i) {
+        return static_cast<uint16_t>((std::to_integer<unsigned>(payload[i]) << 8) |
+                                     std::to_integer<unsigned>(payload[i + 1]));
+    };
+
+    if (payload.size() < kGenericV1HeaderSize || (payload[0] & kGenericExtended) == std::byte{0}) {
+        return std::nullopt;
+    }
+    GenericV1Header header = {
+        .descriptor         = payload[0],
+        .frame_id           = u16(1),
+        .fragment_index     = u16(3),
+        .fragment_count     = u16(5),
+        .crc                = 0,
+    };
+    if (header.fragment_index == 0) {
+        if (payload.size() < kGenericV1FirstHeaderSize) {
+            return std::nullopt;
+        }
+        header.crc = (static_cast<uint32_t>(u16(7)) << 16) | u16(9);
+    }
+    if (header.fragment_count == 0 || header.fragment_index >= header.fragment_count) {
+        return std::nullopt;
+    }
+    return header;
+}
+
+} // namespace vacon
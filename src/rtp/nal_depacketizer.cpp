@@ -0,0 +1,126 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "rtp/nal_depacketizer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <iterator>
+#include <span>
+
+#include <rtc/rtc.hpp>
+#include <plog/Log.h>
+
+#include "rtp/nal_payload.hpp"
+
+namespace vacon {
+
+namespace {
+
+void AppendNal(rtc::binary& out, std::span<const std::byte> nal)
+{
+    out.insert(out.end(), std::begin(kNalStartCode), std::end(kNalStartCode));
+    out.insert(out.end(), nal.begin(), nal.end());
+}
+
+} // namespace
+
+rtc::binary NalRtpDepacketizer::ReassembleFrame(std::span<const Packet> packets)
+{
+    auto header_size = NalHeaderSize(codec_);
+    auto aggregation_type = codec_ == NalCodec::H264 ? kH264NalTypeStapA : kH265NalTypeAp;
+    auto fu_type = codec_ == NalCodec::H264 ? kH264NalTypeFuA : kH265NalTypeFu;
+
+    rtc::binary out = {};
+    rtc::binary fu_nal = {};
+    auto fu_started = false;
+    uint16_t fu_next_seq = 0;
+
+    for (const auto& packet : packets) {
+        auto payload = packet.payload;
+        if (payload.size() < header_size) {
+            continue;
+        }
+
+        if (fu_started && packet.seq != fu_next_seq) {
+            LOG_DEBUG << std::format("Gap in sequence number (expected {}, current {}), dropped NAL unit fragment",
+                                     fu_next_seq, packet.seq);
+            fu_started = false;
+        }
+
+        auto type = NalType(codec_, payload[0]);
+        if (fu_started && type != fu_type) {
+            LOG_DEBUG << "Missing end of fragmented NAL unit, dropped it";
+            fu_started = false;
+        }
+
+        if (type == aggregation_type) {
+            size_t offset = header_size;
+            while (offset + 2 <= payload.size()) {
+                size_t size = (std::to_integer<size_t>(payload[offset]) << 8) |
+                              std::to_integer<size_t>(payload[offset + 1]);
+                offset += 2;
+                if (size == 0 || offset + size > payload.size()) {
+                    LOG_DEBUG << "Invalid NAL unit size in aggregation packet";
+                    break;
+                }
+                AppendNal(out, payload.subspan(offset, size));
+                offset += size;
+            }
+        } else if (type == fu_type) {
+            if (payload.size() <= header_size + 1) {
+                continue;
+            }
+            auto fu = std::to_integer<uint8_t>(payload[header_size]);
+
+            if (fu & kNalFuStart) {
+                // Rebuild the header of the NAL unit from the payload header
+                // and the FU header.
+                fu_nal.clear();
+                if (codec_ == NalCodec::H264) {
+                    fu_nal.push_back((payload[0] & std::byte{0xe0}) | std::byte(fu & 0x1f));
+                } else {
+                    fu_nal.push_back((payload[0] & std::byte{0x81}) | std::byte((fu & 0x3f) << 1));
+                    fu_nal.push_back(payload[1]);
+                }
+                fu_started = true;
+            } else if (!fu_started) {
+                // The start of this NAL unit was lost.
+                continue;
+            }
+
+            auto data = payload.subspan(header_size + 1);
+            fu_nal.insert(fu_nal.end(), data.begin(), data.end());
+            fu_next_seq = packet.seq + 1;
+
+            if (fu & kNalFuEnd) {
+                AppendNal(out, fu_nal);
+                fu_started = false;
+            }
+        } else {
+            // Single NAL unit packet.
+            AppendNal(out, payload);
+        }
+    }
+
+    if (fu_started) {
+        LOG_DEBUG << "Missing end of fragmented NAL unit, dropped it";
+    }
+
+    return out;
+}
+
+} // namespace vacon
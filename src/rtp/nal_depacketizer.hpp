@@ -0,0 +1,43 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <span>
+
+#include <rtc/rtc.hpp>
+
+#include "rtp/frame_depacketizer.hpp"
+#include "rtp/nal_payload.hpp"
+
+namespace vacon {
+
+// Depacketizes H.264 (RFC 6184) or HEVC (RFC 7798) in non-interleaved mode
+// into an Annex-B stream. A lost packet only costs the NAL units it carried,
+// or the fragmented NAL unit it was part of, so the decoder still gets the
+// rest of the frame.
+class NalRtpDepacketizer final : public FrameRtpDepacketizer {
+    public:
+        NalRtpDepacketizer(NalCodec codec)
+        : codec_(codec) {}
+
+    protected:
+        rtc::binary ReassembleFrame(std::span<const Packet> packets) override;
+
+    private:
+        const NalCodec  codec_;
+};
+
+} // namespace vacon
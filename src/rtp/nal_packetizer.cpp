@@ -0,0 +1,160 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "rtp/nal_packetizer.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <rtc/rtc.hpp>
+#include <plog/Log.h>
+
+#include "rtp/nal_payload.hpp"
+
+namespace vacon {
+
+void NalRtpPacketizer::outgoing(rtc::message_vector& messages,
+                                [[maybe_unused]] const rtc::message_callback& send)
+{
+    rtc::message_vector result;
+    auto header_size = NalHeaderSize(codec_);
+
+    for (const auto& message : messages) {
+        auto nals = SplitAnnexB(*message);
+        std::erase_if(nals, [header_size](auto nal) { return nal.size() < header_size; });
+        if (nals.empty()) {
+            LOG_VERBOSE << "No NAL units in frame, size=" << message->size();
+            continue;
+        }
+
+        size_t i = 0;
+        while (i < nals.size()) {
+            if (nals[i].size() > max_payload_size_) {
+                Fragment(nals[i], result, i + 1 == nals.size());
+                ++i;
+                continue;
+            }
+
+            // Aggregate the following NAL units for as long as they fit, each
+            // is preceded by its 16-bit size.
+            auto aggregate_size = header_size + 2 + nals[i].size();
+            auto j = i + 1;
+            while (j < nals.size() && aggregate_size + 2 + nals[j].size() <= max_payload_size_) {
+                aggregate_size += 2 + nals[j].size();
+                ++j;
+            }
+
+            if (j == i + 1) {
+                // Single NAL unit packet.
+                auto payload = std::make_shared<rtc::binary>(nals[i].begin(), nals[i].end());
+                result.push_back(packetize(payload, j == nals.size()));
+            } else {
+                Aggregate(std::span(nals).subspan(i, j - i), result, j == nals.size());
+            }
+            i = j;
+        }
+    }
+
+    messages.swap(result);
+}
+
+void NalRtpPacketizer::Fragment(std::span<const std::byte> nal, rtc::message_vector& result, bool last)
+{
+    auto header_size = NalHeaderSize(codec_);
+    auto fu_header = NalType(codec_, nal[0]);
+    auto max_fragment_size = max_payload_size_ - header_size - 1;
+    auto fragment_count = (nal.size() - header_size + max_fragment_size - 1) / max_fragment_size;
+    auto base_size = (nal.size() - header_size) / fragment_count;
+    auto n_larger = (nal.size() - header_size) % fragment_count;
+    size_t offset = header_size;
+
+    // The NAL unit is spread evenly over the fragments.
+    for (size_t i = 0; i < fragment_count; ++i) {
+        auto size = base_size + (i < n_larger ? 1 : 0);
+        auto fragment = std::make_shared<rtc::binary>();
+        fragment->reserve(header_size + 1 + size);
+
+        if (codec_ == NalCodec::H264) {
+            // FU indicator with the F and NRI bits of the NAL unit.
+            fragment->push_back((nal[0] & std::byte{0xe0}) | std::byte{kH264NalTypeFuA});
+        } else {
+            // Payload header with the F, LayerId and TID of the NAL unit.
+            fragment->push_back((nal[0] & std::byte{0x81}) | std::byte{kH265NalTypeFu << 1});
+            fragment->push_back(nal[1]);
+        }
+
+        auto fu = fu_header;
+        if (offset == header_size) {
+            fu |= kNalFuStart;
+        }
+        if (offset + size == nal.size()) {
+            fu |= kNalFuEnd;
+        }
+        fragment->push_back(std::byte{fu});
+
+        std::copy(nal.begin() + offset, nal.begin() + offset + size, std::back_inserter(*fragment));
+        offset += size;
+
+        result.push_back(packetize(fragment, last && offset == nal.size()));
+    }
+}
+
+void NalRtpPacketizer::Aggregate(std::span<const std::span<const std::byte>> nals,
+                                 rtc::message_vector& result, bool last)
+{
+    auto payload = std::make_shared<rtc::binary>();
+
+    if (codec_ == NalCodec::H264) {
+        // The F bit is set if any NAL unit has it, and NRI is the highest.
+        uint8_t f = 0;
+        uint8_t nri = 0;
+        for (auto nal : nals) {
+            auto b = std::to_integer<uint8_t>(nal[0]);
+            f |= b & 0x80;
+            nri = std::max<uint8_t>(nri, b & 0x60);
+        }
+        payload->push_back(std::byte(f | nri | kH264NalTypeStapA));
+    } else {
+        // The F bit is set if any NAL unit has it, and LayerId and TID are
+        // the lowest.
+        uint8_t f = 0;
+        uint8_t layer_id = 0x3f;
+        uint8_t tid = 0x07;
+        for (auto nal : nals) {
+            auto b0 = std::to_integer<uint8_t>(nal[0]);
+            auto b1 = std::to_integer<uint8_t>(nal[1]);
+            f |= b0 & 0x80;
+            layer_id = std::min<uint8_t>(layer_id, ((b0 & 0x01) << 5) | (b1 >> 3));
+            tid = std::min<uint8_t>(tid, b1 & 0x07);
+        }
+        payload->push_back(std::byte(f | (kH265NalTypeAp << 1) | (layer_id >> 5)));
+        payload->push_back(std::byte(((layer_id & 0x1f) << 3) | tid));
+    }
+
+    for (auto nal : nals) {
+        payload->push_back(std::byte(nal.size() >> 8));
+        payload->push_back(std::byte(nal.size() & 0xff));
+        std::copy(nal.begin(), nal.end(), std::back_inserter(*payload));
+    }
+
+    result.push_back(packetize(payload, last));
+}
+
+} // namespace vacon
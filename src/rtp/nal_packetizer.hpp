@@ -0,0 +1,55 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
+
+#include <rtc/rtc.hpp>
+
+#include "rtp/nal_payload.hpp"
+
+namespace vacon {
+
+// Packetizes an Annex-B H.264 (RFC 6184) or HEVC (RFC 7798) stream in
+// non-interleaved mode. Runs of NAL units that fit into one packet together,
+// such as the parameter sets, are aggregated into STAP-A or AP packets, NAL
+// units that don't fit into a packet are fragmented into FU-A or FU packets,
+// and the rest are sent as single NAL unit packets.
+class NalRtpPacketizer final : public rtc::RtpPacketizer {
+    public:
+        inline static const size_t defaultMaxPayloadSize = 1350;
+
+        NalRtpPacketizer(NalCodec codec,
+                         std::shared_ptr<rtc::RtpPacketizationConfig> rtpConfig,
+                         uint16_t max_payload_size = defaultMaxPayloadSize)
+        : RtpPacketizer(std::move(rtpConfig)), codec_(codec), max_payload_size_(max_payload_size) {}
+
+        void outgoing(rtc::message_vector& messages, const rtc::message_callback& send) override;
+
+    private:
+        void Fragment(std::span<const std::byte> nal, rtc::message_vector& result, bool last);
+        void Aggregate(std::span<const std::span<const std::byte>> nals,
+                       rtc::message_vector& result, bool last);
+
+        const NalCodec  codec_;
+        const size_t    max_payload_size_;
+};
+
+} // namespace vacon
@@ -0,0 +1,94 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace vacon {
+
+// The NAL unit based payload formats of RFC 6184 (H.264) and RFC 7798
+// (HEVC), in non-interleaved mode.
+enum class NalCodec {
+    H264,
+    H265,
+};
+
+// H.264 NAL unit header: F(1) NRI(2) Type(5).
+static const size_t kH264NalHeaderSize      = 1;
+static const uint8_t kH264NalTypeStapA      = 24;
+static const uint8_t kH264NalTypeFuA        = 28;
+
+// HEVC NAL unit header: F(1) Type(6) LayerId(6) TID(3).
+static const size_t kH265NalHeaderSize      = 2;
+static const uint8_t kH265NalTypeAp         = 48;
+static const uint8_t kH265NalTypeFu         = 49;
+
+// FU header start and end bits, common to both codecs.
+static const uint8_t kNalFuStart            = 0x80;
+static const uint8_t kNalFuEnd              = 0x40;
+
+static const std::byte kNalStartCode[]      = { std::byte{0}, std::byte{0}, std::byte{0}, std::byte{1} };
+
+constexpr size_t NalHeaderSize(NalCodec codec)
+{
+    return codec == NalCodec::H264 ? kH264NalHeaderSize : kH265NalHeaderSize;
+}
+
+constexpr uint8_t NalType(NalCodec codec, std::byte first)
+{
+    auto b = std::to_integer<uint8_t>(first);
+    return codec == NalCodec::H264 ? (b & 0x1f) : ((b >> 1) & 0x3f);
+}
+
+// Splits an Annex-B byte stream into NAL units, without the start codes.
+inline std::vector<std::span<const std::byte>> SplitAnnexB(std::span<const std::byte> data)
+{
+    std::vector<std::span<const std::byte>> nals;
+
+    auto is_start_code = [&](size_t i) {
+        return i + 3 <= data.size() &&
+               data[i] == std::byte{0} && data[i + 1] == std::byte{0} && data[i + 2] == std::byte{1};
+    };
+
+    size_t i = 0;
+    while (i < data.size() && !is_start_code(i)) {
+        ++i;
+    }
+    while (i < data.size()) {
+        auto start = i + 3;
+        auto end = start;
+        while (end < data.size() && !is_start_code(end)) {
+            ++end;
+        }
+        i = end;
+
+        // The zero byte of a 4-byte start code, and any trailing zero bytes,
+        // don't belong to the NAL unit.
+        while (end > start && data[end - 1] == std::byte{0}) {
+            --end;
+        }
+        if (end > start) {
+            nals.emplace_back(data.subspan(start, end - start));
+        }
+    }
+
+    return nals;
+}
+
+} // namespace vacon
@@ -0,0 +1,99 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "rtp/payload_format.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include <rtc/rtc.hpp>
+
+#include "codecs.hpp"
+#include "rtp/av1_depacketizer.hpp"
+#include "rtp/av1_packetizer.hpp"
+#include "rtp/generic_depacketizer.hpp"
+#include "rtp/generic_packetizer.hpp"
+#include "rtp/nal_depacketizer.hpp"
+#include "rtp/nal_packetizer.hpp"
+
+namespace vacon {
+
+std::optional<PayloadFormat> PayloadFormatFromString(const std::string& s)
+{
+    if (s == "generic") {
+        return PayloadFormat::Generic;
+    } else if (s == "generic-v1") {
+        return PayloadFormat::GenericV1;
+    } else if (s == "standard") {
+        return PayloadFormat::Standard;
+    }
+    return std::nullopt;
+}
+
+const char* ToString(PayloadFormat format)
+{
+    switch (format) {
+    case PayloadFormat::Generic:    return "generic";
+    case PayloadFormat::GenericV1:  return "generic-v1";
+    case PayloadFormat::Standard:   return "standard";
+    }
+    return "unknown";
+}
+
+std::shared_ptr<rtc::RtpPacketizer> CreateVideoPacketizer(
+    VideoCodec codec, PayloadFormat format, std::shared_ptr<rtc::RtpPacketizationConfig> rtp_config,
+    size_t max_payload_size)
+{
+    if (format == PayloadFormat::Standard) {
+        switch (codec) {
+        case VideoCodec::AV1_10_420:
+        case VideoCodec::AV1_8_420:
+            return std::make_shared<Av1RtpPacketizer>(std::move(rtp_config), max_payload_size);
+        case VideoCodec::HEVC_10_420:
+        case VideoCodec::HEVC_8_420:
+            return std::make_shared<NalRtpPacketizer>(NalCodec::H265, std::move(rtp_config), max_payload_size);
+        case VideoCodec::AVC_8_420:
+            return std::make_shared<NalRtpPacketizer>(NalCodec::H264, std::move(rtp_config), max_payload_size);
+        default:
+            break;
+        }
+    }
+    return std::make_shared<GenericRtpPacketizer>(std::move(rtp_config), max_payload_size,
+                                                  format == PayloadFormat::GenericV1 ? 1 : 0);
+}
+
+std::shared_ptr<rtc::MediaHandler> CreateVideoDepacketizer(VideoCodec codec, PayloadFormat format)
+{
+    if (format == PayloadFormat::Standard) {
+        switch (codec) {
+        case VideoCodec::AV1_10_420:
+        case VideoCodec::AV1_8_420:
+            return std::make_shared<Av1RtpDepacketizer>();
+        case VideoCodec::HEVC_10_420:
+        case VideoCodec::HEVC_8_420:
+            return std::make_shared<NalRtpDepacketizer>(NalCodec::H265);
+        case VideoCodec::AVC_8_420:
+            return std::make_shared<NalRtpDepacketizer>(NalCodec::H264);
+        default:
+            break;
+        }
+    }
+    return std::make_shared<GenericRtpDepacketizer>(format == PayloadFormat::GenericV1 ? 1 : 0);
+}
+
+} // namespace vacon
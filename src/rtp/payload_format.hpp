@@ -0,0 +1,73 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <rtc/rtc.hpp>
+
+#include "codecs.hpp"
+
+namespace vacon {
+
+// The RTP payload format of the video. Generic is the private format with a
+// one byte descriptor, which splits frames at arbitrary offsets and which the
+// SFU router understands. GenericV1 extends the descriptor with a frame ID,
+// the fragment count, frame flags and a CRC, see generic_payload.hpp.
+// Standard is the codec's own payload format: RFC 6184 for H.264, RFC 7798
+// for HEVC, and the AV1 RTP payload format.
+enum class PayloadFormat {
+    Generic,
+    GenericV1,
+    Standard,
+};
+
+// Offers of a payload format other than Generic carry this format parameter,
+// e.g. "x-vacon-payload=standard", on every video codec, and the answer keeps
+// it if the answerer accepts the format.
+static const std::string_view kPayloadFormatFmtp = "x-vacon-payload";
+
+// The largest RTP payload when the path MTU isn't known, which fits into the
+// common 1500 byte MTU with room to spare for tunnels.
+static const size_t kDefaultMaxPayloadSize = 1350;
+
+// What a video packet adds to the RTP payload: the IPv6 and UDP headers, the
+// RTP header, and the SRTP authentication tag.
+static const size_t kRtpPacketOverhead = 40 + 8 + 12 + 16;
+
+static const size_t kMinMtu = 576;
+static const size_t kMaxMtu = 9000;
+
+// The largest RTP payload for the path MTU, or the default if it's 0.
+constexpr size_t MaxPayloadSizeForMtu(size_t mtu)
+{
+    return mtu == 0 ? kDefaultMaxPayloadSize : mtu - kRtpPacketOverhead;
+}
+
+std::optional<PayloadFormat> PayloadFormatFromString(const std::string&);
+const char* ToString(PayloadFormat);
+
+std::shared_ptr<rtc::RtpPacketizer> CreateVideoPacketizer(
+    VideoCodec, PayloadFormat, std::shared_ptr<rtc::RtpPacketizationConfig>,
+    size_t max_payload_size = kDefaultMaxPayloadSize);
+
+std::shared_ptr<rtc::MediaHandler> CreateVideoDepacketizer(VideoCodec, PayloadFormat);
+
+} // namespace vacon
@@ -0,0 +1,208 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "rtp/probe.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <optional>
+
+#include <plog/Log.h>
+#include <rtc/rtc.hpp>
+
+namespace vacon {
+
+namespace {
+
+// RTP version 2 with the padding bit set.
+const uint8_t kProbeRtpFirstByte = 0xa0;
+
+// A probe whose last packet was lost is finished by the first other packet
+// that arrives this long after the last probe packet.
+const auto kProbeTimeout = std::chrono::milliseconds(200);
+
+} // namespace
+
+std::optional<ProbeHeader> ParseProbePacket(const rtc::Message& message)
+{
+    if (message.size() < sizeof(rtc::RtpHeader)) {
+        return std::nullopt;
+    }
+    auto rtp = reinterpret_cast<const rtc::RtpHeader*>(message.data());
+    if (!rtp->padding()) {
+        return std::nullopt;
+    }
+    auto header_size = rtp->getSize() + rtp->getExtensionHeaderSize();
+    if (message.size() < header_size + kProbeHeaderSize) {
+        return std::nullopt;
+    }
+    auto payload = message.data() + header_size;
+    if (!std::equal(kProbeMagic.begin(), kProbeMagic.end(), payload)) {
+        return std::nullopt;
+    }
+    payload += kProbeMagic.size();
+    return ProbeHeader {
+        .burst      = std::to_integer<uint8_t>(payload[0]),
+        .n_bursts   = std::to_integer<uint8_t>(payload[1]),
+        .packet     = std::to_integer<uint8_t>(payload[2]),
+        .n_packets  = std::to_integer<uint8_t>(payload[3]),
+    };
+}
+
+void ProbeSender::QueueBurst(uint8_t burst, uint8_t n_bursts, uint8_t n_packets)
+{
+    burst_ = ProbeHeader {
+        .burst      = burst,
+        .n_bursts   = n_bursts,
+        .packet     = 0,
+        .n_packets  = n_packets,
+    };
+}
+
+void ProbeSender::outgoing(rtc::message_vector& messages, [[maybe_unused]] const rtc::message_callback& send)
+{
+    if (!burst_) {
+        return;
+    }
+    auto burst = *burst_;
+    burst_ = std::nullopt;
+
+    // The padding length is a single byte, so the padding is the end of the
+    // payload, and the rest of it is zeroes.
+    auto header_size = sizeof(rtc::RtpHeader);
+    auto padding_size = std::min<size_t>(255, packet_size_ - header_size - kProbeHeaderSize);
+
+    for (uint8_t i = 0; i < burst.n_packets; ++i) {
+        auto message = rtc::make_message(packet_size_);
+        auto p = message->data();
+        auto put = [&p](uint64_t v, size_t n) {
+            while (n-- > 0) {
+                *p++ = std::byte((v >> (8 * n)) & 0xff);
+            }
+        };
+
+        auto seq = config_->sequenceNumber++;
+        put(kProbeRtpFirstByte, 1);
+        put(config_->payloadType & 0x7f, 1);
+        put(seq, 2);
+        put(config_->timestamp, 4);
+        put(config_->ssrc, 4);
+        p = std::copy(kProbeMagic.begin(), kProbeMagic.end(), p);
+        put(burst.burst, 1);
+        put(burst.n_bursts, 1);
+        put(i, 1);
+        put(burst.n_packets, 1);
+        message->back() = std::byte(padding_size);
+
+        messages.push_back(std::move(message));
+    }
+
+    LOG_VERBOSE << std::format("Sending probe burst {} of {}, {} packets of {} bytes",
+                               burst.burst + 1, burst.n_bursts, burst.n_packets, packet_size_);
+}
+
+void ProbeReceiver::incoming(rtc::message_vector& messages, [[maybe_unused]] const rtc::message_callback& send)
+{
+    auto t_now = std::chrono::steady_clock::now();
+    rtc::message_vector out = {};
+
+    for (auto& message : messages) {
+        auto probe = message->type == rtc::Message::Control ? std::nullopt : ParseProbePacket(*message);
+        if (!probe) {
+            if (!done_ && n_packets_ > 0 && t_now - t_last_probe_ > kProbeTimeout) {
+                Finish();
+            }
+            out.push_back(std::move(message));
+            continue;
+        }
+
+        // Probe packets are dropped, also the late ones after the probe.
+        if (done_) {
+            continue;
+        }
+        ++n_packets_;
+        n_expected_ = unsigned(probe->n_bursts) * probe->n_packets;
+        t_last_probe_ = t_now;
+
+        // The bandwidth is the data that arrived after the first packet of
+        // the burst, over the time it took to arrive.
+        if (burst_ && burst_->id != probe->burst) {
+            FinishBurst();
+        }
+        if (!burst_) {
+            burst_ = Burst {
+                .id         = probe->burst,
+                .n_packets  = 1,
+                .n_bytes    = 0,
+                .t_first    = t_now,
+                .t_last     = t_now,
+            };
+        } else {
+            ++burst_->n_packets;
+            burst_->n_bytes += message->size();
+            burst_->t_last = t_now;
+        }
+
+        if (probe->packet + 1 >= probe->n_packets) {
+            FinishBurst();
+            if (probe->burst + 1 >= probe->n_bursts) {
+                Finish();
+            }
+        }
+    }
+
+    messages.swap(out);
+}
+
+void ProbeReceiver::FinishBurst()
+{
+    if (!burst_) {
+        return;
+    }
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(burst_->t_last - burst_->t_first).count();
+    if (burst_->n_packets >= 2 && us > 0) {
+        burst_kbps_.push_back(burst_->n_bytes * 8.0 * 1000.0 / us);
+        ++n_bursts_;
+    }
+    burst_ = std::nullopt;
+}
+
+void ProbeReceiver::Finish()
+{
+    FinishBurst();
+    done_ = true;
+
+    // The median is robust against a burst that was delayed, or that arrived
+    // all at once, by the scheduling of the receiving thread.
+    unsigned kbps = 0;
+    if (!burst_kbps_.empty()) {
+        auto mid = burst_kbps_.begin() + burst_kbps_.size() / 2;
+        std::nth_element(burst_kbps_.begin(), mid, burst_kbps_.end());
+        kbps = static_cast<unsigned>(*mid);
+    }
+
+    callback_(ProbeResult {
+        .kbps       = kbps,
+        .n_bursts   = n_bursts_,
+        .n_packets  = n_packets_,
+        .n_expected = n_expected_,
+    });
+}
+
+} // namespace vacon
@@ -0,0 +1,122 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <rtc/rtc.hpp>
+
+namespace vacon {
+
+// Bandwidth probe packets are sent on the outgoing video track, in short
+// bursts at the start of a call. They are RTP packets with the padding bit
+// set, which the packetizers never set, and a payload that starts with
+// kProbeMagic, the burst number and count, and the packet number and count.
+// The rest of the payload is padding.
+static const std::array<std::byte, 4> kProbeMagic = {
+    std::byte('V'), std::byte('P'), std::byte('R'), std::byte('B'),
+};
+static const size_t kProbeHeaderSize = kProbeMagic.size() + 4;
+
+struct ProbeHeader {
+    uint8_t     burst;
+    uint8_t     n_bursts;
+    uint8_t     packet;
+    uint8_t     n_packets;
+};
+
+// Returns the probe header of an RTP packet, or nothing if it isn't a probe
+// packet.
+std::optional<ProbeHeader> ParseProbePacket(const rtc::Message&);
+
+// Media handler that adds a queued burst of probe packets to the outgoing
+// packets. It must be chained after the packetizer. QueueBurst() and
+// outgoing() are both called on the thread that sends the frames, or with
+// the sends serialized.
+class ProbeSender final : public rtc::MediaHandler {
+    public:
+        ProbeSender(std::shared_ptr<rtc::RtpPacketizationConfig> config, size_t packet_size)
+            : config_(std::move(config)), packet_size_(packet_size) {};
+
+        // The burst is sent with the next outgoing message, which may be an
+        // empty one.
+        void QueueBurst(uint8_t burst, uint8_t n_bursts, uint8_t n_packets);
+
+        void outgoing(rtc::message_vector& messages, const rtc::message_callback& send) override;
+
+    private:
+        std::shared_ptr<rtc::RtpPacketizationConfig>
+                            config_;
+        size_t              packet_size_;
+        std::optional<ProbeHeader>
+                            burst_ = std::nullopt;
+};
+
+struct ProbeResult {
+    unsigned            kbps;
+    unsigned            n_bursts;
+    unsigned            n_packets;
+    unsigned            n_expected;
+};
+
+// Media handler that removes the probe packets from the incoming packets,
+// and calls back once with the bandwidth estimated from their arrival
+// times. It must be chained last, so that it sees the packets before the
+// depacketizer and the RTP capture.
+class ProbeReceiver final : public rtc::MediaHandler {
+    public:
+        typedef std::function<void(const ProbeResult&)> Callback;
+
+        explicit ProbeReceiver(Callback callback)
+            : callback_(std::move(callback)) {};
+
+        void incoming(rtc::message_vector& messages, const rtc::message_callback& send) override;
+
+    private:
+        void FinishBurst();
+        void Finish();
+
+        struct Burst {
+            uint8_t         id;
+            size_t          n_packets;
+            size_t          n_bytes;
+            std::chrono::time_point<std::chrono::steady_clock>
+                            t_first;
+            std::chrono::time_point<std::chrono::steady_clock>
+                            t_last;
+        };
+
+        Callback            callback_;
+        bool                done_ = false;
+        std::optional<Burst>
+                            burst_ = std::nullopt;
+        std::vector<double> burst_kbps_ = {};
+        unsigned            n_bursts_ = 0;
+        unsigned            n_packets_ = 0;
+        unsigned            n_expected_ = 0;
+        std::chrono::time_point<std::chrono::steady_clock>
+                            t_last_probe_ = {};
+};
+
+} // namespace vacon
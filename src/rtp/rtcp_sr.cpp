@@ -0,0 +1,97 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "rtp/rtcp_sr.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+
+#include <plog/Log.h>
+#include <rtc/rtc.hpp>
+
+#include "util.hpp"
+
+namespace vacon {
+
+// RTCP packet type of a sender report.
+static const uint8_t kRtcpPayloadTypeSr = 200;
+
+void RtcpSrSender::SetCaptureTime(uint32_t rtp_timestamp,
+                                  std::chrono::time_point<std::chrono::steady_clock> t_captured)
+{
+    has_capture_time_ = true;
+    rtp_timestamp_ = rtp_timestamp;
+    t_captured_ = t_captured;
+}
+
+void RtcpSrSender::outgoing(rtc::message_vector& messages, [[maybe_unused]] const rtc::message_callback& send)
+{
+    for (const auto& message : messages) {
+        if (message->type == rtc::Message::Control || message->size() < sizeof(rtc::RtpHeader)) {
+            continue;
+        }
+        auto rtp = reinterpret_cast<const rtc::RtpHeader*>(message->data());
+        auto header_size = rtp->getSize() + rtp->getExtensionHeaderSize();
+        ++n_packets_;
+        n_octets_ += static_cast<uint32_t>(message->size() - std::min(header_size, message->size()));
+    }
+
+    auto t_now = std::chrono::steady_clock::now();
+    if (!has_capture_time_ || t_now - t_last_report_ < kRtcpSrInterval) {
+        return;
+    }
+    t_last_report_ = t_now;
+
+    auto message = rtc::make_message(rtc::RtcpSr::Size(0), rtc::Message::Control);
+    auto sr = reinterpret_cast<rtc::RtcpSr*>(message->data());
+    sr->preparePacket(ssrc_, 0);
+    sr->setNtpTimestamp(util::SteadyToNtp(t_captured_));
+    sr->setRtpTimestamp(rtp_timestamp_);
+    sr->setPacketCount(n_packets_);
+    sr->setOctetCount(n_octets_);
+    messages.push_back(std::move(message));
+
+    LOG_VERBOSE << std::format("Sending RTCP SR for SSRC {}, RTP timestamp {}, {} packets",
+                               ssrc_, rtp_timestamp_, n_packets_);
+}
+
+void RtcpSrReceiver::incoming(rtc::message_vector& messages, [[maybe_unused]] const rtc::message_callback& send)
+{
+    for (const auto& message : messages) {
+        if (message->type != rtc::Message::Control) {
+            continue;
+        }
+
+        // A compound RTCP packet holds several RTCP packets back to back.
+        size_t offset = 0;
+        while (offset + sizeof(rtc::RtcpHeader) <= message->size()) {
+            auto header = reinterpret_cast<const rtc::RtcpHeader*>(message->data() + offset);
+            auto length = header->lengthInBytes();
+            if (length == 0 || offset + length > message->size()) {
+                break;
+            }
+            if (header->payloadType() == kRtcpPayloadTypeSr && length >= rtc::RtcpSr::Size(0)) {
+                auto sr = reinterpret_cast<const rtc::RtcpSr*>(header);
+                callback_(sr->ntpTimestamp(), sr->rtpTimestamp());
+            }
+            offset += length;
+        }
+    }
+}
+
+} // namespace vacon
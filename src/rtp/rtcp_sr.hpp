@@ -0,0 +1,74 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+#include <rtc/rtc.hpp>
+
+namespace vacon {
+
+// Interval between RTCP sender reports.
+static const auto kRtcpSrInterval = std::chrono::seconds(1);
+
+// Media handler that adds an RTCP sender report to the outgoing packets about
+// once per second. The report maps the RTP timestamp of the last frame to the
+// wall clock time at which it was captured, so that the receiver can line up
+// streams that were captured on the same machine. It must be chained after
+// the packetizer. SetCaptureTime() and outgoing() are both called on the
+// thread that sends the frames.
+class RtcpSrSender final : public rtc::MediaHandler {
+    public:
+        explicit RtcpSrSender(rtc::SSRC ssrc)
+            : ssrc_(ssrc) {};
+
+        // Called before sending a frame.
+        void SetCaptureTime(uint32_t rtp_timestamp,
+                            std::chrono::time_point<std::chrono::steady_clock> t_captured);
+
+        void outgoing(rtc::message_vector& messages, const rtc::message_callback& send) override;
+
+    private:
+        rtc::SSRC           ssrc_;
+        bool                has_capture_time_ = false;
+        uint32_t            rtp_timestamp_ = 0;
+        std::chrono::time_point<std::chrono::steady_clock>
+                            t_captured_ = {};
+        std::chrono::time_point<std::chrono::steady_clock>
+                            t_last_report_ = {};
+        uint32_t            n_packets_ = 0;
+        uint32_t            n_octets_ = 0;
+};
+
+// Media handler that calls back with the NTP and RTP timestamps of every
+// incoming RTCP sender report. The other packets pass through.
+class RtcpSrReceiver final : public rtc::MediaHandler {
+    public:
+        typedef std::function<void(uint64_t ntp_timestamp, uint32_t rtp_timestamp)> Callback;
+
+        explicit RtcpSrReceiver(Callback callback)
+            : callback_(std::move(callback)) {};
+
+        void incoming(rtc::message_vector& messages, const rtc::message_callback& send) override;
+
+    private:
+        Callback            callback_;
+};
+
+} // namespace vacon
@@ -0,0 +1,190 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "rtp/rtp_capture.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <plog/Log.h>
+#include <rtc/rtc.hpp>
+
+#include "util.hpp"
+
+using namespace std::chrono_literals;
+
+namespace vacon {
+
+// pcap file header. All fields are in host byte order.
+struct PcapFileHeader {
+    uint32_t    magic;
+    uint16_t    version_major;
+    uint16_t    version_minor;
+    int32_t     thiszone;
+    uint32_t    sigfigs;
+    uint32_t    snaplen;
+    uint32_t    linktype;
+};
+
+struct PcapRecordHeader {
+    uint32_t    ts_sec;
+    uint32_t    ts_nsec;
+    uint32_t    incl_len;
+    uint32_t    orig_len;
+};
+
+static_assert(sizeof(PcapFileHeader) == 24);
+static_assert(sizeof(PcapRecordHeader) == 16);
+
+std::shared_ptr<RtpCaptureHandler> RtpCaptureHandler::Create(const std::string& path)
+{
+    auto handler = std::shared_ptr<RtpCaptureHandler>(new RtpCaptureHandler());
+    handler->path_ = path;
+    handler->file_ = std::fopen(path.c_str(), "wb");
+    if (!handler->file_) {
+        LOG_ERROR << std::format("Unable to open RTP capture file {}: {}", path, strerror(errno));
+        return nullptr;
+    }
+
+    auto header = PcapFileHeader {
+        .magic          = kPcapMagicNanoseconds,
+        .version_major  = 2,
+        .version_minor  = 4,
+        .thiszone       = 0,
+        .sigfigs        = 0,
+        .snaplen        = 65535,
+        .linktype       = kPcapLinkTypeUser0,
+    };
+    if (std::fwrite(&header, sizeof(header), 1, handler->file_) != 1) {
+        LOG_ERROR << std::format("Unable to write RTP capture file {}: {}", path, strerror(errno));
+        return nullptr;
+    }
+
+    handler->thread_ = std::jthread([h = handler.get()](std::stop_token st) { h->RunWriter(st); });
+
+    LOG_INFO << "Capturing incoming RTP packets to " << path;
+
+    return handler;
+}
+
+RtpCaptureHandler::~RtpCaptureHandler()
+{
+    if (thread_.joinable()) {
+        thread_.request_stop();
+        thread_.join();
+    }
+
+    if (file_) {
+        WritePending();
+        std::fclose(file_);
+        file_ = nullptr;
+        LOG_INFO << std::format("Captured {} RTP packets to {}", n_packets_.load(), path_);
+    }
+}
+
+void RtpCaptureHandler::incoming(rtc::message_vector& messages, const rtc::message_callback&)
+{
+    auto t_now = std::chrono::system_clock::now().time_since_epoch();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t_now).count();
+
+    std::lock_guard lock(mutex_);
+    for (const auto& message : messages) {
+        if (message->type == rtc::Message::Control) {
+            continue;
+        }
+
+        auto record = PcapRecordHeader {
+            .ts_sec     = static_cast<uint32_t>(ns / 1'000'000'000),
+            .ts_nsec    = static_cast<uint32_t>(ns % 1'000'000'000),
+            .incl_len   = static_cast<uint32_t>(message->size()),
+            .orig_len   = static_cast<uint32_t>(message->size()),
+        };
+        auto p = reinterpret_cast<const std::byte*>(&record);
+        pending_.insert(pending_.end(), p, p + sizeof(record));
+        pending_.insert(pending_.end(), message->begin(), message->end());
+        n_packets_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void RtpCaptureHandler::RunWriter(std::stop_token st)
+{
+    util::SetThreadName("VRtpCapture");
+
+    while (!st.stop_requested()) {
+        std::this_thread::sleep_for(100ms);
+        WritePending();
+    }
+}
+
+void RtpCaptureHandler::WritePending()
+{
+    std::vector<std::byte> buf;
+    {
+        std::lock_guard lock(mutex_);
+        buf.swap(pending_);
+    }
+
+    if (!buf.empty() && std::fwrite(buf.data(), buf.size(), 1, file_) != 1) {
+        LOG_ERROR << std::format("Unable to write RTP capture file {}: {}", path_, strerror(errno));
+    }
+}
+
+std::optional<std::vector<CapturedRtpPacket>> ReadRtpCapture(const std::string& path)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f) {
+        LOG_ERROR << "Unable to open RTP capture file " << path;
+        return std::nullopt;
+    }
+
+    PcapFileHeader header = {};
+    if (!f.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        LOG_ERROR << "Truncated RTP capture file header in " << path;
+        return std::nullopt;
+    }
+
+    // Captures are written in host byte order, and only ever read back on
+    // the same kind of machine.
+    if (header.magic != kPcapMagicNanoseconds || header.linktype != kPcapLinkTypeUser0) {
+        LOG_ERROR << std::format("{} is not an RTP capture file (magic {:#010x}, link type {})",
+                                 path, header.magic, header.linktype);
+        return std::nullopt;
+    }
+
+    std::vector<CapturedRtpPacket> packets;
+    PcapRecordHeader record = {};
+    while (f.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+        auto packet = CapturedRtpPacket {
+            .t_arrival_ns   = record.ts_sec * 1'000'000'000ull + record.ts_nsec,
+            .data           = rtc::binary(record.incl_len),
+        };
+        if (!f.read(reinterpret_cast<char*>(packet.data.data()), record.incl_len)) {
+            LOG_ERROR << std::format("Truncated record {} in {}, ignoring the rest of the file",
+                                     packets.size(), path);
+            break;
+        }
+        packets.emplace_back(std::move(packet));
+    }
+
+    return packets;
+}
+
+} // namespace vacon
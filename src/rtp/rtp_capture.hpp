@@ -0,0 +1,76 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <rtc/rtc.hpp>
+
+namespace vacon {
+
+// RTP packets are captured to pcap files with nanosecond timestamps. There
+// are no IP or UDP headers, each record holds a raw RTP packet, so the
+// captures use the first user-defined link type.
+static const uint32_t kPcapMagicNanoseconds = 0xa1b23c4d;
+static const uint32_t kPcapLinkTypeUser0    = 147;
+
+// A captured RTP packet and its arrival time.
+struct CapturedRtpPacket {
+    uint64_t            t_arrival_ns;
+    rtc::binary         data;
+};
+
+// Media handler that writes every incoming RTP packet to a capture file. It
+// must be chained after the depacketizer, so that it sees the packets
+// before they are reassembled. The packets are copied into a memory buffer
+// and written by a background thread, off the network thread.
+class RtpCaptureHandler : public rtc::MediaHandler {
+    public:
+        static std::shared_ptr<RtpCaptureHandler> Create(const std::string& path);
+        virtual ~RtpCaptureHandler();
+
+        void incoming(rtc::message_vector& messages, const rtc::message_callback& send) override;
+
+        std::atomic_size_t  n_packets_ = 0;
+
+    private:
+        RtpCaptureHandler() = default;
+        void RunWriter(std::stop_token);
+        void WritePending();
+
+        std::string         path_ = {};
+        std::FILE*          file_ = nullptr;
+
+        std::mutex          mutex_;
+        std::vector<std::byte>
+                            pending_ = {};
+
+        std::jthread        thread_ = {};
+};
+
+// Read a capture file written by RtpCaptureHandler.
+std::optional<std::vector<CapturedRtpPacket>> ReadRtpCapture(const std::string& path);
+
+} // namespace vacon
@@ -0,0 +1,230 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "rtp/sfu_router.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+
+#include <plog/Log.h>
+#include <rtc/rtc.hpp>
+
+#include "rtp/generic_payload.hpp"
+
+namespace vacon {
+
+namespace {
+
+const uint32_t kVideoClockRate = 90'000;
+
+} // namespace
+
+std::shared_ptr<SfuRouter> SfuRouter::Create(const SfuRouterParams& params)
+{
+    // The constructor is private and the object isn't movable, because of
+    // its mutex and atomics.
+    return std::shared_ptr<SfuRouter>(new SfuRouter(params));
+}
+
+void SfuRouter::AddParticipant(size_t id, rtc::SSRC ssrc, uint8_t payload_type, SendFunc send)
+{
+    auto p = std::make_unique<Participant>();
+    p->id = id;
+    p->ssrc = ssrc;
+    p->payload_type = payload_type;
+    p->send = std::move(send);
+
+    std::unique_lock lock(mutex_);
+    participants_.emplace_back(std::move(p));
+    Resubscribe();
+}
+
+void SfuRouter::RemoveParticipant(size_t id)
+{
+    std::unique_lock lock(mutex_);
+    std::erase_if(participants_, [id](const auto& p) { return p->id == id; });
+    Resubscribe();
+}
+
+size_t SfuRouter::NumParticipants()
+{
+    std::shared_lock lock(mutex_);
+    return participants_.size();
+}
+
+void SfuRouter::Resubscribe()
+{
+    routes_.clear();
+    for (auto& p : participants_) {
+        routes_[p->id].publisher = p.get();
+    }
+
+    // Everyone watches the earliest connected participant, who watches the
+    // second one.
+    for (auto& p : participants_) {
+        auto it = std::find_if(participants_.begin(), participants_.end(),
+                               [&p](const auto& other) { return other != p; });
+        auto publisher_id = it != participants_.end() ? (*it)->id : 0;
+
+        if (publisher_id != p->publisher_id) {
+            LOG_DEBUG << std::format("SFU participant {} now receives participant {}", p->id, publisher_id);
+            p->publisher_id = publisher_id;
+
+            // Wait for the start of the next frame of the new publisher, and
+            // continue the timestamps from there.
+            p->forwarding_frame = false;
+            p->timestamp_resync = p->t_last_forward != decltype(p->t_last_forward) {};
+        }
+        if (publisher_id != 0) {
+            routes_[publisher_id].subscribers.push_back(p.get());
+        }
+    }
+}
+
+void SfuRouter::Forward(size_t publisher_id, const rtc::message_ptr& packet)
+{
+    n_packets_in_.fetch_add(1, std::memory_order_relaxed);
+
+    auto rtp = reinterpret_cast<const rtc::RtpHeader*>(packet->data());
+    auto header_size = rtp->getSize() + rtp->getExtensionHeaderSize();
+    if (packet->size() <= header_size) {
+        LOG_VERBOSE << "RTP packet has no payload descriptor, size=" << packet->size();
+        n_packets_unrouted_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    auto descriptor = (*packet)[header_size];
+    auto fragment = GenericFragment(descriptor);
+    auto layer = GenericTemporalLayer(descriptor);
+
+    std::shared_lock lock(mutex_);
+
+    auto route = routes_.find(publisher_id);
+    if (route == routes_.end()) {
+        n_packets_unrouted_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    route->second.publisher->layer_bytes[layer].fetch_add(packet->size(), std::memory_order_relaxed);
+
+    for (auto sub : route->second.subscribers) {
+        // Layers are switched, and new subscribers start, at frame
+        // boundaries, so that only whole frames are dropped. The higher
+        // temporal layers aren't referenced by the lower ones.
+        if (fragment == kGenericFragmentStart) {
+            sub->max_layer = sub->target_layer.load(std::memory_order_relaxed);
+            sub->forwarding_frame = layer <= sub->max_layer;
+        }
+        if (!sub->forwarding_frame) {
+            n_packets_layer_dropped_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        // The new publisher's timestamps follow the last forwarded one by
+        // the time that has passed since, as if the subscriber had kept
+        // receiving the same stream.
+        auto t_now = std::chrono::steady_clock::now();
+        if (sub->timestamp_resync) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(t_now - sub->t_last_forward);
+            auto ticks = static_cast<uint32_t>(std::max<int64_t>(
+                elapsed.count() * kVideoClockRate / 1'000'000, 1));
+            sub->timestamp_offset = sub->last_timestamp + ticks - rtp->timestamp();
+            sub->timestamp_resync = false;
+        }
+        sub->last_timestamp = rtp->timestamp() + sub->timestamp_offset;
+        sub->t_last_forward = t_now;
+
+        // Renumber the packets, so that dropped frames don't look like
+        // packet loss to the subscriber.
+        auto out = rtc::binary(packet->begin(), packet->end());
+        auto out_rtp = reinterpret_cast<rtc::RtpHeader*>(out.data());
+        out_rtp->setSsrc(sub->ssrc);
+        out_rtp->setPayloadType(sub->payload_type);
+        out_rtp->setSeqNumber(sub->seq++);
+        out_rtp->setTimestamp(sub->last_timestamp);
+        sub->send(std::move(out));
+        n_packets_out_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void SfuRouter::UpdateLayers(std::chrono::duration<double> interval)
+{
+    if (interval.count() <= 0.0) {
+        return;
+    }
+
+    std::shared_lock lock(mutex_);
+
+    for (auto& p : participants_) {
+        for (size_t i = 0; i < kGenericMaxTemporalLayers; ++i) {
+            auto bytes = p->layer_bytes[i].exchange(0, std::memory_order_relaxed);
+            p->layer_kbps[i] = bytes * 8.0 / 1000.0 / interval.count();
+        }
+    }
+
+    // Forward the highest layer whose sum with the layers below it fits in
+    // the budget. The base layer is always forwarded.
+    for (auto& p : participants_) {
+        auto route = routes_.find(p->publisher_id);
+        if (route == routes_.end()) {
+            continue;
+        }
+
+        unsigned target = kGenericMaxTemporalLayers - 1;
+        if (params_.max_kbps > 0) {
+            double kbps = 0.0;
+            target = 0;
+            for (unsigned i = 0; i < kGenericMaxTemporalLayers; ++i) {
+                kbps += route->second.publisher->layer_kbps[i];
+                if (kbps > params_.max_kbps) {
+                    break;
+                }
+                target = i;
+            }
+        }
+
+        auto previous = p->target_layer.exchange(target, std::memory_order_relaxed);
+        if (previous != target) {
+            LOG_DEBUG << std::format("SFU participant {} now receives temporal layers up to {}", p->id, target);
+        }
+    }
+}
+
+void SfuForwarder::incoming(rtc::message_vector& messages, [[maybe_unused]] const rtc::message_callback& send)
+{
+    messages.erase(std::remove_if(messages.begin(), messages.end(),
+                                  [&](const rtc::message_ptr& message) {
+                                      if (message->type == rtc::Message::Control) {
+                                          return false;
+                                      }
+
+                                      if (message->size() < sizeof(rtc::RtpHeader)) {
+                                          LOG_VERBOSE << "RTP packet is too small, size="
+                                                      << message->size();
+                                          return true;
+                                      }
+
+                                      router_->Forward(publisher_id_, message);
+                                      return true;
+                                  }),
+                   messages.end());
+}
+
+} // namespace vacon
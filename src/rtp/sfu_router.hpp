@@ -0,0 +1,143 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <rtc/rtc.hpp>
+
+#include "rtp/generic_payload.hpp"
+
+namespace vacon {
+
+struct SfuRouterParams {
+    // Bandwidth budget of each subscriber. Temporal layers are dropped to
+    // stay within it. 0 means unlimited.
+    unsigned    max_kbps = 0;
+};
+
+// Forwards the generic payload RTP packets received from each participant to
+// its subscribers, without reassembling the frames. Every participant
+// publishes one video stream and, since a client negotiates a single
+// incoming video track, subscribes to one: the earliest connected other
+// participant, i.e. the presenter.
+//
+// A received packet is shared by all its subscribers. The only copy is the
+// one that rewrites the SSRC, payload type, sequence number and timestamp for
+// each subscriber, which also serves as the buffer that SRTP encrypts in
+// place.
+//
+// Forward() may be called concurrently for different publishers, the other
+// methods from any thread.
+class SfuRouter {
+    public:
+        typedef std::function<void(rtc::binary&&)> SendFunc;
+
+        static std::shared_ptr<SfuRouter> Create(const SfuRouterParams&);
+
+        // Add a participant, with the SSRC and payload type negotiated for
+        // its outgoing video track and the function that sends on it.
+        void AddParticipant(size_t id, rtc::SSRC ssrc, uint8_t payload_type, SendFunc send);
+        void RemoveParticipant(size_t id);
+        size_t NumParticipants();
+
+        void Forward(size_t publisher_id, const rtc::message_ptr& packet);
+
+        // Measure the bitrate of each publisher's temporal layers over the
+        // interval since the last call, and select the layers that fit in
+        // each subscriber's budget.
+        void UpdateLayers(std::chrono::duration<double> interval);
+
+        std::atomic_size_t  n_packets_in_ = 0;
+        std::atomic_size_t  n_packets_out_ = 0;
+        std::atomic_size_t  n_packets_unrouted_ = 0;
+        std::atomic_size_t  n_packets_layer_dropped_ = 0;
+
+    private:
+        struct Participant {
+            size_t          id = 0;
+            rtc::SSRC       ssrc = 0;
+            uint8_t         payload_type = 0;
+            SendFunc        send = {};
+
+            // As a publisher, updated by Forward().
+            std::array<std::atomic_size_t, kGenericMaxTemporalLayers>
+                            layer_bytes = {};
+            std::array<double, kGenericMaxTemporalLayers>
+                            layer_kbps = {};
+
+            // As a subscriber, updated by the Forward() calls of its
+            // publisher. The target layer is applied at the next frame. The
+            // timestamp offset is recomputed when the publisher changes, so
+            // that the subscriber's timestamps don't jump.
+            size_t          publisher_id = 0;
+            uint16_t        seq = 0;
+            uint32_t        timestamp_offset = 0;
+            uint32_t        last_timestamp = 0;
+            bool            timestamp_resync = false;
+            std::chrono::time_point<std::chrono::steady_clock>
+                            t_last_forward = {};
+            bool            forwarding_frame = false;
+            unsigned        max_layer = kGenericMaxTemporalLayers - 1;
+            std::atomic_uint
+                            target_layer = kGenericMaxTemporalLayers - 1;
+        };
+
+        struct Route {
+            Participant*                publisher = nullptr;
+            std::vector<Participant*>   subscribers = {};
+        };
+
+        SfuRouter(const SfuRouterParams& params)
+            : params_(params) {};
+        void Resubscribe();
+
+        SfuRouterParams     params_;
+
+        std::shared_mutex   mutex_;
+
+        // Participants in the order they joined.
+        std::vector<std::unique_ptr<Participant>>
+                            participants_ = {};
+
+        std::unordered_map<size_t, Route>
+                            routes_ = {};
+};
+
+// Media handler for the incoming video track of a participant, which passes
+// the RTP packets to the router instead of the depacketizer.
+class SfuForwarder final : public rtc::MediaHandler {
+    public:
+        SfuForwarder(std::shared_ptr<SfuRouter> router, size_t publisher_id)
+            : router_(std::move(router)), publisher_id_(publisher_id) {}
+
+        void incoming(rtc::message_vector& messages, const rtc::message_callback& send) override;
+
+    private:
+        std::shared_ptr<SfuRouter>  router_;
+        size_t                      publisher_id_;
+};
+
+} // namespace vacon
@@ -36,6 +36,9 @@ bool App::InitSDL()
     SDL_SetHint(SDL_HINT_VIDEO_FORCE_EGL, "1");
 
     SDL_WindowFlags flags = SDL_WINDOW_HIDDEN | SDL_WINDOW_HIGH_PIXEL_DENSITY | SDL_WINDOW_OPENGL;
+    if (present_mode_ == linux::PresentMode::Immediate) {
+        flags |= SDL_WINDOW_FULLSCREEN;
+    }
     sdl_window_ = SDL_CreateWindow(PROJECT_NAME, 1920, 1080, flags);
     if (!sdl_window_) {
         LOG_FATAL << "SDL_CreateWindow() failed: " << SDL_GetError();
@@ -57,6 +60,11 @@ bool App::InitSDL()
         return -1;
     }
 
+    presentation_ = linux::Presentation::Create(sdl_window_);
+    if (!presentation_ && present_mode_ == linux::PresentMode::LowLatency) {
+        LOG_WARNING << "No presentation feedback, low latency mode renders frames as they arrive";
+    }
+
     // Success.
     return true;
 }
@@ -64,7 +72,13 @@ bool App::InitSDL()
 bool App::InitSDLRenderer()
 {
     // Get the renderer associated with the window.
-    Uint32 renderer_flags = SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_ACCELERATED;
+    // In the other presentation modes, frames are committed without waiting
+    // for the vertical blank.
+    Uint32 renderer_flags = SDL_RENDERER_ACCELERATED;
+    if (present_mode_ == linux::PresentMode::Vsync) {
+        renderer_flags |= SDL_RENDERER_PRESENTVSYNC;
+    }
+    LOG_DEBUG << "Using presentation mode " << linux::ToString(present_mode_);
     sdl_renderer_ = SDL_CreateRenderer(sdl_window_, nullptr, renderer_flags);
     if (!sdl_renderer_) {
         LOG_FATAL << "SDL_CreateRenderer() failed: " << SDL_GetError();
@@ -0,0 +1,117 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "sfu.hpp"
+
+#include <chrono>
+#include <format>
+#include <memory>
+#include <vector>
+
+#include <plog/Log.h>
+
+#include "network_handler.hpp"
+#include "rtp/sfu_router.hpp"
+
+namespace vacon {
+
+std::unique_ptr<Sfu> Sfu::Create(const SfuParams& params)
+{
+    if (params.invites.empty()) {
+        LOG_ERROR << "SfuParams.invites must contain at least one invite";
+        return nullptr;
+    }
+
+    if (params.codec == VideoCodec::UNKNOWN) {
+        LOG_ERROR << "SfuParams.codec must be set";
+        return nullptr;
+    }
+
+    auto sfu = std::unique_ptr<Sfu>(new Sfu());
+    sfu->params_ = params;
+    sfu->router_ = SfuRouter::Create(SfuRouterParams {
+        .max_kbps   = params.max_kbps,
+    });
+
+    auto codecs = std::make_shared<std::vector<VideoCodec>>(1, params.codec);
+    for (size_t i = 0; i < params.invites.size(); ++i) {
+        auto nh = NetworkHandler::Create(NetworkHandlerParams {
+            .peer_id                        = i + 1,
+            .invite                         = params.invites[i],
+            .stun_server                    = params.stun_server,
+            .incoming_video_packet_queue    = nullptr,
+            .decoder_codecs                 = codecs,
+            .encoder_codecs                 = codecs,
+            .sfu_router                     = sfu->router_,
+            .transport                      = params.transport,
+        });
+        if (!nh) {
+            LOG_ERROR << "NetworkHandler::Create() failed";
+            return nullptr;
+        }
+        sfu->nhs_.emplace_back(std::move(nh));
+    }
+
+    return sfu;
+}
+
+Sfu::~Sfu()
+{
+    // The network handlers remove themselves from the router.
+    nhs_.clear();
+}
+
+void Sfu::Start()
+{
+    LOG_INFO << std::format("Starting SFU for {} participants ({})",
+                            nhs_.size(), ToString(params_.codec));
+    for (auto& nh : nhs_) {
+        nh->StartConnectThread();
+    }
+    t_last_update_ = std::chrono::steady_clock::now();
+    cpu_sampler_.Sample();
+}
+
+void Sfu::Update()
+{
+    using namespace std::chrono_literals;
+
+    auto t_now = std::chrono::steady_clock::now();
+    auto interval = std::chrono::duration<double>(t_now - t_last_update_);
+    if (interval < 1s) {
+        return;
+    }
+    t_last_update_ = t_now;
+
+    router_->UpdateLayers(interval);
+    cpu_sampler_.Sample();
+
+    auto n_in = router_->n_packets_in_.load(std::memory_order_relaxed);
+    auto n_out = router_->n_packets_out_.load(std::memory_order_relaxed);
+    auto n_dropped = router_->n_packets_layer_dropped_.load(std::memory_order_relaxed);
+    LOG_INFO << std::format("SFU: {} participants, {:.0f} packets/s in, {:.0f} packets/s out, "
+                            "{:.0f} packets/s dropped by layer, {} unrouted, {:.1f}% CPU",
+                            router_->NumParticipants(),
+                            (n_in - n_packets_in_) / interval.count(),
+                            (n_out - n_packets_out_) / interval.count(),
+                            (n_dropped - n_packets_layer_dropped_) / interval.count(),
+                            router_->n_packets_unrouted_.load(std::memory_order_relaxed),
+                            cpu_sampler_.ProcessCpuPercent());
+    n_packets_in_ = n_in;
+    n_packets_out_ = n_out;
+    n_packets_layer_dropped_ = n_dropped;
+}
+
+} // namespace vacon
@@ -0,0 +1,72 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "codecs.hpp"
+#include "invite.hpp"
+#include "linux/proc.hpp"
+#include "network_handler.hpp"
+#include "rtp/sfu_router.hpp"
+
+namespace vacon {
+
+struct SfuParams {
+    // One invite per participant.
+    std::vector<std::shared_ptr<Invite>>    invites;
+    std::string                             stun_server;
+    NetworkTransportParams                  transport = {};
+
+    // Media is forwarded as is, so every participant must use the same
+    // codec in both directions.
+    VideoCodec                              codec = VideoCodec::UNKNOWN;
+    unsigned                                max_kbps = 0;
+};
+
+// Headless selective forwarding unit. Accepts a peer connection from every
+// participant and relays their video through an SfuRouter, without decoding
+// or re-encoding it.
+class Sfu {
+    public:
+        static std::unique_ptr<Sfu> Create(const SfuParams&);
+        ~Sfu();
+        void Start();
+
+        // Update the layer selection and log the forwarding stats, about
+        // once per second.
+        void Update();
+
+    private:
+        Sfu() = default;
+
+        SfuParams                                       params_ = {};
+        std::shared_ptr<SfuRouter>                      router_ = nullptr;
+        std::vector<std::unique_ptr<NetworkHandler>>    nhs_ = {};
+        linux::ThreadCpuSampler                         cpu_sampler_ = {};
+
+        std::chrono::time_point<std::chrono::steady_clock>
+                                                        t_last_update_ = {};
+
+        size_t                                          n_packets_in_ = 0;
+        size_t                                          n_packets_out_ = 0;
+        size_t                                          n_packets_layer_dropped_ = 0;
+};
+
+} // namespace vacon
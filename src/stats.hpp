@@ -25,6 +25,7 @@ struct Stats {
     double stdev;
     double min;
     double max;
+    double count;
 };
 
 class Welford {
@@ -63,6 +64,7 @@ class Welford {
                 .stdev  = (count_ > 0.0) ? std::sqrt(m2_ / count_) : 0.0,
                 .min    = min_,
                 .max    = max_,
+                .count  = count_,
             };
         }
 
@@ -15,7 +15,14 @@
 
 #include "app.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <format>
+#include <optional>
+#include <string>
+#include <utility>
 
 #include <SDL3/SDL.h>
 #include <plog/Log.h>
@@ -96,7 +103,7 @@ void App::ShowMenu()
 {
     if (ImGui::BeginMainMenuBar()) {
         if (ImGui::BeginMenu("Conference")) {
-            if (ImGui::MenuItem("Create", "Ctrl+N")) {
+            if (ImGui::MenuItem(peers_.empty() ? "Create" : "Add participant", "Ctrl+N")) {
                 LOG_INFO << "Conference -> Create";
                 CreateConference();
             }
@@ -127,7 +134,9 @@ void App::ShowMenu()
         }
         if (ImGui::BeginMenu("Settings")) {
             ImGui::MenuItem("Toggle my camera", "",     &enable_my_camera_);
-            ImGui::MenuItem("Toggle my microphone", "", &enable_my_microphone_);
+            if (ImGui::MenuItem("Toggle my microphone", "", &enable_my_microphone_) && audio_sender_) {
+                audio_sender_->SetMuted(!enable_my_microphone_);
+            }
             ImGui::MenuItem("Toggle self-view", "",     &enable_self_view_);
             ImGui::MenuItem("Mirror self-view", "",     &mirror_self_view_);
             ImGui::Separator();
@@ -177,24 +186,11 @@ void App::ShowStatsOverlay(bool* p_open)
 
         ImGui::Text("Draw: %.3f fps", io.Framerate);
 
-        if (nh_) {
-            auto s = nh_->s_recv_fps_.Result();
-            ImGui::Text("Recv: %.3f ± %.2f fps [%.1f, %.1f]", s.mean, s.stdev, s.min, s.max);
-        }
-
-        if (nh_) {
-            auto s = nh_->s_send_fps_.Result();
-            ImGui::Text("Send: %.3f ± %.2f fps [%.1f, %.1f]", s.mean, s.stdev, s.min, s.max);
-        }
-
         ImGui::Separator();
 
         if (!camera_format_str_.empty()) {
             ImGui::Text("Camera format:  %s", camera_format_str_.c_str());
         }
-        if (!decoder_codec_str_.empty()) {
-            ImGui::Text("Decoder codec:  %s", decoder_codec_str_.c_str());
-        }
         if (!encoder_codec_str_.empty()) {
             ImGui::Text("Encoder codec:  %s", encoder_codec_str_.c_str());
         }
@@ -205,18 +201,59 @@ void App::ShowStatsOverlay(bool* p_open)
                     linux::n_frames_camera_overflow_encoder .load(std::memory_order_relaxed),
                     linux::n_frames_camera_overflow_preview .load(std::memory_order_relaxed)
         );
-        ImGui::Text("Decoded frames: %zu (F:%zu, O:%zu)",
+        ImGui::Text("Decoded frames: %zu (F:%zu, O:%zu, H:%zu)",
                     linux::n_frames_decode_success  .load(std::memory_order_relaxed),
                     linux::n_frames_decode_fail     .load(std::memory_order_relaxed),
-                    linux::n_frames_decode_overflow .load(std::memory_order_relaxed)
+                    linux::n_frames_decode_overflow .load(std::memory_order_relaxed),
+                    linux::n_frames_decode_hidden   .load(std::memory_order_relaxed)
         );
-        ImGui::Text("Encoded frames: %zu (F:%zu, S:%zu)",
+        ImGui::Text("Encoded frames: %zu (F:%zu, S:%zu, K:%zu)",
                     linux::n_frames_encode_success  .load(std::memory_order_relaxed),
                     linux::n_frames_encode_fail     .load(std::memory_order_relaxed),
-                    linux::n_frames_encode_stall    .load(std::memory_order_relaxed)
+                    linux::n_frames_encode_stall    .load(std::memory_order_relaxed),
+                    linux::n_frames_encode_skip     .load(std::memory_order_relaxed)
         );
+        if (file_source_) {
+            ImGui::Text("Source frames:  %zu (S:%zu)",
+                        linux::n_frames_source_success  .load(std::memory_order_relaxed),
+                        linux::n_frames_source_stall    .load(std::memory_order_relaxed)
+            );
+        }
+        if (frame_export_) {
+            ImGui::Text("Export frames:  %zu (D:%zu), %zu consumers",
+                        frame_export_->n_frames_published_  .load(std::memory_order_relaxed),
+                        frame_export_->n_frames_dropped_    .load(std::memory_order_relaxed),
+                        frame_export_->n_clients_           .load(std::memory_order_relaxed)
+            );
+        }
         ImGui::Text("Preview frames: %u (U:%u)", stats_.n_preview, stats_.n_preview_underflow);
-        ImGui::Text("Remote frames:  %u (U:%u)", stats_.n_remote, stats_.n_remote_underflow);
+        ImGui::Text("Redraws:        %u (W:%u)", stats_.n_redraw, stats_.n_idle_wait);
+        if (presentation_) {
+            ImGui::Text("Presentation:   %s, %.2f ms (P:%zu, D:%zu, M:%zu)",
+                        linux::ToString(present_mode_),
+                        presentation_->Refresh().count() / 1e6,
+                        presentation_->n_presented_,
+                        presentation_->n_discarded_,
+                        presentation_->n_missed_);
+        }
+        if (enable_degradation_) {
+            ImGui::Text("Degradation:    %zu, %s (D:%zu, U:%zu)",
+                        degradation_.Level(),
+                        degradation_.CurrentLevel().name,
+                        degradation_.n_steps_down_.load(std::memory_order_relaxed),
+                        degradation_.n_steps_up_.load(std::memory_order_relaxed)
+            );
+        }
+        if (encoder_ && send_rate_.BitrateKbps() > 0) {
+            ImGui::Text("Send bitrate:   %u Kbps (D:%zu, U:%zu)",
+                        send_rate_.BitrateKbps(),
+                        send_rate_.n_decreases_.load(std::memory_order_relaxed),
+                        send_rate_.n_increases_.load(std::memory_order_relaxed)
+            );
+        }
+        if (auto latency = first_frame_latency_.load(std::memory_order_relaxed); latency.count() > 0) {
+            ImGui::Text("First frame:    %.1f ms after connecting", latency.count() / 1000.0);
+        }
 
         if (encoder_) {
             ImGui::Separator();
@@ -227,6 +264,13 @@ void App::ShowStatsOverlay(bool* p_open)
                         (int)(s.min/1024.0), (int)(s.max/1024.0));
         }
 
+        if (file_source_) {
+            ImGui::Separator();
+
+            auto s = file_source_->s_send_mbps_.Result();
+            ImGui::Text("Source: %.2f ± %.2f Mbit/s [%.2f, %.2f]", s.mean, s.stdev, s.min, s.max);
+        }
+
         ImGui::Separator();
 
         if (camera_) {
@@ -234,16 +278,26 @@ void App::ShowStatsOverlay(bool* p_open)
             ImGui::Text("Camera: %d ± %d µs [%d, %d]", (int)s.mean, (int)s.stdev, (int)s.min, (int)s.max);
         }
 
-        if (decoder_) {
-            auto s = decoder_->s_decode_time_.Result();
-            ImGui::Text("Decode: %d ± %d µs [%d, %d]", (int)s.mean, (int)s.stdev, (int)s.min, (int)s.max);
-        }
-
         if (encoder_) {
             auto s = encoder_->s_encode_time_.Result();
             ImGui::Text("Encode: %d ± %d µs [%d, %d]", (int)s.mean, (int)s.stdev, (int)s.min, (int)s.max);
         }
 
+        if (audio_sender_) {
+            auto s = audio_sender_->s_encode_time_.Result();
+            ImGui::Text("Audio encode: %d ± %d µs [%d, %d]", (int)s.mean, (int)s.stdev, (int)s.min, (int)s.max);
+        }
+
+        if (audio_player_) {
+            ImGui::Text("Audio output:   %lld ms queued",
+                        static_cast<long long>(audio_player_->output_delay_us_.load(std::memory_order_relaxed) / 1000));
+        }
+
+        if (event_bus_) {
+            auto s = event_bus_->s_dispatch_time_.Result();
+            ImGui::Text("Event dispatch: %d ± %d µs [%d, %d]", (int)s.mean, (int)s.stdev, (int)s.min, (int)s.max);
+        }
+
         {
             auto s = s_render_time_.Result();
             ImGui::Text("Render: %d ± %d µs [%d, %d]", (int)s.mean, (int)s.stdev, (int)s.min, (int)s.max);
@@ -259,6 +313,155 @@ void App::ShowStatsOverlay(bool* p_open)
             ImGui::Text("Display: %d ± %d µs [%d, %d]", (int)s.mean, (int)s.stdev, (int)s.min, (int)s.max);
         }
 
+        {
+            auto s = s_decode_to_present_.Result();
+            ImGui::Text("Decode→present: %d ± %d µs [%d, %d]", (int)s.mean, (int)s.stdev, (int)s.min, (int)s.max);
+        }
+
+        if (presentation_) {
+            auto s = presentation_->s_decode_to_photon_.Result();
+            ImGui::Text("Decode→photon: %d ± %d µs [%d, %d]", (int)s.mean, (int)s.stdev, (int)s.min, (int)s.max);
+        }
+
+        for (auto& peer : peers_) {
+            ImGui::Separator();
+
+            ImGui::Text("Peer %zu:         %s", peer->id,
+                        peer->decoder_codec_str.empty() ? "connecting" : peer->decoder_codec_str.c_str());
+            {
+                auto s = peer->nh->s_recv_fps_.Result();
+                ImGui::Text("Recv: %.3f ± %.2f fps [%.1f, %.1f]", s.mean, s.stdev, s.min, s.max);
+            }
+            {
+                auto s = peer->nh->s_send_fps_.Result();
+                ImGui::Text("Send: %.3f ± %.2f fps [%.1f, %.1f]", s.mean, s.stdev, s.min, s.max);
+            }
+            {
+                ImGui::Text("Send drops:     S:%zu, F:%zu%s",
+                            peer->nh->n_frames_send_skip_.load(std::memory_order_relaxed),
+                            peer->nh->n_frames_send_fail_.load(std::memory_order_relaxed),
+                            peer->nh->SendBackpressure() ? " backed up" : "");
+            }
+            ImGui::Text("Recv drops:     %zu",
+                        peer->nh->n_frames_recv_drop_.load(std::memory_order_relaxed));
+            if (auto kbps = peer->nh->probe_kbps_.load(std::memory_order_relaxed)) {
+                ImGui::Text("Probe:          %u Kbps in %u ms",
+                            kbps, peer->nh->probe_ms_.load(std::memory_order_relaxed));
+            }
+            ImGui::Text("Remote frames:  %u (U:%u, S:%u)",
+                        peer->stats.n_remote.load(), peer->stats.n_remote_underflow, peer->stats.n_remote_skipped);
+            if (enable_frame_pacing_) {
+                ImGui::Text("Playout:        %lld ms delay, %lld ms jitter (L:%zu, R:%zu)",
+                            static_cast<long long>(peer->playout_clock.Delay().count() / 1000),
+                            static_cast<long long>(peer->playout_clock.Jitter().count() / 1000),
+                            peer->playout_clock.n_late_,
+                            peer->playout_clock.n_resets_);
+            }
+            if (auto offset = peer->nh->clock_sync_.Offset()) {
+                const auto& clock = peer->nh->clock_sync_;
+                auto zero = std::chrono::microseconds(0);
+                ImGui::Text("Clock:          %+lld ms offset, %lld ms RTT",
+                            static_cast<long long>(offset->count() / 1000),
+                            static_cast<long long>(clock.MinRtt().value_or(zero).count() / 1000));
+                ImGui::Text("One-way delay:  %lld ms from peer, %lld ms to peer",
+                            static_cast<long long>(clock.DelayFromPeer().value_or(zero).count() / 1000),
+                            static_cast<long long>(clock.DelayToPeer().value_or(zero).count() / 1000));
+
+                // Capture to show, split into the peer's pipeline, the
+                // network, and the local pipeline.
+                if (auto latency = peer->av_sync->VideoLatency()) {
+                    auto send_ms = peer->nh->remote_send_latency_us_.load(std::memory_order_relaxed) / 1000;
+                    auto arrival_ms = static_cast<long long>(peer->nh->s_recv_latency_.Result().mean / 1000);
+                    auto receive_ms = static_cast<long long>(peer->s_receive_latency.Result().mean / 1000);
+                    ImGui::Text("Video latency:  %lld ms = %lld send + %lld network + %lld receive",
+                                static_cast<long long>(latency->count() / 1000),
+                                static_cast<long long>(send_ms),
+                                arrival_ms - static_cast<long long>(send_ms),
+                                receive_ms);
+                }
+            }
+            ImGui::Text("Cadence:        1:%u 2:%u 3:%u 4+:%u",
+                        peer->cadence[0], peer->cadence[1], peer->cadence[2], peer->cadence[3]);
+            {
+                auto [remote_width, remote_height] = peer->nh->RemoteRenderSize();
+                ImGui::Text("Render size:    %ux%u here, %ux%u there",
+                            peer->render_width, peer->render_height, remote_width, remote_height);
+            }
+            {
+                auto s = peer->decoder->s_decode_time_.Result();
+                ImGui::Text("Decode: %d ± %d µs [%d, %d]", (int)s.mean, (int)s.stdev, (int)s.min, (int)s.max);
+            }
+            {
+                auto s = peer->s_judder.Result();
+                ImGui::Text("Judder: %d ± %d µs [%d, %d]", (int)s.mean, (int)s.stdev, (int)s.min, (int)s.max);
+            }
+            if (peer->audio_receiver) {
+                const auto& r = *peer->audio_receiver;
+                ImGui::Text("Audio buffer:   %lld/%lld ms (F:%zu, C:%zu, L:%zu)",
+                            static_cast<long long>(r.jitter_buffer_us_.load(std::memory_order_relaxed) / 1000),
+                            static_cast<long long>(r.target_delay_us_.load(std::memory_order_relaxed) / 1000),
+                            r.n_frames_.load(std::memory_order_relaxed),
+                            r.n_concealed_.load(std::memory_order_relaxed),
+                            r.n_late_.load(std::memory_order_relaxed));
+                // Capture to playout compares the clocks of both machines,
+                // corrected by the clock offset once it is known.
+                if (auto latency = peer->av_sync->AudioLatency()) {
+                    ImGui::Text("Audio latency:  %lld ms capture→playout",
+                                static_cast<long long>(latency->count() / 1000));
+                }
+                if (auto skew = peer->av_sync->Skew()) {
+                    ImGui::Text("Lip sync:       %+lld ms (A:+%lld ms, V:+%lld ms)",
+                                static_cast<long long>(skew->count() / 1000),
+                                static_cast<long long>(peer->av_sync->AudioDelay().count() / 1000),
+                                static_cast<long long>(peer->av_sync->VideoDelay().count() / 1000));
+                }
+            }
+        }
+
+        // The load with each number of peers, and the marginal cost of a
+        // participant compared to the next smaller conference.
+        if (peer_costs_.size() > 1) {
+            ImGui::Separator();
+
+            ImGui::Text("Peers   CPU %%  +CPU %%  Decoder %%  Render µs");
+            std::optional<std::pair<size_t, double>> prev;
+            for (auto& [n, cost] : peer_costs_) {
+                auto cpu = cost.s_cpu_percent.Result().mean;
+                auto marginal = prev ? (cpu - prev->second) / (n - prev->first) : 0.0;
+                ImGui::Text("%5zu %7.1f %7.1f %10.1f %10d", n, cpu, marginal,
+                            cost.s_decoder_cpu_percent.Result().mean,
+                            (int)cost.s_render_time.Result().mean);
+                prev = std::make_pair(n, cpu);
+            }
+        }
+
+        // Memory and fds held by the pipeline, and their high-water marks.
+        ImGui::Separator();
+        ImGui::Text("Resource       Count  Peak      MiB  Peak MiB");
+        for (const auto& u : GetResourceUsage()) {
+            ImGui::Text("%-13s %6zu %5zu %8.1f %9.1f", ToString(u.resource),
+                        u.count, u.peak_count, u.bytes / 1048576.0, u.peak_bytes / 1048576.0);
+        }
+        for (const auto& u : resource_leaks_) {
+            ImGui::Text("Leaked:        %zu %s, %.1f MiB", u.count, ToString(u.resource), u.bytes / 1048576.0);
+        }
+
+        // Where the CPU goes, by thread name. Involuntary context switches
+        // of the real-time threads mean that they were preempted.
+        if (const auto& usage = cpu_sampler_.LastUsage(); !usage.empty()) {
+            ImGui::Separator();
+
+            ImGui::Text("Thread           N  CPU %%  Vcsw/s  Icsw/s  Minflt/s  Majflt/s  Sched");
+            for (const auto& u : usage) {
+                auto sched = u.rt_priority ? std::format("{} {}", linux::SchedPolicyName(u.policy), u.rt_priority)
+                                           : std::string(linux::SchedPolicyName(u.policy));
+                ImGui::Text("%-15s %2u %6.1f %7.0f %7.0f %9.0f %9.0f  %s",
+                            u.name.c_str(), u.n_threads, u.cpu_percent,
+                            u.vcsw_per_s, u.ivcsw_per_s, u.minflt_per_s, u.majflt_per_s,
+                            sched.c_str());
+            }
+        }
+
         if (g_imfont_mono) {
             ImGui::PopFont();
         }
@@ -281,7 +484,7 @@ void App::RenderFrame()
     SDL_SetRenderDrawColor(sdl_renderer_, 58, 110, 165, SDL_ALPHA_OPAQUE);
     SDL_RenderClear(sdl_renderer_);
 
-    ShowDecodedVideoFrame();
+    ShowDecodedVideoFrames();
 
     if (camera_) {
         ShowPreview();
@@ -306,23 +509,112 @@ void App::RenderFrame()
     auto t_render = std::chrono::steady_clock::now();
     auto micros = std::chrono::duration_cast<std::chrono::microseconds>(t_render - t_start).count();
     s_render_time_.Update(micros);
+    peer_costs_[peers_.size()].s_render_time.Update(micros);
+
+    if (presentation_) {
+        presentation_->RequestFeedback(t_shown_decoded_, t_target_vblank_);
+    }
 
     SDL_RenderPresent(sdl_renderer_);
 
     auto t_present = std::chrono::steady_clock::now();
     micros = std::chrono::duration_cast<std::chrono::microseconds>(t_present - t_render).count();
     s_present_time_.Update(micros);
+
+    if (t_shown_decoded_) {
+        micros = std::chrono::duration_cast<std::chrono::microseconds>(t_present - *t_shown_decoded_).count();
+        s_decode_to_present_.Update(micros);
+    }
+    t_shown_decoded_ = std::nullopt;
+    t_target_vblank_ = std::nullopt;
+}
+
+void App::ShowDecodedVideoFrames()
+{
+    if (peers_.empty()) {
+        return;
+    }
+
+    // Lay the peers out in a grid that is as square as possible, in the
+    // order they joined.
+    int width = 0, height = 0;
+    if (SDL_GetCurrentRenderOutputSize(sdl_renderer_, &width, &height)) {
+        LOG_ERROR << "SDL_GetCurrentRenderOutputSize() failed: " << SDL_GetError();
+        return;
+    }
+    SDL_SetRenderScale(sdl_renderer_, 1.0f, 1.0f);
+
+    auto n_cols = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(peers_.size()))));
+    auto n_rows = (peers_.size() + n_cols - 1) / n_cols;
+    auto tile_width = static_cast<float>(width) / n_cols;
+    auto tile_height = static_cast<float>(height) / n_rows;
+
+    auto t_now = std::chrono::steady_clock::now();
+    auto t_deadline = PlayoutDeadline(t_now);
+    for (size_t i = 0; i < peers_.size(); ++i) {
+        auto tile = SDL_FRect {
+            .x  = tile_width * (i % n_cols),
+            .y  = tile_height * (i / n_cols),
+            .w  = tile_width,
+            .h  = tile_height,
+        };
+        ReportRenderSize(*peers_[i], tile, t_now);
+        ShowDecodedVideoFrame(*peers_[i], tile, t_deadline);
+    }
+}
+
+void App::ReportRenderSize(Peer& peer, const SDL_FRect& tile,
+                           std::chrono::time_point<std::chrono::steady_clock> t_now)
+{
+    using namespace std::chrono_literals;
+
+    // The tile is in output pixels, so the display scale is already part of
+    // the size. It is only reported for information.
+    auto width = static_cast<unsigned>(std::lround(tile.w));
+    auto height = static_cast<unsigned>(std::lround(tile.h));
+    if (width == peer.render_width && height == peer.render_height) {
+        return;
+    }
+
+    // Wait for the window to settle while it is being resized.
+    if (t_now - peer.t_render_size_sent < 500ms) {
+        return;
+    }
+
+    auto scale = SDL_GetWindowDisplayScale(sdl_window_);
+    if (!peer.nh->SendRenderSize(width, height, scale > 0.0f ? scale : 1.0f)) {
+        return;
+    }
+    peer.render_width = width;
+    peer.render_height = height;
+    peer.t_render_size_sent = t_now;
 }
 
-void App::ShowDecodedVideoFrame()
+void App::ShowDecodedVideoFrame(Peer& peer, const SDL_FRect& tile,
+                                std::chrono::time_point<std::chrono::steady_clock> t_deadline)
 {
-    // Get the next decoded video frame from the decoder.
-    if (decoded_video_frame_queue_->try_dequeue(decoded_frame_)) {
-        ++stats_.n_remote;
+    // Take the newest remote frame that is due by the time this redraw is
+    // shown, skipping the older ones.
+    bool new_frame = false;
+    while (!peer.playout_queue.empty() && peer.playout_queue.front().t_playout <= t_deadline) {
+        if (new_frame) {
+            ++peer.stats.n_remote_skipped;
+        }
+        peer.decoded_frame = std::move(peer.playout_queue.front().frame);
+        peer.playout_queue.pop_front();
+        new_frame = true;
+    }
+
+    if (new_frame) {
+        ++peer.stats.n_remote;
+        if (!t_shown_decoded_ || peer.decoded_frame->t_decoded_ < *t_shown_decoded_) {
+            t_shown_decoded_ = peer.decoded_frame->t_decoded_;
+        }
+        UpdateCadence(peer, peer.decoded_frame->rtp_timestamp_, t_deadline);
     } else {
         // No new video frame available from the decoder.
-        if (decoded_frame_) [[likely]] {
-            ++stats_.n_remote_underflow;
+        if (peer.decoded_frame) [[likely]] {
+            ++peer.stats.n_remote_underflow;
         } else {
             // No previous frame, either.
             return;
@@ -330,24 +622,55 @@ void App::ShowDecodedVideoFrame()
     }
 
     // Export the decoded video frame to an OpenGL texture.
-    if (!decoded_frame_->texture_) {
-        if (!decoded_frame_->ExportToOpenGL(sdl_renderer_)) {
+    if (!peer.decoded_frame->texture_) {
+        if (!peer.decoded_frame->ExportToOpenGL(sdl_renderer_)) {
             LOG_ERROR << "DecodedFrame::ExportToOpenGL() failed";
-            decoded_frame_ = nullptr;
+            peer.decoded_frame = nullptr;
             return;
         }
     }
 
     // Render the OpenGL texture.
     if (SDL_RenderTexture(sdl_renderer_,
-                          decoded_frame_->texture_,
+                          peer.decoded_frame->texture_,
                           nullptr /* srcrect */,
-                          nullptr /* dstrect */))
+                          &tile))
     {
         LOG_ERROR << "SDL_RenderTexture() failed: " << SDL_GetError();
     }
 }
 
+void App::UpdateCadence(Peer& peer, uint32_t rtp_timestamp,
+                        std::chrono::time_point<std::chrono::steady_clock> t_deadline)
+{
+    // The frame is shown on the vertical blank half a refresh interval
+    // before the deadline, or right away if the display timing is unknown.
+    auto refresh = presentation_ ? presentation_->Refresh() : std::chrono::nanoseconds(0);
+    auto t_shown = t_deadline - refresh / 2;
+
+    if (peer.stats.n_remote > 1) {
+        auto shown = std::chrono::duration_cast<std::chrono::microseconds>(t_shown - peer.t_last_shown);
+        auto captured = peer.playout_clock.Interval(peer.last_shown_rtp_timestamp, rtp_timestamp);
+        peer.s_judder.Update(std::abs((shown - captured).count()));
+
+        if (refresh.count() > 0) {
+            auto n_refresh = static_cast<size_t>(std::llround(static_cast<double>(shown.count()) * 1000.0 /
+                                                              refresh.count()));
+            ++peer.cadence[std::clamp<size_t>(n_refresh, 1, peer.cadence.size()) - 1];
+        }
+    }
+
+    peer.last_shown_rtp_timestamp = rtp_timestamp;
+    peer.t_last_shown = t_shown;
+    peer.av_sync->OnVideoShown(rtp_timestamp, t_shown);
+
+    auto t_received = peer.decoded_frame->t_received_;
+    if (t_received != std::chrono::time_point<std::chrono::steady_clock>{}) {
+        peer.s_receive_latency.Update(
+            std::chrono::duration_cast<std::chrono::microseconds>(t_shown - t_received).count());
+    }
+}
+
 void App::ShowPreview()
 {
     // Get the next preview frame from the camera.
@@ -358,6 +681,10 @@ void App::ShowPreview()
         // Save the frame in case it's needed for the next rendering
         // iteration (i.e., if the preview queue underflows).
         preview_cref_ = cref;
+
+        if (frame_export_ && export_self_view_) {
+            frame_export_->Publish(cref);
+        }
     } else {
         // No new preview frame, use the previous frame if available.
         if (preview_cref_) [[likely]] {
@@ -388,7 +715,7 @@ void App::ShowPreviewWindow()
         return;
     }
 
-    if (preview_cref_) {
+    if (preview_cref_ && preview_cref_->buf_.texture) {
         ++stats_.n_preview;
 
         // Show the frame from the camera.
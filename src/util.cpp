@@ -15,9 +15,16 @@
 
 #include "util.hpp"
 
+#include <array>
+#include <cerrno>
+#include <chrono>
 #include <cstdarg>
+#include <cstring>
 #include <format>
 
+#include <pthread.h>
+#include <sched.h>
+
 #if defined(__linux__)
 # include <sys/prctl.h>
 #endif
@@ -108,6 +115,28 @@ bool SetupRealtimePriority()
 	return true;
 }
 
+// Raise the calling thread one step above the other real-time threads, for
+// threads that must not miss their deadlines, like audio.
+bool RaiseThreadPriority()
+{
+    const int min_fifo_prio = sched_get_priority_min(SCHED_FIFO);
+    if (min_fifo_prio == -1) {
+        LOG_DEBUG << std::format("sched_get_priority_min() failed: {}", std::strerror(errno));
+        return false;
+    }
+
+    const struct sched_param param = {
+        .sched_priority = min_fifo_prio + 2,
+    };
+
+    if (int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) {
+        LOG_DEBUG << std::format("pthread_setschedparam() failed: {}", std::strerror(ret));
+        return false;
+    }
+
+    return true;
+}
+
 void SetThreadName(const char *name)
 {
 #if defined(__linux__)
@@ -129,5 +158,85 @@ std::string FourCcToString(uint32_t val)
     return s;
 }
 
+// Seconds from the NTP epoch, 1900, to the Unix epoch.
+static const int64_t kNtpUnixEpochOffsetSecs = 2'208'988'800;
+
+static std::chrono::nanoseconds SteadyToSystemOffset()
+{
+    static const auto offset =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()) -
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch());
+    return offset;
+}
+
+uint64_t SteadyToNtp(std::chrono::time_point<std::chrono::steady_clock> t)
+{
+    auto ns = (std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()) +
+               SteadyToSystemOffset()).count();
+    auto secs = static_cast<uint64_t>(ns / 1'000'000'000 + kNtpUnixEpochOffsetSecs);
+    auto frac = (static_cast<uint64_t>(ns % 1'000'000'000) << 32) / 1'000'000'000;
+    return (secs << 32) | frac;
+}
+
+std::chrono::time_point<std::chrono::steady_clock> NtpToSteady(uint64_t ntp)
+{
+    auto secs = static_cast<int64_t>(ntp >> 32) - kNtpUnixEpochOffsetSecs;
+    auto frac_ns = static_cast<int64_t>(((ntp & 0xffffffffull) * 1'000'000'000) >> 32);
+    auto ns = std::chrono::nanoseconds(secs * 1'000'000'000 + frac_ns) - SteadyToSystemOffset();
+    return std::chrono::time_point<std::chrono::steady_clock>(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(ns));
+}
+
+static const uint32_t kCrc32cPolynomial = 0x82f63b78;
+
+static uint32_t Crc32cTable(uint32_t crc, const std::byte* data, size_t size)
+{
+    static const auto table = []() {
+        std::array<uint32_t, 256> t = {};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c >> 1) ^ ((c & 1) ? kCrc32cPolynomial : 0);
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ std::to_integer<uint32_t>(data[i])) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t Crc32cSse42(uint32_t crc, const std::byte* data, size_t size)
+{
+    uint64_t crc64 = crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t v;
+        std::memcpy(&v, data, sizeof(v));
+        crc64 = __builtin_ia32_crc32di(crc64, v);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; size > 0; ++data, --size) {
+        crc = __builtin_ia32_crc32qi(crc, std::to_integer<uint8_t>(*data));
+    }
+    return crc;
+}
+#endif
+
+uint32_t Crc32c(const std::byte* data, size_t size)
+{
+#if defined(__x86_64__)
+    static const bool have_sse42 = __builtin_cpu_supports("sse4.2");
+    if (have_sse42) {
+        return ~Crc32cSse42(~0u, data, size);
+    }
+#endif
+    return ~Crc32cTable(~0u, data, size);
+}
+
 } // namespace util
 } // namespace vacon
@@ -15,7 +15,10 @@
 
 #pragma once
 
+#include <chrono>
 #include <cstdarg>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -30,8 +33,18 @@ template <class T> std::weak_ptr<T> make_weak_ptr(std::shared_ptr<T> ptr) { retu
 
 void SetupLogging(const int verbosity);
 bool SetupRealtimePriority();
+bool RaiseThreadPriority();
 void SetThreadName(const char *name);
 std::string FourCcToString(uint32_t);
 
+// Convert between the steady clock and 64-bit NTP timestamps of the wall
+// clock, as used in RTCP sender reports. The offset between the two clocks is
+// taken once, so that the conversion is monotonic.
+uint64_t SteadyToNtp(std::chrono::time_point<std::chrono::steady_clock>);
+std::chrono::time_point<std::chrono::steady_clock> NtpToSteady(uint64_t ntp);
+
+// CRC-32C (Castagnoli), with the SSE 4.2 instruction if the CPU has it.
+uint32_t Crc32c(const std::byte* data, size_t size);
+
 } // namespace util
 } // namespace vacon
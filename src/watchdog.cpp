@@ -0,0 +1,218 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "watchdog.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <plog/Log.h>
+
+#include "linux/proc.hpp"
+#include "util.hpp"
+
+using namespace std::chrono_literals;
+
+namespace vacon {
+
+std::unique_ptr<Watchdog> Watchdog::Create(const WatchdogParams& params)
+{
+    if (params.stall_timeout <= 0ms) {
+        LOG_ERROR << "WatchdogParams.stall_timeout must be positive";
+        return nullptr;
+    }
+
+    // The constructor is private and the object isn't movable, because of
+    // its mutex.
+    return std::unique_ptr<Watchdog>(new Watchdog(params));
+}
+
+Watchdog::~Watchdog()
+{
+    RequestStop();
+    Join();
+}
+
+void Watchdog::StartThread()
+{
+    thread_ = std::jthread([&](std::stop_token st) { RunWatchdog(st); });
+}
+
+void Watchdog::RequestStop()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Requesting stop of watchdog thread ID " << thread_.get_id();
+        thread_.request_stop();
+    }
+}
+
+void Watchdog::Join()
+{
+    if (thread_.joinable()) {
+        LOG_DEBUG << "Joining watchdog thread ID " << thread_.get_id();
+        thread_.join();
+        thread_ = {};
+    }
+}
+
+void Watchdog::AddStage(size_t key, const std::string& name, Counter progress,
+                        const std::string& upstream)
+{
+    std::lock_guard lock(mutex_);
+    stages_.emplace_back(Stage {
+        .key        = key,
+        .name       = name,
+        .progress   = std::move(progress),
+        .upstream   = upstream,
+    });
+}
+
+void Watchdog::AddGauge(size_t key, const std::string& section, const std::string& name,
+                        Gauge value)
+{
+    std::lock_guard lock(mutex_);
+    gauges_.emplace_back(GaugeEntry {
+        .key        = key,
+        .section    = section,
+        .name       = name,
+        .value      = std::move(value),
+    });
+}
+
+void Watchdog::Remove(size_t key)
+{
+    std::lock_guard lock(mutex_);
+    std::erase_if(stages_, [key](const Stage& s) { return s.key == key; });
+    std::erase_if(gauges_, [key](const GaugeEntry& g) { return g.key == key; });
+}
+
+void Watchdog::RunWatchdog(std::stop_token st)
+{
+    LOG_DEBUG << "Starting watchdog thread ID " << std::this_thread::get_id();
+    util::SetThreadName("VWatchdog");
+
+    // Check a few times per timeout, so that a stall is reported soon after
+    // it reaches the timeout.
+    auto interval = std::clamp<std::chrono::milliseconds>(params_.stall_timeout / 4, 10ms, 250ms);
+
+    while (!st.stop_requested()) {
+        std::this_thread::sleep_for(interval);
+        Check(std::chrono::steady_clock::now());
+    }
+
+    LOG_DEBUG << "Stopping watchdog thread ID " << std::this_thread::get_id();
+}
+
+void Watchdog::Check(std::chrono::time_point<std::chrono::steady_clock> t_now)
+{
+    std::lock_guard lock(mutex_);
+
+    // Read all the counters first, so that every stage is compared with the
+    // same reading of its upstream stage.
+    std::map<std::string, size_t> counts;
+    for (const auto& s : stages_) {
+        counts[s.name] = s.progress();
+    }
+
+    bool stalled = false;
+    for (auto& s : stages_) {
+        auto count = counts[s.name];
+        auto up = counts.find(s.upstream);
+        auto upstream_count = up != counts.end() ? up->second : 0;
+
+        if (!s.primed || count != s.count) {
+            s.primed = true;
+            s.count = count;
+            s.upstream_count = upstream_count;
+            s.t_progress = t_now;
+            s.stalled = false;
+            continue;
+        }
+
+        if (s.stalled || t_now - s.t_progress < params_.stall_timeout) {
+            continue;
+        }
+
+        // Not stalled if there was nothing to do: the upstream stage made no
+        // progress either, or this stage never started.
+        if (!s.upstream.empty()) {
+            if (up == counts.end() || upstream_count == s.upstream_count) {
+                continue;
+            }
+        } else if (count == 0) {
+            continue;
+        }
+
+        s.stalled = true;
+        stalled = true;
+    }
+
+    if (stalled) {
+        n_stalls_.fetch_add(1, std::memory_order_relaxed);
+        Dump(t_now);
+    }
+}
+
+void Watchdog::Dump(std::chrono::time_point<std::chrono::steady_clock> t_now)
+{
+    std::string stalled;
+    std::string stages;
+    for (const auto& s : stages_) {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t_now - s.t_progress).count();
+        if (s.stalled) {
+            stalled += std::format("{}{} ({} ms)", stalled.empty() ? "" : ", ", s.name, ms);
+        }
+        stages += std::format("{}{} {} ({} ms ago{})", stages.empty() ? "" : ", ",
+                              s.name, s.count, ms, s.stalled ? ", STALLED" : "");
+    }
+
+    LOG_WARNING << std::format("Pipeline stall: {}", stalled);
+    LOG_WARNING << std::format("  stages: {}", stages);
+
+    // The gauges, by section, in the order that the sections were added.
+    std::vector<std::pair<std::string, std::string>> sections;
+    for (const auto& g : gauges_) {
+        auto it = std::find_if(sections.begin(), sections.end(),
+                               [&](const auto& section) { return section.first == g.section; });
+        if (it == sections.end()) {
+            it = sections.emplace(sections.end(), g.section, "");
+        }
+        it->second += std::format("{}{} {}", it->second.empty() ? "" : ", ", g.name, g.value());
+    }
+    for (const auto& [section, values] : sections) {
+        LOG_WARNING << std::format("  {}: {}", section, values);
+    }
+
+    // The state of every thread (R running, S sleeping, D waiting on I/O,
+    // e.g. in the GPU driver), by thread name.
+    std::map<std::string, std::string> states;
+    for (const auto& ts : linux::ReadThreadStats()) {
+        states[ts.name] += ts.state;
+    }
+    std::string threads;
+    for (const auto& [name, state] : states) {
+        threads += std::format("{}{} {}", threads.empty() ? "" : ", ", name, state);
+    }
+    LOG_WARNING << std::format("  threads: {}", threads);
+}
+
+} // namespace vacon
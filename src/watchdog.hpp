@@ -0,0 +1,116 @@
+// Copyright (c) 2024 The Vacon Authors
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vacon {
+
+// Key of the stages and gauges that aren't specific to a peer.
+static const size_t kWatchdogPipeline = 0;
+
+struct WatchdogParams {
+    // How long a stage may go without progress before it is stalled.
+    std::chrono::milliseconds stall_timeout = std::chrono::milliseconds(2000);
+};
+
+// Watches the progress counters of the pipeline stages, from the camera to
+// the renderer. A stage is stalled when its upstream stage made progress but
+// it didn't, for longer than the stall timeout, or when a stage without an
+// upstream stage stops after having started. The watchdog then logs a dump
+// of all the stages, the registered gauges and the thread states, once per
+// stall.
+class Watchdog {
+    public:
+        // Cumulative count of the frames, or other units of work, that a
+        // stage has completed.
+        using Counter = std::function<size_t()>;
+
+        // Current value of a gauge, e.g. the depth of a queue, for the dump.
+        using Gauge = std::function<std::string()>;
+
+        static std::unique_ptr<Watchdog> Create(const WatchdogParams&);
+        ~Watchdog();
+        void StartThread();
+        void RequestStop();
+        void Join();
+
+        // Stages and gauges are grouped by a key, the peer ID or
+        // kWatchdogPipeline, so that they can be removed together. Their
+        // callbacks run on the watchdog thread, so they may only read atomics
+        // or otherwise thread safe state.
+        void AddStage(size_t key, const std::string& name, Counter progress,
+                      const std::string& upstream = "");
+        void AddGauge(size_t key, const std::string& section, const std::string& name,
+                      Gauge value);
+
+        // Stop watching the stages and gauges with this key. Their callbacks
+        // aren't called anymore once this returns, so the state they read
+        // can then be destroyed.
+        void Remove(size_t key);
+
+        std::atomic_size_t  n_stalls_ = 0;
+
+    private:
+        Watchdog(const WatchdogParams& params)
+            : params_(params) {};
+        void RunWatchdog(std::stop_token);
+        void Check(std::chrono::time_point<std::chrono::steady_clock> t_now);
+        void Dump(std::chrono::time_point<std::chrono::steady_clock> t_now);
+
+        struct Stage {
+            size_t          key                 = 0;
+            std::string     name                = {};
+            Counter         progress            = {};
+            std::string     upstream            = {};
+
+            // The count when the stage last made progress, and the count of
+            // its upstream stage at that time.
+            bool            primed              = false;
+            size_t          count               = 0;
+            size_t          upstream_count      = 0;
+            std::chrono::time_point<std::chrono::steady_clock>
+                            t_progress          = {};
+            bool            stalled             = false;
+        };
+
+        struct GaugeEntry {
+            size_t          key                 = 0;
+            std::string     section             = {};
+            std::string     name                = {};
+            Gauge           value               = {};
+        };
+
+        WatchdogParams      params_;
+
+        std::mutex          mutex_;
+        std::vector<Stage>  stages_ = {};
+        std::vector<GaugeEntry>
+                            gauges_ = {};
+
+        std::jthread        thread_ = {};
+};
+
+} // namespace vacon